@@ -0,0 +1,147 @@
+#include "batch_ingestor.h"
+#include "raw_processor.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace raw_editor {
+
+static const char* TAG = "BatchIngestor";
+
+BatchIngestor::BatchIngestor(std::vector<std::string> file_paths, std::string thumbnail_dir,
+                             u32 thumbnail_size, u32 worker_count,
+                             std::shared_ptr<DiskImageCache> disk_cache)
+    : file_paths_(std::move(file_paths)),
+      thumbnail_dir_(std::move(thumbnail_dir)),
+      thumbnail_size_(std::max(1u, thumbnail_size)),
+      worker_count_(static_cast<u32>(std::min<size_t>(
+          WorkStealingPool::resolve_thread_count(worker_count), std::max<size_t>(1, file_paths_.size())))),
+      disk_cache_(std::move(disk_cache)),
+      next_index_(0),
+      completed_(0),
+      running_workers_(0),
+      cancelled_(false) {
+}
+
+BatchIngestor::~BatchIngestor() {
+    cancel();
+    wait();
+}
+
+void BatchIngestor::start() {
+    if (!workers_.empty()) {
+        return;
+    }
+
+    LOG_INFO(TAG, ("Ingesting " + std::to_string(file_paths_.size()) + " files with " +
+                   std::to_string(worker_count_) + " workers").c_str());
+
+    running_workers_ = worker_count_;
+    workers_.reserve(worker_count_);
+    for (u32 i = 0; i < worker_count_; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+void BatchIngestor::cancel() {
+    cancelled_ = true;
+}
+
+void BatchIngestor::wait() {
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+std::vector<IngestResult> BatchIngestor::poll(size_t max_results) {
+    std::lock_guard<std::mutex> lock(results_mutex_);
+
+    const size_t count = max_results == 0 ? results_.size() : std::min(max_results, results_.size());
+    std::vector<IngestResult> results(std::make_move_iterator(results_.begin()),
+                                      std::make_move_iterator(results_.begin() + count));
+    results_.erase(results_.begin(), results_.begin() + count);
+    return results;
+}
+
+IngestProgress BatchIngestor::progress() const {
+    IngestProgress progress;
+    progress.total = file_paths_.size();
+    progress.completed = completed_;
+    progress.cancelled = cancelled_;
+    progress.finished = !workers_.empty() && running_workers_ == 0;
+    return progress;
+}
+
+void BatchIngestor::worker_loop() {
+    // LibRaw インスタンスはワーカーごとに1つ作り、ファイル間で使い回す
+    RawProcessor processor;
+    processor.set_disk_cache(disk_cache_);
+
+    while (!cancelled_) {
+        const size_t index = next_index_.fetch_add(1);
+        if (index >= file_paths_.size()) {
+            break;
+        }
+
+        IngestResult result;
+        result.index = index;
+        result.file_path = file_paths_[index];
+
+        BoolResult load_result = processor.load_raw_file(result.file_path, true);
+        if (load_result.is_error()) {
+            result.code = load_result.code;
+            result.error_message = load_result.error_message;
+        } else {
+            MetadataResult metadata_result = processor.extract_metadata();
+            if (metadata_result.is_success()) {
+                result.metadata = metadata_result.data;
+            }
+
+            if (!thumbnail_dir_.empty()) {
+                BytesResult thumbnail = processor.generate_encoded_thumbnail(thumbnail_size_);
+                if (thumbnail.is_success()) {
+                    const std::string path = thumbnail_path_for(result.file_path);
+                    std::FILE* file = std::fopen(path.c_str(), "wb");
+                    const bool written = file &&
+                        std::fwrite(thumbnail.data.data(), 1, thumbnail.data.size(), file) == thumbnail.data.size();
+                    if (file && std::fclose(file) == 0 && written) {
+                        result.thumbnail_path = path;
+                    } else {
+                        std::remove(path.c_str());
+                        result.error_message = "Failed to save thumbnail: " + path;
+                    }
+                } else {
+                    result.error_message = thumbnail.error_message;
+                }
+            }
+        }
+        processor.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(results_mutex_);
+            results_.push_back(std::move(result));
+        }
+        ++completed_;
+    }
+
+    --running_workers_;
+}
+
+std::string BatchIngestor::thumbnail_path_for(const std::string& file_path) const {
+    const size_t slash = file_path.find_last_of('/');
+    std::string name = slash == std::string::npos ? file_path : file_path.substr(slash + 1);
+    const size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos) {
+        name = name.substr(0, dot);
+    }
+
+    std::string directory = thumbnail_dir_;
+    if (directory.back() != '/') {
+        directory += '/';
+    }
+    return directory + name + "_thumb.jpg";
+}
+
+} // namespace raw_editor
@@ -0,0 +1,120 @@
+#ifndef BATCH_INGESTOR_H
+#define BATCH_INGESTOR_H
+
+#include "common_types.h"
+#include "disk_image_cache.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace raw_editor {
+
+/**
+ * 取り込み結果（1ファイル分）
+ */
+struct IngestResult {
+    size_t index = 0;               // 入力リスト上の位置
+    std::string file_path;
+    ResultCode code = ResultCode::SUCCESS;
+    RawMetadata metadata;
+    std::string thumbnail_path;     // サムネイルを保存できなかった場合は空
+    std::string error_message;
+};
+
+/**
+ * 取り込みの進捗
+ */
+struct IngestProgress {
+    size_t total = 0;
+    size_t completed = 0;
+    bool cancelled = false;
+    bool finished = false;          // すべてのワーカーが終了した
+};
+
+/**
+ * RAWファイルの一括取り込み
+ * 固定数のワーカースレッドがそれぞれ RawProcessor（LibRaw インスタンス）を1つ持ち、
+ * ファイルを使い回しながらメタデータ抽出とサムネイル保存を行う。
+ * ファイルはセンサーデータを展開しないサムネイル専用モードで開く。
+ * ディスクキャッシュにあるサムネイルはエンコード済みのままファイルへ書き出す。
+ * 結果はキューに溜まり、呼び出し側はブロックせずに poll で受け取る。
+ */
+class BatchIngestor {
+public:
+    /**
+     * @param file_paths 取り込むファイル一覧
+     * @param thumbnail_dir サムネイルの保存先ディレクトリ（空ならサムネイルを保存しない）
+     * @param thumbnail_size サムネイルの長辺サイズ
+     * @param worker_count ワーカー数 (0 = 自動)
+     * @param disk_cache サムネイルのディスクキャッシュ（nullptr ならキャッシュしない）
+     */
+    BatchIngestor(std::vector<std::string> file_paths, std::string thumbnail_dir,
+                  u32 thumbnail_size = 512, u32 worker_count = 0,
+                  std::shared_ptr<DiskImageCache> disk_cache = nullptr);
+    ~BatchIngestor();
+
+    BatchIngestor(const BatchIngestor&) = delete;
+    BatchIngestor& operator=(const BatchIngestor&) = delete;
+
+    /**
+     * ワーカーを起動（2回目以降の呼び出しは無視される）
+     */
+    void start();
+
+    /**
+     * 未処理のファイルを破棄して取り込みを中止
+     * 処理中のファイルはそのまま完了し、その結果は poll で受け取れる
+     */
+    void cancel();
+
+    /**
+     * すべてのワーカーの終了を待つ
+     */
+    void wait();
+
+    /**
+     * 完了した結果を取り出す（ブロックしない）
+     * @param max_results 取り出す最大件数 (0 = すべて)
+     * @return 完了順の結果
+     */
+    std::vector<IngestResult> poll(size_t max_results = 0);
+
+    /**
+     * 進捗を取得
+     * @return 進捗
+     */
+    IngestProgress progress() const;
+
+private:
+    const std::vector<std::string> file_paths_;
+    const std::string thumbnail_dir_;
+    const u32 thumbnail_size_;
+    const u32 worker_count_;
+    const std::shared_ptr<DiskImageCache> disk_cache_;
+
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> next_index_;
+    std::atomic<size_t> completed_;
+    std::atomic<size_t> running_workers_;
+    std::atomic<bool> cancelled_;
+
+    mutable std::mutex results_mutex_;
+    std::deque<IngestResult> results_;
+
+    void worker_loop();
+
+    /**
+     * サムネイルの保存先パスを作成
+     * @param file_path RAWファイルのパス
+     * @return 保存先パス
+     */
+    std::string thumbnail_path_for(const std::string& file_path) const;
+};
+
+} // namespace raw_editor
+
+#endif // BATCH_INGESTOR_H
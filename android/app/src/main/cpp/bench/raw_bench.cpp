@@ -0,0 +1,848 @@
+// raw_bench - ネイティブパイプラインのベンチマークとゴールデン画像の照合（ホスト用）
+//
+// 使い方:
+//   raw_bench [--iterations N] [--synthetic WxH]... [--no-synthetic]
+//             [--golden DIR] [--update-golden] [--min-psnr DB] [--output FILE] [--trace FILE]
+//             [RAWファイル...]
+//
+// 入力（合成ベイヤー画像と指定されたRAWファイル）ごとに、読み込み・現像・各ステージ・
+// プレビュー生成・フル解像度出力・保存の所要時間を調整パラメータの組み合わせごとに計測し、
+// JSON で出力する。時間は最短値と中央値、画素数で割った ns/Mpix、計測後のピークRSSを記録する。
+//
+// --golden を指定すると、プレビュー出力を DIR/<入力>__<組み合わせ>.png と PSNR で比較する。
+// 閾値（--min-psnr、既定 40 dB）を下回った組み合わせがあれば終了コード 1 を返す。
+// --update-golden は比較せずに現在の出力でゴールデン画像を書き換える。
+// --trace を指定すると、各スレッドに残った直近の計測区間を Chrome トレース形式で書き出す。
+//
+// 組み合わせごとにスライダー操作（露出だけを変えたプレビューの連続）を再現し、慣らしの後に
+// フレームプールがシステムから確保した回数と、プロセス全体のヒープ確保（malloc 系を差し替えて
+// 数える。operator new や OpenCV のワーカースレッドでの確保も含む）を記録する。
+// プールの確保か、フレーム大のヒープ確保（64 KiB 以上）が1回でもあれば終了コード 1 を返す。
+// 小さな確保の回数は記録のみ（std::function などの管理用の確保が残るため）。
+//
+// 合成画像のサイズごとに、アプリの raw_benchmark_denoise と同じ計測（benchmark_denoise）で
+// ノイズ除去の品質段階ごとの ms/Mpix と PSNR を記録する。
+
+#include "raw_processor.h"
+#include "denoise.h"
+#include "fused_pipeline.h"
+#include "trace.h"
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// プロセス全体のヒープ確保の計数
+// glibc では malloc 系の関数をこの実行ファイルで定義し直し、__libc_* に転送しながら数える
+// （operator new と cv::fastMalloc も最終的にここを通る。共有ライブラリからの呼び出しも含む）
+namespace {
+
+// これ以上の確保をフレーム大（画素バッファ相当）とみなす
+constexpr size_t HEAP_LARGE_ALLOCATION = 64 * 1024;
+
+std::atomic<unsigned long long> g_heap_allocations{0};
+std::atomic<unsigned long long> g_heap_bytes{0};
+std::atomic<unsigned long long> g_heap_large_allocations{0};
+
+inline void count_heap_allocation(size_t bytes) {
+    g_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_heap_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (bytes >= HEAP_LARGE_ALLOCATION) {
+        g_heap_large_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+#if defined(__GLIBC__)
+#define RAW_BENCH_COUNTS_HEAP 1
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* pointer);
+
+void* malloc(size_t size) noexcept {
+    count_heap_allocation(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept {
+    count_heap_allocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) noexcept {
+    if (size > 0) {
+        count_heap_allocation(size);
+    }
+    return __libc_realloc(pointer, size);
+}
+
+void free(void* pointer) noexcept {
+    __libc_free(pointer);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept {
+    count_heap_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+    count_heap_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size) noexcept {
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    count_heap_allocation(size);
+    void* block = __libc_memalign(alignment, size);
+    if (!block) {
+        return ENOMEM;
+    }
+    *pointer = block;
+    return 0;
+}
+
+} // extern "C"
+
+#else
+#define RAW_BENCH_COUNTS_HEAP 0
+#endif
+
+namespace raw_editor {
+
+namespace {
+
+// プロセス全体のヒープ確保の累計
+struct HeapCounters {
+    u64 allocations = 0;
+    u64 bytes = 0;
+    u64 large_allocations = 0;
+
+    static HeapCounters now() {
+        HeapCounters counters;
+        counters.allocations = g_heap_allocations.load(std::memory_order_relaxed);
+        counters.bytes = g_heap_bytes.load(std::memory_order_relaxed);
+        counters.large_allocations = g_heap_large_allocations.load(std::memory_order_relaxed);
+        return counters;
+    }
+};
+
+// 合成ベイヤー画像の有効ビット数
+constexpr u32 SYNTHETIC_BITS = 14;
+
+struct BenchOptions {
+    u32 iterations = 3;
+    std::vector<cv::Size> synthetic_sizes;
+    bool synthetic = true;
+    std::string golden_dir;
+    bool update_golden = false;
+    double min_psnr = 40.0;
+    std::string output_path;
+    std::string trace_path;
+    std::vector<std::string> files;
+};
+
+struct ParamsCase {
+    std::string name;
+    AdjustmentParams params;
+};
+
+struct StageTiming {
+    std::string name;
+    std::string params_case;
+    double megapixels = 0.0;
+    double best_ns = 0.0;
+    double median_ns = 0.0;
+    long peak_rss_kb = 0;
+};
+
+struct GoldenCheck {
+    std::string params_case;
+    std::string status; // pass / fail / missing / updated / error
+    double psnr_db = 0.0;
+};
+
+struct PreviewLoopCheck {
+    std::string params_case;
+    u32 steps = 0;
+    u64 allocations = 0;     // 慣らしの後にフレームプールがシステムから確保した回数
+    u64 allocated_bytes = 0;
+    u64 reuses = 0;
+    u64 heap_allocations = 0;       // 慣らしの後のプロセス全体のヒープ確保の回数（全スレッド）
+    u64 heap_bytes = 0;
+    u64 large_heap_allocations = 0; // そのうち HEAP_LARGE_ALLOCATION 以上のもの
+};
+
+struct InputReport {
+    std::string name;
+    std::string kind;
+    cv::Size size;
+    std::string error;
+    std::vector<StageTiming> stages;
+    std::vector<GoldenCheck> golden;
+    std::vector<PreviewLoopCheck> preview_loops;
+};
+
+long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // Linux では KB
+}
+
+std::string json_string(const std::string& value) {
+    std::string escaped = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned>(c));
+            escaped += buffer;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped + "\"";
+}
+
+std::string file_stem(const std::string& path) {
+    const size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    const size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+// 調整パラメータの組み合わせ（プレビューで頻繁に使われる調整のまとまりごと）
+std::vector<ParamsCase> params_matrix() {
+    std::vector<ParamsCase> cases;
+
+    cases.push_back({"default", AdjustmentParams()});
+
+    AdjustmentParams tone;
+    tone.exposure = 0.5f;
+    tone.contrast = 20.0f;
+    tone.highlights = -40.0f;
+    tone.shadows = 40.0f;
+    tone.whites = 10.0f;
+    tone.blacks = -10.0f;
+    tone.clarity = 25.0f;
+    tone.vibrance = 20.0f;
+    tone.saturation = 10.0f;
+    cases.push_back({"tone", tone});
+
+    AdjustmentParams color;
+    color.temperature = 400.0f;
+    color.tint = -10.0f;
+    color.hue_orange = 10.0f;
+    color.hue_blue = -15.0f;
+    color.saturation_green = -30.0f;
+    color.saturation_aqua = 20.0f;
+    color.luminance_orange = 15.0f;
+    color.luminance_blue = -20.0f;
+    color.curve_highlights = 10.0f;
+    color.curve_lights = 5.0f;
+    color.curve_darks = -5.0f;
+    color.curve_shadows = -10.0f;
+    cases.push_back({"color", color});
+
+    AdjustmentParams detail;
+    detail.sharpening = 40.0f;
+    detail.noise_reduction = 30.0f;
+    detail.color_noise_reduction = 30.0f;
+    cases.push_back({"detail", detail});
+
+    AdjustmentParams geometry;
+    geometry.lens_distortion = 10.0f;
+    geometry.vignetting = -20.0f;
+    geometry.rotation = 3.0f;
+    geometry.crop_left = 0.05f;
+    geometry.crop_top = 0.05f;
+    geometry.crop_right = 0.95f;
+    geometry.crop_bottom = 0.95f;
+    cases.push_back({"geometry", geometry});
+
+    AdjustmentParams full = tone;
+    full.temperature = color.temperature;
+    full.tint = color.tint;
+    full.hue_orange = color.hue_orange;
+    full.saturation_green = color.saturation_green;
+    full.curve_highlights = color.curve_highlights;
+    full.curve_shadows = color.curve_shadows;
+    full.sharpening = detail.sharpening;
+    full.noise_reduction = detail.noise_reduction;
+    full.color_noise_reduction = detail.color_noise_reduction;
+    full.lens_distortion = geometry.lens_distortion;
+    full.vignetting = geometry.vignetting;
+    full.rotation = geometry.rotation;
+    full.crop_left = geometry.crop_left;
+    full.crop_top = geometry.crop_top;
+    full.crop_right = geometry.crop_right;
+    full.crop_bottom = geometry.crop_bottom;
+    cases.push_back({"full", full});
+
+    return cases;
+}
+
+/**
+ * 合成シーンをRGGBのベイヤー配列にする
+ * 中間調のパッチ・なめらかな階調・細かい縞（デモザイクの偽色が出やすい）を含み、
+ * ショットノイズと読み出しノイズを加える。乱数の種は固定なので毎回同じ画像になる
+ */
+std::vector<u16> make_synthetic_bayer(int width, int height) {
+    static const f32 patches[6][3] = {
+        {0.45f, 0.30f, 0.22f}, {0.20f, 0.35f, 0.55f}, {0.25f, 0.45f, 0.20f},
+        {0.70f, 0.60f, 0.15f}, {0.55f, 0.20f, 0.40f}, {0.18f, 0.18f, 0.18f}
+    };
+    const f32 maximum = static_cast<f32>((1u << SYNTHETIC_BITS) - 1);
+
+    std::vector<u16> samples(static_cast<size_t>(width) * height);
+    cv::RNG rng(0x5eed);
+    for (int y = 0; y < height; ++y) {
+        const f32 fy = static_cast<f32>(y) / height;
+        for (int x = 0; x < width; ++x) {
+            const f32 fx = static_cast<f32>(x) / width;
+            f32 rgb[3];
+            if (fy < 0.5f) {
+                // 上半分: 色パッチ（横6列）に縦方向の明るさの階調を掛ける
+                const f32* patch = patches[std::min(5, static_cast<int>(fx * 6.0f))];
+                const f32 shade = 0.3f + 1.4f * fy;
+                for (int c = 0; c < 3; ++c) {
+                    rgb[c] = patch[c] * shade;
+                }
+            } else if (fx < 0.5f) {
+                // 左下: 横方向の無彩色の階調（シャドウからハイライトまで）
+                const f32 value = 0.002f + 0.9f * fx * 2.0f;
+                rgb[0] = rgb[1] = rgb[2] = value;
+            } else {
+                // 右下: 周期が徐々に細かくなる縞
+                const f32 phase = (fx - 0.5f) * (fx - 0.5f) * width * 0.5f;
+                const f32 value = 0.25f + 0.2f * std::sin(phase);
+                rgb[0] = value;
+                rgb[1] = value * 0.9f;
+                rgb[2] = value * 0.8f;
+            }
+
+            // RGGB: (偶数行, 偶数列) = R、(奇数行, 奇数列) = B、それ以外 = G
+            const int channel = (y & 1) == 0 ? ((x & 1) == 0 ? 0 : 1) : ((x & 1) == 0 ? 1 : 2);
+            const f32 signal = std::min(1.0f, rgb[channel]) * maximum;
+            const f32 noise = static_cast<f32>(rng.gaussian(std::sqrt(signal * 0.5f) + 4.0f));
+            samples[static_cast<size_t>(y) * width + x] =
+                static_cast<u16>(std::min(maximum, std::max(0.0f, signal + noise)));
+        }
+    }
+    return samples;
+}
+
+} // namespace
+
+/**
+ * RawProcessor の公開・非公開のステージを計測する（RawProcessor の friend）
+ */
+class PipelineBenchmark {
+public:
+    PipelineBenchmark(const BenchOptions& options, const std::vector<ParamsCase>& cases)
+        : options_(options), cases_(cases) {}
+
+    InputReport run_synthetic(cv::Size size) {
+        InputReport report;
+        report.name = "synthetic-" + std::to_string(size.width) + "x" + std::to_string(size.height);
+        report.kind = "synthetic";
+
+        const std::vector<u16> samples = make_synthetic_bayer(size.width, size.height);
+        const double megapixels = size.area() / 1e6;
+        bool loaded = false;
+        time_stage(report, "load_bayer_buffer", "", megapixels, [&] {
+            loaded = processor_.load_bayer_buffer(samples, size.width, size.height, SYNTHETIC_BITS,
+                                                  report.name).is_success();
+        });
+        if (!loaded) {
+            report.error = "Failed to load synthetic Bayer buffer";
+            return report;
+        }
+        run_loaded(report);
+        return report;
+    }
+
+    InputReport run_file(const std::string& path) {
+        InputReport report;
+        report.name = file_stem(path);
+        report.kind = "file";
+
+        // 画素数はメタデータから求める（読み込みの計測にも使う）
+        BoolResult probe = processor_.load_raw_file(path, true);
+        if (probe.is_error()) {
+            report.error = probe.error_message;
+            return report;
+        }
+        MetadataResult metadata = processor_.extract_metadata();
+        const double megapixels = metadata.data.image_width * static_cast<double>(metadata.data.image_height) / 1e6;
+
+        bool loaded = false;
+        time_stage(report, "load_raw_file", "", megapixels, [&] {
+            loaded = processor_.load_raw_file(path).is_success();
+        });
+        if (!loaded) {
+            report.error = "Failed to load " + path;
+            return report;
+        }
+        run_loaded(report);
+        return report;
+    }
+
+private:
+    const BenchOptions& options_;
+    const std::vector<ParamsCase>& cases_;
+    RawProcessor processor_;
+
+    template<typename Body>
+    void time_stage(InputReport& report, const std::string& name, const std::string& params_case,
+                    double megapixels, Body body) {
+        std::vector<double> samples;
+        samples.reserve(options_.iterations);
+        for (u32 i = 0; i < options_.iterations; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        }
+        std::sort(samples.begin(), samples.end());
+
+        StageTiming timing;
+        timing.name = name;
+        timing.params_case = params_case;
+        timing.megapixels = megapixels;
+        timing.best_ns = samples.front();
+        timing.median_ns = samples[samples.size() / 2];
+        timing.peak_rss_kb = peak_rss_kb();
+        report.stages.push_back(timing);
+    }
+
+    void run_loaded(InputReport& report) {
+        RawProcessor& p = processor_;
+        const cv::Size full = p.full_developed_size();
+        const double full_mp = full.area() / 1e6;
+        report.size = full;
+
+        // 現像（LibRaw と自前のデモザイク。最後に高品質で現像したベースを残す）
+        time_stage(report, "process_with_libraw", "", full_mp, [&] {
+            p.process_with_libraw(DemosaicMethod::HIGH_QUALITY);
+        });
+        time_stage(report, "demosaic.half_size", "", full_mp, [&] { p.develop(DemosaicMethod::HALF_SIZE); });
+        time_stage(report, "demosaic.bilinear", "", full_mp, [&] { p.develop(DemosaicMethod::BILINEAR); });
+        time_stage(report, "demosaic.high_quality", "", full_mp, [&] { p.develop(DemosaicMethod::HIGH_QUALITY); });
+
+        // ステージはプレビュー（スライダー操作時）の解像度で計測する
+        const ProcessingOptions preview_options(true);
+        const cv::Mat linear = p.resize_if_needed(
+            p.get_linear_image(preview_options.output_width, preview_options.output_height),
+            preview_options.output_width, preview_options.output_height);
+        if (linear.empty()) {
+            report.error = "Failed to develop";
+            return;
+        }
+        const double preview_mp = linear.total() / 1e6;
+        const cv::Mat display = p.linear_to_display(linear);
+
+        for (const ParamsCase& c : cases_) {
+            const AdjustmentParams& params = c.params;
+
+            // 融合パイプラインの各ステージ（16ビットリニア → float）
+            cv::Mat denoised;
+            time_stage(report, "apply_noise_reduction.preview", c.name, preview_mp, [&] {
+                denoised = p.apply_noise_reduction(linear, params, DenoiseTier::PREVIEW);
+            });
+            time_stage(report, "apply_noise_reduction.export", c.name, preview_mp, [&] {
+                p.apply_noise_reduction(linear, params, DenoiseTier::EXPORT);
+            });
+            cv::Mat adjusted;
+            time_stage(report, "fused_pipeline", c.name, preview_mp, [&] {
+                adjusted = FusedPipeline(params).run(denoised);
+            });
+            cv::Mat sharpened;
+            time_stage(report, "apply_sharpening", c.name, preview_mp, [&] {
+                sharpened = p.apply_sharpening(adjusted, params);
+            });
+            time_stage(report, "apply_geometry", c.name, preview_mp, [&] {
+                p.apply_geometry(sharpened, params);
+            });
+
+            // 段階的な基準実装の各ステージ（8ビット）
+            cv::Mat staged = display;
+            time_stage(report, "apply_white_balance", c.name, preview_mp, [&] {
+                staged = p.apply_white_balance(display, params);
+            });
+            const cv::Mat balanced = staged;
+            time_stage(report, "apply_basic_adjustments", c.name, preview_mp, [&] {
+                staged = p.apply_basic_adjustments(balanced, params);
+            });
+            const cv::Mat basic = staged;
+            time_stage(report, "apply_hsl_adjustments", c.name, preview_mp, [&] {
+                staged = p.apply_hsl_adjustments(basic, params);
+            });
+            const cv::Mat hsl = staged;
+            time_stage(report, "apply_tone_curve", c.name, preview_mp, [&] {
+                staged = p.apply_tone_curve(hsl, params);
+            });
+            const cv::Mat toned = staged;
+            time_stage(report, "apply_detail_adjustments", c.name, preview_mp, [&] {
+                staged = p.apply_detail_adjustments(toned, params);
+            });
+            const cv::Mat detailed = staged;
+            time_stage(report, "apply_lens_corrections", c.name, preview_mp, [&] {
+                staged = p.apply_lens_corrections(detailed, params);
+            });
+            const cv::Mat corrected = staged;
+            time_stage(report, "apply_transform", c.name, preview_mp, [&] {
+                p.apply_transform(corrected, params);
+            });
+
+            // プレビュー生成（ステージキャッシュと縮小したフレームを毎回捨て、スライダー操作の最初の1回に相当させる）
+            ImageResult preview;
+            time_stage(report, "generate_preview", c.name, preview_mp, [&] {
+                p.preview_pipeline_.invalidate();
+                p.preview_source_ = RawProcessor::PreviewSource();
+                preview = p.generate_preview(params, preview_options);
+            });
+            check_golden(report, c.name, preview);
+            check_preview_loop(report, c, preview_options, preview_mp);
+
+            ImageResult output;
+            time_stage(report, "process_full_image", c.name, full_mp, [&] {
+                output = p.process_full_image(params);
+            });
+            if (output.is_success()) {
+                const std::string path = temporary_path(report.name + "__" + c.name + ".jpg");
+                time_stage(report, "save_image.jpeg", c.name, full_mp, [&] {
+                    p.save_image(output.data, path, "JPEG", 95);
+                });
+                std::remove(path.c_str());
+            }
+        }
+    }
+
+    // スライダー操作の再現（露出を少しずつ変え、キャッシュを残したままプレビューを繰り返す）
+    // 各回の出力はすぐに捨てる（Dart 側が前のフレームを解放するのに相当）
+    void check_preview_loop(InputReport& report, const ParamsCase& c, const ProcessingOptions& options,
+                            double preview_mp) {
+        RawProcessor& p = processor_;
+        AdjustmentParams params = c.params;
+        u32 step = 0;
+        bool measuring = false;
+        HeapCounters heap;
+        auto drag = [&] {
+            params.exposure = c.params.exposure + 0.01f * static_cast<f32>(++step % 8);
+            // ヒープはプレビューの生成と出力の破棄の間だけ数える（計測自体の確保を含めない）
+            const HeapCounters start = HeapCounters::now();
+            {
+                ImageResult frame = p.generate_preview(params, options);
+                (void)frame;
+            }
+            const HeapCounters end = HeapCounters::now();
+            if (measuring) {
+                heap.allocations += end.allocations - start.allocations;
+                heap.bytes += end.bytes - start.bytes;
+                heap.large_allocations += end.large_allocations - start.large_allocations;
+            }
+        };
+
+        // 慣らし（各サイズクラスに前回分と今回分のブロックが揃うまで）
+        for (int i = 0; i < 2; ++i) {
+            drag();
+        }
+
+        const FramePoolStats before = p.frame_pool_stats();
+        measuring = true;
+        time_stage(report, "generate_preview.drag", c.name, preview_mp, drag);
+        measuring = false;
+        const FramePoolStats after = p.frame_pool_stats();
+
+        PreviewLoopCheck check;
+        check.params_case = c.name;
+        check.steps = options_.iterations;
+        check.allocations = after.allocations - before.allocations;
+        check.allocated_bytes = after.allocated_bytes - before.allocated_bytes;
+        check.reuses = after.reuses - before.reuses;
+        check.heap_allocations = heap.allocations;
+        check.heap_bytes = heap.bytes;
+        check.large_heap_allocations = heap.large_allocations;
+        report.preview_loops.push_back(check);
+    }
+
+    static std::string temporary_path(const std::string& name) {
+        const char* directory = std::getenv("TMPDIR");
+        return std::string(directory && directory[0] ? directory : "/tmp") + "/raw_bench_" +
+               std::to_string(getpid()) + "_" + name;
+    }
+
+    void check_golden(InputReport& report, const std::string& params_case, const ImageResult& preview) {
+        if (options_.golden_dir.empty()) {
+            return;
+        }
+
+        GoldenCheck check;
+        check.params_case = params_case;
+        if (preview.is_error()) {
+            check.status = "error";
+            report.golden.push_back(check);
+            return;
+        }
+
+        // プレビューはRGB順の8ビット（PNGはBGR順で読み書きする）
+        const ImageData& image = preview.data;
+        cv::Mat rgb(image.height, image.width, CV_8UC3, const_cast<byte*>(image.data.data()));
+        cv::Mat bgr;
+        cv::cvtColor(rgb, bgr, cv::COLOR_RGB2BGR);
+
+        const std::string path = options_.golden_dir + "/" + report.name + "__" + params_case + ".png";
+        if (options_.update_golden) {
+            check.status = cv::imwrite(path, bgr) ? "updated" : "error";
+            report.golden.push_back(check);
+            return;
+        }
+
+        cv::Mat golden = cv::imread(path, cv::IMREAD_COLOR);
+        if (golden.empty()) {
+            check.status = "missing";
+        } else if (golden.size() != bgr.size()) {
+            check.status = "fail";
+        } else {
+            check.psnr_db = cv::PSNR(golden, bgr);
+            check.status = check.psnr_db >= options_.min_psnr ? "pass" : "fail";
+        }
+        report.golden.push_back(check);
+    }
+};
+
+namespace {
+
+bool parse_size(const std::string& text, cv::Size& size) {
+    int width = 0;
+    int height = 0;
+    if (std::sscanf(text.c_str(), "%dx%d", &width, &height) != 2 || width < 64 || height < 64) {
+        return false;
+    }
+    // ベイヤー配列の2x2単位に揃える
+    size = cv::Size(width & ~1, height & ~1);
+    return true;
+}
+
+bool parse_arguments(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto next = [&](std::string& value) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            value = argv[++i];
+            return true;
+        };
+
+        std::string value;
+        if (arg == "--iterations") {
+            if (!next(value)) return false;
+            options.iterations = static_cast<u32>(std::max(1, std::atoi(value.c_str())));
+        } else if (arg == "--synthetic") {
+            cv::Size size;
+            if (!next(value) || !parse_size(value, size)) {
+                std::cerr << "Invalid synthetic size (expected WxH, at least 64x64)" << std::endl;
+                return false;
+            }
+            options.synthetic_sizes.push_back(size);
+        } else if (arg == "--no-synthetic") {
+            options.synthetic = false;
+        } else if (arg == "--golden") {
+            if (!next(options.golden_dir)) return false;
+        } else if (arg == "--update-golden") {
+            options.update_golden = true;
+        } else if (arg == "--min-psnr") {
+            if (!next(value)) return false;
+            options.min_psnr = std::atof(value.c_str());
+        } else if (arg == "--output") {
+            if (!next(options.output_path)) return false;
+        } else if (arg == "--trace") {
+            if (!next(options.trace_path)) return false;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        } else {
+            options.files.push_back(arg);
+        }
+    }
+
+    if (options.synthetic && options.synthetic_sizes.empty()) {
+        options.synthetic_sizes.push_back(cv::Size(4000, 3000));
+    }
+    if (options.update_golden && options.golden_dir.empty()) {
+        std::cerr << "--update-golden requires --golden DIR" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void write_report(std::ostream& out, const BenchOptions& options, const std::vector<InputReport>& reports,
+                  const std::vector<DenoiseBenchmark>& denoise, bool passed) {
+    out << std::fixed << std::setprecision(3)
+        << "{\n"
+        << "  \"iterations\": " << options.iterations << ",\n"
+        << "  \"threads\": " << cv::getNumThreads() << ",\n"
+        << "  \"inputs\": [";
+
+    for (size_t r = 0; r < reports.size(); ++r) {
+        const InputReport& report = reports[r];
+        out << (r > 0 ? "," : "") << "\n    {\n"
+            << "      \"name\": " << json_string(report.name) << ",\n"
+            << "      \"kind\": " << json_string(report.kind) << ",\n"
+            << "      \"width\": " << report.size.width << ",\n"
+            << "      \"height\": " << report.size.height << ",\n";
+        if (!report.error.empty()) {
+            out << "      \"error\": " << json_string(report.error) << ",\n";
+        }
+
+        out << "      \"stages\": [";
+        for (size_t s = 0; s < report.stages.size(); ++s) {
+            const StageTiming& stage = report.stages[s];
+            out << (s > 0 ? "," : "") << "\n        {"
+                << "\"stage\": " << json_string(stage.name) << ", "
+                << "\"params\": " << (stage.params_case.empty() ? "null" : json_string(stage.params_case)) << ", "
+                << "\"megapixels\": " << stage.megapixels << ", "
+                << "\"best_ns\": " << stage.best_ns << ", "
+                << "\"median_ns\": " << stage.median_ns << ", "
+                << "\"ns_per_mpix\": " << (stage.megapixels > 0.0 ? stage.best_ns / stage.megapixels : 0.0) << ", "
+                << "\"peak_rss_kb\": " << stage.peak_rss_kb
+                << "}";
+        }
+        out << "\n      ],\n";
+
+        out << "      \"golden\": [";
+        for (size_t g = 0; g < report.golden.size(); ++g) {
+            const GoldenCheck& check = report.golden[g];
+            out << (g > 0 ? "," : "") << "\n        {"
+                << "\"params\": " << json_string(check.params_case) << ", "
+                << "\"status\": " << json_string(check.status) << ", "
+                << "\"psnr_db\": " << (std::isfinite(check.psnr_db) ? check.psnr_db : 999.0)
+                << "}";
+        }
+        out << (report.golden.empty() ? "],\n" : "\n      ],\n");
+
+        out << "      \"preview_loop\": [";
+        for (size_t l = 0; l < report.preview_loops.size(); ++l) {
+            const PreviewLoopCheck& check = report.preview_loops[l];
+            out << (l > 0 ? "," : "") << "\n        {"
+                << "\"params\": " << json_string(check.params_case) << ", "
+                << "\"steps\": " << check.steps << ", "
+                << "\"allocations\": " << check.allocations << ", "
+                << "\"allocated_bytes\": " << check.allocated_bytes << ", "
+                << "\"reuses\": " << check.reuses << ", "
+                << "\"heap_allocations\": " << check.heap_allocations << ", "
+                << "\"heap_bytes\": " << check.heap_bytes << ", "
+                << "\"large_heap_allocations\": " << check.large_heap_allocations
+                << "}";
+        }
+        out << (report.preview_loops.empty() ? "]\n" : "\n      ]\n") << "    }";
+    }
+
+    out << "\n  ],\n"
+        << "  \"denoise\": [";
+    for (size_t d = 0; d < denoise.size(); ++d) {
+        const DenoiseBenchmark& benchmark = denoise[d];
+        out << (d > 0 ? "," : "") << "\n    {"
+            << "\"width\": " << benchmark.width << ", "
+            << "\"height\": " << benchmark.height << ", "
+            << "\"input_psnr_db\": " << benchmark.input_psnr_db << ", "
+            << "\"tiers\": [";
+        for (size_t t = 0; t < benchmark.tiers.size(); ++t) {
+            const DenoiseTierBenchmark& tier = benchmark.tiers[t];
+            out << (t > 0 ? ", " : "") << "{"
+                << "\"tier\": " << json_string(denoise_tier_name(tier.tier)) << ", "
+                << "\"best_ms\": " << tier.best_ms << ", "
+                << "\"ms_per_mpix\": " << tier.ms_per_megapixel << ", "
+                << "\"psnr_db\": " << tier.psnr_db
+                << "}";
+        }
+        out << "]}";
+    }
+    out << (denoise.empty() ? "],\n" : "\n  ],\n")
+        << "  \"min_psnr_db\": " << options.min_psnr << ",\n"
+        << "  \"peak_rss_kb\": " << peak_rss_kb() << ",\n"
+        << "  \"heap_counted\": " << (RAW_BENCH_COUNTS_HEAP ? "true" : "false") << ",\n"
+        << "  \"passed\": " << (passed ? "true" : "false") << "\n"
+        << "}\n";
+}
+
+} // namespace
+
+} // namespace raw_editor
+
+int main(int argc, char** argv) {
+    using namespace raw_editor;
+
+    BenchOptions options;
+    if (!parse_arguments(argc, argv, options)) {
+        std::cerr << "Usage: raw_bench [--iterations N] [--synthetic WxH]... [--no-synthetic] "
+                     "[--golden DIR] [--update-golden] [--min-psnr DB] [--output FILE] [--trace FILE] [RAW files...]"
+                  << std::endl;
+        return 2;
+    }
+
+    const std::vector<ParamsCase> cases = params_matrix();
+    std::vector<InputReport> reports;
+    std::vector<DenoiseBenchmark> denoise;
+
+    // 入力ごとにプロセッサーを作り直し、キャッシュを持ち越さない
+    if (options.synthetic) {
+        for (const cv::Size& size : options.synthetic_sizes) {
+            PipelineBenchmark bench(options, cases);
+            reports.push_back(bench.run_synthetic(size));
+            denoise.push_back(benchmark_denoise(static_cast<u32>(size.width), static_cast<u32>(size.height),
+                                                options.iterations));
+        }
+    }
+    for (const std::string& path : options.files) {
+        PipelineBenchmark bench(options, cases);
+        reports.push_back(bench.run_file(path));
+    }
+
+    bool passed = true;
+    for (const InputReport& report : reports) {
+        passed = passed && report.error.empty();
+        for (const GoldenCheck& check : report.golden) {
+            passed = passed && (check.status == "pass" || check.status == "missing" || check.status == "updated");
+        }
+        for (const PreviewLoopCheck& check : report.preview_loops) {
+            passed = passed && check.allocations == 0 && check.large_heap_allocations == 0;
+        }
+    }
+
+    if (options.output_path.empty()) {
+        write_report(std::cout, options, reports, denoise, passed);
+    } else {
+        std::ofstream out(options.output_path);
+        write_report(out, options, reports, denoise, passed);
+    }
+    if (!options.trace_path.empty()) {
+        std::ofstream trace(options.trace_path);
+        trace << trace_to_chrome_json(trace_snapshot(0));
+    }
+    return passed ? 0 : 1;
+}
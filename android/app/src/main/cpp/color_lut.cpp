@@ -0,0 +1,221 @@
+#include "color_lut.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace raw_editor {
+
+static const char* TAG = "ColorLut3D";
+
+namespace {
+
+// 並列処理の行ブロックサイズ
+constexpr int ROW_BLOCK = 32;
+
+inline f32 encode_srgb(f32 v) {
+    return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+}
+
+inline f32 decode_srgb(f32 v) {
+    return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+}
+
+// 16ビットリニア値 → 格子座標（sRGBガンマ・[0, 1]）のテーブル
+const f32* shaper_table() {
+    static const std::vector<f32> table = [] {
+        std::vector<f32> t(65536);
+        for (int i = 0; i < 65536; ++i) {
+            t[i] = encode_srgb(i / 65535.0f);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+} // namespace
+
+ColorLut3D::ColorLut3D()
+    : size_(0) {
+}
+
+ColorLut3D::ColorLut3D(int size, const cv::Mat& values)
+    : size_(size) {
+    CV_Assert(size >= MIN_SIZE && size <= MAX_SIZE);
+    CV_Assert(values.type() == CV_32FC3 && values.rows == size * size && values.cols == size);
+
+    // 連続した格子点の出力はそのまま共有する（切り出しなどで連続でなければ複製）
+    table_ = values.isContinuous() ? values : values.clone();
+}
+
+cv::Mat ColorLut3D::lattice(int size) {
+    CV_Assert(size >= MIN_SIZE && size <= MAX_SIZE);
+
+    // 格子座標をリニア値に戻して16ビットに量子化
+    std::vector<u16> levels(size);
+    for (int i = 0; i < size; ++i) {
+        f32 linear = decode_srgb(static_cast<f32>(i) / (size - 1));
+        levels[i] = static_cast<u16>(std::lround(std::min(1.0f, linear) * 65535.0f));
+    }
+
+    cv::Mat nodes(size * size, size, CV_16UC3);
+    for (int b = 0; b < size; ++b) {
+        for (int g = 0; g < size; ++g) {
+            u16* row = nodes.ptr<u16>(b * size + g);
+            for (int r = 0; r < size; ++r) {
+                row[r * 3 + 0] = levels[b];
+                row[r * 3 + 1] = levels[g];
+                row[r * 3 + 2] = levels[r];
+            }
+        }
+    }
+    return nodes;
+}
+
+cv::Mat ColorLut3D::apply(const cv::Mat& linear, bool parallel) const {
+    CV_Assert(!empty() && linear.type() == CV_16UC3);
+
+    cv::Mat image(linear.size(), CV_32FC3);
+    const int stripes = parallel ? std::max(1, linear.rows / ROW_BLOCK) : 1;
+    cv::parallel_for_(cv::Range(0, linear.rows), [&](const cv::Range& rows) {
+        for (int y = rows.start; y < rows.end; ++y) {
+            apply_row(linear.ptr<u16>(y), image.ptr<f32>(y), linear.cols);
+        }
+    }, stripes);
+    return image;
+}
+
+void ColorLut3D::apply_row(const u16* src, f32* dst, int width) const {
+    const f32* shaper = shaper_table();
+    const f32* lut = table_.ptr<f32>();
+    const int n = size_;
+    const f32 scale = static_cast<f32>(n - 1);
+
+    // 格子の各軸方向のストライド（要素数）
+    const int stride_r = 3;
+    const int stride_g = 3 * n;
+    const int stride_b = 3 * n * n;
+    const int stride_all = stride_r + stride_g + stride_b;
+
+    int x = 0;
+#if CV_SIMD128
+    using namespace cv;
+    const v_float32x4 v_scale = v_setall_f32(scale);
+    const v_float32x4 v_last = v_setall_f32(static_cast<f32>(n - 2));
+    const v_float32x4 v_stride_r = v_setall_f32(static_cast<f32>(stride_r));
+    const v_float32x4 v_stride_g = v_setall_f32(static_cast<f32>(stride_g));
+    const v_float32x4 v_stride_b = v_setall_f32(static_cast<f32>(stride_b));
+    const v_float32x4 v_stride_all = v_setall_f32(static_cast<f32>(stride_all));
+
+    // 4画素分の四面体補間（オフセットは2^24未満なのでfloatのまま正確に扱える）
+    auto interpolate = [&](const v_float32x4& b, const v_float32x4& g, const v_float32x4& r, f32* out) {
+        v_float32x4 pr = r * v_scale, pg = g * v_scale, pb = b * v_scale;
+        v_float32x4 ir = v_min(v_cvt_f32(v_floor(pr)), v_last);
+        v_float32x4 ig = v_min(v_cvt_f32(v_floor(pg)), v_last);
+        v_float32x4 ib = v_min(v_cvt_f32(v_floor(pb)), v_last);
+        v_float32x4 fr = pr - ir, fg = pg - ig, fb = pb - ib;
+
+        // 端数の大きい順に軸をたどる（最大軸と最小軸は同順位でも必ず異なる軸になる）
+        v_float32x4 f_max = v_max(fr, v_max(fg, fb));
+        v_float32x4 f_min = v_min(fr, v_min(fg, fb));
+        v_float32x4 f_mid = fr + fg + fb - f_max - f_min;
+        v_float32x4 max_axis = v_select((fr >= fg) & (fr >= fb), v_stride_r,
+                                        v_select(fg >= fb, v_stride_g, v_stride_b));
+        v_float32x4 min_axis = v_select((fb <= fg) & (fb <= fr), v_stride_b,
+                                        v_select(fg <= fr, v_stride_g, v_stride_r));
+
+        v_float32x4 base = ib * v_stride_b + ig * v_stride_g + ir * v_stride_r;
+        v_int32x4 i0 = v_round(base);
+        v_int32x4 i1 = v_round(base + max_axis);
+        v_int32x4 i2 = v_round(base + v_stride_all - min_axis);
+        v_int32x4 i3 = v_round(base + v_stride_all);
+
+        v_float32x4 c[3];
+        for (int ch = 0; ch < 3; ++ch) {
+            v_float32x4 c0 = v_lut(lut + ch, i0);
+            v_float32x4 c1 = v_lut(lut + ch, i1);
+            v_float32x4 c2 = v_lut(lut + ch, i2);
+            v_float32x4 c3 = v_lut(lut + ch, i3);
+            c[ch] = c0 + (c1 - c0) * f_max + (c2 - c1) * f_mid + (c3 - c2) * f_min;
+        }
+        v_store_interleave(out, c[0], c[1], c[2]);
+    };
+
+    for (; x <= width - 8; x += 8) {
+        v_uint16x8 b16, g16, r16;
+        v_load_deinterleave(src + x * 3, b16, g16, r16);
+
+        v_uint32x4 b_lo, b_hi, g_lo, g_hi, r_lo, r_hi;
+        v_expand(b16, b_lo, b_hi);
+        v_expand(g16, g_lo, g_hi);
+        v_expand(r16, r_lo, r_hi);
+
+        interpolate(v_lut(shaper, v_reinterpret_as_s32(b_lo)),
+                    v_lut(shaper, v_reinterpret_as_s32(g_lo)),
+                    v_lut(shaper, v_reinterpret_as_s32(r_lo)), dst + x * 3);
+        interpolate(v_lut(shaper, v_reinterpret_as_s32(b_hi)),
+                    v_lut(shaper, v_reinterpret_as_s32(g_hi)),
+                    v_lut(shaper, v_reinterpret_as_s32(r_hi)), dst + x * 3 + 12);
+    }
+#endif
+    for (; x < width; ++x) {
+        const u16* px = src + x * 3;
+        f32 pr = shaper[px[2]] * scale, pg = shaper[px[1]] * scale, pb = shaper[px[0]] * scale;
+        int ir = std::min(static_cast<int>(pr), n - 2);
+        int ig = std::min(static_cast<int>(pg), n - 2);
+        int ib = std::min(static_cast<int>(pb), n - 2);
+        f32 fr = pr - ir, fg = pg - ig, fb = pb - ib;
+
+        f32 f_max = std::max(fr, std::max(fg, fb));
+        f32 f_min = std::min(fr, std::min(fg, fb));
+        f32 f_mid = fr + fg + fb - f_max - f_min;
+        int max_axis = (fr >= fg && fr >= fb) ? stride_r : (fg >= fb ? stride_g : stride_b);
+        int min_axis = (fb <= fg && fb <= fr) ? stride_b : (fg <= fr ? stride_g : stride_r);
+
+        const f32* c0 = lut + ib * stride_b + ig * stride_g + ir * stride_r;
+        const f32* c1 = c0 + max_axis;
+        const f32* c2 = c0 + stride_all - min_axis;
+        const f32* c3 = c0 + stride_all;
+        for (int ch = 0; ch < 3; ++ch) {
+            dst[x * 3 + ch] = c0[ch] + (c1[ch] - c0[ch]) * f_max + (c2[ch] - c1[ch]) * f_mid +
+                              (c3[ch] - c2[ch]) * f_min;
+        }
+    }
+}
+
+BoolResult ColorLut3D::write_cube(const std::string& path, const std::string& title) const {
+    if (empty()) {
+        return BoolResult(ResultCode::ERROR_INVALID_PARAMETERS, std::string("Color LUT is empty"));
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::string error = "Failed to open LUT file: " + path;
+        LOG_ERROR(TAG, error.c_str());
+        return BoolResult(ResultCode::ERROR_PROCESSING_FAILED, error);
+    }
+
+    // .cube は R・G・B の順で、r が最も速く変化する（格子の並びと同じ）
+    bool ok = std::fprintf(file, "TITLE \"%s\"\n", title.c_str()) > 0 &&
+              std::fprintf(file, "LUT_3D_SIZE %d\n", size_) > 0 &&
+              std::fprintf(file, "DOMAIN_MIN 0.0 0.0 0.0\nDOMAIN_MAX 1.0 1.0 1.0\n") > 0;
+    const size_t nodes = table_.total();
+    const f32* table = table_.ptr<f32>();
+    for (size_t i = 0; ok && i < nodes; ++i) {
+        const f32* bgr = table + i * 3;
+        ok = std::fprintf(file, "%.6f %.6f %.6f\n", bgr[2], bgr[1], bgr[0]) > 0;
+    }
+
+    if (std::fclose(file) != 0 || !ok) {
+        std::remove(path.c_str());
+        std::string error = "Failed to write LUT file: " + path;
+        LOG_ERROR(TAG, error.c_str());
+        return BoolResult(ResultCode::ERROR_PROCESSING_FAILED, error);
+    }
+
+    LOG_INFO(TAG, ("Color LUT written: " + path + " (" + std::to_string(size_) + "^3)").c_str());
+    return BoolResult(ResultCode::SUCCESS, true);
+}
+
+} // namespace raw_editor
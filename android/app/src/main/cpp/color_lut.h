@@ -0,0 +1,79 @@
+#ifndef COLOR_LUT_H
+#define COLOR_LUT_H
+
+#include "common_types.h"
+#include <opencv2/opencv.hpp>
+#include <string>
+
+namespace raw_editor {
+
+/**
+ * 3D カラーLUT
+ * 16ビットリニア入力から調整済みsRGB出力への画素単位の変換を格子点で保持し、
+ * 四面体補間で適用する。
+ * 格子はリニア値をsRGBガンマで符号化した座標上に等間隔に置く（シャドウ側の精度を確保するため）。
+ * 構築コストは格子点数のみに依存し、画像サイズには依存しない。
+ */
+class ColorLut3D {
+public:
+    // プレビュー用・書き出し用の格子サイズ
+    static constexpr int PREVIEW_SIZE = 33;
+    static constexpr int EXPORT_SIZE = 65;
+
+    // 格子サイズの範囲（.cube の仕様上の上限は256）
+    static constexpr int MIN_SIZE = 2;
+    static constexpr int MAX_SIZE = 256;
+
+    /**
+     * 空のLUTを生成
+     */
+    ColorLut3D();
+
+    /**
+     * 格子点での変換結果からLUTを生成
+     * @param size 格子サイズ（1軸あたりの点数）
+     * @param values lattice(size) を変換した結果 (CV_32FC3、sRGBガンマ・[0, 1]範囲)
+     */
+    ColorLut3D(int size, const cv::Mat& values);
+
+    /**
+     * 格子点の入力画像を生成
+     * 行 (b * size + g)・列 r の画素が格子点 (r, g, b) に対応する
+     * @param size 格子サイズ
+     * @return 16ビットリニアBGR画像 (CV_16UC3、size*size 行 × size 列)
+     */
+    static cv::Mat lattice(int size);
+
+    bool empty() const { return size_ == 0; }
+    int size() const { return size_; }
+
+    /**
+     * 16ビットリニア画像に適用
+     * @param linear 16ビットリニアBGR画像 (CV_16UC3)
+     * @param parallel 行方向に並列化するか（タイル処理時は false）
+     * @return sRGBガンマ・[0, 1]範囲のfloat画像 (CV_32FC3)
+     */
+    cv::Mat apply(const cv::Mat& linear, bool parallel = true) const;
+
+    /**
+     * Adobe .cube 形式で書き出す
+     * 入力はsRGBガンマで符号化した無調整の画像（DOMAIN 0〜1）として解釈される
+     * @param path 出力パス
+     * @param title LUTのタイトル
+     * @return 書き出し結果
+     */
+    BoolResult write_cube(const std::string& path, const std::string& title) const;
+
+private:
+    int size_;
+
+    // 格子点ごとのBGR出力（r が最も速く変化する順、連続した CV_32FC3）
+    // cv::Mat で持つため、プレビューごとの再構築でもフレームプールのブロックが再利用される
+    cv::Mat table_;
+
+    void apply_row(const u16* src, f32* dst, int width) const;
+};
+
+} // namespace raw_editor
+
+#endif // COLOR_LUT_H
@@ -1,10 +1,16 @@
 #ifndef COMMON_TYPES_H
 #define COMMON_TYPES_H
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <type_traits>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#endif
 
 namespace raw_editor {
 
@@ -16,9 +22,35 @@ using u64 = uint64_t;
 using f32 = float;
 using f64 = double;
 
+// 参照カウント付き画素バッファ
+// メモリと解放処理をまとめて保持し、ImageData間やFFI境界をコピーなしで受け渡す
+class PixelBuffer {
+public:
+    using Releaser = std::function<void()>;
+    
+    PixelBuffer() : size_(0) {}
+    
+    // 新しいメモリを確保
+    explicit PixelBuffer(size_t size)
+        : storage_(new byte[size], std::default_delete<byte[]>()), size_(size) {}
+    
+    // 外部のメモリを参照（最後の参照が消えたときに release を呼ぶ）
+    PixelBuffer(byte* data, size_t size, Releaser release)
+        : storage_(data, [release](byte*) { if (release) release(); }), size_(size) {}
+    
+    byte* data() { return storage_.get(); }
+    const byte* data() const { return storage_.get(); }
+    size_t size() const { return size_; }
+    bool empty() const { return !storage_ || size_ == 0; }
+    
+private:
+    std::shared_ptr<byte> storage_;
+    size_t size_;
+};
+
 // 画像データ構造体
 struct ImageData {
-    std::vector<byte> data;
+    PixelBuffer data;
     u32 width;
     u32 height;
     u32 channels;
@@ -27,9 +59,11 @@ struct ImageData {
     ImageData() : width(0), height(0), channels(0), bit_depth(0) {}
     
     ImageData(u32 w, u32 h, u32 c, u32 depth) 
-        : width(w), height(h), channels(c), bit_depth(depth) {
-        data.resize(w * h * c * (depth / 8));
-    }
+        : data(static_cast<size_t>(w) * h * c * (depth / 8)),
+          width(w), height(h), channels(c), bit_depth(depth) {}
+    
+    ImageData(u32 w, u32 h, u32 c, u32 depth, PixelBuffer buffer)
+        : data(std::move(buffer)), width(w), height(h), channels(c), bit_depth(depth) {}
     
     size_t size() const {
         return data.size();
@@ -132,6 +166,8 @@ struct AdjustmentParams {
     f32 crop_bottom = 1.0f;
 };
 
+class JobControl;
+
 // 処理オプション構造体
 struct ProcessingOptions {
     u32 output_width = 0;      // 0 = 元のサイズ
@@ -140,6 +176,9 @@ struct ProcessingOptions {
     bool preview_mode = false; // プレビューモード
     bool use_gpu = true;       // GPU加速使用
     u32 thread_count = 0;      // 0 = 自動
+    u32 output_bit_depth = 8;  // 出力ビット深度 (8 または 16)
+    JobControl* job = nullptr; // 非同期ジョブの中止要求・進捗の報告先（nullptr = 同期呼び出し）
+    bool draft = false;        // 低解像度の先行プレビュー（通常のプレビューとは別のステージキャッシュを使う）
     
     ProcessingOptions() = default;
     
@@ -162,6 +201,7 @@ enum class ResultCode {
     ERROR_INVALID_PARAMETERS = -5,
     ERROR_LIBRAW_ERROR = -6,
     ERROR_OPENCV_ERROR = -7,
+    ERROR_CANCELLED = -8,
     ERROR_UNKNOWN = -999
 };
 
@@ -176,9 +216,15 @@ struct ProcessingResult {
     
     ProcessingResult(ResultCode c, const T& d) : code(c), data(d) {}
     
+    // StringResult では (コード, 文字列) はデータとして扱う（エラーは文字列リテラルで渡す）
+    template<typename U = T, typename std::enable_if<!std::is_same<U, std::string>::value, int>::type = 0>
     ProcessingResult(ResultCode c, const std::string& msg) 
         : code(c), error_message(msg) {}
     
+    // 文字列リテラルは常にエラーメッセージ（BoolResult で bool への変換が選ばれないようにする）
+    ProcessingResult(ResultCode c, const char* msg)
+        : code(c), error_message(msg) {}
+    
     bool is_success() const {
         return code == ResultCode::SUCCESS;
     }
@@ -193,6 +239,7 @@ using ImageResult = ProcessingResult<ImageData>;
 using MetadataResult = ProcessingResult<RawMetadata>;
 using BoolResult = ProcessingResult<bool>;
 using StringResult = ProcessingResult<std::string>;
+using BytesResult = ProcessingResult<std::vector<byte>>;
 
 // ユーティリティマクロ
 #define RETURN_ON_ERROR(result) \
@@ -200,6 +247,8 @@ using StringResult = ProcessingResult<std::string>;
         return result; \
     }
 
+#ifdef __ANDROID__
+
 #define LOG_ERROR(tag, msg) \
     __android_log_print(ANDROID_LOG_ERROR, tag, "%s", msg)
 
@@ -209,6 +258,35 @@ using StringResult = ProcessingResult<std::string>;
 #define LOG_DEBUG(tag, msg) \
     __android_log_print(ANDROID_LOG_DEBUG, tag, "%s", msg)
 
+#else
+
+// ホスト（ベンチマーク）用のログ出力。優先度の値は android_LogPriority と同じ
+enum HostLogPriority {
+    HOST_LOG_DEBUG = 3,
+    HOST_LOG_INFO = 4,
+    HOST_LOG_ERROR = 6
+};
+
+/**
+ * 標準エラー出力にログを書く
+ * 環境変数 RAW_EDITOR_LOG（debug / info / error、既定は error）より低い優先度は捨てる
+ * @param priority 優先度
+ * @param tag タグ
+ * @param msg メッセージ
+ */
+void host_log(int priority, const char* tag, const char* msg);
+
+#define LOG_ERROR(tag, msg) \
+    ::raw_editor::host_log(::raw_editor::HOST_LOG_ERROR, tag, msg)
+
+#define LOG_INFO(tag, msg) \
+    ::raw_editor::host_log(::raw_editor::HOST_LOG_INFO, tag, msg)
+
+#define LOG_DEBUG(tag, msg) \
+    ::raw_editor::host_log(::raw_editor::HOST_LOG_DEBUG, tag, msg)
+
+#endif
+
 } // namespace raw_editor
 
 #endif // COMMON_TYPES_H
\ No newline at end of file
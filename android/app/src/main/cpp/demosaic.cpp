@@ -0,0 +1,679 @@
+#include "demosaic.h"
+#include "trace.h"
+#include "tiled_renderer.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+namespace raw_editor {
+
+namespace {
+
+// タイルの1辺（有効画素数）。タイル1枚分の作業用の平面がL2キャッシュに収まる大きさにする
+constexpr int TILE_SIZE = 128;
+
+// タイルの周囲に読み込む画素数（CFAの位相を保つため偶数）
+// 高品質: 緑の補間 ±2、色差の補間 ±1、均質性 ±1、均質性の集計 ±1
+constexpr int HIGH_QUALITY_BORDER = 6;
+constexpr int BILINEAR_BORDER = 2;
+
+// ハーフサイズ現像で1タスクが処理する出力行数
+constexpr int HALF_SIZE_BAND_ROWS = 32;
+
+// デモザイクできる最小の画像サイズ（これより小さい画像は LibRaw に任せる）
+constexpr int MIN_FRAME_SIZE = 16;
+
+constexpr f32 WHITE = 65535.0f;
+
+// sRGBリニア → XYZ（D65の白が (1, 1, 1) になるよう正規化済み）
+constexpr f32 SRGB_TO_XYZ[3][3] = {
+    {0.412453f / 0.950456f, 0.357580f / 0.950456f, 0.180423f / 0.950456f},
+    {0.212671f, 0.715160f, 0.072169f},
+    {0.019334f / 1.088754f, 0.119193f / 1.088754f, 0.950227f / 1.088754f},
+};
+
+inline f32 clamp_white(f32 value) {
+    return std::min(std::max(value, 0.0f), WHITE);
+}
+
+inline u16 to_u16(f32 value) {
+    return static_cast<u16>(clamp_white(value) + 0.5f);
+}
+
+inline f32 scale_sample(u16 raw, f32 black, f32 scale) {
+    return clamp_white((static_cast<f32>(raw) - black) * scale);
+}
+
+// 範囲外の座標を端で折り返す（偶数離れた位置に折り返すためCFAの位相が保たれる）
+inline int mirror(int i, int n) {
+    if (i < 0) {
+        i = -i;
+    }
+    if (i >= n) {
+        i = 2 * (n - 1) - i;
+    }
+    return std::min(std::max(i, 0), n - 1);
+}
+
+bool is_supported(const BayerFrame& frame) {
+    if (!frame.data || frame.width < MIN_FRAME_SIZE || frame.height < MIN_FRAME_SIZE ||
+        frame.stride < static_cast<size_t>(frame.width)) {
+        return false;
+    }
+
+    // 2x2の中に R が1つ、G が2つ、B が1つ
+    int counts[3] = {0, 0, 0};
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < 2; ++x) {
+            const int c = frame.color[y][x];
+            if (c < 0 || c > 2) {
+                return false;
+            }
+            ++counts[c];
+        }
+    }
+    return counts[0] == 1 && counts[1] == 2 && counts[2] == 1;
+}
+
+/**
+ * 補間結果を出力色空間へ変換し、向きを補正した位置へ書き込む
+ */
+class OutputWriter {
+public:
+    /**
+     * @param frame センサーデータ（色変換と向き）
+     * @param width 向きの補正前の幅
+     * @param height 向きの補正前の高さ
+     * @param output 出力画像（向きの補正後のサイズ）
+     */
+    OutputWriter(const BayerFrame& frame, int width, int height, cv::Mat& output)
+        : width_(width), height_(height), flip_(frame.flip), output_(output) {
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                matrix_[i][j] = frame.camera_to_output[i][j];
+            }
+        }
+    }
+
+    /**
+     * 1行分の補間結果（カメラRGBの平面）を書き込む
+     * @param y 補正前の行
+     * @param x 補正前の先頭の列
+     */
+    void write_row(const f32* r, const f32* g, const f32* b, int count, int y, int x) const {
+        const int row = (flip_ & 2) ? height_ - 1 - y : y;
+
+        if ((flip_ & 5) == 0) {
+            // 転置・左右反転がなければ行の中で連続して書ける
+            u16* dst = output_.ptr<u16>(row) + x * 3;
+            int i = 0;
+#if CV_SIMD128
+            using namespace cv;
+            const v_float32x4 v_zero = v_setzero_f32();
+            const v_float32x4 v_white = v_setall_f32(WHITE);
+            v_float32x4 m[3][3];
+            for (int c = 0; c < 3; ++c) {
+                for (int k = 0; k < 3; ++k) {
+                    m[c][k] = v_setall_f32(matrix_[c][k]);
+                }
+            }
+            for (; i <= count - 8; i += 8) {
+                const v_float32x4 r0 = v_load(r + i), r1 = v_load(r + i + 4);
+                const v_float32x4 g0 = v_load(g + i), g1 = v_load(g + i + 4);
+                const v_float32x4 b0 = v_load(b + i), b1 = v_load(b + i + 4);
+                v_uint16x8 out[3];
+                for (int c = 0; c < 3; ++c) {
+                    v_float32x4 lo = v_muladd(r0, m[c][0], v_muladd(g0, m[c][1], b0 * m[c][2]));
+                    v_float32x4 hi = v_muladd(r1, m[c][0], v_muladd(g1, m[c][1], b1 * m[c][2]));
+                    lo = v_min(v_max(lo, v_zero), v_white);
+                    hi = v_min(v_max(hi, v_zero), v_white);
+                    out[c] = v_pack_u(v_round(lo), v_round(hi));
+                }
+                v_store_interleave(dst + i * 3, out[2], out[1], out[0]);
+            }
+#endif
+            for (; i < count; ++i) {
+                store_pixel(dst + i * 3, r[i], g[i], b[i]);
+            }
+            return;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            const int col = (flip_ & 1) ? width_ - 1 - (x + i) : x + i;
+            u16* dst = (flip_ & 4) ? output_.ptr<u16>(col) + row * 3 : output_.ptr<u16>(row) + col * 3;
+            store_pixel(dst, r[i], g[i], b[i]);
+        }
+    }
+
+private:
+    f32 matrix_[3][3];
+    int width_;
+    int height_;
+    int flip_;
+    cv::Mat& output_;
+
+    void store_pixel(u16* dst, f32 r, f32 g, f32 b) const {
+        dst[0] = to_u16(matrix_[2][0] * r + matrix_[2][1] * g + matrix_[2][2] * b);
+        dst[1] = to_u16(matrix_[1][0] * r + matrix_[1][1] * g + matrix_[1][2] * b);
+        dst[2] = to_u16(matrix_[0][0] * r + matrix_[0][1] * g + matrix_[0][2] * b);
+    }
+};
+
+/**
+ * タイル1枚分の作業用バッファ（タスクごとに確保して使い回す）
+ */
+struct TileBuffers {
+    std::vector<f32> cfa;
+    std::vector<f32> green[2];          // [0] = 水平方向、[1] = 垂直方向の補間
+    std::vector<f32> rgb[2];            // 方向ごとのRGB（平面）
+    std::vector<f32> lab[2];            // 方向ごとの L*a*b*（平面）
+    std::vector<byte> homogeneity[2];
+    std::vector<f32> result;            // 有効画素のRGB（平面）
+
+    void prepare(DemosaicMethod method, size_t padded, size_t core) {
+        cfa.resize(padded);
+        green[0].resize(padded);
+        rgb[0].resize(padded * 3);
+        result.resize(core * 3);
+        if (method == DemosaicMethod::HIGH_QUALITY) {
+            green[1].resize(padded);
+            rgb[1].resize(padded * 3);
+            lab[0].resize(padded * 3);
+            lab[1].resize(padded * 3);
+            homogeneity[0].resize(padded);
+            homogeneity[1].resize(padded);
+        }
+    }
+};
+
+/**
+ * タイルとその周囲のセンサーデータを読み込み、黒レベル減算と倍率を適用
+ * タイルの左上は偶数座標なので、タイル内の座標の偶奇は画像内の座標の偶奇と一致する
+ */
+void load_tile(const BayerFrame& frame, const cv::Rect& core, int border, f32* cfa) {
+    const int width = core.width + border * 2;
+    const int height = core.height + border * 2;
+    const int left = core.x - border;
+    const int top = core.y - border;
+
+    // 折り返しなしで読める列の範囲（タイル内の座標）
+    const int inside_begin = std::max(0, -left);
+    const int inside_end = std::min(width, frame.width - left);
+
+    for (int y = 0; y < height; ++y) {
+        const int sy = mirror(top + y, frame.height);
+        const u16* src = frame.data + static_cast<size_t>(sy) * frame.stride;
+        const f32* black = frame.black[sy & 1];
+        const f32* scale = frame.scale[sy & 1];
+        f32* dst = cfa + static_cast<size_t>(y) * width;
+
+        for (int x = 0; x < inside_begin; ++x) {
+            const int sx = mirror(left + x, frame.width);
+            dst[x] = scale_sample(src[sx], black[sx & 1], scale[sx & 1]);
+        }
+
+        int x = inside_begin;
+#if CV_SIMD128
+        using namespace cv;
+        const v_float32x4 v_black(black[0], black[1], black[0], black[1]);
+        const v_float32x4 v_scale(scale[0], scale[1], scale[0], scale[1]);
+        const v_float32x4 v_zero = v_setzero_f32();
+        const v_float32x4 v_white = v_setall_f32(WHITE);
+        for (; x <= inside_end - 4; x += 4) {
+            const v_float32x4 raw = v_cvt_f32(v_reinterpret_as_s32(v_load_expand(src + left + x)));
+            v_store(dst + x, v_min(v_max((raw - v_black) * v_scale, v_zero), v_white));
+        }
+#endif
+        for (; x < inside_end; ++x) {
+            dst[x] = scale_sample(src[left + x], black[x & 1], scale[x & 1]);
+        }
+
+        for (x = std::max(inside_end, inside_begin); x < width; ++x) {
+            const int sx = mirror(left + x, frame.width);
+            dst[x] = scale_sample(src[sx], black[sx & 1], scale[sx & 1]);
+        }
+    }
+}
+
+/**
+ * 緑を双線形補間（上下左右の緑の平均）
+ * 有効範囲はタイルの外周1画素を除く
+ */
+void interpolate_green_bilinear(const BayerFrame& frame, const f32* cfa, int width, int height, f32* green) {
+    for (int y = 1; y < height - 1; ++y) {
+        const f32* row = cfa + static_cast<size_t>(y) * width;
+        const f32* up = row - width;
+        const f32* down = row + width;
+        f32* dst = green + static_cast<size_t>(y) * width;
+        const int green_phase = frame.color[y & 1][0] == 1 ? 0 : 1;
+
+        // 先頭を偶数列にそろえてSIMDのレーンの偶奇を固定する
+        int x = 1;
+        dst[x] = (x & 1) == green_phase ? row[x] : (row[x - 1] + row[x + 1] + up[x] + down[x]) * 0.25f;
+        ++x;
+#if CV_SIMD128
+        using namespace cv;
+        const v_float32x4 v_quarter = v_setall_f32(0.25f);
+        const v_float32x4 v_is_green = green_phase == 0 ? v_float32x4(1.0f, 0.0f, 1.0f, 0.0f)
+                                                        : v_float32x4(0.0f, 1.0f, 0.0f, 1.0f);
+        const v_float32x4 v_green_mask = v_is_green == v_setall_f32(1.0f);
+        for (; x <= width - 1 - 4; x += 4) {
+            const v_float32x4 c = v_load(row + x);
+            const v_float32x4 estimate =
+                (v_load(row + x - 1) + v_load(row + x + 1) + v_load(up + x) + v_load(down + x)) * v_quarter;
+            v_store(dst + x, v_select(v_green_mask, c, estimate));
+        }
+#endif
+        for (; x < width - 1; ++x) {
+            dst[x] = (x & 1) == green_phase ? row[x] : (row[x - 1] + row[x + 1] + up[x] + down[x]) * 0.25f;
+        }
+    }
+}
+
+// Hamilton-Adams: 隣接する緑の平均を同色画素の2次微分で補正し、隣接する緑の範囲に収める
+inline f32 directional_green(f32 center, f32 near0, f32 near1, f32 far0, f32 far1) {
+    const f32 estimate = (near0 + near1) * 0.5f + (2.0f * center - far0 - far1) * 0.25f;
+    return std::min(std::max(estimate, std::min(near0, near1)), std::max(near0, near1));
+}
+
+/**
+ * 緑を水平・垂直それぞれの方向で補間
+ * 有効範囲はタイルの外周2画素を除く
+ */
+void interpolate_green_directional(const BayerFrame& frame, const f32* cfa, int width, int height,
+                                   f32* green_h, f32* green_v) {
+    for (int y = 2; y < height - 2; ++y) {
+        const f32* row = cfa + static_cast<size_t>(y) * width;
+        const f32* up2 = row - 2 * width;
+        const f32* up1 = row - width;
+        const f32* down1 = row + width;
+        const f32* down2 = row + 2 * width;
+        f32* dst_h = green_h + static_cast<size_t>(y) * width;
+        f32* dst_v = green_v + static_cast<size_t>(y) * width;
+        const int green_phase = frame.color[y & 1][0] == 1 ? 0 : 1;
+
+        int x = 2;
+#if CV_SIMD128
+        using namespace cv;
+        const v_float32x4 v_half = v_setall_f32(0.5f);
+        const v_float32x4 v_quarter = v_setall_f32(0.25f);
+        const v_float32x4 v_two = v_setall_f32(2.0f);
+        const v_float32x4 v_is_green = green_phase == 0 ? v_float32x4(1.0f, 0.0f, 1.0f, 0.0f)
+                                                        : v_float32x4(0.0f, 1.0f, 0.0f, 1.0f);
+        const v_float32x4 v_green_mask = v_is_green == v_setall_f32(1.0f);
+        auto estimate = [&](const v_float32x4& c, const v_float32x4& near0, const v_float32x4& near1,
+                            const v_float32x4& far0, const v_float32x4& far1) {
+            const v_float32x4 value = (near0 + near1) * v_half + (c * v_two - far0 - far1) * v_quarter;
+            return v_min(v_max(value, v_min(near0, near1)), v_max(near0, near1));
+        };
+        for (; x <= width - 2 - 4; x += 4) {
+            const v_float32x4 c = v_load(row + x);
+            const v_float32x4 h = estimate(c, v_load(row + x - 1), v_load(row + x + 1),
+                                           v_load(row + x - 2), v_load(row + x + 2));
+            const v_float32x4 v = estimate(c, v_load(up1 + x), v_load(down1 + x),
+                                           v_load(up2 + x), v_load(down2 + x));
+            v_store(dst_h + x, v_select(v_green_mask, c, h));
+            v_store(dst_v + x, v_select(v_green_mask, c, v));
+        }
+#endif
+        for (; x < width - 2; ++x) {
+            if ((x & 1) == green_phase) {
+                dst_h[x] = row[x];
+                dst_v[x] = row[x];
+            } else {
+                dst_h[x] = directional_green(row[x], row[x - 1], row[x + 1], row[x - 2], row[x + 2]);
+                dst_v[x] = directional_green(row[x], up1[x], down1[x], up2[x], down2[x]);
+            }
+        }
+    }
+}
+
+/**
+ * 補間済みの緑から、色差（R - G, B - G）の補間で赤と青を求める
+ * @param margin 有効範囲から除くタイルの外周（緑の有効範囲より1画素内側）
+ */
+void interpolate_color(const BayerFrame& frame, const f32* cfa, const f32* green, int width, int height,
+                       int margin, f32* rgb) {
+    const size_t plane = static_cast<size_t>(width) * height;
+    f32* out[3] = {rgb, rgb + plane, rgb + plane * 2};
+
+    for (int y = margin; y < height - margin; ++y) {
+        // 緑の位置で左右・上下に並ぶ色（行の偶奇で決まる）
+        const int row_color = frame.color[y & 1][frame.color[y & 1][0] == 1 ? 1 : 0];
+        const int column_color = 2 - row_color;
+
+        for (int x = margin; x < width - margin; ++x) {
+            const size_t i = static_cast<size_t>(y) * width + x;
+            const int c = frame.color[y & 1][x & 1];
+            const f32 g = green[i];
+            out[1][i] = g;
+
+            if (c == 1) {
+                const f32 horizontal = ((cfa[i - 1] - green[i - 1]) + (cfa[i + 1] - green[i + 1])) * 0.5f;
+                const f32 vertical = ((cfa[i - width] - green[i - width]) + (cfa[i + width] - green[i + width])) * 0.5f;
+                out[row_color][i] = clamp_white(g + horizontal);
+                out[column_color][i] = clamp_white(g + vertical);
+            } else {
+                const f32 diagonal = ((cfa[i - width - 1] - green[i - width - 1]) +
+                                      (cfa[i - width + 1] - green[i - width + 1]) +
+                                      (cfa[i + width - 1] - green[i + width - 1]) +
+                                      (cfa[i + width + 1] - green[i + width + 1])) * 0.25f;
+                out[c][i] = cfa[i];
+                out[2 - c][i] = clamp_white(g + diagonal);
+            }
+        }
+    }
+}
+
+/**
+ * 均質性の判定に使う L*a*b* を求める（XYZの立方根はテーブルで引く）
+ */
+void convert_to_lab(const f32 (*camera_to_xyz)[3], const f32* rgb, int width, int height, int margin, f32* lab) {
+    static const std::vector<f32> cube_root = [] {
+        std::vector<f32> table(65536);
+        for (int i = 0; i < 65536; ++i) {
+            const f64 r = i / 65535.0;
+            table[i] = static_cast<f32>(r > 0.008856 ? std::cbrt(r) : 7.787 * r + 16.0 / 116.0);
+        }
+        return table;
+    }();
+
+    const size_t plane = static_cast<size_t>(width) * height;
+    for (int y = margin; y < height - margin; ++y) {
+        for (int x = margin; x < width - margin; ++x) {
+            const size_t i = static_cast<size_t>(y) * width + x;
+            const f32 r = rgb[i];
+            const f32 g = rgb[i + plane];
+            const f32 b = rgb[i + plane * 2];
+            f32 f[3];
+            for (int c = 0; c < 3; ++c) {
+                const f32 value = camera_to_xyz[c][0] * r + camera_to_xyz[c][1] * g + camera_to_xyz[c][2] * b;
+                f[c] = cube_root[static_cast<int>(clamp_white(value))];
+            }
+            lab[i] = 116.0f * f[1] - 16.0f;
+            lab[i + plane] = 500.0f * (f[0] - f[1]);
+            lab[i + plane * 2] = 200.0f * (f[1] - f[2]);
+        }
+    }
+}
+
+/**
+ * 方向ごとの均質性（近傍4画素のうち色の近い画素の数）を求める
+ * 許容差は水平補間の左右・垂直補間の上下の差のうち小さい方から決める（AHD）
+ */
+void measure_homogeneity(const f32* lab_h, const f32* lab_v, int width, int height, int margin,
+                         byte* homogeneity_h, byte* homogeneity_v) {
+    const size_t plane = static_cast<size_t>(width) * height;
+    const ptrdiff_t offsets[4] = {-1, 1, -width, width};
+    const f32* labs[2] = {lab_h, lab_v};
+    byte* outputs[2] = {homogeneity_h, homogeneity_v};
+
+    for (int y = margin; y < height - margin; ++y) {
+        for (int x = margin; x < width - margin; ++x) {
+            const size_t i = static_cast<size_t>(y) * width + x;
+            f32 l_diff[2][4];
+            f32 ab_diff[2][4];
+            for (int d = 0; d < 2; ++d) {
+                const f32* lab = labs[d];
+                for (int k = 0; k < 4; ++k) {
+                    const size_t j = i + offsets[k];
+                    const f32 da = lab[i + plane] - lab[j + plane];
+                    const f32 db = lab[i + plane * 2] - lab[j + plane * 2];
+                    l_diff[d][k] = std::abs(lab[i] - lab[j]);
+                    ab_diff[d][k] = da * da + db * db;
+                }
+            }
+
+            const f32 l_eps = std::min(std::max(l_diff[0][0], l_diff[0][1]), std::max(l_diff[1][2], l_diff[1][3]));
+            const f32 ab_eps = std::min(std::max(ab_diff[0][0], ab_diff[0][1]), std::max(ab_diff[1][2], ab_diff[1][3]));
+            for (int d = 0; d < 2; ++d) {
+                byte count = 0;
+                for (int k = 0; k < 4; ++k) {
+                    count += (l_diff[d][k] <= l_eps && ab_diff[d][k] <= ab_eps) ? 1 : 0;
+                }
+                outputs[d][i] = count;
+            }
+        }
+    }
+}
+
+/**
+ * 高品質デモザイク（AHD方式）
+ * 水平・垂直の両方向で補間し、3x3近傍の均質性が高い方向の結果を画素ごとに選ぶ
+ */
+void demosaic_tile_high_quality(const BayerFrame& frame, const f32 (*camera_to_xyz)[3], int width, int height,
+                                const cv::Size& core, TileBuffers& buffers) {
+    const f32* cfa = buffers.cfa.data();
+    interpolate_green_directional(frame, cfa, width, height, buffers.green[0].data(), buffers.green[1].data());
+    for (int d = 0; d < 2; ++d) {
+        interpolate_color(frame, cfa, buffers.green[d].data(), width, height, 3, buffers.rgb[d].data());
+        convert_to_lab(camera_to_xyz, buffers.rgb[d].data(), width, height, 3, buffers.lab[d].data());
+    }
+    measure_homogeneity(buffers.lab[0].data(), buffers.lab[1].data(), width, height, 4,
+                        buffers.homogeneity[0].data(), buffers.homogeneity[1].data());
+
+    const size_t plane = static_cast<size_t>(width) * height;
+    const size_t core_plane = static_cast<size_t>(core.area());
+    const byte* homogeneity_h = buffers.homogeneity[0].data();
+    const byte* homogeneity_v = buffers.homogeneity[1].data();
+    const f32* rgb_h = buffers.rgb[0].data();
+    const f32* rgb_v = buffers.rgb[1].data();
+    f32* result = buffers.result.data();
+
+    for (int y = 0; y < core.height; ++y) {
+        for (int x = 0; x < core.width; ++x) {
+            const size_t i = static_cast<size_t>(y + HIGH_QUALITY_BORDER) * width + x + HIGH_QUALITY_BORDER;
+            int score_h = 0;
+            int score_v = 0;
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    const size_t j = i + dy * width + dx;
+                    score_h += homogeneity_h[j];
+                    score_v += homogeneity_v[j];
+                }
+            }
+
+            const size_t o = static_cast<size_t>(y) * core.width + x;
+            for (int c = 0; c < 3; ++c) {
+                const f32 h = rgb_h[i + plane * c];
+                const f32 v = rgb_v[i + plane * c];
+                result[o + core_plane * c] = score_h > score_v ? h : score_h < score_v ? v : (h + v) * 0.5f;
+            }
+        }
+    }
+}
+
+/**
+ * 双線形デモザイク（緑は双線形、赤と青は色差の双線形補間）
+ */
+void demosaic_tile_bilinear(const BayerFrame& frame, int width, int height, const cv::Size& core,
+                            TileBuffers& buffers) {
+    interpolate_green_bilinear(frame, buffers.cfa.data(), width, height, buffers.green[0].data());
+    interpolate_color(frame, buffers.cfa.data(), buffers.green[0].data(), width, height, 2, buffers.rgb[0].data());
+
+    const size_t plane = static_cast<size_t>(width) * height;
+    const size_t core_plane = static_cast<size_t>(core.area());
+    for (int c = 0; c < 3; ++c) {
+        for (int y = 0; y < core.height; ++y) {
+            const f32* src = buffers.rgb[0].data() + plane * c +
+                             static_cast<size_t>(y + BILINEAR_BORDER) * width + BILINEAR_BORDER;
+            std::copy(src, src + core.width, buffers.result.data() + core_plane * c + static_cast<size_t>(y) * core.width);
+        }
+    }
+}
+
+/**
+ * ハーフサイズ現像（2x2画素の R, G の平均, B を1画素にまとめる）
+ */
+void demosaic_half_size_rows(const BayerFrame& frame, const OutputWriter& writer, int out_width,
+                             int row_begin, int row_end, std::vector<f32>& planes) {
+    planes.resize(static_cast<size_t>(out_width) * 3);
+    f32* out[3] = {planes.data(), planes.data() + out_width, planes.data() + out_width * 2};
+
+    for (int oy = row_begin; oy < row_end; ++oy) {
+        const u16* rows[2] = {
+            frame.data + static_cast<size_t>(oy * 2) * frame.stride,
+            frame.data + static_cast<size_t>(oy * 2 + 1) * frame.stride,
+        };
+
+        int ox = 0;
+#if CV_SIMD128
+        using namespace cv;
+        const v_float32x4 v_zero = v_setzero_f32();
+        const v_float32x4 v_white = v_setall_f32(WHITE);
+        const v_float32x4 v_half = v_setall_f32(0.5f);
+        for (; ox <= out_width - 8; ox += 8) {
+            // 偶数列と奇数列に分けて読む（[行の偶奇][列の偶奇]）
+            v_uint16x8 samples[2][2];
+            v_load_deinterleave(rows[0] + ox * 2, samples[0][0], samples[0][1]);
+            v_load_deinterleave(rows[1] + ox * 2, samples[1][0], samples[1][1]);
+
+            for (int half = 0; half < 2; ++half) {
+                v_float32x4 sum[3] = {v_zero, v_zero, v_zero};
+                for (int dy = 0; dy < 2; ++dy) {
+                    for (int dx = 0; dx < 2; ++dx) {
+                        v_uint32x4 lo, hi;
+                        v_expand(samples[dy][dx], lo, hi);
+                        const v_float32x4 raw = v_cvt_f32(v_reinterpret_as_s32(half == 0 ? lo : hi));
+                        const v_float32x4 value = (raw - v_setall_f32(frame.black[dy][dx])) *
+                                                  v_setall_f32(frame.scale[dy][dx]);
+                        const int c = frame.color[dy][dx];
+                        sum[c] = sum[c] + v_min(v_max(value, v_zero), v_white);
+                    }
+                }
+                v_store(out[0] + ox + half * 4, sum[0]);
+                v_store(out[1] + ox + half * 4, sum[1] * v_half);
+                v_store(out[2] + ox + half * 4, sum[2]);
+            }
+        }
+#endif
+        for (; ox < out_width; ++ox) {
+            f32 sum[3] = {0.0f, 0.0f, 0.0f};
+            for (int dy = 0; dy < 2; ++dy) {
+                for (int dx = 0; dx < 2; ++dx) {
+                    sum[frame.color[dy][dx]] += scale_sample(rows[dy][ox * 2 + dx], frame.black[dy][dx],
+                                                             frame.scale[dy][dx]);
+                }
+            }
+            out[0][ox] = sum[0];
+            out[1][ox] = sum[1] * 0.5f;
+            out[2][ox] = sum[2];
+        }
+
+        writer.write_row(out[0], out[1], out[2], out_width, oy, 0);
+    }
+}
+
+} // namespace
+
+cv::Size demosaic_output_size(const BayerFrame& frame, DemosaicMethod method) {
+    cv::Size size(frame.width, frame.height);
+    if (method == DemosaicMethod::HALF_SIZE) {
+        size = cv::Size(frame.width / 2, frame.height / 2);
+    }
+    if (frame.flip & 4) {
+        std::swap(size.width, size.height);
+    }
+    return size;
+}
+
+cv::Mat demosaic_bayer(const BayerFrame& frame, DemosaicMethod method, WorkStealingPool& pool,
+                       JobControl* job) {
+    if (!is_supported(frame)) {
+        return cv::Mat();
+    }
+
+    TraceScope trace(std::string("demosaic.") + demosaic_method_name(method),
+                     static_cast<u64>(frame.width) * frame.height);
+    cv::Mat output(demosaic_output_size(frame, method), CV_16UC3);
+    trace.add_bytes(static_cast<u64>(output.total() * output.elemSize()));
+
+    // タスクはワーカー数だけ作り、各タスクが作業用バッファを使い回しながらタイル（行の帯）を順に取る
+    const size_t task_count = pool.thread_count() + 1;
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> completed(0);
+
+    if (method == DemosaicMethod::HALF_SIZE) {
+        const int out_width = frame.width / 2;
+        const int out_height = frame.height / 2;
+        const OutputWriter writer(frame, out_width, out_height, output);
+        const size_t bands = (out_height + HALF_SIZE_BAND_ROWS - 1) / HALF_SIZE_BAND_ROWS;
+
+        pool.parallel_for(task_count, [&](size_t) {
+            std::vector<f32> planes;
+            for (size_t band = next++; band < bands; band = next++) {
+                // 中止された場合は未着手の帯を処理しない（例外は parallel_for から再送出される）
+                check_cancelled(job);
+                const int row_begin = static_cast<int>(band) * HALF_SIZE_BAND_ROWS;
+                const int row_end = std::min(out_height, row_begin + HALF_SIZE_BAND_ROWS);
+                demosaic_half_size_rows(frame, writer, out_width, row_begin, row_end, planes);
+                if (job) {
+                    job->report(++completed, bands);
+                }
+            }
+        });
+        return output;
+    }
+
+    // 均質性の判定用に、カメラRGB → XYZ の行列を求める
+    f32 camera_to_xyz[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            camera_to_xyz[i][j] = 0.0f;
+            for (int k = 0; k < 3; ++k) {
+                camera_to_xyz[i][j] += SRGB_TO_XYZ[i][k] * frame.camera_to_output[k][j];
+            }
+        }
+    }
+
+    const int border = method == DemosaicMethod::HIGH_QUALITY ? HIGH_QUALITY_BORDER : BILINEAR_BORDER;
+    const std::vector<Tile> tiles = plan_tiles(cv::Size(frame.width, frame.height),
+                                               cv::Rect(0, 0, frame.width, frame.height), TILE_SIZE, TILE_SIZE, 0);
+    const OutputWriter writer(frame, frame.width, frame.height, output);
+
+    pool.parallel_for(task_count, [&](size_t) {
+        TileBuffers buffers;
+        for (size_t index = next++; index < tiles.size(); index = next++) {
+            check_cancelled(job);
+            const cv::Rect& core = tiles[index].core;
+            const int width = core.width + border * 2;
+            const int height = core.height + border * 2;
+            buffers.prepare(method, static_cast<size_t>(width) * height, static_cast<size_t>(core.area()));
+
+            load_tile(frame, core, border, buffers.cfa.data());
+            if (method == DemosaicMethod::HIGH_QUALITY) {
+                demosaic_tile_high_quality(frame, camera_to_xyz, width, height, core.size(), buffers);
+            } else {
+                demosaic_tile_bilinear(frame, width, height, core.size(), buffers);
+            }
+
+            // タイル同士の書き込み先は重ならない
+            const size_t core_plane = static_cast<size_t>(core.area());
+            for (int y = 0; y < core.height; ++y) {
+                const f32* r = buffers.result.data() + static_cast<size_t>(y) * core.width;
+                writer.write_row(r, r + core_plane, r + core_plane * 2, core.width, core.y + y, core.x);
+            }
+
+            if (job) {
+                job->report(++completed, tiles.size());
+            }
+        }
+    });
+    return output;
+}
+
+const char* demosaic_method_name(DemosaicMethod method) {
+    switch (method) {
+        case DemosaicMethod::HALF_SIZE:
+            return "half size";
+        case DemosaicMethod::BILINEAR:
+            return "bilinear";
+        case DemosaicMethod::HIGH_QUALITY:
+            return "high quality";
+    }
+    return "unknown";
+}
+
+} // namespace raw_editor
@@ -0,0 +1,65 @@
+#ifndef DEMOSAIC_H
+#define DEMOSAIC_H
+
+#include "common_types.h"
+#include "job_control.h"
+#include "thread_pool.h"
+#include <opencv2/opencv.hpp>
+
+namespace raw_editor {
+
+/**
+ * デモザイク方式（品質段階）
+ */
+enum class DemosaicMethod {
+    HALF_SIZE = 0,      // 2x2画素を1画素にまとめる（補間なし、プレビュー用のプロキシ）
+    BILINEAR = 1,       // 双線形補間（フル解像度のプレビュー用）
+    HIGH_QUALITY = 2    // 方向別補間と均質性判定によるAHD方式（書き出し用）
+};
+
+/**
+ * ベイヤー配列のセンサーデータと、現像に必要な色情報
+ * 値は LibRaw の展開済みデータ（rawdata）から作る。位置 (行 & 1, 列 & 1) ごとの値は
+ * 有効領域の左上を原点とした座標で引く。
+ */
+struct BayerFrame {
+    const u16* data = nullptr;      // 有効領域の左上の画素
+    size_t stride = 0;              // 1行の要素数
+    int width = 0;                  // 有効領域の幅
+    int height = 0;                 // 有効領域の高さ
+    int color[2][2] = {};           // 各位置の色 (0 = R, 1 = G, 2 = B)
+    f32 black[2][2] = {};           // 各位置の黒レベル
+    f32 scale[2][2] = {};           // 黒レベル減算後の倍率（ホワイトバランスと16ビットへの正規化を含む）
+    f32 camera_to_output[3][3] = {};// カメラRGB → 出力色空間（sRGBリニア）、行が出力のR, G, B
+    int flip = 0;                   // LibRaw の向き（bit 0 = 左右反転, bit 1 = 上下反転, bit 2 = 転置）
+};
+
+/**
+ * デモザイク結果の画像サイズ（向きの補正後）
+ * @param frame センサーデータ
+ * @param method デモザイク方式
+ * @return 画像サイズ
+ */
+cv::Size demosaic_output_size(const BayerFrame& frame, DemosaicMethod method);
+
+/**
+ * ベイヤー配列のセンサーデータをデモザイクし、16ビットリニアのBGR画像を作る
+ * LibRaw の dcraw_process と同じく、黒レベル減算・ホワイトバランス・色変換・向きの補正までを行う。
+ * 画像をタイルに分けてスレッドプールで並列に処理し、タイル内の主要なループはSIMD化している。
+ * @param frame センサーデータ
+ * @param method デモザイク方式
+ * @param pool スレッドプール
+ * @param job 実行中のジョブ（nullptr 可。中止されると JobCancelled を送出する）
+ * @return 16ビットリニアBGR画像 (CV_16UC3)
+ */
+cv::Mat demosaic_bayer(const BayerFrame& frame, DemosaicMethod method, WorkStealingPool& pool,
+                       JobControl* job = nullptr);
+
+/**
+ * デモザイク方式の名前（ログ用）
+ */
+const char* demosaic_method_name(DemosaicMethod method);
+
+} // namespace raw_editor
+
+#endif // DEMOSAIC_H
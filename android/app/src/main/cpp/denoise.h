@@ -0,0 +1,106 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "common_types.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace raw_editor {
+
+/**
+ * ノイズ除去の品質段階
+ * どちらも平方根で符号化した画素値（ショットノイズの分散がほぼ一定になる）を
+ * 輝度 Y と2つの色差に分けて処理する。色差は縦横1/2に縮小した平面で処理して拡大する。
+ */
+enum class DenoiseTier {
+    PREVIEW = 0,    // 輝度はウェーブレット縮退（à trous、4レベル）。コストは画素数に比例し強度によらない
+    EXPORT = 1      // 輝度は非局所平均（NLM、輝度の1平面のみ）。書き出しのタイル処理で並列に実行する
+};
+
+/**
+ * ノイズ除去の強さ（8ビット換算の標準偏差。従来の NLM の h と同じ目盛り）
+ */
+struct DenoiseStrength {
+    f32 luminance = 0.0f;
+    f32 chroma = 0.0f;
+
+    bool empty() const { return luminance <= 0.0f && chroma <= 0.0f; }
+};
+
+/**
+ * 調整パラメータからノイズ除去の強さを求める
+ * 輝度ノイズ除去は従来どおり色差にも効き、カラーノイズ除去は色差だけに効く
+ * @param params 調整パラメータ
+ * @return 強さ
+ */
+DenoiseStrength denoise_strength(const AdjustmentParams& params);
+
+/**
+ * ノイズ除去が参照する周辺画素の幅
+ * @param strength 強さ
+ * @param tier 品質段階
+ * @return ハロー幅（ピクセル）
+ */
+int denoise_halo(const DenoiseStrength& strength, DenoiseTier tier);
+
+/**
+ * 16ビットリニア画像のノイズを除去
+ * @param linear 16ビットリニアBGR画像 (CV_16UC3)
+ * @param strength 強さ
+ * @param tier 品質段階
+ * @param origin 入力の左上のフレーム上の位置（色差の縮小格子をタイル間で揃えるため）
+ * @param parallel 行方向に並列化するか（タイル処理時は false）
+ * @return ノイズ除去後の画像（強さが0なら入力をそのまま返す）
+ */
+cv::Mat denoise_linear(const cv::Mat& linear, const DenoiseStrength& strength, DenoiseTier tier,
+                       cv::Point origin = cv::Point(), bool parallel = true);
+
+/**
+ * ガンマ空間のfloat画像のノイズを除去（段階的パイプライン用）
+ * @param image [0, 1]範囲のBGR画像 (CV_32FC3、その場で更新)
+ * @param strength 強さ
+ * @param tier 品質段階
+ */
+void denoise_encoded(cv::Mat& image, const DenoiseStrength& strength, DenoiseTier tier);
+
+/**
+ * 品質段階の名前（ログ・ベンチマーク用）
+ */
+const char* denoise_tier_name(DenoiseTier tier);
+
+/**
+ * ノイズ除去ベンチマークの品質段階ごとの結果
+ */
+struct DenoiseTierBenchmark {
+    DenoiseTier tier = DenoiseTier::PREVIEW;
+    f64 best_ms = 0.0;
+    f64 ms_per_megapixel = 0.0;
+    f64 psnr_db = 0.0;  // ノイズのない元画像に対する PSNR（平方根で符号化した値）
+};
+
+/**
+ * ノイズ除去ベンチマークの結果
+ */
+struct DenoiseBenchmark {
+    u32 width = 0;
+    u32 height = 0;
+    u32 iterations = 0;
+    f64 megapixels = 0.0;
+    f64 input_psnr_db = 0.0;  // ノイズを加えた入力の PSNR
+    std::vector<DenoiseTierBenchmark> tiers;
+};
+
+/**
+ * 合成画像でノイズ除去の速度と品質を計測
+ * 階調・色の異なるブロックと境界を持つ16ビットリニア画像に、平方根で符号化した値で
+ * 一定の標準偏差（8ビット換算で8）のノイズを加え、品質段階ごとに最短時間と PSNR を求める
+ * @param width 画像の幅（64以上）
+ * @param height 画像の高さ（64以上）
+ * @param iterations 計測回数（慣らしの1回は含まない、0 は1回として扱う）
+ * @return 計測結果
+ */
+DenoiseBenchmark benchmark_denoise(u32 width, u32 height, u32 iterations);
+
+} // namespace raw_editor
+
+#endif // DENOISE_H
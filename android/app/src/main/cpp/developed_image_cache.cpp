@@ -0,0 +1,230 @@
+#include "developed_image_cache.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace raw_editor {
+
+static const char* TAG = "DevelopedImageCache";
+
+DevelopedImageCache::DevelopedImageCache(size_t memory_budget)
+    : memory_budget_(memory_budget),
+      access_clock_(0),
+      generation_clock_(0) {
+}
+
+void DevelopedImageCache::set_base(const cv::Mat& base) {
+    if (base.empty()) {
+        clear();
+        return;
+    }
+
+    // プロキシから作ったレベルはサイズが一致すればそのまま使える
+    if (levels_.empty() || base.size() != base_size_) {
+        reset_levels(base.size());
+    }
+
+    store(0, base);
+    touch(0);
+    enforce_budget(0);
+
+    LOG_INFO(TAG, ("Developed base cached: " + std::to_string(base.cols) + "x" +
+                   std::to_string(base.rows) + ", levels: " + std::to_string(levels_.size())).c_str());
+}
+
+void DevelopedImageCache::set_proxy(const cv::Mat& proxy, const cv::Size& full_size) {
+    if (proxy.empty() || has_base()) {
+        return;
+    }
+
+    reset_levels(full_size);
+    if (levels_.size() < 2) {
+        return;
+    }
+
+    store(1, proxy);
+    touch(1);
+    enforce_budget(1);
+
+    LOG_INFO(TAG, ("Proxy cached: " + std::to_string(proxy.cols) + "x" +
+                   std::to_string(proxy.rows)).c_str());
+}
+
+bool DevelopedImageCache::has_proxy() const {
+    for (size_t i = 1; i < levels_.size(); ++i) {
+        if (!levels_[i].image.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DevelopedImageCache::has_base() const {
+    return !levels_.empty() && !levels_[0].image.empty();
+}
+
+bool DevelopedImageCache::can_serve(u32 max_width, u32 max_height) const {
+    if (levels_.empty()) {
+        return false;
+    }
+
+    size_t target = select_level_index(max_width, max_height);
+    for (size_t i = 0; i <= target; ++i) {
+        if (!levels_[i].image.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+cv::Mat DevelopedImageCache::get_level(u32 max_width, u32 max_height, DevelopedLevelInfo* info) {
+    if (levels_.empty()) {
+        return cv::Mat();
+    }
+
+    size_t target = select_level_index(max_width, max_height);
+    if (info) {
+        info->index = target;
+    }
+    if (!levels_[target].image.empty()) {
+        touch(target);
+        if (info) {
+            info->generation = levels_[target].generation;
+        }
+        return levels_[target].image;
+    }
+
+    // 目的レベルより細かい保持済みレベルを探す
+    size_t source = target;
+    while (source > 0 && levels_[source].image.empty()) {
+        --source;
+    }
+    if (levels_[source].image.empty()) {
+        return cv::Mat();
+    }
+
+    // 1段ずつ縮小して目的レベルまで生成
+    cv::Mat current = levels_[source].image;
+    for (size_t i = source + 1; i <= target; ++i) {
+        cv::Mat next;
+        cv::resize(current, next, level_size(i), 0, 0, cv::INTER_AREA);
+        store(i, next);
+        touch(i);
+        current = next;
+    }
+
+    touch(source);
+    enforce_budget(target);
+    if (info) {
+        info->generation = levels_[target].generation;
+    }
+    return levels_[target].image;
+}
+
+void DevelopedImageCache::set_memory_budget(size_t bytes) {
+    memory_budget_ = bytes;
+    enforce_budget(std::numeric_limits<size_t>::max());
+}
+
+size_t DevelopedImageCache::memory_usage() const {
+    size_t total = 0;
+    for (const auto& level : levels_) {
+        total += level.image.total() * level.image.elemSize();
+    }
+    return total;
+}
+
+void DevelopedImageCache::clear() {
+    ++generation_clock_;
+    levels_.clear();
+    base_size_ = cv::Size();
+}
+
+cv::Size DevelopedImageCache::level_size(size_t index) const {
+    cv::Size size = base_size_;
+    for (size_t i = 0; i < index; ++i) {
+        size = cv::Size(std::max(1, size.width / 2), std::max(1, size.height / 2));
+    }
+    return size;
+}
+
+size_t DevelopedImageCache::select_level_index(u32 max_width, u32 max_height) const {
+    if (levels_.empty() || (max_width == 0 && max_height == 0)) {
+        return 0;
+    }
+
+    // resize_if_needed と同じ規則で最終出力サイズを求める
+    f32 scale_x = max_width > 0 ? static_cast<f32>(max_width) / base_size_.width : 1.0f;
+    f32 scale_y = max_height > 0 ? static_cast<f32>(max_height) / base_size_.height : 1.0f;
+    f32 scale = std::min(1.0f, std::min(scale_x, scale_y));
+
+    int required_width = static_cast<int>(std::ceil(base_size_.width * scale));
+    int required_height = static_cast<int>(std::ceil(base_size_.height * scale));
+
+    // 出力サイズを下回らない最小レベル（以降の処理は縮小のみになる）
+    size_t index = 0;
+    for (size_t i = 1; i < levels_.size(); ++i) {
+        cv::Size size = level_size(i);
+        if (size.width < required_width || size.height < required_height) {
+            break;
+        }
+        index = i;
+    }
+    return index;
+}
+
+void DevelopedImageCache::enforce_budget(size_t pinned) {
+    size_t usage = memory_usage();
+
+    while (usage > memory_budget_) {
+        // ピラミッドレベルをLRU順に破棄し、ベースは最後の手段とする
+        size_t victim = levels_.size();
+        u64 oldest = std::numeric_limits<u64>::max();
+        for (size_t i = 1; i < levels_.size(); ++i) {
+            if (i == pinned || levels_[i].image.empty()) {
+                continue;
+            }
+            if (levels_[i].last_access < oldest) {
+                oldest = levels_[i].last_access;
+                victim = i;
+            }
+        }
+
+        if (victim == levels_.size()) {
+            if (pinned == 0 || levels_.empty() || levels_[0].image.empty()) {
+                break;
+            }
+            victim = 0;
+            LOG_INFO(TAG, "Memory budget exceeded, evicting full resolution base");
+        }
+
+        usage -= levels_[victim].image.total() * levels_[victim].image.elemSize();
+        levels_[victim].image.release();
+    }
+}
+
+void DevelopedImageCache::reset_levels(const cv::Size& base_size) {
+    clear();
+    base_size_ = base_size;
+
+    // ピラミッドの段数を決定（短辺が64px未満になる手前まで）
+    size_t count = 1;
+    cv::Size size = base_size_;
+    while (count < MAX_LEVELS && std::min(size.width, size.height) / 2 >= 64) {
+        size = cv::Size(size.width / 2, size.height / 2);
+        ++count;
+    }
+
+    levels_.resize(count);
+}
+
+void DevelopedImageCache::touch(size_t index) {
+    levels_[index].last_access = ++access_clock_;
+}
+
+void DevelopedImageCache::store(size_t index, const cv::Mat& image) {
+    levels_[index].image = image;
+    levels_[index].generation = ++generation_clock_;
+}
+
+} // namespace raw_editor
@@ -0,0 +1,153 @@
+#ifndef DEVELOPED_IMAGE_CACHE_H
+#define DEVELOPED_IMAGE_CACHE_H
+
+#include "common_types.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace raw_editor {
+
+/**
+ * 取得したピラミッドレベルの識別情報
+ * 世代はレベルの画像が作られるたび（ベース・プロキシの登録、縮小による再生成）に
+ * キャッシュ全体で単調に増える番号から割り当てられ、同じ世代なら同じ画像であることを保証する
+ * （バッファのアドレスと違い、破棄後に同じアドレスで作り直されても一致しない）
+ */
+struct DevelopedLevelInfo {
+    size_t index = 0;
+    u64 generation = 0;
+};
+
+/**
+ * 現像済みベース画像キャッシュ
+ * 読み込んだRAWファイル1枚につき、フル解像度の16ビットリニア画像（BGR）を
+ * 一度だけ保持し、そこから1/2ずつ縮小したピラミッドレベルを遅延生成する。
+ * プレビュー・サムネイル・フル解像度出力はすべてこのキャッシュから画像を取得する。
+ *
+ * フル解像度の現像より先に、ハーフサイズ現像のプロキシをレベル1として登録できる。
+ * プレビューはプロキシ以下のレベルだけで賄えるため、フル解像度の現像は
+ * 書き出しなどレベル0が必要になるまで行われない。
+ *
+ * メモリ予算を超えた場合は、要求中のレベルを除いて最も長く使われていない
+ * ピラミッドレベルから破棄し、それでも足りない場合のみベース画像を破棄する。
+ */
+class DevelopedImageCache {
+public:
+    // デフォルトのメモリ予算（60MPの16ビットRGBベース + ピラミッドが収まるサイズ）
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 768ull * 1024 * 1024;
+
+    // ピラミッドの最大段数（ベースを含む）
+    static constexpr size_t MAX_LEVELS = 8;
+
+    explicit DevelopedImageCache(size_t memory_budget = DEFAULT_MEMORY_BUDGET);
+
+    /**
+     * フル解像度のベース画像を登録
+     * プロキシ登録時に想定したサイズと一致する場合は既存のピラミッドレベルを残し、
+     * それ以外の場合は既存のレベルをすべて破棄する
+     * @param base 16ビットリニアBGR画像 (CV_16UC3)
+     */
+    void set_base(const cv::Mat& base);
+
+    /**
+     * ハーフサイズ現像のプロキシをレベル1として登録
+     * ベース画像が未登録の場合のみ有効（登録済みなら何もしない）
+     * @param proxy 16ビットリニアBGR画像 (CV_16UC3)
+     * @param full_size フル解像度で現像した場合の画像サイズ
+     */
+    void set_proxy(const cv::Mat& proxy, const cv::Size& full_size);
+
+    /**
+     * プロキシ（またはそれ以下のレベル）が保持されているかチェック
+     * @return 保持していればtrue
+     */
+    bool has_proxy() const;
+
+    /**
+     * ベース画像が保持されているかチェック
+     * @return 保持していればtrue
+     */
+    bool has_base() const;
+
+    /**
+     * 指定サイズの出力に使えるレベルがキャッシュ内から取得可能かチェック
+     * @param max_width 最大幅 (0 = 制限なし)
+     * @param max_height 最大高さ (0 = 制限なし)
+     * @return 取得可能ならtrue
+     */
+    bool can_serve(u32 max_width, u32 max_height) const;
+
+    /**
+     * 指定サイズ以上を満たす最小のピラミッドレベルを取得
+     * 返される画像はキャッシュとバッファを共有するため、呼び出し側で書き換えないこと
+     * @param max_width 最大幅 (0 = 制限なし)
+     * @param max_height 最大高さ (0 = 制限なし)
+     * @param info 出力：取得したレベルの番号と世代（nullptr = 不要）
+     * @return 16ビットリニアBGR画像（取得できない場合は空）
+     */
+    cv::Mat get_level(u32 max_width, u32 max_height, DevelopedLevelInfo* info = nullptr);
+
+    /**
+     * メモリ予算を設定（超過分は即座に破棄される）
+     * @param bytes 予算（バイト）
+     */
+    void set_memory_budget(size_t bytes);
+
+    size_t memory_budget() const { return memory_budget_; }
+
+    /**
+     * 現在のメモリ使用量を取得
+     * @return 使用量（バイト）
+     */
+    size_t memory_usage() const;
+
+    /**
+     * すべてのレベルを破棄
+     */
+    void clear();
+
+private:
+    struct Level {
+        cv::Mat image;
+        u64 last_access = 0;
+        u64 generation = 0;         // 画像を作ったときの世代
+    };
+
+    std::vector<Level> levels_;     // [0] = フル解像度ベース
+    cv::Size base_size_;
+    size_t memory_budget_;
+    u64 access_clock_;
+    u64 generation_clock_;          // clear でも戻さない
+
+    /**
+     * 指定レベルの画像サイズを計算
+     */
+    cv::Size level_size(size_t index) const;
+
+    /**
+     * 出力サイズを満たす最小レベルのインデックスを選択
+     */
+    size_t select_level_index(u32 max_width, u32 max_height) const;
+
+    /**
+     * LRU順にレベルを破棄してメモリ予算内に収める
+     * @param pinned 破棄対象から除外するレベル
+     */
+    void enforce_budget(size_t pinned);
+
+    void touch(size_t index);
+
+    /**
+     * レベルに画像を設定し、新しい世代を割り当てる
+     */
+    void store(size_t index, const cv::Mat& image);
+
+    /**
+     * ベースサイズからピラミッドの段数を決めてレベル配列を初期化
+     */
+    void reset_levels(const cv::Size& base_size);
+};
+
+} // namespace raw_editor
+
+#endif // DEVELOPED_IMAGE_CACHE_H
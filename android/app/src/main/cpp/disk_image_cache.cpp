@@ -0,0 +1,403 @@
+#include "disk_image_cache.h"
+#include "incremental_pipeline.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace raw_editor {
+
+static const char* TAG = "DiskImageCache";
+
+namespace {
+
+// 内容ハッシュに使う先頭・末尾のバイト数
+constexpr size_t PARTIAL_HASH_BYTES = 64 * 1024;
+
+// パックファイルの形式
+// ヘッダ: PACK_MAGIC, PACK_VERSION
+// レコード: RECORD_MAGIC, key(u64), length(u32), crc32(u32), data[length]
+constexpr u32 PACK_MAGIC = 0x50434552;    // "RECP"
+constexpr u32 PACK_VERSION = 1;
+constexpr u32 RECORD_MAGIC = 0x44524352;  // "RCRD"
+constexpr size_t PACK_HEADER_SIZE = sizeof(u32) * 2;
+constexpr size_t RECORD_HEADER_SIZE = sizeof(u32) + sizeof(u64) + sizeof(u32) + sizeof(u32);
+
+// 1エントリの上限（壊れたレコードで巨大な確保をしないため）
+constexpr u32 MAX_ENTRY_BYTES = 64 * 1024 * 1024;
+
+struct RecordHeader {
+    u32 magic;
+    u64 key;
+    u32 length;
+    u32 crc;
+};
+
+bool read_record_header(std::FILE* file, RecordHeader& header) {
+    return std::fread(&header.magic, sizeof(header.magic), 1, file) == 1 &&
+           std::fread(&header.key, sizeof(header.key), 1, file) == 1 &&
+           std::fread(&header.length, sizeof(header.length), 1, file) == 1 &&
+           std::fread(&header.crc, sizeof(header.crc), 1, file) == 1;
+}
+
+bool write_record(std::FILE* file, u64 key, const byte* data, u32 length, u32 crc) {
+    return std::fwrite(&RECORD_MAGIC, sizeof(RECORD_MAGIC), 1, file) == 1 &&
+           std::fwrite(&key, sizeof(key), 1, file) == 1 &&
+           std::fwrite(&length, sizeof(length), 1, file) == 1 &&
+           std::fwrite(&crc, sizeof(crc), 1, file) == 1 &&
+           (length == 0 || std::fwrite(data, 1, length, file) == length);
+}
+
+bool write_pack_header(std::FILE* file) {
+    return std::fwrite(&PACK_MAGIC, sizeof(PACK_MAGIC), 1, file) == 1 &&
+           std::fwrite(&PACK_VERSION, sizeof(PACK_VERSION), 1, file) == 1;
+}
+
+u32 compute_crc(const byte* data, size_t length) {
+    return static_cast<u32>(crc32(0L, data, static_cast<uInt>(length)));
+}
+
+} // namespace
+
+u64 FileIdentity::cache_key(u32 kind, u32 max_size) const {
+    return ParamFingerprint()
+        .add(path)
+        .add(size)
+        .add(modified_ns)
+        .add(content_hash)
+        .add(static_cast<u64>(kind))
+        .add(static_cast<u64>(max_size))
+        .value();
+}
+
+FileIdentity make_file_identity(const std::string& path) {
+    FileIdentity identity;
+
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+        return identity;
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return identity;
+    }
+
+    const u64 size = static_cast<u64>(info.st_size);
+    std::vector<unsigned char> buffer(PARTIAL_HASH_BYTES);
+    ParamFingerprint hash;
+
+    size_t head = std::fread(buffer.data(), 1, buffer.size(), file);
+    hash.add(buffer.data(), head);
+    if (size > PARTIAL_HASH_BYTES * 2) {
+        if (std::fseek(file, -static_cast<long>(PARTIAL_HASH_BYTES), SEEK_END) == 0) {
+            size_t tail = std::fread(buffer.data(), 1, buffer.size(), file);
+            hash.add(buffer.data(), tail);
+        }
+    }
+    std::fclose(file);
+
+    identity.path = path;
+    identity.size = size;
+    identity.modified_ns = static_cast<u64>(info.st_mtim.tv_sec) * 1000000000ull +
+                           static_cast<u64>(info.st_mtim.tv_nsec);
+    identity.content_hash = hash.value();
+    return identity;
+}
+
+FileIdentity make_file_identity(const std::string& path, const byte* data, size_t size, u64 modified_ns) {
+    FileIdentity identity;
+    if (!data || size == 0) {
+        return identity;
+    }
+
+    // パスを指定する版と同じ範囲をハッシュする
+    ParamFingerprint hash;
+    hash.add(data, std::min(size, PARTIAL_HASH_BYTES));
+    if (size > PARTIAL_HASH_BYTES * 2) {
+        hash.add(data + size - PARTIAL_HASH_BYTES, PARTIAL_HASH_BYTES);
+    }
+
+    identity.path = path;
+    identity.size = static_cast<u64>(size);
+    identity.modified_ns = modified_ns;
+    identity.content_hash = hash.value();
+    return identity;
+}
+
+DiskImageCache::DiskImageCache(std::string directory, size_t byte_budget)
+    : directory_(std::move(directory)),
+      pack_path_(directory_ + "/images.pack"),
+      byte_budget_(byte_budget),
+      pack_(nullptr),
+      pack_size_(0),
+      live_bytes_(0),
+      access_clock_(0) {
+    ::mkdir(directory_.c_str(), 0755);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_pack();
+    enforce_budget();
+}
+
+DiskImageCache::~DiskImageCache() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pack_) {
+        std::fclose(pack_);
+        pack_ = nullptr;
+    }
+}
+
+bool DiskImageCache::get(u64 key, std::vector<byte>& data) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it == index_.end() || !pack_) {
+        return false;
+    }
+
+    Entry& entry = it->second;
+    data.resize(entry.length);
+    if (std::fseek(pack_, static_cast<long>(entry.offset), SEEK_SET) != 0 ||
+        std::fread(data.data(), 1, entry.length, pack_) != entry.length ||
+        compute_crc(data.data(), data.size()) != entry.crc) {
+        // 壊れたエントリは索引から外す（領域は次の詰め直しで回収される）
+        LOG_ERROR(TAG, "Corrupted cache entry dropped");
+        live_bytes_ -= entry.length;
+        index_.erase(it);
+        data.clear();
+        return false;
+    }
+
+    entry.last_access = ++access_clock_;
+    return true;
+}
+
+bool DiskImageCache::put(u64 key, const std::vector<byte>& data) {
+    if (data.empty() || data.size() > MAX_ENTRY_BYTES) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pack_) {
+        return false;
+    }
+
+    const u32 length = static_cast<u32>(data.size());
+    const u32 crc = compute_crc(data.data(), data.size());
+    if (std::fseek(pack_, static_cast<long>(pack_size_), SEEK_SET) != 0 ||
+        !write_record(pack_, key, data.data(), length, crc) ||
+        std::fflush(pack_) != 0) {
+        LOG_ERROR(TAG, ("Failed to append cache entry: " + std::string(std::strerror(errno))).c_str());
+        // 途中まで書かれたレコードは次回起動時に切り捨てられる
+        return false;
+    }
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        live_bytes_ -= it->second.length;
+    }
+
+    Entry& entry = index_[key];
+    entry.offset = pack_size_ + RECORD_HEADER_SIZE;
+    entry.length = length;
+    entry.crc = crc;
+    entry.last_access = ++access_clock_;
+
+    pack_size_ += RECORD_HEADER_SIZE + length;
+    live_bytes_ += length;
+
+    enforce_budget();
+    return true;
+}
+
+void DiskImageCache::set_byte_budget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    byte_budget_ = bytes;
+    enforce_budget();
+}
+
+size_t DiskImageCache::size_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return live_bytes_;
+}
+
+void DiskImageCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reset_pack();
+}
+
+void DiskImageCache::open_pack() {
+    pack_ = std::fopen(pack_path_.c_str(), "r+b");
+    if (!pack_) {
+        reset_pack();
+        return;
+    }
+
+    u32 magic = 0;
+    u32 version = 0;
+    if (std::fread(&magic, sizeof(magic), 1, pack_) != 1 ||
+        std::fread(&version, sizeof(version), 1, pack_) != 1 ||
+        magic != PACK_MAGIC || version != PACK_VERSION) {
+        LOG_INFO(TAG, "Cache pack has an unknown format, recreating");
+        reset_pack();
+        return;
+    }
+
+    // レコードを先頭から走査（後ろのレコードほど新しい）
+    u64 offset = PACK_HEADER_SIZE;
+    RecordHeader header;
+    while (read_record_header(pack_, header)) {
+        if (header.magic != RECORD_MAGIC || header.length > MAX_ENTRY_BYTES ||
+            std::fseek(pack_, static_cast<long>(header.length), SEEK_CUR) != 0) {
+            break;
+        }
+
+        const u64 data_offset = offset + RECORD_HEADER_SIZE;
+        const u64 end = data_offset + header.length;
+        // fseek はファイル末尾を越えても成功するため、長さは実サイズで確かめる
+        if (std::fseek(pack_, 0, SEEK_END) != 0 || static_cast<u64>(std::ftell(pack_)) < end) {
+            break;
+        }
+        std::fseek(pack_, static_cast<long>(end), SEEK_SET);
+
+        auto it = index_.find(header.key);
+        if (it != index_.end()) {
+            live_bytes_ -= it->second.length;
+        }
+        Entry& entry = index_[header.key];
+        entry.offset = data_offset;
+        entry.length = header.length;
+        entry.crc = header.crc;
+        entry.last_access = ++access_clock_;
+        live_bytes_ += header.length;
+
+        offset = end;
+    }
+
+    // 書き込み途中で終了した末尾のレコードを切り捨てる
+    pack_size_ = offset;
+    std::fflush(pack_);
+    if (::ftruncate(::fileno(pack_), static_cast<off_t>(pack_size_)) != 0) {
+        LOG_ERROR(TAG, "Failed to truncate cache pack");
+    }
+
+    LOG_INFO(TAG, ("Cache opened: " + std::to_string(index_.size()) + " entries, " +
+                   std::to_string(live_bytes_) + " bytes").c_str());
+}
+
+void DiskImageCache::enforce_budget() {
+    const u64 dead_bytes = pack_size_ - PACK_HEADER_SIZE - live_bytes_ - index_.size() * RECORD_HEADER_SIZE;
+    if (live_bytes_ <= byte_budget_ && dead_bytes <= std::max<u64>(live_bytes_, byte_budget_ / 4)) {
+        return;
+    }
+
+    // 予算の 3/4 まで古い順に破棄し、詰め直しの頻度を抑える
+    if (live_bytes_ > byte_budget_) {
+        std::vector<std::pair<u64, u64>> order;
+        order.reserve(index_.size());
+        for (const auto& item : index_) {
+            order.emplace_back(item.second.last_access, item.first);
+        }
+        std::sort(order.begin(), order.end());
+
+        const size_t target = byte_budget_ / 4 * 3;
+        for (const auto& item : order) {
+            if (live_bytes_ <= target) {
+                break;
+            }
+            live_bytes_ -= index_[item.second].length;
+            index_.erase(item.second);
+        }
+    }
+
+    if (!compact()) {
+        reset_pack();
+    }
+}
+
+bool DiskImageCache::compact() {
+    if (!pack_) {
+        return false;
+    }
+
+    const std::string temp_path = pack_path_ + ".tmp";
+    std::FILE* temp = std::fopen(temp_path.c_str(), "w+b");
+    if (!temp) {
+        return false;
+    }
+
+    // 使用順に並べて書き出す（次回起動時の走査順が LRU 順になる）
+    std::vector<std::pair<u64, u64>> order;
+    order.reserve(index_.size());
+    for (const auto& item : index_) {
+        order.emplace_back(item.second.last_access, item.first);
+    }
+    std::sort(order.begin(), order.end());
+
+    bool ok = write_pack_header(temp);
+    u64 offset = PACK_HEADER_SIZE;
+    std::vector<byte> data;
+    std::unordered_map<u64, Entry> compacted;
+    for (const auto& item : order) {
+        if (!ok) {
+            break;
+        }
+        const Entry& entry = index_[item.second];
+        data.resize(entry.length);
+        if (std::fseek(pack_, static_cast<long>(entry.offset), SEEK_SET) != 0 ||
+            std::fread(data.data(), 1, entry.length, pack_) != entry.length) {
+            continue;
+        }
+        ok = write_record(temp, item.second, data.data(), entry.length, entry.crc);
+
+        Entry moved = entry;
+        moved.offset = offset + RECORD_HEADER_SIZE;
+        compacted[item.second] = moved;
+        offset += RECORD_HEADER_SIZE + entry.length;
+    }
+    ok = ok && std::fflush(temp) == 0;
+
+    if (!ok || std::rename(temp_path.c_str(), pack_path_.c_str()) != 0) {
+        std::fclose(temp);
+        std::remove(temp_path.c_str());
+        return false;
+    }
+
+    std::fclose(pack_);
+    pack_ = temp;
+    pack_size_ = offset;
+    live_bytes_ = 0;
+    for (const auto& item : compacted) {
+        live_bytes_ += item.second.length;
+    }
+    index_ = std::move(compacted);
+
+    LOG_INFO(TAG, ("Cache compacted: " + std::to_string(index_.size()) + " entries, " +
+                   std::to_string(live_bytes_) + " bytes").c_str());
+    return true;
+}
+
+void DiskImageCache::reset_pack() {
+    if (pack_) {
+        std::fclose(pack_);
+    }
+    index_.clear();
+    live_bytes_ = 0;
+    pack_size_ = 0;
+
+    pack_ = std::fopen(pack_path_.c_str(), "w+b");
+    if (!pack_ || !write_pack_header(pack_) || std::fflush(pack_) != 0) {
+        LOG_ERROR(TAG, ("Failed to create cache pack: " + pack_path_).c_str());
+        if (pack_) {
+            std::fclose(pack_);
+            pack_ = nullptr;
+        }
+        return;
+    }
+    pack_size_ = PACK_HEADER_SIZE;
+}
+
+} // namespace raw_editor
@@ -0,0 +1,157 @@
+#ifndef DISK_IMAGE_CACHE_H
+#define DISK_IMAGE_CACHE_H
+
+#include "common_types.h"
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace raw_editor {
+
+/**
+ * ファイルの同一性
+ * パス・サイズ・更新時刻に加え、先頭と末尾の一部の内容ハッシュで判定する
+ * （同じパスに別のファイルがコピーされた場合も別物として扱う）
+ */
+struct FileIdentity {
+    std::string path;
+    u64 size = 0;
+    u64 modified_ns = 0;
+    u64 content_hash = 0;
+
+    bool is_valid() const { return !path.empty() && size > 0; }
+
+    /**
+     * キャッシュキーを作成
+     * @param kind 保存する画像の種類（サムネイル・プレビューなど）
+     * @param max_size 画像の長辺サイズ
+     * @return キー
+     */
+    u64 cache_key(u32 kind, u32 max_size) const;
+};
+
+/**
+ * ファイルの同一性を取得
+ * 内容ハッシュは先頭と末尾の PARTIAL_HASH_BYTES バイトのみを読むため、ファイルサイズによらず高速
+ * @param path ファイルパス
+ * @return 同一性（読めない場合は is_valid() が false）
+ */
+FileIdentity make_file_identity(const std::string& path);
+
+/**
+ * メモリ上の内容からファイルの同一性を取得（マップ済みのファイルやファイル記述子で開いたファイル用）
+ * パスを指定する版と同じ値になるため、どちらで開いても同じキャッシュを共有できる
+ * @param path ファイルパス（パスを持たない場合はコンテンツURIなどの識別名）
+ * @param data ファイルの内容
+ * @param size ファイルサイズ
+ * @param modified_ns 更新時刻（ナノ秒）
+ * @return 同一性
+ */
+FileIdentity make_file_identity(const std::string& path, const byte* data, size_t size, u64 modified_ns);
+
+/**
+ * ディスク上の画像キャッシュ
+ * エンコード済みの画像（JPEG）を1つのパックファイルに追記して保存する。
+ * 起動時にパックファイルを走査して索引を作り、予算を超えたら最近使われていない
+ * エントリから破棄してパックファイルを詰め直す（詰め直し時は使用順に並べるため、
+ * 次回起動時もおおよその LRU 順が復元される）。
+ * 複数スレッドから同時に使用できる。
+ */
+class DiskImageCache {
+public:
+    // キャッシュする画像の種類
+    static constexpr u32 KIND_THUMBNAIL = 1;
+    static constexpr u32 KIND_PREVIEW = 2;
+
+    // 既定の容量予算（256MB）
+    static constexpr size_t DEFAULT_BUDGET = 256 * 1024 * 1024;
+
+    /**
+     * @param directory キャッシュディレクトリ（存在しない場合は作成する）
+     * @param byte_budget 容量予算（バイト）
+     */
+    DiskImageCache(std::string directory, size_t byte_budget = DEFAULT_BUDGET);
+    ~DiskImageCache();
+
+    DiskImageCache(const DiskImageCache&) = delete;
+    DiskImageCache& operator=(const DiskImageCache&) = delete;
+
+    /**
+     * エントリを取得
+     * @param key キャッシュキー
+     * @param data 出力：エンコード済み画像
+     * @return ヒットしたらtrue
+     */
+    bool get(u64 key, std::vector<byte>& data);
+
+    /**
+     * エントリを保存（同じキーは上書き）
+     * @param key キャッシュキー
+     * @param data エンコード済み画像
+     * @return 成功ならtrue
+     */
+    bool put(u64 key, const std::vector<byte>& data);
+
+    /**
+     * 容量予算を設定（超過分は直ちに破棄する）
+     * @param bytes 予算（バイト）
+     */
+    void set_byte_budget(size_t bytes);
+
+    /**
+     * 有効なエントリの合計サイズを取得
+     * @return サイズ（バイト）
+     */
+    size_t size_bytes() const;
+
+    /**
+     * すべてのエントリを削除
+     */
+    void clear();
+
+private:
+    struct Entry {
+        u64 offset = 0;     // パックファイル上のデータ位置
+        u32 length = 0;
+        u32 crc = 0;
+        u64 last_access = 0;
+    };
+
+    const std::string directory_;
+    const std::string pack_path_;
+    size_t byte_budget_;
+
+    mutable std::mutex mutex_;
+    std::FILE* pack_;
+    std::unordered_map<u64, Entry> index_;
+    u64 pack_size_;
+    size_t live_bytes_;
+    u64 access_clock_;
+
+    /**
+     * パックファイルを開いて索引を作成（壊れた末尾は切り捨てる）
+     */
+    void open_pack();
+
+    /**
+     * 予算を超えていれば LRU 順に破棄し、パックファイルを詰め直す
+     */
+    void enforce_budget();
+
+    /**
+     * 索引に残っているエントリだけでパックファイルを作り直す
+     * @return 成功ならtrue
+     */
+    bool compact();
+
+    /**
+     * パックファイルを空の状態で作り直す
+     */
+    void reset_pack();
+};
+
+} // namespace raw_editor
+
+#endif // DISK_IMAGE_CACHE_H
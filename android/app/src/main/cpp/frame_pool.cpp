@@ -0,0 +1,259 @@
+#include "frame_pool.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace raw_editor {
+
+// 最小のサイズクラス（これより小さい要求もこの大きさで確保する）
+static constexpr size_t MIN_BLOCK_SIZE = 4096;
+
+// 再利用のために保持する Mat ヘッダー（UMatData）の上限
+static constexpr size_t MAX_SPARE_HEADERS = 256;
+
+// この回数のスコープ（プレビュー）の間に再利用されなかった空きブロックは解放する
+static constexpr u64 MAX_IDLE_FRAMES = 4;
+
+struct FreeBlock {
+    void* data;
+    u64 frame; // 空きになったときのスコープの番号
+};
+
+// プールの本体
+// 所有者（FramePool）と使用中のブロックがそれぞれ参照を持ち、最後の参照が戻ったときに破棄する
+struct FramePoolState {
+    mutable std::mutex mutex;
+    std::unordered_map<size_t, std::vector<FreeBlock>> free_blocks; // サイズクラス → 空きブロック
+    std::vector<void*> spare_headers;
+    size_t budget;
+    u64 frame = 0;
+    FramePoolStats stats;
+    std::atomic<size_t> references{1};
+
+    explicit FramePoolState(size_t retain_budget) : budget(retain_budget) {}
+
+    void* take_block(size_t bytes) {
+        const size_t block_size = FramePool::size_class(bytes);
+        references.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++stats.outstanding;
+            auto found = free_blocks.find(block_size);
+            if (found != free_blocks.end() && !found->second.empty()) {
+                void* block = found->second.back().data;
+                found->second.pop_back();
+                stats.retained_bytes -= block_size;
+                ++stats.reuses;
+                return block;
+            }
+            ++stats.allocations;
+            stats.allocated_bytes += block_size;
+        }
+        return cv::fastMalloc(block_size);
+    }
+
+    void give_back_block(void* block, size_t bytes) {
+        const size_t block_size = FramePool::size_class(bytes);
+        bool retained = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --stats.outstanding;
+            if (stats.retained_bytes + block_size <= budget) {
+                free_blocks[block_size].push_back({block, frame});
+                stats.retained_bytes += block_size;
+                retained = true;
+            }
+        }
+        if (!retained) {
+            cv::fastFree(block);
+        }
+    }
+
+    void* take_header() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!spare_headers.empty()) {
+            void* header = spare_headers.back();
+            spare_headers.pop_back();
+            return header;
+        }
+        ++stats.allocations;
+        stats.allocated_bytes += sizeof(cv::UMatData);
+        return ::operator new(sizeof(cv::UMatData));
+    }
+
+    void give_back_header(void* header) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (budget > 0 && spare_headers.size() < MAX_SPARE_HEADERS) {
+                spare_headers.push_back(header);
+                return;
+            }
+        }
+        ::operator delete(header);
+    }
+
+    // スコープの終わり。しばらく再利用されていないサイズクラスのブロックを解放する
+    // （プレビューの大きさや有効な調整が変わると、使われなくなったクラスが残るため）
+    void end_frame() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++frame;
+        for (auto& entry : free_blocks) {
+            std::vector<FreeBlock>& blocks = entry.second;
+            // 空きになった順に並んでいるため、古いものは先頭にまとまっている
+            size_t stale = 0;
+            while (stale < blocks.size() && blocks[stale].frame + MAX_IDLE_FRAMES < frame) {
+                cv::fastFree(blocks[stale].data);
+                stats.retained_bytes -= entry.first;
+                ++stale;
+            }
+            blocks.erase(blocks.begin(), blocks.begin() + stale);
+        }
+    }
+
+    // 空きブロックと保持中のヘッダーを解放する
+    void release_idle() {
+        std::unordered_map<size_t, std::vector<FreeBlock>> blocks;
+        std::vector<void*> headers;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocks.swap(free_blocks);
+            headers.swap(spare_headers);
+            stats.retained_bytes = 0;
+        }
+        for (auto& entry : blocks) {
+            for (const FreeBlock& block : entry.second) {
+                cv::fastFree(block.data);
+            }
+        }
+        for (void* header : headers) {
+            ::operator delete(header);
+        }
+    }
+
+    void release_reference() {
+        if (references.fetch_sub(1) == 1) {
+            release_idle();
+            delete this;
+        }
+    }
+};
+
+namespace {
+
+thread_local FramePoolState* t_pool = nullptr;
+
+// OpenCV の既定のアロケーターを置き換え、FramePoolScope の中でだけプールから確保する
+// スコープの外や外部メモリを包む Mat は標準のアロケーターに任せる（そのブロックはこのクラスを経由しない）
+class PoolMatAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+        FramePoolState* pool = t_pool;
+        if (data || !pool) {
+            return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usage);
+        }
+
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; --i) {
+            if (step) {
+                step[i] = total;
+            }
+            total *= static_cast<size_t>(sizes[i]);
+        }
+
+        cv::UMatData* u = new (pool->take_header()) cv::UMatData(this);
+        u->data = u->origdata = static_cast<uchar*>(pool->take_block(total));
+        u->size = total;
+        u->userdata = pool;
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+        return cv::Mat::getStdAllocator()->allocate(u, flags, usage);
+    }
+
+    void deallocate(cv::UMatData* u) const override {
+        if (!u) {
+            return;
+        }
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+
+        FramePoolState* pool = static_cast<FramePoolState*>(u->userdata);
+        pool->give_back_block(u->origdata, u->size);
+        u->~UMatData();
+        pool->give_back_header(u);
+        pool->release_reference();
+    }
+};
+
+void install_pool_allocator() {
+    // プロセス全体で1度だけ差し替える（解放は Mat が参照し続けるため行わない）
+    static PoolMatAllocator* allocator = [] {
+        PoolMatAllocator* instance = new PoolMatAllocator();
+        cv::Mat::setDefaultAllocator(instance);
+        return instance;
+    }();
+    (void)allocator;
+}
+
+} // namespace
+
+FramePool::FramePool(size_t retain_budget) : state_(new FramePoolState(retain_budget)) {
+    install_pool_allocator();
+}
+
+FramePool::~FramePool() {
+    // 以後戻ってくるブロックは保持せずに解放する
+    set_retain_budget(0);
+    state_->release_reference();
+}
+
+void FramePool::trim() {
+    state_->release_idle();
+}
+
+void FramePool::set_retain_budget(size_t bytes) {
+    bool over_budget;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->budget = bytes;
+        over_budget = state_->stats.retained_bytes > bytes || (bytes == 0 && !state_->spare_headers.empty());
+    }
+    if (over_budget) {
+        state_->release_idle();
+    }
+}
+
+FramePoolStats FramePool::stats() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->stats;
+}
+
+size_t FramePool::size_class(size_t bytes) {
+    if (bytes <= MIN_BLOCK_SIZE) {
+        return MIN_BLOCK_SIZE;
+    }
+    // bytes を含む [base, base * 2) を4等分した刻みに切り上げる
+    size_t base = MIN_BLOCK_SIZE;
+    while (base * 2 < bytes) {
+        base *= 2;
+    }
+    const size_t step = base / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+FramePoolScope::FramePoolScope(FramePool& pool) : previous_(t_pool) {
+    t_pool = pool.state_;
+}
+
+FramePoolScope::~FramePoolScope() {
+    if (previous_ != t_pool) {
+        t_pool->end_frame();
+    }
+    t_pool = previous_;
+}
+
+} // namespace raw_editor
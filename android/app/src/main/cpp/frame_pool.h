@@ -0,0 +1,113 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include "common_types.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace raw_editor {
+
+struct FramePoolState;
+
+/**
+ * フレームプールの統計
+ */
+struct FramePoolStats {
+    u64 allocations = 0;        // システムから確保した回数（画素ブロックと Mat のヘッダー）
+    u64 allocated_bytes = 0;    // システムから確保したバイト数
+    u64 reuses = 0;             // 空きブロックを再利用した回数
+    u64 outstanding = 0;        // 使用中のブロック数
+    u64 retained_bytes = 0;     // 再利用のために保持している空きブロックのバイト数
+};
+
+// 空きブロックとして保持するバイト数の既定値（上限。通常は直近のプレビューの作業領域分だけ保持する）
+constexpr size_t FRAME_POOL_DEFAULT_BUDGET = 256ull * 1024 * 1024;
+
+/**
+ * プロセッサーごとの画素バッファのプール
+ * FramePoolScope の間にそのスレッドで確保された cv::Mat（OpenCV 関数の出力や一時バッファを含む）の
+ * メモリをサイズクラスごとに再利用する。スライダー操作中の連続したプレビューでは、ステージの出力・
+ * 中間バッファ・出力の ImageData が前回の呼び出しで解放されたブロックから割り当てられる。
+ * 数回のスコープの間再利用されなかった空きブロックは解放する（サイズが変わったクラスを残さない）。
+ * 使用中のブロックはプールより長く生きてよい（プールの破棄後に戻ったブロックはそのまま解放する）。
+ */
+class FramePool {
+public:
+    /**
+     * @param retain_budget 空きブロックとして保持する上限（バイト、超えた分は解放する）
+     */
+    explicit FramePool(size_t retain_budget = FRAME_POOL_DEFAULT_BUDGET);
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    /**
+     * 保持している空きブロックをすべて解放する（使用中のブロックは対象外）
+     */
+    void trim();
+
+    /**
+     * 空きブロックとして保持する上限を設定
+     * @param bytes 上限（バイト、0 = 保持しない）
+     */
+    void set_retain_budget(size_t bytes);
+
+    /**
+     * 統計を取得（どのスレッドからでも呼べる）
+     */
+    FramePoolStats stats() const;
+
+    /**
+     * 要求サイズが属するサイズクラスの大きさ
+     * 2の累乗の間を4等分した刻みに切り上げる（無駄は最大25%）
+     * @param bytes 要求サイズ
+     * @return ブロックの大きさ（バイト）
+     */
+    static size_t size_class(size_t bytes);
+
+private:
+    friend class FramePoolScope;
+
+    FramePoolState* state_;
+};
+
+/**
+ * スコープの間、このスレッドでの cv::Mat の確保を pool から行う
+ * 入れ子にでき、外側のプールはスコープを抜けると元に戻る
+ * 同じプールの一番外側のスコープを抜けるたびに、古い空きブロックを解放する
+ * 他のスレッド（OpenCV の並列処理のワーカーなど）での確保は通常のアロケーターのまま
+ * （プレビューの並列処理の本体では Mat を作らず、行単位の一時領域は thread_scratch を使う）
+ */
+class FramePoolScope {
+public:
+    explicit FramePoolScope(FramePool& pool);
+    ~FramePoolScope();
+
+    FramePoolScope(const FramePoolScope&) = delete;
+    FramePoolScope& operator=(const FramePoolScope&) = delete;
+
+private:
+    FramePoolState* previous_;
+};
+
+/**
+ * スレッドごとの作業用バッファ
+ * 並列処理の本体で使う行単位の一時領域（係数・座標など）をスレッドごとに保持し、
+ * 呼び出しのたびに確保し直さない。OpenCV のワーカースレッドでも使える（容量は縮めない）。
+ * 同時に使う領域は Tag を変えて別のバッファにする。
+ * @param count 必要な要素数
+ * @return count 要素以上の領域（内容は不定、次に同じ Tag で呼ぶまで有効）
+ */
+template <typename T, typename Tag>
+T* thread_scratch(size_t count) {
+    thread_local std::vector<T> buffer;
+    if (buffer.size() < count) {
+        buffer.resize(count);
+    }
+    return buffer.data();
+}
+
+} // namespace raw_editor
+
+#endif // FRAME_POOL_H
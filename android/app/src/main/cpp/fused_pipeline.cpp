@@ -0,0 +1,432 @@
+#include "fused_pipeline.h"
+#include "frame_pool.h"
+#include "trace.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace raw_editor {
+
+namespace {
+
+// 並列処理の行ブロック（タイル）サイズ
+constexpr int ROW_BLOCK = 32;
+
+// ベースレイヤーの係数の作業領域（thread_scratch の区別用）
+struct CoeffA;
+struct CoeffB;
+
+// sRGBエンコードテーブルの入力範囲（1.0を超えるハイライトの余裕を含む）
+constexpr f32 ENCODE_RANGE = 4.0f;
+constexpr int ENCODE_TABLE_SIZE = 16384;
+constexpr f32 ENCODE_SCALE = ENCODE_TABLE_SIZE / ENCODE_RANGE;
+
+// リニア → sRGBガンマのテーブル（線形補間用に末尾へ1要素追加）
+const f32* srgb_encode_table() {
+    static const std::vector<f32> table = [] {
+        std::vector<f32> t(ENCODE_TABLE_SIZE + 2);
+        for (int i = 0; i < ENCODE_TABLE_SIZE + 2; ++i) {
+            f32 v = i / ENCODE_SCALE;
+            t[i] = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+inline f32 clamp01(f32 v) {
+    return std::min(1.0f, std::max(0.0f, v));
+}
+
+inline f32 encode_srgb(const f32* table, f32 v) {
+    f32 pos = std::min(ENCODE_RANGE, std::max(0.0f, v)) * ENCODE_SCALE;
+    int index = static_cast<int>(pos);
+    f32 frac = pos - index;
+    return table[index] + (table[index + 1] - table[index]) * frac;
+}
+
+// ホワイトバランスと露出をリニア空間でまとめたゲイン（16ビット正規化込み）
+inline void linear_gains(const PointOpsProgram& p, f32 gains[3]) {
+    for (int c = 0; c < 3; ++c) {
+        gains[c] = p.wb_gain[c] * p.exposure_gain / 65535.0f;
+    }
+}
+
+// 16ビットリニアの1行をデコードしてゲインを掛ける（分岐なしで自動ベクトル化される）
+inline void decode_row(const u16* src, f32* dst, int width, const f32 gains[3]) {
+    for (int x = 0; x < width; ++x) {
+        dst[x * 3 + 0] = src[x * 3 + 0] * gains[0];
+        dst[x * 3 + 1] = src[x * 3 + 1] * gains[1];
+        dst[x * 3 + 2] = src[x * 3 + 2] * gains[2];
+    }
+}
+
+inline int stripe_count(int rows) {
+    return std::max(1, rows / ROW_BLOCK);
+}
+
+// ガンマ空間の輝度（cv::COLOR_BGR2GRAY と同じ係数）
+inline f32 luma(f32 b, f32 g, f32 r) {
+    return 0.114f * b + 0.587f * g + 0.299f * r;
+}
+
+// apply_tone_curve と同じ4区間のカーブ
+inline f32 tone_curve_value(const PointOpsProgram& p, f32 x) {
+    int segment = std::max(0, std::min(3, static_cast<int>(x * 4.0f)));
+    f32 t = x * 4.0f - segment;
+    return clamp01(x + p.curve[segment] * t * (1.0f - t));
+}
+
+// 前段の1画素処理（SIMDの端数処理にも使用）
+// 入力はホワイトバランス・露出適用済みのリニア値、coeff_a / coeff_b はその画素のベースレイヤーの係数
+inline void front_pixel(const PointOpsProgram& p, const f32* table, f32* px, f32 coeff_a, f32 coeff_b) {
+    f32& b = px[0];
+    f32& g = px[1];
+    f32& r = px[2];
+
+    b = encode_srgb(table, b);
+    g = encode_srgb(table, g);
+    r = encode_srgb(table, r);
+
+    if (p.has_local_tone()) {
+        // ゲインはベース輝度で決め、ベースからの差分（ディテール）はクラリティで強調する
+        const f32 luminance = luma(b, g, r);
+        const f32 base = coeff_a * luminance + coeff_b;
+        const f32 gain = (1.0f + p.highlight_delta * highlight_weight(base)) *
+                         (1.0f + p.shadow_delta * shadow_weight(base));
+        const f32 detail = p.clarity_amount * (luminance - base);
+        b = (b + detail) * gain;
+        g = (g + detail) * gain;
+        r = (r + detail) * gain;
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        f32& v = px[c];
+        if (p.has_whites && v > 0.8f) v *= p.white_factor;
+        if (p.has_blacks && v < 0.2f) v *= p.black_factor;
+        v = (v - 0.5f) * p.contrast_factor + 0.5f + p.brightness_offset;
+    }
+
+    if (p.has_saturation || p.has_vibrance) {
+        // HSVの彩度スケールと等価なRGB演算（色相と明度を保つ）
+        f32 v = std::max(b, std::max(g, r));
+        f32 mn = std::min(b, std::min(g, r));
+        if (v > 0.0f) {
+            f32 k = p.saturation_factor;
+            if (p.has_vibrance && (v - mn) / v * k < 0.5f) {
+                k *= p.vibrance_factor;
+            }
+            b = v - (v - b) * k;
+            g = v - (v - g) * k;
+            r = v - (v - r) * k;
+        }
+    }
+}
+
+} // namespace
+
+PointOpsProgram compile_point_ops(const AdjustmentParams& params) {
+    PointOpsProgram p;
+
+    // ホワイトバランス（calculate_white_balance_matrix と同じ係数）
+    if (params.temperature != 0.0f || params.tint != 0.0f) {
+        f32 temp_factor = params.temperature / 1000.0f;
+        f32 tint_factor = params.tint / 100.0f;
+        f32 r_factor, g_factor = 1.0f, b_factor;
+
+        if (temp_factor > 0) {
+            r_factor = 1.0f + temp_factor * 0.3f;
+            b_factor = 1.0f - temp_factor * 0.2f;
+        } else {
+            r_factor = 1.0f + temp_factor * 0.2f;
+            b_factor = 1.0f - temp_factor * 0.3f;
+        }
+
+        if (tint_factor > 0) {
+            r_factor += tint_factor * 0.1f;
+            b_factor += tint_factor * 0.1f;
+            g_factor -= tint_factor * 0.05f;
+        } else {
+            g_factor -= tint_factor * 0.1f;
+        }
+
+        p.has_white_balance = true;
+        p.wb_gain[0] = b_factor;
+        p.wb_gain[1] = g_factor;
+        p.wb_gain[2] = r_factor;
+    }
+
+    p.has_exposure = params.exposure != 0.0f;
+    p.exposure_gain = std::pow(2.0f, params.exposure);
+
+    // 無効な演算の係数は0にしておく（ベースレイヤーの式で恒等になる）
+    p.has_highlights = params.highlights != 0.0f;
+    p.highlight_delta = params.highlights / 100.0f;
+    p.has_shadows = params.shadows != 0.0f;
+    p.shadow_delta = params.shadows / 100.0f;
+
+    p.has_whites = params.whites != 0.0f;
+    p.white_factor = 1.0f + params.whites / 100.0f;
+    p.has_blacks = params.blacks != 0.0f;
+    p.black_factor = 1.0f + params.blacks / 100.0f;
+
+    p.has_contrast = params.contrast != 0.0f;
+    p.contrast_factor = 1.0f + params.contrast / 100.0f;
+    p.has_brightness = params.brightness != 0.0f;
+    p.brightness_offset = params.brightness / 100.0f;
+
+    p.has_saturation = params.saturation != 0.0f;
+    p.saturation_factor = 1.0f + params.saturation / 100.0f;
+    p.has_vibrance = params.vibrance != 0.0f;
+    p.vibrance_factor = 1.0f + params.vibrance / 100.0f;
+
+    p.has_clarity = params.clarity != 0.0f;
+    p.clarity_amount = params.clarity / 100.0f;
+
+    const f32 hues[HSL_BAND_COUNT] = {
+        params.hue_red, params.hue_orange, params.hue_yellow, params.hue_green,
+        params.hue_aqua, params.hue_blue, params.hue_purple, params.hue_magenta
+    };
+    const f32 sats[HSL_BAND_COUNT] = {
+        params.saturation_red, params.saturation_orange, params.saturation_yellow, params.saturation_green,
+        params.saturation_aqua, params.saturation_blue, params.saturation_purple, params.saturation_magenta
+    };
+    const f32 lums[HSL_BAND_COUNT] = {
+        params.luminance_red, params.luminance_orange, params.luminance_yellow, params.luminance_green,
+        params.luminance_aqua, params.luminance_blue, params.luminance_purple, params.luminance_magenta
+    };
+    for (int i = 0; i < HSL_BAND_COUNT; ++i) {
+        p.hsl_hue[i] = hues[i];
+        p.hsl_saturation[i] = sats[i] / 100.0f;
+        p.hsl_luminance[i] = lums[i] / 100.0f;
+        p.has_hsl = p.has_hsl || hues[i] != 0.0f || sats[i] != 0.0f || lums[i] != 0.0f;
+    }
+
+    p.curve[0] = params.curve_shadows / 100.0f;
+    p.curve[1] = params.curve_darks / 100.0f;
+    p.curve[2] = params.curve_lights / 100.0f;
+    p.curve[3] = params.curve_highlights / 100.0f;
+    p.has_tone_curve = params.curve_shadows != 0.0f || params.curve_darks != 0.0f ||
+                       params.curve_lights != 0.0f || params.curve_highlights != 0.0f;
+
+    return p;
+}
+
+FusedPipeline::FusedPipeline(const AdjustmentParams& params, int lut_size)
+    : program_(compile_point_ops(params)),
+      hsl_kernel_(program_.hsl_hue, program_.hsl_saturation, program_.hsl_luminance) {
+    // 画素単位の演算だけなら格子点で1度評価してLUTにする（コストは画像サイズに依存しない）
+    if (lut_size > 0 && !program_.has_spatial_ops()) {
+        lut_ = std::make_shared<const ColorLut3D>(lut_size, evaluate(ColorLut3D::lattice(lut_size), true, cv::Point()));
+    }
+}
+
+void FusedPipeline::prepare(const cv::Mat& frame) {
+    if (program_.has_local_tone()) {
+        TraceScope trace("tone_base_layer", static_cast<u64>(frame.total()));
+        base_layer_ = build_base_layer(frame);
+    }
+}
+
+cv::Mat FusedPipeline::run(const cv::Mat& linear, bool parallel, cv::Point origin) const {
+    CV_Assert(linear.type() == CV_16UC3);
+    TraceScope trace(lut_ ? "fused.lut" : "fused.direct", static_cast<u64>(linear.total()));
+
+    cv::Mat output = lut_ ? lut_->apply(linear, parallel) : evaluate(linear, parallel, origin);
+    trace.add_bytes(static_cast<u64>(output.total() * output.elemSize()));
+    return output;
+}
+
+cv::Mat FusedPipeline::evaluate(const cv::Mat& linear, bool parallel, cv::Point origin) const {
+
+    // タイル単位で呼ばれる場合は外側のプールが並列化するので行分割しない
+    const int stripes = parallel ? stripe_count(linear.rows) : 1;
+
+    // prepare されていなければ入力全体をフレームとして扱う
+    std::shared_ptr<const ToneBaseLayer> base = base_layer_;
+    if (program_.has_local_tone() && !base) {
+        base = build_base_layer(linear);
+        origin = cv::Point();
+    }
+
+    // デコード・前段・後段を1回の走査で実行
+    cv::Mat image(linear.size(), CV_32FC3);
+    cv::parallel_for_(cv::Range(0, linear.rows), [&](const cv::Range& rows) {
+        run_front_rows(linear, image, base.get(), origin, rows);
+        run_back_rows(image, rows);
+    }, stripes);
+
+    return image;
+}
+
+std::shared_ptr<const ToneBaseLayer> FusedPipeline::build_base_layer(const cv::Mat& frame) const {
+    const f32* table = srgb_encode_table();
+
+    f32 gains[3];
+    linear_gains(program_, gains);
+
+    cv::Mat small;
+    const cv::Size plane_size = ToneBaseLayer::plane_size(frame.size());
+    cv::resize(frame, small, plane_size, 0, 0, ToneBaseLayer::plane_interpolation(frame.size()));
+
+    // ホワイトバランス・露出適用後の輝度（前段と同じガンマ空間）
+    cv::Mat luminance(plane_size, CV_32F);
+    for (int y = 0; y < small.rows; ++y) {
+        const u16* src = small.ptr<u16>(y);
+        f32* dst = luminance.ptr<f32>(y);
+        for (int x = 0; x < small.cols; ++x) {
+            dst[x] = luma(encode_srgb(table, src[x * 3 + 0] * gains[0]),
+                          encode_srgb(table, src[x * 3 + 1] * gains[1]),
+                          encode_srgb(table, src[x * 3 + 2] * gains[2]));
+        }
+    }
+
+    return std::make_shared<const ToneBaseLayer>(luminance, frame.size());
+}
+
+void FusedPipeline::run_front_rows(const cv::Mat& linear, cv::Mat& image, const ToneBaseLayer* base,
+                                   cv::Point origin, const cv::Range& rows) const {
+    const PointOpsProgram& p = program_;
+    const bool use_base = base != nullptr;
+    const int width = image.cols;
+    const f32* table = srgb_encode_table();
+
+    f32 gains[3];
+    linear_gains(p, gains);
+
+    // ベースレイヤーの係数をフル解像度に補間した1行分（スレッドごとに使い回す）
+    f32* coeff_a = use_base ? thread_scratch<f32, CoeffA>(width) : nullptr;
+    f32* coeff_b = use_base ? thread_scratch<f32, CoeffB>(width) : nullptr;
+
+    for (int y = rows.start; y < rows.end; ++y) {
+        f32* row = image.ptr<f32>(y);
+        int x = 0;
+        if (use_base) {
+            base->sample_row(origin.y + y, origin.x, width, coeff_a, coeff_b);
+        }
+
+        // ホワイトバランス・露出はリニア空間で適用（クランプしないためハイライトの余裕が残る）
+        decode_row(linear.ptr<u16>(y), row, width, gains);
+
+#if CV_SIMD128
+        using namespace cv;
+        const v_float32x4 zero = v_setzero_f32();
+        const v_float32x4 one = v_setall_f32(1.0f);
+        const v_float32x4 half = v_setall_f32(0.5f);
+        const v_float32x4 white_threshold = v_setall_f32(0.8f);
+        const v_float32x4 black_threshold = v_setall_f32(0.2f);
+        const v_float32x4 encode_max = v_setall_f32(ENCODE_RANGE);
+        const v_float32x4 encode_scale = v_setall_f32(ENCODE_SCALE);
+        const v_float32x4 luma_b = v_setall_f32(0.114f);
+        const v_float32x4 luma_g = v_setall_f32(0.587f);
+        const v_float32x4 luma_r = v_setall_f32(0.299f);
+        const v_float32x4 highlight_low = v_setall_f32(HIGHLIGHT_WEIGHT_LOW);
+        const v_float32x4 highlight_scale = v_setall_f32(1.0f / (HIGHLIGHT_WEIGHT_HIGH - HIGHLIGHT_WEIGHT_LOW));
+        const v_float32x4 shadow_low = v_setall_f32(SHADOW_WEIGHT_LOW);
+        const v_float32x4 shadow_scale = v_setall_f32(1.0f / (SHADOW_WEIGHT_HIGH - SHADOW_WEIGHT_LOW));
+        const v_float32x4 three = v_setall_f32(3.0f);
+        const v_float32x4 highlight_delta = v_setall_f32(p.highlight_delta);
+        const v_float32x4 shadow_delta = v_setall_f32(p.shadow_delta);
+        const v_float32x4 clarity = v_setall_f32(p.clarity_amount);
+        const v_float32x4 white_factor = v_setall_f32(p.white_factor);
+        const v_float32x4 black_factor = v_setall_f32(p.black_factor);
+        const v_float32x4 contrast = v_setall_f32(p.contrast_factor);
+        const v_float32x4 offset = v_setall_f32(0.5f + p.brightness_offset);
+        const v_float32x4 saturation = v_setall_f32(p.saturation_factor);
+        const v_float32x4 vibrance = v_setall_f32(p.vibrance_factor);
+
+        for (; x <= width - 4; x += 4) {
+            v_float32x4 c[3];
+            v_load_deinterleave(row + x * 3, c[0], c[1], c[2]);
+
+            for (int i = 0; i < 3; ++i) {
+                // sRGBエンコード（テーブルの線形補間）
+                v_float32x4 pos = v_min(v_max(c[i], zero), encode_max) * encode_scale;
+                v_int32x4 index = v_trunc(pos);
+                v_float32x4 frac = pos - v_cvt_f32(index);
+                v_float32x4 lo = v_lut(table, index);
+                v_float32x4 hi = v_lut(table + 1, index);
+                c[i] = lo + (hi - lo) * frac;
+            }
+
+            if (use_base) {
+                v_float32x4 luminance = c[0] * luma_b + c[1] * luma_g + c[2] * luma_r;
+                v_float32x4 base_value = v_load(coeff_a + x) * luminance + v_load(coeff_b + x);
+
+                // smoothstep による重み（front_pixel と同じ式）
+                v_float32x4 th = v_min(one, v_max(zero, (base_value - highlight_low) * highlight_scale));
+                v_float32x4 ts = v_min(one, v_max(zero, (base_value - shadow_low) * shadow_scale));
+                v_float32x4 highlight = th * th * (three - th - th);
+                v_float32x4 shadow = one - ts * ts * (three - ts - ts);
+
+                v_float32x4 gain = (one + highlight_delta * highlight) * (one + shadow_delta * shadow);
+                v_float32x4 detail = clarity * (luminance - base_value);
+                for (int i = 0; i < 3; ++i) {
+                    c[i] = (c[i] + detail) * gain;
+                }
+            }
+
+            for (int i = 0; i < 3; ++i) {
+                if (p.has_whites) c[i] = v_select(c[i] > white_threshold, c[i] * white_factor, c[i]);
+                if (p.has_blacks) c[i] = v_select(c[i] < black_threshold, c[i] * black_factor, c[i]);
+                c[i] = (c[i] - half) * contrast + offset;
+            }
+
+            if (p.has_saturation || p.has_vibrance) {
+                v_float32x4 vmax = v_max(c[0], v_max(c[1], c[2]));
+                v_float32x4 vmin = v_min(c[0], v_min(c[1], c[2]));
+                v_float32x4 k = saturation;
+                if (p.has_vibrance) {
+                    v_float32x4 s = (vmax - vmin) / vmax * saturation;
+                    k = v_select(s < half, k * vibrance, k);
+                }
+                v_float32x4 valid = vmax > zero;
+                for (int i = 0; i < 3; ++i) {
+                    c[i] = v_select(valid, vmax - (vmax - c[i]) * k, c[i]);
+                }
+            }
+
+            v_store_interleave(row + x * 3, c[0], c[1], c[2]);
+        }
+#endif
+
+        for (; x < width; ++x) {
+            front_pixel(p, table, row + x * 3, use_base ? coeff_a[x] : 1.0f, use_base ? coeff_b[x] : 0.0f);
+        }
+    }
+}
+
+void FusedPipeline::run_back_rows(cv::Mat& image, const cv::Range& rows) const {
+    const PointOpsProgram& p = program_;
+    const int elements = image.cols * 3;
+
+    for (int y = rows.start; y < rows.end; ++y) {
+        f32* row = image.ptr<f32>(y);
+        int i = 0;
+#if CV_SIMD128
+        {
+            using namespace cv;
+            const v_float32x4 zero = v_setzero_f32();
+            const v_float32x4 one = v_setall_f32(1.0f);
+            for (; i <= elements - 4; i += 4) {
+                v_store(row + i, v_min(one, v_max(zero, v_load(row + i))));
+            }
+        }
+#endif
+        for (; i < elements; ++i) {
+            row[i] = clamp01(row[i]);
+        }
+
+        // HSLはLUT参照の専用カーネルで8バンドを1回の走査で適用
+        hsl_kernel_.apply_row(row, image.cols);
+
+        if (p.has_tone_curve) {
+            for (i = 0; i < elements; ++i) {
+                row[i] = tone_curve_value(p, row[i]);
+            }
+        }
+    }
+}
+
+} // namespace raw_editor
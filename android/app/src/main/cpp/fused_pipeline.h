@@ -0,0 +1,160 @@
+#ifndef FUSED_PIPELINE_H
+#define FUSED_PIPELINE_H
+
+#include "common_types.h"
+#include "color_lut.h"
+#include "hsl_kernel.h"
+#include "local_tone.h"
+#include <opencv2/opencv.hpp>
+#include <memory>
+
+namespace raw_editor {
+
+/**
+ * 点演算プログラム
+ * AdjustmentParamsから各画素演算の定数を事前計算したもの
+ * 係数はすべて「無調整なら恒等変換」になるように正規化してある
+ */
+struct PointOpsProgram {
+    // ホワイトバランス（B, G, R の順）
+    bool has_white_balance = false;
+    f32 wb_gain[3] = {1.0f, 1.0f, 1.0f};
+
+    // 露出
+    bool has_exposure = false;
+    f32 exposure_gain = 1.0f;
+
+    // ハイライト・シャドウ（ベースレイヤーの重み付きゲイン - 1）
+    bool has_highlights = false;
+    f32 highlight_delta = 0.0f;
+    bool has_shadows = false;
+    f32 shadow_delta = 0.0f;
+
+    // ホワイト・ブラック
+    bool has_whites = false;
+    f32 white_factor = 1.0f;
+    bool has_blacks = false;
+    f32 black_factor = 1.0f;
+
+    // コントラスト・明度
+    bool has_contrast = false;
+    f32 contrast_factor = 1.0f;
+    bool has_brightness = false;
+    f32 brightness_offset = 0.0f;
+
+    // 彩度・自然な彩度
+    bool has_saturation = false;
+    f32 saturation_factor = 1.0f;
+    bool has_vibrance = false;
+    f32 vibrance_factor = 1.0f;
+
+    // クラリティ（ベースレイヤーとの差分の強調）
+    bool has_clarity = false;
+    f32 clarity_amount = 0.0f;
+
+    // HSL（バンドごとの色相シフト[度]・彩度/輝度調整[-1, 1]）
+    bool has_hsl = false;
+    f32 hsl_hue[HSL_BAND_COUNT] = {};
+    f32 hsl_saturation[HSL_BAND_COUNT] = {};
+    f32 hsl_luminance[HSL_BAND_COUNT] = {};
+
+    // トーンカーブ（シャドウ・ダーク・ライト・ハイライト [-1, 1]）
+    bool has_tone_curve = false;
+    f32 curve[4] = {};
+
+    // ベースレイヤーを参照する演算を含むか
+    bool has_local_tone() const { return has_highlights || has_shadows || has_clarity; }
+
+    // 周辺画素を参照する演算を含むか（含まなければ全体が入力RGBの関数になる）
+    bool has_spatial_ops() const { return has_local_tone(); }
+};
+
+/**
+ * 調整パラメータから点演算プログラムを生成
+ * @param params 調整パラメータ
+ * @return 点演算プログラム
+ */
+PointOpsProgram compile_point_ops(const AdjustmentParams& params);
+
+/**
+ * 融合パイプライン
+ * ホワイトバランスからトーンカーブまでの画素単位の演算を、
+ * float画像上の1回のタイル走査（SIMD）にまとめて実行する。
+ * ホワイトバランスと露出はリニア空間で適用し、その後sRGBガンマに変換する。
+ * ハイライト/シャドウ・クラリティは縮小輝度から作るベースレイヤー（ToneBaseLayer）を共有し、
+ * 画素ごとの演算として同じ走査に含める。
+ * シャープネス・ノイズ除去・幾何変換は呼び出し側で別途適用する。
+ * 空間演算を含まない場合は、構築時にプログラム全体を3D LUTに焼き込み、
+ * 画像への適用は四面体補間の1パスで行う。
+ */
+class FusedPipeline {
+public:
+    /**
+     * @param params 調整パラメータ
+     * @param lut_size 3D LUTの格子サイズ（0 ならLUTを使わず常に直接評価する）
+     */
+    explicit FusedPipeline(const AdjustmentParams& params, int lut_size = ColorLut3D::PREVIEW_SIZE);
+
+    /**
+     * フレーム全体からベースレイヤーを作る（空間演算を含まなければ何もしない）
+     * 画像の一部（タイル・切り出し領域）に run を適用する場合は、事前にフレーム全体で呼ぶこと。
+     * ベースレイヤーはフレーム全体で共有されるため、タイルにハローを付ける必要はない
+     * @param frame 16ビットリニアBGR画像 (CV_16UC3)
+     */
+    void prepare(const cv::Mat& frame);
+
+    /**
+     * 16ビットリニア画像に点演算を適用
+     * prepare されていなければ、入力全体をフレームとしてベースレイヤーを作る
+     * @param linear 16ビットリニアBGR画像 (CV_16UC3)
+     * @param parallel 行方向に並列化するか（タイル処理時は false）
+     * @param origin 入力の左上のフレーム上の位置（prepare した場合のみ使用）
+     * @return sRGBガンマ・[0, 1]範囲のfloat画像 (CV_32FC3)
+     */
+    cv::Mat run(const cv::Mat& linear, bool parallel = true, cv::Point origin = cv::Point()) const;
+
+    const PointOpsProgram& program() const { return program_; }
+
+    /**
+     * 焼き込んだ3D LUT
+     * @return LUT（空間演算を含む・LUT無効の場合は nullptr）
+     */
+    const ColorLut3D* color_lut() const { return lut_.get(); }
+
+private:
+    PointOpsProgram program_;
+    HslKernel hsl_kernel_;
+    std::shared_ptr<const ColorLut3D> lut_;
+    std::shared_ptr<const ToneBaseLayer> base_layer_;
+
+    /**
+     * LUTを使わずにプログラムを直接評価
+     */
+    cv::Mat evaluate(const cv::Mat& linear, bool parallel, cv::Point origin) const;
+
+    /**
+     * ベースレイヤーを作る
+     * 先に縮小してから輝度（ホワイトバランス・露出適用後のガンマ空間）を求めるため、
+     * フル解像度で走査するのは縮小の1回だけ
+     * @param frame 16ビットリニア画像
+     * @return ベースレイヤー
+     */
+    std::shared_ptr<const ToneBaseLayer> build_base_layer(const cv::Mat& frame) const;
+
+    /**
+     * デコードと前段（ホワイトバランス〜彩度）を行単位で適用
+     * @param base ベースレイヤー（空間演算を含まなければ nullptr）
+     * @param origin 入力の左上のフレーム上の位置
+     */
+    void run_front_rows(const cv::Mat& linear, cv::Mat& image, const ToneBaseLayer* base, cv::Point origin,
+                        const cv::Range& rows) const;
+
+    /**
+     * 後段（クランプ・HSL・トーンカーブ）を行単位で適用
+     */
+    void run_back_rows(cv::Mat& image, const cv::Range& rows) const;
+};
+
+} // namespace raw_editor
+
+#endif // FUSED_PIPELINE_H
@@ -0,0 +1,507 @@
+#include "geometry_cache.h"
+#include "frame_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+
+namespace raw_editor {
+
+static const char* TAG = "GeometryCache";
+
+namespace {
+
+// 並列処理の行ブロックサイズ
+constexpr int ROW_BLOCK = 32;
+
+// 双線形補間が参照する外側の画素の分の余白
+constexpr int INTERPOLATION_MARGIN = 2;
+
+// テーブルに収まらない場合に、参照座標とゲインを作りながら処理する出力の行数
+constexpr int STRIP_ROWS = 64;
+
+// 1行分の参照座標の作業領域（thread_scratch の区別用）
+struct MappedXs;
+struct MappedYs;
+
+// テーブルの1画素あたりのバイト数（参照座標 CV_16SC2 + 補間係数 CV_16UC1、ゲイン CV_32FC1）
+constexpr size_t REMAP_BYTES_PER_PIXEL = 6;
+constexpr size_t GAIN_BYTES_PER_PIXEL = 4;
+
+bool same_remap(const GeometrySpec& a, const GeometrySpec& b) {
+    return a.frame == b.frame && a.crop == b.crop && a.origin == b.origin &&
+           a.distortion == b.distortion && a.rotation == b.rotation;
+}
+
+// ゲインはフレーム座標で決まるため origin には依存しない
+bool same_gain(const GeometrySpec& a, const GeometrySpec& b) {
+    return a.frame == b.frame && a.crop == b.crop && a.distortion == b.distortion &&
+           a.rotation == b.rotation && a.vignetting == b.vignetting;
+}
+
+/**
+ * 出力画素 → 入力画像上の参照座標
+ * 回転（warpAffine）の逆変換のあと、歪み補正（initUndistortRectifyMap と同じ
+ * k1 のみの放射歪みモデル）の逆写像をたどる
+ */
+class SourceMapping {
+public:
+    explicit SourceMapping(const GeometrySpec& spec)
+        : crop_(spec.crop),
+          origin_(spec.origin),
+          rotate_(spec.rotation != 0.0f),
+          distort_(spec.distortion != 0.0f),
+          k1_(spec.distortion / 1000.0),
+          fx_(spec.frame.width),
+          fy_(spec.frame.height),
+          cx_(spec.frame.width / 2.0),
+          cy_(spec.frame.height / 2.0) {
+        if (rotate_) {
+            cv::Point2f center(spec.frame.width / 2.0f, spec.frame.height / 2.0f);
+            cv::Mat rotation = cv::getRotationMatrix2D(center, spec.rotation, 1.0);
+            cv::Mat inverse;
+            cv::invertAffineTransform(rotation, inverse);
+            for (int i = 0; i < 6; ++i) {
+                inverse_[i] = inverse.at<double>(i / 3, i % 3);
+            }
+        }
+    }
+
+    /**
+     * 出力の1行分の参照座標（入力画像の座標）を計算
+     * @param y 出力の行
+     * @param xs 出力：x座標（クロップ幅分）
+     * @param ys 出力：y座標（クロップ幅分）
+     */
+    void row(int y, f32* xs, f32* ys) const {
+        for (int x = 0; x < crop_.width; ++x) {
+            point(x, y, xs[x], ys[x]);
+        }
+    }
+
+    /**
+     * 出力の1画素の参照座標を計算
+     * @param x, y 出力の位置
+     * @param sx, sy 出力：入力画像上の座標
+     */
+    void point(int x, int y, f32& sx, f32& sy) const {
+        double px = x + crop_.x;
+        double py = y + crop_.y;
+        if (rotate_) {
+            double rx = inverse_[0] * px + inverse_[1] * py + inverse_[2];
+            double ry = inverse_[3] * px + inverse_[4] * py + inverse_[5];
+            px = rx;
+            py = ry;
+        }
+        if (distort_) {
+            double nx = (px - cx_) / fx_;
+            double ny = (py - cy_) / fy_;
+            double k = 1.0 + k1_ * (nx * nx + ny * ny);
+            px = nx * k * fx_ + cx_;
+            py = ny * k * fy_ + cy_;
+        }
+        sx = static_cast<f32>(px - origin_.x);
+        sy = static_cast<f32>(py - origin_.y);
+    }
+
+private:
+    cv::Rect crop_;
+    cv::Point origin_;
+    bool rotate_;
+    bool distort_;
+    double k1_;
+    double fx_, fy_, cx_, cy_;
+    double inverse_[6] = {};
+};
+
+/**
+ * ビネットのゲイン（apply_vignette と同じく、補正前のフレーム中心からの距離で決める）
+ */
+class VignetteGain {
+public:
+    explicit VignetteGain(const GeometrySpec& spec)
+        : mapping_(frame_spec(spec)),
+          cx_(spec.frame.width / 2.0f),
+          cy_(spec.frame.height / 2.0f),
+          inv_max_dist_(1.0f / std::sqrt(cx_ * cx_ + cy_ * cy_)),
+          strength_(spec.vignetting / 100.0f) {
+    }
+
+    /**
+     * 出力の1行分のゲインを計算
+     * @param y 出力の行
+     * @param gain 出力：ゲイン（クロップ幅分）
+     * @param xs, ys 作業領域（クロップ幅分）
+     */
+    void row(int y, f32* gain, f32* xs, f32* ys, int width) const {
+        mapping_.row(y, xs, ys);
+        for (int x = 0; x < width; ++x) {
+            const f32 dx = xs[x] - cx_;
+            const f32 dy = ys[x] - cy_;
+            gain[x] = 1.0f + strength_ * (1.0f - std::sqrt(dx * dx + dy * dy) * inv_max_dist_);
+        }
+    }
+
+private:
+    // ゲインはフレーム座標で決まるため origin には依存しない
+    static GeometrySpec frame_spec(GeometrySpec spec) {
+        spec.origin = cv::Point(0, 0);
+        return spec;
+    }
+
+    SourceMapping mapping_;
+    f32 cx_, cy_;
+    f32 inv_max_dist_;
+    f32 strength_;
+};
+
+/**
+ * 出力の行 [y0, y1) の参照座標を remap 用の固定小数点形式で書き込む
+ * （convertMaps と同じ変換。float のテーブルを経由しない）
+ * @param map1 出力：参照座標の整数部 (CV_16SC2、y1 - y0 行)
+ * @param map2 出力：補間係数の番号 (CV_16UC1、y1 - y0 行)
+ */
+void fill_fixed_point_map(const SourceMapping& mapping, int y0, int y1, cv::Mat& map1, cv::Mat& map2) {
+    const int width = map1.cols;
+    f32* xs = thread_scratch<f32, MappedXs>(width);
+    f32* ys = thread_scratch<f32, MappedYs>(width);
+    for (int y = y0; y < y1; ++y) {
+        mapping.row(y, xs, ys);
+        short* coords = map1.ptr<short>(y - y0);
+        u16* fractions = map2.ptr<u16>(y - y0);
+        for (int x = 0; x < width; ++x) {
+            const int ix = cv::saturate_cast<int>(xs[x] * cv::INTER_TAB_SIZE);
+            const int iy = cv::saturate_cast<int>(ys[x] * cv::INTER_TAB_SIZE);
+            coords[x * 2 + 0] = cv::saturate_cast<short>(ix >> cv::INTER_BITS);
+            coords[x * 2 + 1] = cv::saturate_cast<short>(iy >> cv::INTER_BITS);
+            fractions[x] = static_cast<u16>((iy & (cv::INTER_TAB_SIZE - 1)) * cv::INTER_TAB_SIZE +
+                                            (ix & (cv::INTER_TAB_SIZE - 1)));
+        }
+    }
+}
+
+/**
+ * 出力の行 [y0, y1) のゲインを書き込む
+ * @param gain 出力：ゲイン (CV_32FC1、y1 - y0 行)
+ */
+void fill_gain(const VignetteGain& vignette, int y0, int y1, cv::Mat& gain) {
+    f32* xs = thread_scratch<f32, MappedXs>(gain.cols);
+    f32* ys = thread_scratch<f32, MappedYs>(gain.cols);
+    for (int y = y0; y < y1; ++y) {
+        vignette.row(y, gain.ptr<f32>(y - y0), xs, ys, gain.cols);
+    }
+}
+
+/**
+ * ゲインをその場で掛ける（整数型は1回の丸めで元の型に戻す）
+ */
+template<typename T>
+void multiply_gain_rows(cv::Mat& image, const cv::Mat& gain) {
+    const int channels = image.channels();
+    for (int y = 0; y < image.rows; ++y) {
+        T* row = image.ptr<T>(y);
+        const f32* g = gain.ptr<f32>(y);
+        for (int x = 0; x < image.cols; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                row[x * channels + c] = cv::saturate_cast<T>(row[x * channels + c] * g[x]);
+            }
+        }
+    }
+}
+
+void multiply_gain(cv::Mat& image, const cv::Mat& gain) {
+    const int depth = image.depth();
+    CV_Assert(depth == CV_8U || depth == CV_16U || depth == CV_32F);
+    if (depth == CV_8U) {
+        multiply_gain_rows<uchar>(image, gain);
+    } else if (depth == CV_16U) {
+        multiply_gain_rows<u16>(image, gain);
+    } else {
+        multiply_gain_rows<f32>(image, gain);
+    }
+}
+
+size_t mat_bytes(const cv::Mat& mat) {
+    return mat.total() * mat.elemSize();
+}
+
+} // namespace
+
+cv::Rect geometry_source_region(const GeometrySpec& spec) {
+    const cv::Rect frame(cv::Point(0, 0), spec.frame);
+    if (!spec.has_remap()) {
+        return spec.crop & frame;
+    }
+
+    GeometrySpec frame_spec = spec;
+    frame_spec.origin = cv::Point(0, 0);
+    const SourceMapping mapping(frame_spec);
+
+    // 写像は連続な単射なので、外接矩形はクロップ範囲の外周の像だけで決まる
+    f32 min_x = static_cast<f32>(spec.frame.width), min_y = static_cast<f32>(spec.frame.height);
+    f32 max_x = 0.0f, max_y = 0.0f;
+    auto extend = [&](const f32* xs, const f32* ys, int count) {
+        for (int i = 0; i < count; ++i) {
+            min_x = std::min(min_x, xs[i]);
+            min_y = std::min(min_y, ys[i]);
+            max_x = std::max(max_x, xs[i]);
+            max_y = std::max(max_y, ys[i]);
+        }
+    };
+
+    // 上下の辺は全画素、それ以外の行は左右端の2点だけを写像する（コストはクロップの周長に比例）
+    f32* xs = thread_scratch<f32, MappedXs>(spec.crop.width);
+    f32* ys = thread_scratch<f32, MappedYs>(spec.crop.width);
+    for (int y : {0, spec.crop.height - 1}) {
+        mapping.row(y, xs, ys);
+        extend(xs, ys, spec.crop.width);
+    }
+    for (int y = 1; y < spec.crop.height - 1; ++y) {
+        f32 ex[2], ey[2];
+        mapping.point(0, y, ex[0], ey[0]);
+        mapping.point(spec.crop.width - 1, y, ex[1], ey[1]);
+        extend(ex, ey, 2);
+    }
+    cv::Rect bounds(cv::Point(static_cast<int>(std::floor(min_x)) - INTERPOLATION_MARGIN,
+                              static_cast<int>(std::floor(min_y)) - INTERPOLATION_MARGIN),
+                    cv::Point(static_cast<int>(std::ceil(max_x)) + INTERPOLATION_MARGIN + 1,
+                              static_cast<int>(std::ceil(max_y)) + INTERPOLATION_MARGIN + 1));
+    bounds &= frame;
+    return bounds.empty() ? cv::Rect(0, 0, 1, 1) : bounds;
+}
+
+GeometryCache::GeometryCache(size_t memory_budget)
+    : memory_budget_(memory_budget),
+      access_clock_(0) {
+}
+
+cv::Mat GeometryCache::apply(const cv::Mat& image, const GeometrySpec& spec) {
+    if (image.empty() || spec.is_identity()) {
+        return image;
+    }
+    CV_Assert((cv::Rect(spec.origin, image.size()) & cv::Rect(cv::Point(0, 0), spec.frame)) ==
+              cv::Rect(spec.origin, image.size()));
+    TraceScope trace("geometry", static_cast<u64>(image.total()));
+
+    const bool vignette = spec.vignetting != 0.0f;
+    const size_t table_bytes = static_cast<size_t>(spec.crop.area()) *
+        ((spec.has_remap() ? REMAP_BYTES_PER_PIXEL : 0) + (vignette ? GAIN_BYTES_PER_PIXEL : 0));
+    if (table_bytes > memory_budget_) {
+        // フル解像度の書き出しなど、テーブルが予算に収まらない場合はキャッシュせず帯ごとに処理する
+        return apply_strips(image, spec);
+    }
+
+    cv::Mat result;
+    if (spec.has_remap()) {
+        // 歪み補正・回転・クロップを1回の補間で行う（出力はクロップ範囲のみ）
+        std::shared_ptr<const RemapTable> table = get_remap(spec);
+        cv::remap(image, result, table->map1, table->map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    } else {
+        CV_Assert((spec.crop & cv::Rect(spec.origin, image.size())) == spec.crop);
+        result = image(spec.crop - spec.origin).clone();
+    }
+
+    if (vignette) {
+        std::shared_ptr<const GainField> field = get_gain(spec);
+        cv::parallel_for_(cv::Range(0, result.rows), [&](const cv::Range& rows) {
+            cv::Mat block = result.rowRange(rows.start, rows.end);
+            multiply_gain(block, field->gain.rowRange(rows.start, rows.end));
+        }, std::max(1, result.rows / ROW_BLOCK));
+    }
+
+    return result;
+}
+
+cv::Mat GeometryCache::apply_strips(const cv::Mat& image, const GeometrySpec& spec) const {
+    cv::Mat result(spec.crop.size(), image.type());
+    const SourceMapping mapping(spec);
+    const VignetteGain vignette(spec);
+    const int strips = (result.rows + STRIP_ROWS - 1) / STRIP_ROWS;
+    if (!spec.has_remap()) {
+        CV_Assert((spec.crop & cv::Rect(spec.origin, image.size())) == spec.crop);
+    }
+
+    // 作業領域は並列数 × 帯1つ分に限られる。呼び出し元のスレッドでまとめて確保し
+    // （FramePoolScope の中ならプールから）、ワーカーでは Mat を確保しない
+    const int lanes = std::max(1, std::min(strips, cv::getNumThreads()));
+    cv::Mat map1, map2, gain;
+    if (spec.has_remap()) {
+        map1.create(lanes * STRIP_ROWS, result.cols, CV_16SC2);
+        map2.create(lanes * STRIP_ROWS, result.cols, CV_16UC1);
+    }
+    if (spec.vignetting != 0.0f) {
+        gain.create(lanes * STRIP_ROWS, result.cols, CV_32FC1);
+    }
+
+    // レーン lane は帯 lane, lane + lanes, ... を順に処理する
+    cv::parallel_for_(cv::Range(0, lanes), [&](const cv::Range& range) {
+        for (int lane = range.start; lane < range.end; ++lane) {
+            const int scratch = lane * STRIP_ROWS;
+            for (int strip = lane; strip < strips; strip += lanes) {
+                const int y0 = strip * STRIP_ROWS;
+                const int y1 = std::min(result.rows, y0 + STRIP_ROWS);
+                cv::Mat output = result.rowRange(y0, y1);
+
+                if (spec.has_remap()) {
+                    cv::Mat strip_map1 = map1.rowRange(scratch, scratch + y1 - y0);
+                    cv::Mat strip_map2 = map2.rowRange(scratch, scratch + y1 - y0);
+                    fill_fixed_point_map(mapping, y0, y1, strip_map1, strip_map2);
+                    cv::remap(image, output, strip_map1, strip_map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+                } else {
+                    const cv::Rect source(spec.crop.x - spec.origin.x, spec.crop.y - spec.origin.y + y0,
+                                          spec.crop.width, y1 - y0);
+                    image(source).copyTo(output);
+                }
+
+                if (spec.vignetting != 0.0f) {
+                    cv::Mat strip_gain = gain.rowRange(scratch, scratch + y1 - y0);
+                    fill_gain(vignette, y0, y1, strip_gain);
+                    multiply_gain(output, strip_gain);
+                }
+            }
+        }
+    }, lanes);
+
+    LOG_INFO(TAG, ("Geometry applied in strips: " + std::to_string(spec.crop.width) + "x" +
+                   std::to_string(spec.crop.height)).c_str());
+    return result;
+}
+
+void GeometryCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    remaps_.clear();
+    gains_.clear();
+}
+
+size_t GeometryCache::memory_usage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t total = 0;
+    for (const auto& entry : remaps_) {
+        total += mat_bytes(entry->map1) + mat_bytes(entry->map2);
+    }
+    for (const auto& entry : gains_) {
+        total += mat_bytes(entry->gain);
+    }
+    return total;
+}
+
+std::shared_ptr<const GeometryCache::RemapTable> GeometryCache::get_remap(const GeometrySpec& spec) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : remaps_) {
+            if (same_remap(entry->spec, spec)) {
+                entry->last_access = ++access_clock_;
+                return entry;
+            }
+        }
+    }
+
+    // テーブルの構築はロックの外で行う（同じキーを同時に構築した場合は後から来た方を捨てる）
+    auto table = std::make_shared<RemapTable>();
+    table->spec = spec;
+
+    // 固定小数点のテーブルの方が remap が速く、メモリも小さい（行ブロックごとに直接書き込む）
+    const SourceMapping mapping(spec);
+    table->map1.create(spec.crop.size(), CV_16SC2);
+    table->map2.create(spec.crop.size(), CV_16UC1);
+    cv::parallel_for_(cv::Range(0, spec.crop.height), [&](const cv::Range& rows) {
+        cv::Mat map1 = table->map1.rowRange(rows.start, rows.end);
+        cv::Mat map2 = table->map2.rowRange(rows.start, rows.end);
+        fill_fixed_point_map(mapping, rows.start, rows.end, map1, map2);
+    }, std::max(1, spec.crop.height / ROW_BLOCK));
+
+    LOG_INFO(TAG, ("Remap table built: " + std::to_string(spec.crop.width) + "x" +
+                   std::to_string(spec.crop.height)).c_str());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : remaps_) {
+        if (same_remap(entry->spec, spec)) {
+            entry->last_access = ++access_clock_;
+            return entry;
+        }
+    }
+    table->last_access = ++access_clock_;
+    remaps_.push_back(table);
+    enforce_budget();
+    return table;
+}
+
+std::shared_ptr<const GeometryCache::GainField> GeometryCache::get_gain(const GeometrySpec& spec) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : gains_) {
+            if (same_gain(entry->spec, spec)) {
+                entry->last_access = ++access_clock_;
+                return entry;
+            }
+        }
+    }
+
+    auto field = std::make_shared<GainField>();
+    field->spec = spec;
+
+    const VignetteGain vignette(spec);
+    field->gain.create(spec.crop.size(), CV_32FC1);
+    cv::parallel_for_(cv::Range(0, field->gain.rows), [&](const cv::Range& rows) {
+        cv::Mat gain = field->gain.rowRange(rows.start, rows.end);
+        fill_gain(vignette, rows.start, rows.end, gain);
+    }, std::max(1, field->gain.rows / ROW_BLOCK));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : gains_) {
+        if (same_gain(entry->spec, spec)) {
+            entry->last_access = ++access_clock_;
+            return entry;
+        }
+    }
+    field->last_access = ++access_clock_;
+    gains_.push_back(field);
+    enforce_budget();
+    return field;
+}
+
+void GeometryCache::enforce_budget() {
+    auto usage = [this] {
+        size_t total = 0;
+        for (const auto& entry : remaps_) {
+            total += mat_bytes(entry->map1) + mat_bytes(entry->map2);
+        }
+        for (const auto& entry : gains_) {
+            total += mat_bytes(entry->gain);
+        }
+        return total;
+    };
+
+    // 予算を超えるテーブルは apply_strips で処理するためここには来ないが、複数のテーブルの合計は予算を超えうる
+    while (!remaps_.empty() || !gains_.empty()) {
+        if (usage() <= memory_budget_ && remaps_.size() <= MAX_ENTRIES && gains_.size() <= MAX_ENTRIES) {
+            break;
+        }
+
+        auto oldest = [](const auto& entries) {
+            return std::min_element(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+                return a->last_access < b->last_access;
+            });
+        };
+        auto remap_victim = oldest(remaps_);
+        auto gain_victim = oldest(gains_);
+
+        const bool remap_over = remaps_.size() > MAX_ENTRIES;
+        const bool gain_over = gains_.size() > MAX_ENTRIES;
+        bool evict_remap;
+        if (remap_over != gain_over) {
+            evict_remap = remap_over;
+        } else if (remaps_.empty() || gains_.empty()) {
+            evict_remap = !remaps_.empty();
+        } else {
+            evict_remap = (*remap_victim)->last_access < (*gain_victim)->last_access;
+        }
+
+        if (evict_remap) {
+            remaps_.erase(remap_victim);
+        } else {
+            gains_.erase(gain_victim);
+        }
+    }
+}
+
+} // namespace raw_editor
@@ -0,0 +1,118 @@
+#ifndef GEOMETRY_CACHE_H
+#define GEOMETRY_CACHE_H
+
+#include "common_types.h"
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace raw_editor {
+
+/**
+ * 幾何補正の指定
+ * ビネット補正・レンズ歪み補正・回転・クロップをこの順に適用した結果を表す
+ */
+struct GeometrySpec {
+    cv::Size frame;      // フレーム全体のサイズ（回転後もこのサイズのフレームに収める）
+    cv::Rect crop;       // 出力範囲（回転後のフレーム座標）
+    cv::Point origin;    // 入力画像の左上のフレーム上の位置（フレームの一部だけを渡す場合）
+    f32 vignetting = 0.0f;
+    f32 distortion = 0.0f;
+    f32 rotation = 0.0f; // 度（反時計回り）
+
+    // 画素の移動を伴うか（伴わなければクロップ範囲の切り出しだけで済む）
+    bool has_remap() const { return distortion != 0.0f || rotation != 0.0f; }
+
+    bool is_identity() const {
+        return !has_remap() && vignetting == 0.0f && origin == cv::Point(0, 0) &&
+               crop == cv::Rect(cv::Point(0, 0), frame);
+    }
+};
+
+/**
+ * 出力（クロップ範囲）の生成に必要な入力側の領域を求める
+ * クロップ範囲の外周を回転・歪み補正の逆写像でたどった外接矩形に、
+ * 双線形補間の参照分の余白を加えてフレーム内に収めたもの。
+ * この領域（と前段の各処理のハロー）だけを現像・処理すれば出力は全体処理と一致する
+ * @param spec 幾何補正の指定（origin は無視される）
+ * @return フレーム座標の領域（参照がすべてフレーム外なら左上の1画素）
+ */
+cv::Rect geometry_source_region(const GeometrySpec& spec);
+
+/**
+ * 幾何補正キャッシュ
+ * 出力（クロップ範囲）の各画素について入力画像上の参照座標を一度だけ計算し、
+ * 歪み補正・回転・クロップを1回の remap にまとめる。
+ * 参照座標テーブルはフレームサイズ・クロップ・歪み・回転ごとに、
+ * ビネットのゲイン場はそれにビネット量を加えたキーごとにキャッシュする。
+ * ビネットは参照座標で評価したゲインを remap 後に掛ける（元画像に掛けてから補間するのと等価）。
+ * テーブルがメモリ予算に収まらない場合（フル解像度の書き出しなど）はキャッシュせず、
+ * 出力を帯に分けて参照座標・ゲインを帯ごとに作りながら処理する（作業領域は帯の大きさに限られる）。
+ */
+class GeometryCache {
+public:
+    // デフォルトのメモリ予算（プレビューサイズのテーブル数枚分）
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 64ull * 1024 * 1024;
+
+    // 種類ごとに保持するエントリ数の上限
+    static constexpr size_t MAX_ENTRIES = 4;
+
+    explicit GeometryCache(size_t memory_budget = DEFAULT_MEMORY_BUDGET);
+
+    /**
+     * 幾何補正を適用
+     * @param image 入力画像（spec.origin を左上とするフレームの一部、またはフレーム全体）
+     * @param spec 幾何補正の指定
+     * @return クロップ範囲の補正済み画像（入力と同じ型。ビネットは整数型でも1回の丸めで掛ける）
+     */
+    cv::Mat apply(const cv::Mat& image, const GeometrySpec& spec);
+
+    /**
+     * キャッシュを破棄
+     */
+    void clear();
+
+    /**
+     * キャッシュのメモリ使用量を取得
+     * @return 使用量（バイト）
+     */
+    size_t memory_usage() const;
+
+private:
+    struct RemapTable {
+        GeometrySpec spec;
+        cv::Mat map1; // 固定小数点の参照座標 (CV_16SC2)
+        cv::Mat map2; // 補間係数 (CV_16UC1)
+        u64 last_access = 0;
+    };
+
+    struct GainField {
+        GeometrySpec spec;
+        cv::Mat gain; // ビネットのゲイン (CV_32FC1)
+        u64 last_access = 0;
+    };
+
+    size_t memory_budget_;
+    u64 access_clock_;
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<RemapTable>> remaps_;
+    std::vector<std::shared_ptr<GainField>> gains_;
+
+    std::shared_ptr<const RemapTable> get_remap(const GeometrySpec& spec);
+    std::shared_ptr<const GainField> get_gain(const GeometrySpec& spec);
+
+    /**
+     * テーブルを作らずに、出力の帯ごとに参照座標・ゲインを計算して適用
+     */
+    cv::Mat apply_strips(const cv::Mat& image, const GeometrySpec& spec) const;
+
+    /**
+     * 予算と上限を超えた分をLRU順に破棄（ロック中に呼ぶこと）
+     */
+    void enforce_budget();
+};
+
+} // namespace raw_editor
+
+#endif // GEOMETRY_CACHE_H
@@ -0,0 +1,289 @@
+#ifndef HANDLE_TABLE_H
+#define HANDLE_TABLE_H
+
+#include "common_types.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace raw_editor {
+
+/**
+ * ロックフリーの世代付きハンドルテーブル
+ * ハンドルはスロット番号と世代番号の組で、破棄されたスロットを再利用しても
+ * 古いハンドルは世代が一致しないため無効として扱われる。
+ *
+ * 参照は acquire で参照カウントを増やしてから使う（Lease が自動で解放する）。
+ * destroy は生存フラグを下ろすだけで、その時点で使用中の参照があれば、
+ * 最後の参照が解放された時点でオブジェクトを削除する（使用中の解放は起きない）。
+ *
+ * スロットの状態は 64 ビットの原子変数1つにまとめてある：
+ *   上位32ビット = 世代、ビット31 = 生存フラグ、下位31ビット = 参照カウント
+ */
+template<typename T>
+class HandleTable {
+public:
+    // スロット数（ハンドルの下位ビットに入る）
+    static constexpr u32 INDEX_BITS = 12;
+    static constexpr u32 CAPACITY = 1u << INDEX_BITS;
+
+    /**
+     * 参照（スコープを抜けると参照カウントを戻す）
+     */
+    class Lease {
+    public:
+        Lease() : table_(nullptr), index_(0), object_(nullptr) {}
+        Lease(Lease&& other) noexcept
+            : table_(other.table_), index_(other.index_), object_(other.object_) {
+            other.object_ = nullptr;
+        }
+        Lease& operator=(Lease&& other) noexcept {
+            if (this != &other) {
+                reset();
+                table_ = other.table_;
+                index_ = other.index_;
+                object_ = other.object_;
+                other.object_ = nullptr;
+            }
+            return *this;
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() { reset(); }
+
+        T* get() const { return object_; }
+        T* operator->() const { return object_; }
+        T& operator*() const { return *object_; }
+        explicit operator bool() const { return object_ != nullptr; }
+
+        void reset() {
+            if (object_) {
+                object_ = nullptr;
+                table_->release(index_);
+            }
+        }
+
+    private:
+        friend class HandleTable;
+        Lease(HandleTable* table, u32 index, T* object)
+            : table_(table), index_(index), object_(object) {}
+
+        HandleTable* table_;
+        u32 index_;
+        T* object_;
+    };
+
+    HandleTable()
+        : slots_(new Slot[CAPACITY]),
+          high_water_(0),
+          free_head_(0) {
+    }
+
+    ~HandleTable() {
+        clear();
+    }
+
+    HandleTable(const HandleTable&) = delete;
+    HandleTable& operator=(const HandleTable&) = delete;
+
+    /**
+     * オブジェクトを登録
+     * @param object 登録するオブジェクト（所有権はテーブルへ移る）
+     * @return ハンドル（満杯の場合は 0、オブジェクトは破棄される）
+     */
+    int64_t insert(std::unique_ptr<T> object) {
+        u32 index;
+        if (!pop_free(index)) {
+            index = high_water_.fetch_add(1, std::memory_order_relaxed);
+            if (index >= CAPACITY) {
+                high_water_.fetch_sub(1, std::memory_order_relaxed);
+                return 0;
+            }
+        }
+
+        Slot& slot = slots_[index];
+        slot.object.store(object.release(), std::memory_order_relaxed);
+
+        // 生存フラグを立てた状態の公開（オブジェクトの書き込みより後に見えるよう release）
+        u64 generation = slot.state.load(std::memory_order_relaxed) >> 32;
+        slot.state.store((generation << 32) | ALIVE, std::memory_order_release);
+        return make_handle(index, static_cast<u32>(generation));
+    }
+
+    /**
+     * ハンドルから参照を取得
+     * @param handle ハンドル
+     * @return 参照（無効・破棄済みのハンドルなら空）
+     */
+    Lease acquire(int64_t handle) {
+        u32 index, generation;
+        if (!split_handle(handle, index, generation)) {
+            return Lease();
+        }
+        Slot& slot = slots_[index];
+        u64 state = slot.state.load(std::memory_order_acquire);
+        do {
+            if ((state >> 32) != generation || !(state & ALIVE)) {
+                return Lease();
+            }
+        } while (!slot.state.compare_exchange_weak(state, state + 1, std::memory_order_acquire,
+                                                   std::memory_order_acquire));
+        return Lease(this, index, slot.object.load(std::memory_order_relaxed));
+    }
+
+    /**
+     * ハンドルが生存しているか
+     * @param handle ハンドル
+     * @return destroy されていなければ true
+     */
+    bool is_alive(int64_t handle) const {
+        u32 index, generation;
+        if (!split_handle(handle, index, generation)) {
+            return false;
+        }
+        u64 state = slots_[index].state.load(std::memory_order_acquire);
+        return (state >> 32) == generation && (state & ALIVE);
+    }
+
+    /**
+     * ハンドルを破棄
+     * 使用中の参照があれば、最後の参照が解放された時点でオブジェクトを削除する
+     * @param handle ハンドル
+     * @return 生存していたハンドルを破棄した場合は true
+     */
+    bool destroy(int64_t handle) {
+        u32 index, generation;
+        if (!split_handle(handle, index, generation)) {
+            return false;
+        }
+        Slot& slot = slots_[index];
+        u64 state = slot.state.load(std::memory_order_acquire);
+        do {
+            if ((state >> 32) != generation || !(state & ALIVE)) {
+                return false;
+            }
+        } while (!slot.state.compare_exchange_weak(state, state & ~ALIVE, std::memory_order_acq_rel,
+                                                   std::memory_order_acquire));
+
+        if ((state & REFCOUNT_MASK) == 0) {
+            reclaim(index);
+        }
+        return true;
+    }
+
+    /**
+     * 生存しているすべてのオブジェクトに関数を適用
+     * @param fn 参照を受け取る関数
+     */
+    template<typename F>
+    void for_each(F&& fn) {
+        const u32 count = std::min(high_water_.load(std::memory_order_acquire), CAPACITY);
+        for (u32 index = 0; index < count; ++index) {
+            u64 state = slots_[index].state.load(std::memory_order_acquire);
+            if (state & ALIVE) {
+                Lease lease = acquire(make_handle(index, static_cast<u32>(state >> 32)));
+                if (lease) {
+                    fn(lease);
+                }
+            }
+        }
+    }
+
+    /**
+     * すべてのハンドルを破棄
+     */
+    void clear() {
+        const u32 count = std::min(high_water_.load(std::memory_order_acquire), CAPACITY);
+        for (u32 index = 0; index < count; ++index) {
+            u64 state = slots_[index].state.load(std::memory_order_acquire);
+            if (state & ALIVE) {
+                destroy(make_handle(index, static_cast<u32>(state >> 32)));
+            }
+        }
+    }
+
+private:
+    static constexpr u64 ALIVE = 1ull << 31;
+    static constexpr u64 REFCOUNT_MASK = ALIVE - 1;
+    static constexpr u32 NO_SLOT = 0;
+
+    struct Slot {
+        // 世代は1から始める（ハンドル 0 を無効値として使うため）
+        std::atomic<u64> state{1ull << 32};
+        std::atomic<T*> object{nullptr};
+        std::atomic<u32> next_free{NO_SLOT};
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<u32> high_water_;
+
+    // 空きスロットのスタック（上位32ビット = ABA対策のタグ、下位32ビット = スロット番号 + 1）
+    std::atomic<u64> free_head_;
+
+    static int64_t make_handle(u32 index, u32 generation) {
+        return (static_cast<int64_t>(generation) << INDEX_BITS) | index;
+    }
+
+    bool split_handle(int64_t handle, u32& index, u32& generation) const {
+        if (handle <= 0) {
+            return false;
+        }
+        const u64 high = static_cast<u64>(handle) >> INDEX_BITS;
+        if (high > 0xFFFFFFFFull) {
+            return false;
+        }
+        index = static_cast<u32>(handle & (CAPACITY - 1));
+        generation = static_cast<u32>(high);
+        return index < high_water_.load(std::memory_order_acquire);
+    }
+
+    void release(u32 index) {
+        u64 previous = slots_[index].state.fetch_sub(1, std::memory_order_acq_rel);
+        if ((previous & REFCOUNT_MASK) == 1 && !(previous & ALIVE)) {
+            // 破棄済みで最後の参照だった
+            reclaim(index);
+        }
+    }
+
+    void reclaim(u32 index) {
+        Slot& slot = slots_[index];
+        delete slot.object.exchange(nullptr, std::memory_order_acq_rel);
+
+        // 世代を進めて古いハンドルを無効化してから空きスタックへ戻す
+        u64 generation = (slot.state.load(std::memory_order_relaxed) >> 32) + 1;
+        if (generation > 0xFFFFFFFFull) {
+            generation = 1;
+        }
+        slot.state.store(generation << 32, std::memory_order_release);
+        push_free(index);
+    }
+
+    void push_free(u32 index) {
+        u64 head = free_head_.load(std::memory_order_relaxed);
+        u64 next;
+        do {
+            slots_[index].next_free.store(static_cast<u32>(head), std::memory_order_relaxed);
+            next = (((head >> 32) + 1) << 32) | (index + 1);
+        } while (!free_head_.compare_exchange_weak(head, next, std::memory_order_release,
+                                                   std::memory_order_relaxed));
+    }
+
+    bool pop_free(u32& index) {
+        u64 head = free_head_.load(std::memory_order_acquire);
+        u64 next;
+        do {
+            u32 top = static_cast<u32>(head);
+            if (top == NO_SLOT) {
+                return false;
+            }
+            index = top - 1;
+            next = (((head >> 32) + 1) << 32) | slots_[index].next_free.load(std::memory_order_relaxed);
+        } while (!free_head_.compare_exchange_weak(head, next, std::memory_order_acquire,
+                                                   std::memory_order_acquire));
+        return true;
+    }
+};
+
+} // namespace raw_editor
+
+#endif // HANDLE_TABLE_H
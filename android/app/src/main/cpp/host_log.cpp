@@ -0,0 +1,46 @@
+#include "common_types.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace raw_editor {
+
+namespace {
+
+int log_threshold() {
+    static const int threshold = [] {
+        const char* level = std::getenv("RAW_EDITOR_LOG");
+        if (level && std::strcmp(level, "debug") == 0) {
+            return static_cast<int>(HOST_LOG_DEBUG);
+        }
+        if (level && std::strcmp(level, "info") == 0) {
+            return static_cast<int>(HOST_LOG_INFO);
+        }
+        return static_cast<int>(HOST_LOG_ERROR);
+    }();
+    return threshold;
+}
+
+char priority_letter(int priority) {
+    switch (priority) {
+        case HOST_LOG_DEBUG: return 'D';
+        case HOST_LOG_INFO: return 'I';
+        default: return 'E';
+    }
+}
+
+} // namespace
+
+void host_log(int priority, const char* tag, const char* msg) {
+    if (priority < log_threshold()) {
+        return;
+    }
+    
+    // 複数スレッドからの出力が行の途中で混ざらないようにする
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::fprintf(stderr, "%c/%s: %s\n", priority_letter(priority), tag, msg);
+}
+
+} // namespace raw_editor
@@ -0,0 +1,215 @@
+#include "hsl_kernel.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace raw_editor {
+
+namespace {
+
+// HSLバンドの中心色相（度）
+constexpr f32 HSL_BAND_CENTERS[HSL_BAND_COUNT] = {
+    0.0f, 30.0f, 60.0f, 120.0f, 180.0f, 240.0f, 270.0f, 300.0f
+};
+
+constexpr f32 LUT_SCALE = HslKernel::LUT_SIZE / 360.0f;
+
+// 低彩度の画素ほど影響を弱める（彩度0.1で最大）
+constexpr f32 SATURATION_WEIGHT = 10.0f;
+
+// 並列処理の行ブロックサイズ
+constexpr int ROW_BLOCK = 32;
+
+inline f32 clamp01(f32 v) {
+    return std::min(1.0f, std::max(0.0f, v));
+}
+
+// 正の除数による剰余（結果は [0, m)）
+inline f32 wrap(f32 x, f32 m) {
+    return x - m * std::floor(x / m);
+}
+
+// 分岐のないHSV → RGB の1チャンネル（n = 5:R, 3:G, 1:B）
+inline f32 hsv_channel(f32 n, f32 h6, f32 s, f32 v) {
+    f32 k = wrap(n + h6, 6.0f);
+    return v - v * s * clamp01(std::min(k, 4.0f - k));
+}
+
+} // namespace
+
+HslKernel::HslKernel()
+    : active_(false) {
+}
+
+HslKernel::HslKernel(const f32 hue[HSL_BAND_COUNT], const f32 saturation[HSL_BAND_COUNT],
+                     const f32 luminance[HSL_BAND_COUNT])
+    : active_(false) {
+    for (int i = 0; i < HSL_BAND_COUNT; ++i) {
+        active_ = active_ || hue[i] != 0.0f || saturation[i] != 0.0f || luminance[i] != 0.0f;
+    }
+
+    // 隣接2バンドの調整値をスムーズステップで補間した値を色相ごとに求める
+    for (int i = 0; i < LUT_SIZE; ++i) {
+        f32 h = i / LUT_SCALE;
+
+        int band = HSL_BAND_COUNT - 1;
+        for (int j = 0; j < HSL_BAND_COUNT - 1; ++j) {
+            if (h < HSL_BAND_CENTERS[j + 1]) {
+                band = j;
+                break;
+            }
+        }
+        int next = (band + 1) % HSL_BAND_COUNT;
+        f32 end = band == HSL_BAND_COUNT - 1 ? 360.0f : HSL_BAND_CENTERS[next];
+        f32 t = (h - HSL_BAND_CENTERS[band]) / (end - HSL_BAND_CENTERS[band]);
+        t = t * t * (3.0f - 2.0f * t);
+
+        hue_lut_[i] = hue[band] + (hue[next] - hue[band]) * t;
+        saturation_lut_[i] = saturation[band] + (saturation[next] - saturation[band]) * t;
+        luminance_lut_[i] = luminance[band] + (luminance[next] - luminance[band]) * t;
+    }
+
+    // 360度は0度と同じ
+    hue_lut_[LUT_SIZE] = hue_lut_[0];
+    saturation_lut_[LUT_SIZE] = saturation_lut_[0];
+    luminance_lut_[LUT_SIZE] = luminance_lut_[0];
+}
+
+void HslKernel::apply_pixel(f32& b, f32& g, f32& r) const {
+    f32 v = std::max(b, std::max(g, r));
+    f32 mn = std::min(b, std::min(g, r));
+    f32 delta = v - mn;
+    if (delta <= 0.0f) {
+        return; // 無彩色は色相が定義されない
+    }
+
+    f32 s = delta / v;
+    f32 h;
+    if (v == r) {
+        h = 60.0f * (g - b) / delta;
+    } else if (v == g) {
+        h = 120.0f + 60.0f * (b - r) / delta;
+    } else {
+        h = 240.0f + 60.0f * (r - g) / delta;
+    }
+    if (h < 0.0f) h += 360.0f;
+
+    f32 pos = h * LUT_SCALE;
+    int index = std::max(0, std::min(LUT_SIZE - 1, static_cast<int>(std::floor(pos))));
+    f32 frac = pos - index;
+
+    f32 weight = std::min(1.0f, s * SATURATION_WEIGHT);
+    f32 hue_shift = weight * (hue_lut_[index] + (hue_lut_[index + 1] - hue_lut_[index]) * frac);
+    f32 sat_adj = weight * (saturation_lut_[index] + (saturation_lut_[index + 1] - saturation_lut_[index]) * frac);
+    f32 lum_adj = weight * (luminance_lut_[index] + (luminance_lut_[index + 1] - luminance_lut_[index]) * frac);
+
+    // 色相は全体を引き伸ばさず、1画素ずつ円環上で折り返す
+    f32 h6 = wrap(h + hue_shift, 360.0f) / 60.0f;
+    s = clamp01(s * (1.0f + sat_adj));
+    v = clamp01(v * (1.0f + lum_adj));
+
+    r = hsv_channel(5.0f, h6, s, v);
+    g = hsv_channel(3.0f, h6, s, v);
+    b = hsv_channel(1.0f, h6, s, v);
+}
+
+void HslKernel::apply_row(f32* bgr, int width) const {
+    if (!active_) {
+        return;
+    }
+
+    int x = 0;
+#if CV_SIMD128
+    using namespace cv;
+    const v_float32x4 zero = v_setzero_f32();
+    const v_float32x4 one = v_setall_f32(1.0f);
+    const v_float32x4 four = v_setall_f32(4.0f);
+    const v_float32x4 six = v_setall_f32(6.0f);
+    const v_float32x4 inv_six = v_setall_f32(1.0f / 6.0f);
+    const v_float32x4 v60 = v_setall_f32(60.0f);
+    const v_float32x4 v120 = v_setall_f32(120.0f);
+    const v_float32x4 v240 = v_setall_f32(240.0f);
+    const v_float32x4 v360 = v_setall_f32(360.0f);
+    const v_float32x4 inv_360 = v_setall_f32(1.0f / 360.0f);
+    const v_float32x4 inv_60 = v_setall_f32(1.0f / 60.0f);
+    const v_float32x4 lut_scale = v_setall_f32(LUT_SCALE);
+    const v_float32x4 sat_weight = v_setall_f32(SATURATION_WEIGHT);
+    const v_int32x4 index_min = v_setzero_s32();
+    const v_int32x4 index_max = v_setall_s32(LUT_SIZE - 1);
+    const v_int32x4 index_one = v_setall_s32(1);
+
+    // x - m * floor(x / m)
+    auto wrap4 = [](const v_float32x4& x, const v_float32x4& m, const v_float32x4& inv_m) {
+        return x - m * v_cvt_f32(v_floor(x * inv_m));
+    };
+    auto lerp_lut = [](const Lut& lut, const v_int32x4& i0, const v_int32x4& i1,
+                       const v_float32x4& frac) {
+        v_float32x4 a = v_lut(lut.data(), i0);
+        return a + (v_lut(lut.data(), i1) - a) * frac;
+    };
+    auto channel = [&](f32 n, const v_float32x4& h6, const v_float32x4& s, const v_float32x4& v) {
+        v_float32x4 k = wrap4(v_setall_f32(n) + h6, six, inv_six);
+        v_float32x4 w = v_min(one, v_max(zero, v_min(k, four - k)));
+        return v - v * s * w;
+    };
+
+    for (; x <= width - 4; x += 4) {
+        f32* px = bgr + x * 3;
+        v_float32x4 b, g, r;
+        v_load_deinterleave(px, b, g, r);
+
+        v_float32x4 v = v_max(b, v_max(g, r));
+        v_float32x4 delta = v - v_min(b, v_min(g, r));
+        v_float32x4 chromatic = delta > zero;
+
+        // 無彩色の画素は0除算を避け、最後に元の値へ戻す
+        v_float32x4 safe_delta = v_select(chromatic, delta, one);
+        v_float32x4 safe_v = v_select(chromatic, v, one);
+        v_float32x4 scale = v60 / safe_delta;
+
+        v_float32x4 h = v240 + (r - g) * scale;
+        h = v_select(v == g, v120 + (b - r) * scale, h);
+        h = v_select(v == r, (g - b) * scale, h);
+        h = v_select(h < zero, h + v360, h);
+        v_float32x4 s = delta / safe_v;
+
+        v_float32x4 pos = h * lut_scale;
+        v_int32x4 i0 = v_max(index_min, v_min(index_max, v_floor(pos)));
+        v_int32x4 i1 = i0 + index_one;
+        v_float32x4 frac = pos - v_cvt_f32(i0);
+
+        v_float32x4 weight = v_min(one, s * sat_weight);
+        v_float32x4 hue_shift = weight * lerp_lut(hue_lut_, i0, i1, frac);
+        v_float32x4 sat_adj = weight * lerp_lut(saturation_lut_, i0, i1, frac);
+        v_float32x4 lum_adj = weight * lerp_lut(luminance_lut_, i0, i1, frac);
+
+        v_float32x4 h6 = wrap4(h + hue_shift, v360, inv_360) * inv_60;
+        s = v_min(one, v_max(zero, s * (one + sat_adj)));
+        v = v_min(one, v_max(zero, v * (one + lum_adj)));
+
+        b = v_select(chromatic, channel(1.0f, h6, s, v), b);
+        g = v_select(chromatic, channel(3.0f, h6, s, v), g);
+        r = v_select(chromatic, channel(5.0f, h6, s, v), r);
+        v_store_interleave(px, b, g, r);
+    }
+#endif
+    for (; x < width; ++x) {
+        f32* px = bgr + x * 3;
+        apply_pixel(px[0], px[1], px[2]);
+    }
+}
+
+void HslKernel::apply(cv::Mat& image) const {
+    CV_Assert(image.type() == CV_32FC3);
+    if (!active_) {
+        return;
+    }
+
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& rows) {
+        for (int y = rows.start; y < rows.end; ++y) {
+            apply_row(image.ptr<f32>(y), image.cols);
+        }
+    }, std::max(1, image.rows / ROW_BLOCK));
+}
+
+} // namespace raw_editor
@@ -0,0 +1,72 @@
+#ifndef HSL_KERNEL_H
+#define HSL_KERNEL_H
+
+#include "common_types.h"
+#include <opencv2/opencv.hpp>
+#include <array>
+
+namespace raw_editor {
+
+// HSL調整の色相バンド数（赤・オレンジ・黄・緑・アクア・青・紫・マゼンタ）
+constexpr int HSL_BAND_COUNT = 8;
+
+/**
+ * HSLカーネル
+ * 8バンドの色相シフト・彩度・輝度調整を1回の走査でまとめて適用する。
+ * バンド間の重み（スムーズステップ補間）は色相ごとの1次元LUTに事前計算しておき、
+ * 画素ごとにはHSV変換・LUT参照・逆変換だけを行う（SIMD、端数はスカラー）。
+ */
+class HslKernel {
+public:
+    // LUTの分割数（0.5度刻み、参照時は線形補間）
+    static constexpr int LUT_SIZE = 720;
+
+    /**
+     * 無調整のカーネルを生成
+     */
+    HslKernel();
+
+    /**
+     * バンドごとの調整値からLUTを生成
+     * @param hue 色相シフト（度）
+     * @param saturation 彩度調整 [-1, 1]
+     * @param luminance 輝度調整 [-1, 1]
+     */
+    HslKernel(const f32 hue[HSL_BAND_COUNT], const f32 saturation[HSL_BAND_COUNT],
+              const f32 luminance[HSL_BAND_COUNT]);
+
+    /**
+     * 画像を変更するか
+     * @return 調整がひとつでもあれば true
+     */
+    bool is_active() const { return active_; }
+
+    /**
+     * 1行に適用
+     * @param bgr [0, 1]範囲のBGRインターリーブ行（その場で書き換える）
+     * @param width 画素数
+     */
+    void apply_row(f32* bgr, int width) const;
+
+    /**
+     * 画像全体に適用（行方向に並列化）
+     * @param image [0, 1]範囲のfloat画像 (CV_32FC3、その場で書き換える)
+     */
+    void apply(cv::Mat& image) const;
+
+private:
+    bool active_;
+
+    // 色相シフト・彩度・輝度のテーブル（線形補間用に末尾へ先頭と同じ1要素を追加）
+    // 固定長で持ち、プレビューごとのカーネル生成でヒープを使わない
+    using Lut = std::array<f32, LUT_SIZE + 1>;
+    Lut hue_lut_{};
+    Lut saturation_lut_{};
+    Lut luminance_lut_{};
+
+    void apply_pixel(f32& b, f32& g, f32& r) const;
+};
+
+} // namespace raw_editor
+
+#endif // HSL_KERNEL_H
@@ -0,0 +1,118 @@
+#include "incremental_pipeline.h"
+#include "trace.h"
+#include <cstring>
+
+namespace raw_editor {
+
+ParamFingerprint& ParamFingerprint::add(u64 value) {
+    for (int i = 0; i < 8; ++i) {
+        hash_ ^= (value >> (i * 8)) & 0xFF;
+        hash_ *= PRIME;
+    }
+    return *this;
+}
+
+ParamFingerprint& ParamFingerprint::add(f32 value) {
+    // -0.0 と 0.0 を同じ値として扱う
+    if (value == 0.0f) {
+        value = 0.0f;
+    }
+    u32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return add(static_cast<u64>(bits));
+}
+
+ParamFingerprint& ParamFingerprint::add(std::initializer_list<f32> values) {
+    for (f32 value : values) {
+        add(value);
+    }
+    return *this;
+}
+
+ParamFingerprint& ParamFingerprint::add(const void* data, size_t length) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < length; ++i) {
+        hash_ ^= bytes[i];
+        hash_ *= PRIME;
+    }
+    return *this;
+}
+
+ParamFingerprint& ParamFingerprint::add(const std::string& value) {
+    // 長さも加えて、連結した文字列同士が衝突しないようにする
+    add(static_cast<u64>(value.size()));
+    return add(value.data(), value.size());
+}
+
+IncrementalPipeline::IncrementalPipeline(std::vector<PipelineStage> stages)
+    : stages_(std::move(stages)),
+      caches_(stages_.size()),
+      last_first_dirty_(0) {
+}
+
+cv::Mat IncrementalPipeline::render(u64 source_key, const SourceFunction& make_source,
+                                    const AdjustmentParams& params, JobControl* job) {
+    if (!source_.valid || source_.key != source_key) {
+        source_.output = make_source();
+        source_.key = source_key;
+        source_.valid = !source_.output.empty();
+    }
+
+    cv::Mat current = source_.output;
+    u64 key = source_key;
+    last_first_dirty_ = stages_.size();
+
+    for (size_t i = 0; i < stages_.size(); ++i) {
+        const PipelineStage& stage = stages_[i];
+        StageCache& cache = caches_[i];
+
+        key = ParamFingerprint().add(key).add(static_cast<u64>(i)).add(stage.fingerprint(params)).value();
+
+        if (!stage.is_active(params)) {
+            // 恒等ステージは入力をそのまま渡す（キャッシュは不要なので解放する）
+            cache.valid = false;
+            cache.output.release();
+            continue;
+        }
+
+        if (cache.valid && cache.key == key) {
+            current = cache.output;
+            continue;
+        }
+
+        // 中止されても、実行済みのステージのキャッシュはそのキーに対して正しいまま残る
+        check_cancelled(job);
+        if (last_first_dirty_ == stages_.size()) {
+            last_first_dirty_ = i;
+        }
+        TraceScope trace(std::string("stage.") + stage.name, static_cast<u64>(current.total()));
+        current = stage.run(current, params);
+        trace.add_bytes(static_cast<u64>(current.total() * current.elemSize()));
+        cache.output = current;
+        cache.key = key;
+        cache.valid = true;
+        
+        if (job) {
+            job->report(i + 1, stages_.size());
+        }
+    }
+
+    return current;
+}
+
+void IncrementalPipeline::invalidate() {
+    source_ = StageCache();
+    for (auto& cache : caches_) {
+        cache = StageCache();
+    }
+}
+
+size_t IncrementalPipeline::memory_usage() const {
+    size_t total = source_.output.total() * source_.output.elemSize();
+    for (const auto& cache : caches_) {
+        total += cache.output.total() * cache.output.elemSize();
+    }
+    return total;
+}
+
+} // namespace raw_editor
@@ -0,0 +1,110 @@
+#ifndef INCREMENTAL_PIPELINE_H
+#define INCREMENTAL_PIPELINE_H
+
+#include "common_types.h"
+#include "job_control.h"
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace raw_editor {
+
+/**
+ * パラメータのフィンガープリント（FNV-1a）
+ * ステージが読むパラメータだけを順に加えてハッシュ値を作る
+ * （ファイル内容などのバイト列のハッシュにも使う）
+ */
+class ParamFingerprint {
+public:
+    ParamFingerprint() : hash_(OFFSET_BASIS) {}
+
+    ParamFingerprint& add(u64 value);
+    ParamFingerprint& add(f32 value);
+    ParamFingerprint& add(std::initializer_list<f32> values);
+    ParamFingerprint& add(const void* data, size_t length);
+    ParamFingerprint& add(const std::string& value);
+
+    u64 value() const { return hash_; }
+
+private:
+    static constexpr u64 OFFSET_BASIS = 14695981039346656037ull;
+    static constexpr u64 PRIME = 1099511628211ull;
+
+    u64 hash_;
+};
+
+/**
+ * パイプラインのステージ定義
+ */
+struct PipelineStage {
+    std::string name;
+
+    // ステージが読むパラメータのフィンガープリント
+    std::function<u64(const AdjustmentParams&)> fingerprint;
+
+    // ステージが画像を変更するか（false なら入力をそのまま次へ渡し、キャッシュもしない）
+    std::function<bool(const AdjustmentParams&)> is_active;
+
+    // ステージ本体（入力は書き換えずに新しい画像を返すこと）
+    std::function<cv::Mat(const cv::Mat&, const AdjustmentParams&)> run;
+};
+
+/**
+ * 増分パイプライン
+ * ステージごとに出力をキャッシュし、キーには入力のキーと自分が読むパラメータの
+ * フィンガープリントを連鎖させたものを使う。
+ * パラメータが変わると、そのパラメータを読む最初のステージ以降だけが再実行される。
+ */
+class IncrementalPipeline {
+public:
+    using SourceFunction = std::function<cv::Mat()>;
+
+    explicit IncrementalPipeline(std::vector<PipelineStage> stages = {});
+
+    /**
+     * パイプラインを実行
+     * 返される画像はキャッシュとバッファを共有するため、呼び出し側で書き換えないこと
+     * @param source_key 入力画像の識別キー
+     * @param make_source 入力画像を生成する関数（キーが変わったときだけ呼ばれる）
+     * @param params 調整パラメータ
+     * @param job 中止要求・進捗の報告先（各ステージの実行前に中止を確認する、nullptr = なし）
+     * @return 最終ステージの出力
+     */
+    cv::Mat render(u64 source_key, const SourceFunction& make_source, const AdjustmentParams& params,
+                   JobControl* job = nullptr);
+
+    /**
+     * すべてのキャッシュを破棄
+     */
+    void invalidate();
+
+    /**
+     * 直前の render で最初に再実行されたステージ
+     * @return ステージ番号（すべてキャッシュから得た場合はステージ数）
+     */
+    size_t last_first_dirty_stage() const { return last_first_dirty_; }
+
+    /**
+     * キャッシュのメモリ使用量を取得
+     * @return 使用量（バイト）
+     */
+    size_t memory_usage() const;
+
+private:
+    struct StageCache {
+        u64 key = 0;
+        bool valid = false;
+        cv::Mat output;
+    };
+
+    std::vector<PipelineStage> stages_;
+    StageCache source_;
+    std::vector<StageCache> caches_;
+    size_t last_first_dirty_;
+};
+
+} // namespace raw_editor
+
+#endif // INCREMENTAL_PIPELINE_H
@@ -0,0 +1,104 @@
+#ifndef JOB_CONTROL_H
+#define JOB_CONTROL_H
+
+#include "common_types.h"
+#include <atomic>
+#include <exception>
+
+namespace raw_editor {
+
+/**
+ * ジョブの中止を伝える例外
+ * 処理の途中（ステージ間・タイル内）で中止を確認した箇所から送出し、
+ * 呼び出し元で ResultCode::ERROR_CANCELLED に変換する
+ */
+class JobCancelled : public std::exception {
+public:
+    const char* what() const noexcept override { return "Job cancelled"; }
+};
+
+/**
+ * 非同期ジョブの中止要求と進捗
+ * 中止は協調的で、処理側が check() を呼んだ時点で JobCancelled が送出される。
+ * 進捗は処理全体を区間（フェーズ）に分け、フェーズ内の完了数から求める。
+ * 進捗は単調増加で、複数のスレッドから報告してよい。
+ * 親を指定すると、親が中止された場合も中止されたものとして扱う（ジョブ内の個別の処理用）。
+ */
+class JobControl {
+public:
+    explicit JobControl(const JobControl* parent = nullptr)
+        : parent_(parent), cancelled_(false), progress_(0.0f), phase_start_(0.0f), phase_end_(1.0f) {}
+
+    JobControl(const JobControl&) = delete;
+    JobControl& operator=(const JobControl&) = delete;
+
+    void cancel() { cancelled_.store(true, std::memory_order_release); }
+    bool is_cancelled() const {
+        return cancelled_.load(std::memory_order_acquire) || (parent_ && parent_->is_cancelled());
+    }
+
+    /**
+     * 中止されていれば JobCancelled を送出
+     */
+    void check() const {
+        if (is_cancelled()) {
+            throw JobCancelled();
+        }
+    }
+
+    /**
+     * 次のフェーズの進捗範囲を設定（並列処理を始める前に呼ぶこと）
+     * @param start フェーズ開始時の進捗
+     * @param end フェーズ終了時の進捗
+     */
+    void begin_phase(f32 start, f32 end) {
+        phase_start_ = start;
+        phase_end_ = end;
+        set_progress(start);
+    }
+
+    /**
+     * フェーズ内の完了数を報告
+     * @param done 完了した単位数
+     * @param total 単位数
+     */
+    void report(size_t done, size_t total) {
+        if (total > 0) {
+            set_progress(phase_start_ + (phase_end_ - phase_start_) * static_cast<f32>(done) / total);
+        }
+    }
+
+    /**
+     * 進捗を設定（現在より小さい値は無視される）
+     * @param value 進捗 (0〜1)
+     */
+    void set_progress(f32 value) {
+        f32 current = progress_.load(std::memory_order_relaxed);
+        while (value > current &&
+               !progress_.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    f32 progress() const { return progress_.load(std::memory_order_relaxed); }
+
+private:
+    const JobControl* parent_;
+    std::atomic<bool> cancelled_;
+    std::atomic<f32> progress_;
+    f32 phase_start_;
+    f32 phase_end_;
+};
+
+/**
+ * ジョブが指定されていれば中止を確認
+ * @param job ジョブ（nullptr = 同期呼び出しなので何もしない）
+ */
+inline void check_cancelled(const JobControl* job) {
+    if (job) {
+        job->check();
+    }
+}
+
+} // namespace raw_editor
+
+#endif // JOB_CONTROL_H
@@ -0,0 +1,218 @@
+#include "job_scheduler.h"
+#include <algorithm>
+
+namespace raw_editor {
+
+static const char* TAG = "JobScheduler";
+
+JobScheduler::JobScheduler(u32 worker_count)
+    : worker_count_(std::max(1u, worker_count)),
+      next_id_(1),
+      stopping_(false) {
+}
+
+JobScheduler::~JobScheduler() {
+    shutdown();
+}
+
+u64 JobScheduler::submit(int64_t owner, bool supersede, JobFunction work) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+        return 0;
+    }
+
+    // 古いプレビューは新しいパラメータの結果で置き換わるため、待たずに中止する
+    if (supersede) {
+        std::vector<std::shared_ptr<Job>> superseded;
+        for (const auto& item : jobs_) {
+            const Job& job = *item.second;
+            if (job.owner == owner && job.supersedable && job.state != JobState::FINISHED) {
+                superseded.push_back(item.second);
+            }
+        }
+        for (const auto& job : superseded) {
+            cancel_locked(*job);
+        }
+    }
+
+    auto job = std::make_shared<Job>();
+    job->id = next_id_++;
+    job->owner = owner;
+    job->supersedable = supersede;
+    job->work = std::move(work);
+    jobs_[job->id] = job;
+    queue_.push_back(job);
+
+    if (workers_.empty()) {
+        workers_.reserve(worker_count_);
+        for (u32 i = 0; i < worker_count_; ++i) {
+            workers_.emplace_back([this]() { worker_loop(); });
+        }
+        LOG_INFO(TAG, ("Job scheduler started with " + std::to_string(worker_count_) + " workers").c_str());
+    }
+
+    wake_.notify_one();
+    return job->id;
+}
+
+bool JobScheduler::cancel(u64 id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end() || it->second->state == JobState::FINISHED) {
+        return false;
+    }
+    cancel_locked(*it->second);
+    return true;
+}
+
+void JobScheduler::cancel_owner(int64_t owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::shared_ptr<Job>> owned;
+    for (const auto& item : jobs_) {
+        if (item.second->owner == owner && item.second->state != JobState::FINISHED) {
+            owned.push_back(item.second);
+        }
+    }
+    for (const auto& job : owned) {
+        cancel_locked(*job);
+    }
+}
+
+void JobScheduler::cancel_all() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::shared_ptr<Job>> pending;
+    for (const auto& item : jobs_) {
+        if (item.second->state != JobState::FINISHED) {
+            pending.push_back(item.second);
+        }
+    }
+    for (const auto& job : pending) {
+        cancel_locked(*job);
+    }
+}
+
+bool JobScheduler::poll(u64 id, JobStatus& status) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) {
+        return false;
+    }
+
+    Job& job = *it->second;
+    status.state = job.state;
+    status.progress = job.state == JobState::FINISHED ? 1.0f : job.control.progress();
+    if (job.state == JobState::FINISHED) {
+        status.result = std::move(job.result);
+        jobs_.erase(it);
+    }
+    return true;
+}
+
+void JobScheduler::release(u64 id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) {
+        return;
+    }
+
+    std::shared_ptr<Job> job = it->second;
+    if (job->state == JobState::FINISHED) {
+        jobs_.erase(it);
+        return;
+    }
+    job->released = true;
+    cancel_locked(*job);
+}
+
+void JobScheduler::detach(u64 id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) {
+        return;
+    }
+
+    if (it->second->state == JobState::FINISHED) {
+        jobs_.erase(it);
+    } else {
+        it->second->released = true;
+    }
+}
+
+void JobScheduler::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    cancel_all();
+    wake_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void JobScheduler::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+
+        std::shared_ptr<Job> job = queue_.front();
+        queue_.pop_front();
+        job->state = JobState::RUNNING;
+
+        // ジョブ本体はロックの外で実行する（中止・poll は実行中も受け付ける）
+        lock.unlock();
+        ImageResult result;
+        try {
+            result = job->work(job->control);
+        } catch (const JobCancelled&) {
+            result = ImageResult(ResultCode::ERROR_CANCELLED, std::string("Cancelled"));
+        } catch (const std::exception& e) {
+            std::string error = "Job failed: " + std::string(e.what());
+            LOG_ERROR(TAG, error.c_str());
+            result = ImageResult(ResultCode::ERROR_PROCESSING_FAILED, error);
+        }
+        lock.lock();
+
+        // 中止が要求されていれば、処理が最後まで進んでいても結果は使わない
+        if (job->control.is_cancelled() && result.is_success()) {
+            result = ImageResult(ResultCode::ERROR_CANCELLED, std::string("Cancelled"));
+        }
+        finish_locked(*job, std::move(result));
+    }
+}
+
+void JobScheduler::cancel_locked(Job& job) {
+    job.control.cancel();
+    if (job.state != JobState::QUEUED) {
+        return;
+    }
+
+    auto it = std::find_if(queue_.begin(), queue_.end(),
+                           [&](const std::shared_ptr<Job>& queued) { return queued.get() == &job; });
+    if (it != queue_.end()) {
+        queue_.erase(it);
+    }
+    finish_locked(job, ImageResult(ResultCode::ERROR_CANCELLED, std::string("Cancelled")));
+}
+
+void JobScheduler::finish_locked(Job& job, ImageResult result) {
+    job.state = JobState::FINISHED;
+    job.work = nullptr;
+    if (job.released) {
+        const u64 id = job.id;
+        jobs_.erase(id);
+        return;
+    }
+    job.result = std::move(result);
+}
+
+} // namespace raw_editor
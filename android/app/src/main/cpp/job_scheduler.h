@@ -0,0 +1,149 @@
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include "common_types.h"
+#include "job_control.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace raw_editor {
+
+/**
+ * ジョブの状態
+ */
+enum class JobState {
+    QUEUED = 0,
+    RUNNING = 1,
+    FINISHED = 2
+};
+
+/**
+ * ジョブの状態と結果
+ */
+struct JobStatus {
+    JobState state = JobState::QUEUED;
+    f32 progress = 0.0f;
+    ImageResult result;     // FINISHED のときのみ有効（中止・置き換え時は ERROR_CANCELLED）
+};
+
+/**
+ * 非同期ジョブスケジューラ
+ * プレビュー生成や書き出しを固定数のワーカースレッドで実行し、呼び出し側はジョブIDで
+ * 進捗と結果をブロックせずに poll する。
+ * 中止は JobControl を通じた協調的なもので、実行中のジョブは次の確認箇所で打ち切られる。
+ * 置き換え可能なジョブ（プレビュー）は、同じ所有者の新しい置き換え可能なジョブが投入されると
+ * 待機中なら即座に、実行中なら次の確認箇所で中止される。
+ */
+class JobScheduler {
+public:
+    using JobFunction = std::function<ImageResult(JobControl&)>;
+
+    // 既定のワーカー数（同時に実行するジョブ数。ジョブ内のタイル処理は別のプールで並列化される）
+    static constexpr u32 DEFAULT_WORKER_COUNT = 2;
+
+    explicit JobScheduler(u32 worker_count = DEFAULT_WORKER_COUNT);
+    ~JobScheduler();
+
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    /**
+     * ジョブを投入（ワーカーは最初の投入時に起動する）
+     * @param owner 所有者（プロセッサーハンドルなど）
+     * @param supersede true なら置き換え可能なジョブとして投入し、同じ所有者の置き換え可能なジョブを中止する
+     * @param work ジョブ本体
+     * @return ジョブID（停止済みなら 0）
+     */
+    u64 submit(int64_t owner, bool supersede, JobFunction work);
+
+    /**
+     * ジョブを中止
+     * @param id ジョブID
+     * @return 未完了のジョブに中止を要求した場合は true
+     */
+    bool cancel(u64 id);
+
+    /**
+     * 所有者のジョブをすべて中止
+     * @param owner 所有者
+     */
+    void cancel_owner(int64_t owner);
+
+    /**
+     * すべてのジョブを中止
+     */
+    void cancel_all();
+
+    /**
+     * ジョブの状態を取得（ブロックしない）
+     * 完了したジョブは結果を返した時点で記録から削除される
+     * @param id ジョブID
+     * @param status 状態の格納先
+     * @return 記録のあるジョブなら true
+     */
+    bool poll(u64 id, JobStatus& status);
+
+    /**
+     * ジョブの結果を受け取らないことを通知
+     * 未完了なら中止し、完了時に結果を破棄する
+     * @param id ジョブID
+     */
+    void release(u64 id);
+
+    /**
+     * ジョブを中止せずに切り離す（完了時に結果を破棄する）
+     * 結果を別の経路で受け渡すジョブに使う
+     * @param id ジョブID
+     */
+    void detach(u64 id);
+
+    /**
+     * すべてのジョブを中止し、ワーカーの終了を待つ
+     */
+    void shutdown();
+
+private:
+    struct Job {
+        u64 id = 0;
+        int64_t owner = 0;
+        bool supersedable = false;
+        bool released = false;
+        JobState state = JobState::QUEUED;
+        JobFunction work;
+        JobControl control;
+        ImageResult result;
+    };
+
+    const u32 worker_count_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::shared_ptr<Job>> queue_;
+    std::unordered_map<u64, std::shared_ptr<Job>> jobs_;
+    std::vector<std::thread> workers_;
+    u64 next_id_;
+    bool stopping_;
+
+    void worker_loop();
+
+    /**
+     * ジョブを中止（ロック中に呼ぶこと）
+     * 待機中のジョブはキューから外して完了扱いにする
+     */
+    void cancel_locked(Job& job);
+
+    /**
+     * ジョブを完了させる（ロック中に呼ぶこと）
+     */
+    void finish_locked(Job& job, ImageResult result);
+};
+
+} // namespace raw_editor
+
+#endif // JOB_SCHEDULER_H
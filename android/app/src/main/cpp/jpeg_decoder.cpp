@@ -0,0 +1,98 @@
+#include "jpeg_decoder.h"
+#include "trace.h"
+#include <algorithm>
+#include <csetjmp>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+namespace raw_editor {
+
+static const char* TAG = "JpegDecoder";
+
+namespace {
+
+/**
+ * libjpeg のエラーを longjmp で呼び出し元へ戻すためのエラーマネージャ
+ */
+struct JpegErrorManager {
+    jpeg_error_mgr base;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+void jpeg_error_exit(j_common_ptr cinfo) {
+    JpegErrorManager* error = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, error->message);
+    longjmp(error->jump, 1);
+}
+
+/**
+ * デコード状態
+ * setjmp をまたいでデストラクタが飛ばされないよう、longjmp 後に参照する値はすべてここに置く
+ */
+struct Decoder {
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager error;
+    cv::Mat image;
+};
+
+} // namespace
+
+u32 select_jpeg_scale_denom(u32 width, u32 height, u32 max_size) {
+    const u32 long_edge = std::max(width, height);
+    if (max_size == 0 || long_edge == 0) {
+        return 1;
+    }
+
+    u32 denom = 1;
+    while (denom < 8 && (long_edge + denom * 2 - 1) / (denom * 2) >= max_size) {
+        denom *= 2;
+    }
+    return denom;
+}
+
+cv::Mat decode_jpeg_scaled(const byte* data, size_t length, u32 max_size) {
+    if (!data || length == 0) {
+        return cv::Mat();
+    }
+    TraceScope trace("decode.jpeg");
+
+    Decoder decoder;
+    jpeg_decompress_struct& cinfo = decoder.cinfo;
+    cinfo.err = jpeg_std_error(&decoder.error.base);
+    decoder.error.base.error_exit = jpeg_error_exit;
+    if (setjmp(decoder.error.jump)) {
+        LOG_ERROR(TAG, ("JPEG decode failed: " + std::string(decoder.error.message)).c_str());
+        jpeg_destroy_decompress(&cinfo);
+        return cv::Mat();
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data), static_cast<unsigned long>(length));
+    jpeg_read_header(&cinfo, TRUE);
+
+    // IDCT で縮小し、libjpeg-turbo の拡張色空間で BGR を直接出力する
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = select_jpeg_scale_denom(cinfo.image_width, cinfo.image_height, max_size);
+    cinfo.out_color_space = JCS_EXT_BGR;
+    cinfo.dct_method = JDCT_IFAST;
+    jpeg_start_decompress(&cinfo);
+
+    decoder.image.create(static_cast<int>(cinfo.output_height), static_cast<int>(cinfo.output_width), CV_8UC3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = decoder.image.ptr<JSAMPLE>(static_cast<int>(cinfo.output_scanline));
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+    const unsigned int denom = cinfo.scale_denom;
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    LOG_INFO(TAG, ("Decoded JPEG at 1/" + std::to_string(denom) + ": " +
+                   std::to_string(decoder.image.cols) + "x" + std::to_string(decoder.image.rows)).c_str());
+    return decoder.image;
+}
+
+} // namespace raw_editor
@@ -0,0 +1,33 @@
+#ifndef JPEG_DECODER_H
+#define JPEG_DECODER_H
+
+#include "common_types.h"
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+
+namespace raw_editor {
+
+/**
+ * JPEGの縮小デコード率を選択
+ * 長辺が max_size を下回らない範囲で最も小さい 1/1, 1/2, 1/4, 1/8 を選ぶ
+ * @param width 元画像の幅
+ * @param height 元画像の高さ
+ * @param max_size 必要な長辺のサイズ (0 = 縮小しない)
+ * @return 分母 (1, 2, 4, 8)
+ */
+u32 select_jpeg_scale_denom(u32 width, u32 height, u32 max_size);
+
+/**
+ * JPEGをDCT領域で縮小しながらデコード
+ * 縮小率は IDCT の段階で適用されるため、フルサイズの画素は一度も展開されない。
+ * 埋め込みプレビューからサムネイルを作る場合、デコード量は 1/16〜1/64 になる
+ * @param data JPEGデータ
+ * @param length データ長（バイト）
+ * @param max_size 必要な長辺のサイズ（出力はこれ以上・2倍未満の長辺になる）
+ * @return 8ビットBGR画像（失敗時は空）
+ */
+cv::Mat decode_jpeg_scaled(const byte* data, size_t length, u32 max_size);
+
+} // namespace raw_editor
+
+#endif // JPEG_DECODER_H
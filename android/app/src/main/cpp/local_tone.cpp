@@ -0,0 +1,108 @@
+#include "local_tone.h"
+#include "frame_pool.h"
+#include <cmath>
+
+namespace raw_editor {
+
+ToneBaseLayer::ToneBaseLayer(const cv::Mat& plane, cv::Size frame_size)
+    : frame_size_(frame_size) {
+    CV_Assert(plane.type() == CV_32F && !plane.empty());
+
+    // 自己ガイドのガイデッドフィルタ: 窓ごとに q = a * I + b を最小二乗で当てはめる
+    // 分散が EPSILON より十分大きい窓（エッジ）では a ≈ 1 となり入力がそのまま残る
+    const cv::Size window(RADIUS * 2 + 1, RADIUS * 2 + 1);
+    cv::Mat mean, mean_square;
+    cv::boxFilter(plane, mean, CV_32F, window);
+    cv::boxFilter(plane.mul(plane), mean_square, CV_32F, window);
+
+    cv::Mat variance = mean_square - mean.mul(mean);
+    cv::Mat a, b;
+    cv::divide(variance, variance + EPSILON, a);
+    b = mean - a.mul(mean);
+
+    // 各画素を含むすべての窓の係数を平均する
+    cv::boxFilter(a, coeff_a_, CV_32F, window);
+    cv::boxFilter(b, coeff_b_, CV_32F, window);
+}
+
+ToneBaseLayer ToneBaseLayer::from_luminance(const cv::Mat& luminance) {
+    cv::Mat plane;
+    cv::resize(luminance, plane, plane_size(luminance.size()), 0, 0, plane_interpolation(luminance.size()));
+    return ToneBaseLayer(plane, luminance.size());
+}
+
+cv::Size ToneBaseLayer::plane_size(cv::Size frame_size) {
+    const double scale = static_cast<double>(PLANE_LONG_SIDE) / std::max(1, std::max(frame_size.width, frame_size.height));
+    return cv::Size(std::max(1, static_cast<int>(std::lround(frame_size.width * scale))),
+                    std::max(1, static_cast<int>(std::lround(frame_size.height * scale))));
+}
+
+int ToneBaseLayer::plane_interpolation(cv::Size frame_size) {
+    return std::max(frame_size.width, frame_size.height) > PLANE_LONG_SIDE ? cv::INTER_AREA : cv::INTER_LINEAR;
+}
+
+void ToneBaseLayer::sample_row(int y, int x0, int width, f32* a, f32* b) const {
+    const f32 scale_x = static_cast<f32>(coeff_a_.cols) / frame_size_.width;
+    const f32 scale_y = static_cast<f32>(coeff_a_.rows) / frame_size_.height;
+    const int last_x = coeff_a_.cols - 1;
+    const int last_y = coeff_a_.rows - 1;
+
+    // 画素中心を合わせて縮小平面上の位置に写す
+    const f32 v = std::min(static_cast<f32>(last_y), std::max(0.0f, (y + 0.5f) * scale_y - 0.5f));
+    const int v0 = static_cast<int>(v);
+    const int v1 = std::min(v0 + 1, last_y);
+    const f32 wy = v - v0;
+
+    const f32* a0 = coeff_a_.ptr<f32>(v0);
+    const f32* a1 = coeff_a_.ptr<f32>(v1);
+    const f32* b0 = coeff_b_.ptr<f32>(v0);
+    const f32* b1 = coeff_b_.ptr<f32>(v1);
+
+    for (int x = 0; x < width; ++x) {
+        const f32 u = std::min(static_cast<f32>(last_x), std::max(0.0f, (x0 + x + 0.5f) * scale_x - 0.5f));
+        const int u0 = static_cast<int>(u);
+        const int u1 = std::min(u0 + 1, last_x);
+        const f32 wx = u - u0;
+
+        const f32 a_top = a0[u0] + (a0[u1] - a0[u0]) * wx;
+        const f32 a_bottom = a1[u0] + (a1[u1] - a1[u0]) * wx;
+        const f32 b_top = b0[u0] + (b0[u1] - b0[u0]) * wx;
+        const f32 b_bottom = b1[u0] + (b1[u1] - b1[u0]) * wx;
+        a[x] = a_top + (a_bottom - a_top) * wy;
+        b[x] = b_top + (b_bottom - b_top) * wy;
+    }
+}
+
+namespace {
+
+// ベースレイヤーの係数の作業領域（thread_scratch の区別用）
+struct CoeffA;
+struct CoeffB;
+
+} // namespace
+
+void apply_local_tone(cv::Mat& image, const cv::Mat& luminance, const ToneBaseLayer& base,
+                      f32 highlight_delta, f32 shadow_delta, f32 clarity_amount) {
+    CV_Assert(image.type() == CV_32FC3 && luminance.type() == CV_32F && image.size() == luminance.size());
+
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& rows) {
+        f32* coeff_a = thread_scratch<f32, CoeffA>(image.cols);
+        f32* coeff_b = thread_scratch<f32, CoeffB>(image.cols);
+        for (int y = rows.start; y < rows.end; ++y) {
+            base.sample_row(y, 0, image.cols, coeff_a, coeff_b);
+            f32* row = image.ptr<f32>(y);
+            const f32* lum = luminance.ptr<f32>(y);
+            for (int x = 0; x < image.cols; ++x) {
+                const f32 base_value = coeff_a[x] * lum[x] + coeff_b[x];
+                const f32 gain = (1.0f + highlight_delta * highlight_weight(base_value)) *
+                                 (1.0f + shadow_delta * shadow_weight(base_value));
+                const f32 detail = clarity_amount * (lum[x] - base_value);
+                for (int c = 0; c < 3; ++c) {
+                    row[x * 3 + c] = (row[x * 3 + c] + detail) * gain;
+                }
+            }
+        }
+    });
+}
+
+} // namespace raw_editor
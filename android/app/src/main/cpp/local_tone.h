@@ -0,0 +1,116 @@
+#ifndef LOCAL_TONE_H
+#define LOCAL_TONE_H
+
+#include "common_types.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+
+namespace raw_editor {
+
+// ハイライト・シャドウの重みの遷移域（ベース輝度、ガンマ空間）
+// 従来の二値マスクの閾値 0.7 / 0.3 を中心に幅を持たせたもの
+constexpr f32 HIGHLIGHT_WEIGHT_LOW = 0.6f;
+constexpr f32 HIGHLIGHT_WEIGHT_HIGH = 0.8f;
+constexpr f32 SHADOW_WEIGHT_LOW = 0.2f;
+constexpr f32 SHADOW_WEIGHT_HIGH = 0.4f;
+
+inline f32 smoothstep(f32 edge0, f32 edge1, f32 x) {
+    f32 t = std::min(1.0f, std::max(0.0f, (x - edge0) / (edge1 - edge0)));
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// ハイライト調整の重み
+inline f32 highlight_weight(f32 base) {
+    return smoothstep(HIGHLIGHT_WEIGHT_LOW, HIGHLIGHT_WEIGHT_HIGH, base);
+}
+
+// シャドウ調整の重み
+inline f32 shadow_weight(f32 base) {
+    return 1.0f - smoothstep(SHADOW_WEIGHT_LOW, SHADOW_WEIGHT_HIGH, base);
+}
+
+/**
+ * 局所トーンマッピングのベースレイヤー
+ * 長辺 PLANE_LONG_SIDE に縮小した輝度にガイデッドフィルタ（自己ガイド）を掛け、
+ * 線形係数 (a, b) を縮小平面のまま保持する。画素のベース輝度はその画素の輝度 L と
+ * 双線形補間した係数から a * L + b で求める（Fast Guided Filter）。
+ * フル解像度の輝度をガイドに使うため、縮小してもエッジはフル解像度で保たれハローが出ない。
+ *
+ * ハイライト・シャドウ・クラリティはすべてこの1枚を参照する。平面の大きさは画像に対する比率で
+ * 決まるため、プレビューと書き出しで効き方が一致する。フレーム全体から1度だけ作れば、
+ * タイル処理でも継ぎ目は出ず、タイルにハローを付ける必要もない。
+ */
+class ToneBaseLayer {
+public:
+    // 縮小平面の長辺
+    static constexpr int PLANE_LONG_SIDE = 512;
+
+    // 縮小平面上のフィルタ半径（長辺の約1/64）
+    static constexpr int RADIUS = 8;
+
+    // 正則化係数（標準偏差で約0.1未満の輝度変化は平滑化し、それより大きな段差はエッジとして残す）
+    static constexpr f32 EPSILON = 0.01f;
+
+    ToneBaseLayer() = default;
+
+    /**
+     * 縮小済みの輝度平面から作る
+     * @param plane 縮小した輝度 (CV_32F, plane_size(frame_size) の大きさ)
+     * @param frame_size 元の画像サイズ
+     */
+    ToneBaseLayer(const cv::Mat& plane, cv::Size frame_size);
+
+    /**
+     * フル解像度の輝度から作る（縮小も行う）
+     * @param luminance 輝度 (CV_32F)
+     * @return ベースレイヤー
+     */
+    static ToneBaseLayer from_luminance(const cv::Mat& luminance);
+
+    /**
+     * 画像サイズに対する縮小平面のサイズ
+     * @param frame_size 画像サイズ
+     * @return 縮小平面のサイズ
+     */
+    static cv::Size plane_size(cv::Size frame_size);
+
+    /**
+     * 縮小に使う補間方式（縮小なら INTER_AREA、小さな画像の拡大なら INTER_LINEAR）
+     */
+    static int plane_interpolation(cv::Size frame_size);
+
+    bool empty() const { return coeff_a_.empty(); }
+    cv::Size frame_size() const { return frame_size_; }
+
+    /**
+     * 1行分の係数を補間
+     * @param y 元画像での行
+     * @param x0 元画像での開始列
+     * @param width 列数
+     * @param a 係数 a の格納先（width 要素）
+     * @param b 係数 b の格納先（width 要素）
+     */
+    void sample_row(int y, int x0, int width, f32* a, f32* b) const;
+
+private:
+    cv::Mat coeff_a_;
+    cv::Mat coeff_b_;
+    cv::Size frame_size_;
+};
+
+/**
+ * ベースレイヤーを使ってハイライト・シャドウ・クラリティを適用（段階的パイプライン用）
+ * 融合パイプラインの前段と同じ式を画素ごとに評価する
+ * @param image ガンマ空間のfloat画像 (CV_32FC3、その場で更新)
+ * @param luminance image の輝度 (CV_32F)
+ * @param base luminance から作ったベースレイヤー
+ * @param highlight_delta ハイライトのゲイン - 1
+ * @param shadow_delta シャドウのゲイン - 1
+ * @param clarity_amount クラリティの強さ（ベースとの差分に掛ける係数）
+ */
+void apply_local_tone(cv::Mat& image, const cv::Mat& luminance, const ToneBaseLayer& base,
+                      f32 highlight_delta, f32 shadow_delta, f32 clarity_amount);
+
+} // namespace raw_editor
+
+#endif // LOCAL_TONE_H
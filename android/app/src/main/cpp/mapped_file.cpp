@@ -0,0 +1,94 @@
+#include "mapped_file.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace raw_editor {
+
+static const char* TAG = "MappedFile";
+
+MappedFile::MappedFile()
+    : data_(nullptr),
+      size_(0),
+      modified_ns_(0) {
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+BoolResult MappedFile::open(const std::string& path) {
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        const int error_number = errno;
+        std::string error = (error_number == ENOENT ? "File not found: " : "Failed to open file: ") + path;
+        LOG_ERROR(TAG, (error + " (" + std::strerror(error_number) + ")").c_str());
+        return BoolResult(error_number == ENOENT ? ResultCode::ERROR_FILE_NOT_FOUND : ResultCode::ERROR_UNKNOWN,
+                          error);
+    }
+
+    // マップは記述子を閉じても有効なため、ここで閉じる
+    BoolResult result = open_descriptor(fd);
+    ::close(fd);
+    return result;
+}
+
+BoolResult MappedFile::open_descriptor(int fd) {
+    close();
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        std::string error = "Not a regular file descriptor: " + std::to_string(fd);
+        LOG_ERROR(TAG, error.c_str());
+        return BoolResult(ResultCode::ERROR_INVALID_PARAMETERS, error);
+    }
+    if (info.st_size <= 0) {
+        std::string error = "Empty file";
+        LOG_ERROR(TAG, error.c_str());
+        return BoolResult(ResultCode::ERROR_INVALID_FORMAT, error);
+    }
+
+    const size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::string error = std::string("mmap failed: ") + std::strerror(errno);
+        LOG_ERROR(TAG, error.c_str());
+        return BoolResult(ResultCode::ERROR_MEMORY_ALLOCATION, error);
+    }
+
+    data_ = static_cast<byte*>(mapping);
+    size_ = size;
+    modified_ns_ = static_cast<u64>(info.st_mtim.tv_sec) * 1000000000ull +
+                   static_cast<u64>(info.st_mtim.tv_nsec);
+    return BoolResult(ResultCode::SUCCESS, true);
+}
+
+void MappedFile::advise(Access access) const {
+    if (!data_) {
+        return;
+    }
+
+    // ヒントは最適化のためだけなので、失敗しても無視する
+    if (access == Access::RANDOM) {
+        ::madvise(data_, size_, MADV_RANDOM);
+    } else {
+        ::madvise(data_, size_, MADV_SEQUENTIAL);
+        ::madvise(data_, size_, MADV_WILLNEED);
+    }
+}
+
+void MappedFile::close() {
+    if (data_) {
+        ::munmap(data_, size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    modified_ns_ = 0;
+}
+
+} // namespace raw_editor
@@ -0,0 +1,72 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "common_types.h"
+#include <string>
+
+namespace raw_editor {
+
+/**
+ * 読み取り専用でメモリにマップしたファイル
+ * RAWファイルを LibRaw の open_buffer に渡すことで、stdio 経由の細かな read 呼び出しを省く。
+ * マップはページキャッシュを直接参照するため、同じファイルを開き直してもディスクから読み直さない。
+ * ファイル記述子からも作れるため、コンテンツURIなどパスを持たないファイルも扱える。
+ */
+class MappedFile {
+public:
+    /**
+     * アクセスパターンのヒント（madvise）
+     */
+    enum class Access {
+        RANDOM,     // ヘッダーと埋め込みサムネイルのみを読む（先読みを抑える）
+        SEQUENTIAL  // センサーデータを先頭から展開する（先読みを広げ、ファイル全体を読み込み始める）
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * パスを指定してマップ
+     * @param path ファイルパス
+     * @return 結果（存在しない場合は ERROR_FILE_NOT_FOUND）
+     */
+    BoolResult open(const std::string& path);
+
+    /**
+     * ファイル記述子を指定してマップ
+     * 記述子は呼び出し側が所有する（マップはこの後に記述子を閉じても有効）
+     * @param fd 読み取り可能なファイル記述子
+     * @return 結果
+     */
+    BoolResult open_descriptor(int fd);
+
+    /**
+     * アクセスパターンを通知
+     * @param access アクセスパターン
+     */
+    void advise(Access access) const;
+
+    /**
+     * マップを解除
+     */
+    void close();
+
+    bool is_open() const { return data_ != nullptr; }
+    const byte* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // ファイルの更新時刻（ナノ秒）
+    u64 modified_ns() const { return modified_ns_; }
+
+private:
+    byte* data_;
+    size_t size_;
+    u64 modified_ns_;
+};
+
+} // namespace raw_editor
+
+#endif // MAPPED_FILE_H
@@ -1,7 +1,16 @@
 #include "native_bridge.h"
-#include <android/log.h>
+#include "batch_ingestor.h"
+#include "fused_pipeline.h"
+#include "job_scheduler.h"
+#include "denoise.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
 #include <unordered_map>
 #include <mutex>
+#include <cstdio>
 #include <cstring>
 #include <sstream>
 #include <iomanip>
@@ -10,17 +19,88 @@ namespace raw_editor {
 
 static const char* TAG = "NativeBridge";
 
-// グローバル状態管理
-static std::unordered_map<int64_t, std::unique_ptr<RawProcessor>> g_processors;
-static std::mutex g_processors_mutex;
-static int64_t g_next_handle = 1;
+// グローバル状態管理（ハンドルの検索はロックフリー、ロックはプロセッサー単位）
+static HandleTable<bridge_internal::ProcessorEntry> g_processors;
+
+// 非同期ジョブ（プロセッサーより先に破棄され、実行中のジョブの終了を待つ）
+static JobScheduler g_jobs;
+
+// サムネイル・プレビューのディスクキャッシュ（全プロセッサーで共有）
+static std::shared_ptr<DiskImageCache> g_disk_cache;
+static std::mutex g_disk_cache_mutex;
+
+static std::shared_ptr<DiskImageCache> get_disk_cache() {
+    std::lock_guard<std::mutex> lock(g_disk_cache_mutex);
+    return g_disk_cache;
+}
+
+static std::unordered_map<int64_t, std::shared_ptr<BatchIngestor>> g_ingestors;
+static std::mutex g_ingestors_mutex;
+static int64_t g_next_ingest_handle = 1;
+
+static FFIImageData empty_image_data() {
+    FFIImageData empty_data;
+    empty_data.data = nullptr;
+    empty_data.width = 0;
+    empty_data.height = 0;
+    empty_data.channels = 0;
+    empty_data.data_length = 0;
+    empty_data.bit_depth = 0;
+    empty_data.context = nullptr;
+    return empty_data;
+}
+
+/**
+ * プロセッサーを使うジョブを投入
+ * プロセッサーのロックはジョブの実行中だけ保持する（待機中のジョブは他の呼び出しを妨げない）
+ * @param handle プロセッサーハンドル
+ * @param supersede 同じプロセッサーの置き換え可能なジョブを置き換えるか
+ * @param work ジョブ本体
+ * @return ジョブID（失敗時は0）
+ */
+static int64_t submit_processor_job(
+    int64_t handle, bool supersede,
+    std::function<ImageResult(RawProcessor&, JobControl&)> work) {
+    if (!g_processors.is_alive(handle)) {
+        LOG_ERROR(TAG, "Invalid processor handle for job submission");
+        return 0;
+    }
+    
+    u64 job_id = g_jobs.submit(handle, supersede, [handle, work](JobControl& job) {
+        bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
+        if (!processor) {
+            return ImageResult(ResultCode::ERROR_INVALID_PARAMETERS, std::string("Invalid processor handle"));
+        }
+        // ロック待ちの間に置き換えられていれば実行しない
+        job.check();
+        return work(*processor.get(), job);
+    });
+    return static_cast<int64_t>(job_id);
+}
+
+static std::shared_ptr<BatchIngestor> get_ingestor_from_handle(int64_t handle) {
+    std::lock_guard<std::mutex> lock(g_ingestors_mutex);
+    auto it = g_ingestors.find(handle);
+    return (it != g_ingestors.end()) ? it->second : nullptr;
+}
 
 namespace bridge_internal {
 
-RawProcessor* get_processor_from_handle(int64_t handle) {
-    std::lock_guard<std::mutex> lock(g_processors_mutex);
-    auto it = g_processors.find(handle);
-    return (it != g_processors.end()) ? it->second.get() : nullptr;
+ProcessorLease::ProcessorLease(HandleTable<ProcessorEntry>::Lease lease)
+    : lease_(std::move(lease)) {
+    if (lease_) {
+        lock_ = std::unique_lock<std::mutex>(lease_->mutex);
+    }
+}
+
+ProcessorLease get_processor_from_handle(int64_t handle) {
+    ProcessorLease processor(g_processors.acquire(handle));
+    
+    // ロック待ちの間に破棄されたプロセッサーは使わない
+    if (processor && !g_processors.is_alive(handle)) {
+        return ProcessorLease();
+    }
+    return processor;
 }
 
 template<>
@@ -69,25 +149,7 @@ FFIResult convert_result<RawMetadata>(const ProcessingResult<RawMetadata>& resul
     
     if (result.is_success()) {
         // メタデータをJSON形式に変換
-        std::ostringstream json;
-        json << "{"
-             << "\"camera_make\":\"" << result.data.camera_make << "\","
-             << "\"camera_model\":\"" << result.data.camera_model << "\","
-             << "\"lens_model\":\"" << result.data.lens_model << "\","
-             << "\"iso\":" << result.data.iso << ","
-             << "\"aperture\":" << std::fixed << std::setprecision(1) << result.data.aperture << ","
-             << "\"shutter_speed\":\"" << result.data.shutter_speed << "\","
-             << "\"focal_length\":" << std::fixed << std::setprecision(1) << result.data.focal_length << ","
-             << "\"flash_used\":" << (result.data.flash_used ? "true" : "false") << ","
-             << "\"orientation\":" << result.data.orientation << ","
-             << "\"white_balance\":\"" << result.data.white_balance << "\","
-             << "\"color_space\":\"" << result.data.color_space << "\","
-             << "\"image_width\":" << result.data.image_width << ","
-             << "\"image_height\":" << result.data.image_height << ","
-             << "\"color_temperature\":" << std::fixed << std::setprecision(0) << result.data.color_temperature
-             << "}";
-        
-        std::string json_str = json.str();
+        std::string json_str = metadata_to_json(result.data);
         ffi_result.data_length = static_cast<int32_t>(json_str.length() + 1);
         ffi_result.data = new char[ffi_result.data_length];
         std::strcpy(ffi_result.data, json_str.c_str());
@@ -110,6 +172,8 @@ FFIImageData convert_image_data(const ImageData& image_data) {
         ffi_data.height = 0;
         ffi_data.channels = 0;
         ffi_data.data_length = 0;
+        ffi_data.bit_depth = 0;
+        ffi_data.context = nullptr;
         return ffi_data;
     }
     
@@ -117,10 +181,12 @@ FFIImageData convert_image_data(const ImageData& image_data) {
     ffi_data.height = image_data.height;
     ffi_data.channels = image_data.channels;
     ffi_data.data_length = static_cast<uint32_t>(image_data.data.size());
+    ffi_data.bit_depth = image_data.bit_depth;
     
-    // データをコピー
-    ffi_data.data = new uint8_t[ffi_data.data_length];
-    std::memcpy(ffi_data.data, image_data.data.data(), ffi_data.data_length);
+    // 画素バッファはコピーせず、参照をcontextとして渡す
+    PixelBuffer* buffer = new PixelBuffer(image_data.data);
+    ffi_data.data = buffer->data();
+    ffi_data.context = buffer;
     
     return ffi_data;
 }
@@ -206,6 +272,7 @@ ProcessingOptions convert_processing_options(const FFIProcessingOptions& ffi_opt
     options.preview_mode = ffi_options.preview_mode;
     options.use_gpu = ffi_options.use_gpu;
     options.thread_count = ffi_options.thread_count;
+    options.output_bit_depth = ffi_options.output_bit_depth == 16 ? 16 : 8;
     return options;
 }
 
@@ -214,12 +281,60 @@ ImageData convert_from_ffi_image_data(const FFIImageData& ffi_data) {
         return ImageData();
     }
     
-    ImageData image_data(ffi_data.width, ffi_data.height, ffi_data.channels, 8);
-    
-    size_t copy_size = std::min(static_cast<size_t>(ffi_data.data_length), image_data.data.size());
-    std::memcpy(image_data.data.data(), ffi_data.data, copy_size);
+    u32 bit_depth = ffi_data.bit_depth == 16 ? 16 : 8;
+    size_t expected_size = static_cast<size_t>(ffi_data.width) * ffi_data.height *
+                           ffi_data.channels * (bit_depth / 8);
+    if (ffi_data.data_length < expected_size) {
+        return ImageData();
+    }
     
-    return image_data;
+    // 呼び出し中だけ使うため、Dart側のメモリをコピーせずに参照する
+    PixelBuffer buffer(ffi_data.data, ffi_data.data_length, nullptr);
+    return ImageData(ffi_data.width, ffi_data.height, ffi_data.channels, bit_depth, std::move(buffer));
+}
+
+std::string metadata_to_json(const RawMetadata& metadata) {
+    std::ostringstream json;
+    json << "{"
+         << "\"camera_make\":\"" << json_escape(metadata.camera_make) << "\","
+         << "\"camera_model\":\"" << json_escape(metadata.camera_model) << "\","
+         << "\"lens_model\":\"" << json_escape(metadata.lens_model) << "\","
+         << "\"iso\":" << metadata.iso << ","
+         << "\"aperture\":" << std::fixed << std::setprecision(1) << metadata.aperture << ","
+         << "\"shutter_speed\":\"" << json_escape(metadata.shutter_speed) << "\","
+         << "\"focal_length\":" << std::fixed << std::setprecision(1) << metadata.focal_length << ","
+         << "\"flash_used\":" << (metadata.flash_used ? "true" : "false") << ","
+         << "\"orientation\":" << metadata.orientation << ","
+         << "\"white_balance\":\"" << json_escape(metadata.white_balance) << "\","
+         << "\"color_space\":\"" << json_escape(metadata.color_space) << "\","
+         << "\"image_width\":" << metadata.image_width << ","
+         << "\"image_height\":" << metadata.image_height << ","
+         << "\"color_temperature\":" << std::fixed << std::setprecision(0) << metadata.color_temperature
+         << "}";
+    return json.str();
+}
+
+std::string json_escape(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    escaped += buffer;
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
 }
 
 std::string create_json_string(const std::string& key, const std::string& value) {
@@ -227,7 +342,7 @@ std::string create_json_string(const std::string& key, const std::string& value)
 }
 
 std::string create_error_json(const std::string& message) {
-    return "{\"error\":\"" + message + "\"}";
+    return "{\"error\":\"" + json_escape(message) + "\"}";
 }
 
 } // namespace bridge_internal
@@ -239,10 +354,14 @@ extern "C" {
 int64_t raw_processor_create() {
     LOG_INFO(TAG, "Creating new RawProcessor instance");
     
-    std::lock_guard<std::mutex> lock(g_processors_mutex);
+    auto entry = std::make_unique<bridge_internal::ProcessorEntry>();
+    entry->processor.set_disk_cache(get_disk_cache());
     
-    int64_t handle = g_next_handle++;
-    g_processors[handle] = std::make_unique<RawProcessor>();
+    int64_t handle = g_processors.insert(std::move(entry));
+    if (handle == 0) {
+        LOG_ERROR(TAG, "Too many RawProcessor instances");
+        return 0;
+    }
     
     LOG_INFO(TAG, ("RawProcessor created with handle: " + std::to_string(handle)).c_str());
     return handle;
@@ -251,10 +370,9 @@ int64_t raw_processor_create() {
 void raw_processor_destroy(int64_t handle) {
     LOG_INFO(TAG, ("Destroying RawProcessor with handle: " + std::to_string(handle)).c_str());
     
-    std::lock_guard<std::mutex> lock(g_processors_mutex);
-    auto it = g_processors.find(handle);
-    if (it != g_processors.end()) {
-        g_processors.erase(it);
+    // 待機中・実行中のジョブを中止する（使用中の呼び出しがあれば、その完了後に解放される）
+    g_jobs.cancel_owner(handle);
+    if (g_processors.destroy(handle)) {
         LOG_INFO(TAG, "RawProcessor destroyed successfully");
     } else {
         LOG_ERROR(TAG, "Invalid handle for destruction");
@@ -262,7 +380,7 @@ void raw_processor_destroy(int64_t handle) {
 }
 
 FFIResult raw_processor_load_file(int64_t handle, const char* file_path) {
-    RawProcessor* processor = bridge_internal::get_processor_from_handle(handle);
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
     if (!processor) {
         FFIResult result;
         result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
@@ -287,8 +405,60 @@ FFIResult raw_processor_load_file(int64_t handle, const char* file_path) {
     return bridge_internal::convert_result(load_result);
 }
 
+FFIResult raw_processor_open_thumbnail_only(int64_t handle, const char* file_path) {
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
+    if (!processor) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json("Invalid processor handle");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    if (!file_path) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json("Null file path");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    BoolResult load_result = processor->load_raw_file(std::string(file_path), true);
+    return bridge_internal::convert_result(load_result);
+}
+
+FFIResult raw_processor_load_descriptor(int64_t handle, int32_t fd, const char* name, bool thumbnail_only) {
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
+    if (!processor) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json("Invalid processor handle");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    if (fd < 0 || !name) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json("Invalid file descriptor or name");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    BoolResult load_result = processor->load_raw_descriptor(fd, std::string(name), thumbnail_only);
+    return bridge_internal::convert_result(load_result);
+}
+
 FFIResult raw_processor_extract_metadata(int64_t handle) {
-    RawProcessor* processor = bridge_internal::get_processor_from_handle(handle);
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
     if (!processor) {
         FFIResult result;
         result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
@@ -304,28 +474,16 @@ FFIResult raw_processor_extract_metadata(int64_t handle) {
 }
 
 FFIImageData raw_processor_generate_thumbnail(int64_t handle, uint32_t max_size) {
-    RawProcessor* processor = bridge_internal::get_processor_from_handle(handle);
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
     if (!processor) {
-        FFIImageData empty_data;
-        empty_data.data = nullptr;
-        empty_data.width = 0;
-        empty_data.height = 0;
-        empty_data.channels = 0;
-        empty_data.data_length = 0;
-        return empty_data;
+        return empty_image_data();
     }
     
     ImageResult thumbnail_result = processor->generate_thumbnail(max_size);
     if (thumbnail_result.is_success()) {
         return bridge_internal::convert_image_data(thumbnail_result.data);
     } else {
-        FFIImageData empty_data;
-        empty_data.data = nullptr;
-        empty_data.width = 0;
-        empty_data.height = 0;
-        empty_data.channels = 0;
-        empty_data.data_length = 0;
-        return empty_data;
+        return empty_image_data();
     }
 }
 
@@ -334,15 +492,9 @@ FFIImageData raw_processor_generate_preview(
     const FFIAdjustmentParams* params,
     const FFIProcessingOptions* options) {
     
-    RawProcessor* processor = bridge_internal::get_processor_from_handle(handle);
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
     if (!processor || !params || !options) {
-        FFIImageData empty_data;
-        empty_data.data = nullptr;
-        empty_data.width = 0;
-        empty_data.height = 0;
-        empty_data.channels = 0;
-        empty_data.data_length = 0;
-        return empty_data;
+        return empty_image_data();
     }
     
     AdjustmentParams cpp_params = bridge_internal::convert_adjustment_params(*params);
@@ -352,13 +504,51 @@ FFIImageData raw_processor_generate_preview(
     if (preview_result.is_success()) {
         return bridge_internal::convert_image_data(preview_result.data);
     } else {
-        FFIImageData empty_data;
-        empty_data.data = nullptr;
-        empty_data.width = 0;
-        empty_data.height = 0;
-        empty_data.channels = 0;
-        empty_data.data_length = 0;
-        return empty_data;
+        return empty_image_data();
+    }
+}
+
+FFIImageData raw_processor_generate_preview_into(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options,
+    uint8_t* buffer,
+    uint64_t capacity) {
+    
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
+    if (!processor || !params || !options) {
+        return empty_image_data();
+    }
+    
+    AdjustmentParams cpp_params = bridge_internal::convert_adjustment_params(*params);
+    ProcessingOptions cpp_options = bridge_internal::convert_processing_options(*options);
+    
+    // 呼び出し側のバッファは所有しないので、解放処理なしで参照する
+    PixelBuffer destination;
+    if (buffer && capacity > 0) {
+        destination = PixelBuffer(buffer, static_cast<size_t>(capacity), nullptr);
+    }
+    
+    ImageResult preview_result = processor->generate_preview(cpp_params, cpp_options, destination);
+    if (preview_result.is_success()) {
+        const ImageData& image_data = preview_result.data;
+        if (image_data.data.data() == buffer) {
+            FFIImageData ffi_data;
+            ffi_data.data = buffer;
+            ffi_data.width = image_data.width;
+            ffi_data.height = image_data.height;
+            ffi_data.channels = image_data.channels;
+            ffi_data.data_length = static_cast<uint32_t>(
+                static_cast<size_t>(image_data.width) * image_data.height *
+                image_data.channels * (image_data.bit_depth / 8));
+            ffi_data.bit_depth = image_data.bit_depth;
+            ffi_data.context = nullptr;
+            return ffi_data;
+        }
+        // 容量不足でネイティブ側が確保したバッファを返す
+        return bridge_internal::convert_image_data(image_data);
+    } else {
+        return empty_image_data();
     }
 }
 
@@ -367,15 +557,9 @@ FFIImageData raw_processor_process_full_image(
     const FFIAdjustmentParams* params,
     const FFIProcessingOptions* options) {
     
-    RawProcessor* processor = bridge_internal::get_processor_from_handle(handle);
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
     if (!processor || !params || !options) {
-        FFIImageData empty_data;
-        empty_data.data = nullptr;
-        empty_data.width = 0;
-        empty_data.height = 0;
-        empty_data.channels = 0;
-        empty_data.data_length = 0;
-        return empty_data;
+        return empty_image_data();
     }
     
     AdjustmentParams cpp_params = bridge_internal::convert_adjustment_params(*params);
@@ -385,13 +569,7 @@ FFIImageData raw_processor_process_full_image(
     if (full_result.is_success()) {
         return bridge_internal::convert_image_data(full_result.data);
     } else {
-        FFIImageData empty_data;
-        empty_data.data = nullptr;
-        empty_data.width = 0;
-        empty_data.height = 0;
-        empty_data.channels = 0;
-        empty_data.data_length = 0;
-        return empty_data;
+        return empty_image_data();
     }
 }
 
@@ -402,7 +580,7 @@ FFIResult raw_processor_save_image(
     const char* format,
     uint32_t quality) {
     
-    RawProcessor* processor = bridge_internal::get_processor_from_handle(handle);
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
     if (!processor || !image_data || !output_path || !format) {
         FFIResult result;
         result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
@@ -424,8 +602,216 @@ FFIResult raw_processor_save_image(
     return bridge_internal::convert_result(save_result);
 }
 
+FFIResult raw_processor_export_to_file(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options,
+    const char* output_path,
+    const char* format,
+    uint32_t quality) {
+    
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
+    if (!processor || !params || !options || !output_path || !format) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json("Invalid parameters");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    AdjustmentParams cpp_params = bridge_internal::convert_adjustment_params(*params);
+    ProcessingOptions cpp_options = bridge_internal::convert_processing_options(*options);
+    
+    BoolResult export_result = processor->export_to_file(
+        cpp_params,
+        cpp_options,
+        std::string(output_path),
+        std::string(format),
+        quality
+    );
+    
+    return bridge_internal::convert_result(export_result);
+}
+
+int64_t raw_processor_submit_preview(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options) {
+    
+    if (!params || !options) {
+        LOG_ERROR(TAG, "Null parameters for preview job");
+        return 0;
+    }
+    
+    AdjustmentParams cpp_params = bridge_internal::convert_adjustment_params(*params);
+    ProcessingOptions cpp_options = bridge_internal::convert_processing_options(*options);
+    return submit_processor_job(handle, true, [cpp_params, cpp_options](RawProcessor& processor, JobControl& job) {
+        ProcessingOptions job_options = cpp_options;
+        job_options.job = &job;
+        return processor.generate_preview(cpp_params, job_options);
+    });
+}
+
+int64_t raw_processor_submit_full_image(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options) {
+    
+    if (!params || !options) {
+        LOG_ERROR(TAG, "Null parameters for full image job");
+        return 0;
+    }
+    
+    AdjustmentParams cpp_params = bridge_internal::convert_adjustment_params(*params);
+    ProcessingOptions cpp_options = bridge_internal::convert_processing_options(*options);
+    return submit_processor_job(handle, false, [cpp_params, cpp_options](RawProcessor& processor, JobControl& job) {
+        ProcessingOptions job_options = cpp_options;
+        job_options.job = &job;
+        return processor.process_full_image(cpp_params, job_options);
+    });
+}
+
+int64_t raw_processor_submit_export(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options,
+    const char* output_path,
+    const char* format,
+    uint32_t quality) {
+    
+    if (!params || !options || !output_path || !format) {
+        LOG_ERROR(TAG, "Null parameters for export job");
+        return 0;
+    }
+    
+    AdjustmentParams cpp_params = bridge_internal::convert_adjustment_params(*params);
+    ProcessingOptions cpp_options = bridge_internal::convert_processing_options(*options);
+    std::string path(output_path);
+    std::string format_name(format);
+    return submit_processor_job(handle, false,
+        [cpp_params, cpp_options, path, format_name, quality](RawProcessor& processor, JobControl& job) {
+            ProcessingOptions job_options = cpp_options;
+            job_options.job = &job;
+            BoolResult export_result = processor.export_to_file(cpp_params, job_options, path, format_name, quality);
+            if (export_result.is_error()) {
+                return ImageResult(export_result.code, export_result.error_message);
+            }
+            return ImageResult(ResultCode::SUCCESS, ImageData());
+        });
+}
+
+int64_t raw_processor_request_preview(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options,
+    bool progressive) {
+    
+    if (!params || !options) {
+        LOG_ERROR(TAG, "Null parameters for preview request");
+        return 0;
+    }
+    
+    // スケジューラは内部で同期するため、プロセッサーのロックは取らない
+    auto entry = g_processors.acquire(handle);
+    if (!entry) {
+        LOG_ERROR(TAG, "Invalid processor handle for preview request");
+        return 0;
+    }
+    
+    AdjustmentParams cpp_params = bridge_internal::convert_adjustment_params(*params);
+    ProcessingOptions cpp_options = bridge_internal::convert_processing_options(*options);
+    u64 sequence = 0;
+    if (!entry->previews.request(cpp_params, cpp_options, progressive, sequence)) {
+        // 描画ジョブが実行中なら、保留中の要求として拾われる
+        return static_cast<int64_t>(sequence);
+    }
+    
+    u64 job_id = g_jobs.submit(handle, false, [handle](JobControl& job) {
+        auto drain_entry = g_processors.acquire(handle);
+        if (!drain_entry) {
+            return ImageResult(ResultCode::ERROR_INVALID_PARAMETERS, std::string("Invalid processor handle"));
+        }
+        // 描画ごとにプロセッサーをロックし、描画の合間は他の呼び出しに譲る
+        drain_entry->previews.drain(job, [handle](const AdjustmentParams& render_params,
+                                                  const ProcessingOptions& render_options) {
+            bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
+            if (!processor) {
+                return ImageResult(ResultCode::ERROR_INVALID_PARAMETERS, std::string("Invalid processor handle"));
+            }
+            return processor->generate_preview(render_params, render_options);
+        });
+        return ImageResult(ResultCode::SUCCESS, ImageData());
+    });
+    
+    if (job_id == 0) {
+        entry->previews.launch_failed();
+        return 0;
+    }
+    // 結果は take_preview で受け渡すため、ジョブの結果は受け取らない
+    g_jobs.detach(job_id);
+    return static_cast<int64_t>(sequence);
+}
+
+bool raw_processor_take_preview(int64_t handle, FFIPreviewFrame* frame) {
+    if (!frame) {
+        return false;
+    }
+    
+    auto entry = g_processors.acquire(handle);
+    if (!entry) {
+        return false;
+    }
+    
+    PreviewFrame preview;
+    if (!entry->previews.take(preview)) {
+        return false;
+    }
+    
+    frame->sequence = static_cast<int64_t>(preview.sequence);
+    frame->code = static_cast<int32_t>(preview.result.code);
+    frame->draft = preview.draft;
+    frame->image = preview.result.is_success()
+        ? bridge_internal::convert_image_data(preview.result.data)
+        : empty_image_data();
+    return true;
+}
+
+bool raw_job_poll(int64_t job_id, FFIJobStatus* status) {
+    if (!status || job_id <= 0) {
+        return false;
+    }
+    
+    JobStatus job_status;
+    if (!g_jobs.poll(static_cast<u64>(job_id), job_status)) {
+        return false;
+    }
+    
+    status->state = static_cast<int32_t>(job_status.state);
+    status->progress = job_status.progress;
+    status->code = static_cast<int32_t>(job_status.state == JobState::FINISHED ? job_status.result.code
+                                                                                : ResultCode::SUCCESS);
+    status->image = job_status.state == JobState::FINISHED && job_status.result.is_success()
+        ? bridge_internal::convert_image_data(job_status.result.data)
+        : empty_image_data();
+    return true;
+}
+
+void raw_job_cancel(int64_t job_id) {
+    if (job_id > 0) {
+        g_jobs.cancel(static_cast<u64>(job_id));
+    }
+}
+
+void raw_job_release(int64_t job_id) {
+    if (job_id > 0) {
+        g_jobs.release(static_cast<u64>(job_id));
+    }
+}
+
 FFIResult raw_processor_get_current_file_path(int64_t handle) {
-    RawProcessor* processor = bridge_internal::get_processor_from_handle(handle);
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
     if (!processor) {
         FFIResult result;
         result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
@@ -442,17 +828,410 @@ FFIResult raw_processor_get_current_file_path(int64_t handle) {
 }
 
 bool raw_processor_is_loaded(int64_t handle) {
-    RawProcessor* processor = bridge_internal::get_processor_from_handle(handle);
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
     return processor ? processor->is_loaded() : false;
 }
 
 void raw_processor_clear(int64_t handle) {
-    RawProcessor* processor = bridge_internal::get_processor_from_handle(handle);
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
     if (processor) {
         processor->clear();
     }
 }
 
+void raw_processor_set_cache_budget(int64_t handle, uint64_t budget_bytes) {
+    bridge_internal::ProcessorLease processor = bridge_internal::get_processor_from_handle(handle);
+    if (processor) {
+        processor->set_cache_memory_budget(static_cast<size_t>(budget_bytes));
+    }
+}
+
+FFIResult raw_processor_get_stats(int64_t handle) {
+    // 計測中の処理を妨げないよう、プロセッサーのロックは取らない（識別子は不変）
+    auto entry = g_processors.acquire(handle);
+    if (!entry) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json("Invalid processor handle");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    const std::vector<TraceEvent> events = trace_snapshot(entry->processor.trace_context());
+    const std::vector<TraceStageStats> stages = trace_summarize(events);
+    const FramePoolStats pool = entry->processor.frame_pool_stats();
+    
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3)
+         << "{"
+         << "\"enabled\":" << (tracing_enabled() ? "true" : "false") << ","
+         << "\"events\":" << events.size() << ","
+         << "\"frame_pool\":{"
+         << "\"allocations\":" << pool.allocations << ","
+         << "\"allocated_bytes\":" << pool.allocated_bytes << ","
+         << "\"reuses\":" << pool.reuses << ","
+         << "\"outstanding\":" << pool.outstanding << ","
+         << "\"retained_bytes\":" << pool.retained_bytes
+         << "},"
+         << "\"stages\":[";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const TraceStageStats& stage = stages[i];
+        const double megapixels = stage.pixels / 1e6;
+        json << (i > 0 ? "," : "")
+             << "{"
+             << "\"name\":\"" << bridge_internal::json_escape(stage.name) << "\","
+             << "\"count\":" << stage.count << ","
+             << "\"total_ms\":" << stage.total_ns / 1e6 << ","
+             << "\"mean_ms\":" << stage.total_ns / 1e6 / stage.count << ","
+             << "\"max_ms\":" << stage.max_ns / 1e6 << ","
+             << "\"megapixels\":" << megapixels << ","
+             << "\"ns_per_mpix\":" << (stage.pixels > 0 ? stage.total_ns / megapixels : 0.0) << ","
+             << "\"bytes\":" << stage.bytes
+             << "}";
+    }
+    json << "]}";
+    
+    FFIResult result;
+    result.code = static_cast<int32_t>(ResultCode::SUCCESS);
+    std::string data = json.str();
+    result.data_length = static_cast<int32_t>(data.length() + 1);
+    result.data = new char[result.data_length];
+    std::strcpy(result.data, data.c_str());
+    return result;
+}
+
+FFIResult raw_processor_dump_trace(int64_t handle, const char* output_path) {
+    auto entry = g_processors.acquire(handle);
+    if (!entry || !output_path) {
+        return bridge_internal::convert_result(BoolResult(ResultCode::ERROR_INVALID_PARAMETERS,
+                                                          std::string("Invalid processor handle or path")));
+    }
+    
+    const std::string trace = trace_to_chrome_json(trace_snapshot(entry->processor.trace_context()));
+    FILE* file = std::fopen(output_path, "wb");
+    if (!file) {
+        return bridge_internal::convert_result(BoolResult(ResultCode::ERROR_FILE_NOT_FOUND,
+                                                          std::string("Failed to open trace file: ") + output_path));
+    }
+    const bool written = std::fwrite(trace.data(), 1, trace.size(), file) == trace.size();
+    const bool closed = std::fclose(file) == 0;
+    if (!written || !closed) {
+        return bridge_internal::convert_result(BoolResult(ResultCode::ERROR_PROCESSING_FAILED,
+                                                          std::string("Failed to write trace file: ") + output_path));
+    }
+    return bridge_internal::convert_result(BoolResult(ResultCode::SUCCESS, true));
+}
+
+void raw_set_tracing_enabled(bool enabled) {
+    set_tracing_enabled(enabled);
+}
+
+void image_cache_configure(const char* directory, uint64_t budget_bytes) {
+    std::shared_ptr<DiskImageCache> cache;
+    if (directory && directory[0] != '\0') {
+        cache = std::make_shared<DiskImageCache>(
+            std::string(directory),
+            budget_bytes > 0 ? static_cast<size_t>(budget_bytes) : DiskImageCache::DEFAULT_BUDGET);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(g_disk_cache_mutex);
+        g_disk_cache = cache;
+    }
+    
+    // 既存のプロセッサーにも反映する（実行中の一括取り込みは開始時のキャッシュを使い続ける）
+    g_processors.for_each([&](HandleTable<bridge_internal::ProcessorEntry>::Lease& entry) {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        entry->processor.set_disk_cache(cache);
+    });
+    
+    LOG_INFO(TAG, cache ? "Disk image cache configured" : "Disk image cache disabled");
+}
+
+void image_cache_clear() {
+    std::shared_ptr<DiskImageCache> cache = get_disk_cache();
+    if (cache) {
+        cache->clear();
+    }
+}
+
+FFIImageData raw_generate_file_thumbnail(const char* file_path, uint32_t max_size) {
+    if (!file_path) {
+        return empty_image_data();
+    }
+    
+    // キャッシュにあればRAWファイルは開かない
+    std::shared_ptr<DiskImageCache> cache = get_disk_cache();
+    if (cache) {
+        ImageResult cached = RawProcessor::cached_thumbnail(*cache, make_file_identity(file_path), max_size);
+        if (cached.is_success()) {
+            return bridge_internal::convert_image_data(cached.data);
+        }
+    }
+    
+    RawProcessor processor;
+    processor.set_disk_cache(cache);
+    if (processor.load_raw_file(std::string(file_path), true).is_error()) {
+        return empty_image_data();
+    }
+    
+    ImageResult thumbnail_result = processor.generate_thumbnail(max_size);
+    if (thumbnail_result.is_error()) {
+        return empty_image_data();
+    }
+    return bridge_internal::convert_image_data(thumbnail_result.data);
+}
+
+FFIResult color_lut_export_cube(const FFIAdjustmentParams* params, const char* output_path, uint32_t lut_size) {
+    const int size = lut_size > 0 ? static_cast<int>(lut_size) : ColorLut3D::EXPORT_SIZE;
+    if (!params || !output_path || size < ColorLut3D::MIN_SIZE || size > ColorLut3D::MAX_SIZE) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json("Invalid parameters");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    AdjustmentParams cpp_params = bridge_internal::convert_adjustment_params(*params);
+    FusedPipeline pipeline(cpp_params, size);
+    if (!pipeline.color_lut()) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json(
+            "Highlights, shadows and clarity cannot be expressed as a 3D LUT");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    // タイトルには拡張子を除いたファイル名を使う
+    std::string path(output_path);
+    size_t name_start = path.find_last_of('/');
+    std::string title = path.substr(name_start == std::string::npos ? 0 : name_start + 1);
+    size_t extension = title.find_last_of('.');
+    if (extension != std::string::npos && extension > 0) {
+        title.erase(extension);
+    }
+    
+    BoolResult write_result = pipeline.color_lut()->write_cube(path, title);
+    return bridge_internal::convert_result(write_result);
+}
+
+int64_t batch_ingest_start(const char* const* file_paths, uint32_t count, const char* thumbnail_dir,
+                           uint32_t thumbnail_size, uint32_t worker_count) {
+    if (!file_paths && count > 0) {
+        LOG_ERROR(TAG, "Null file path list for batch ingestion");
+        return 0;
+    }
+    
+    std::vector<std::string> paths;
+    paths.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (file_paths[i]) {
+            paths.emplace_back(file_paths[i]);
+        }
+    }
+    
+    auto ingestor = std::make_shared<BatchIngestor>(
+        std::move(paths), thumbnail_dir ? std::string(thumbnail_dir) : std::string(),
+        thumbnail_size, worker_count, get_disk_cache());
+    ingestor->start();
+    
+    std::lock_guard<std::mutex> lock(g_ingestors_mutex);
+    int64_t handle = g_next_ingest_handle++;
+    g_ingestors[handle] = std::move(ingestor);
+    
+    LOG_INFO(TAG, ("Batch ingestion started with handle: " + std::to_string(handle)).c_str());
+    return handle;
+}
+
+FFIResult batch_ingest_poll(int64_t handle, uint32_t max_results) {
+    std::shared_ptr<BatchIngestor> ingestor = get_ingestor_from_handle(handle);
+    if (!ingestor) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json("Invalid ingestion handle");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    // 進捗は結果を取り出す前に読む（finished なら以降に新しい結果は増えない）
+    IngestProgress progress = ingestor->progress();
+    std::vector<IngestResult> results = ingestor->poll(max_results);
+    
+    std::ostringstream json;
+    json << "{"
+         << "\"total\":" << progress.total << ","
+         << "\"completed\":" << progress.completed << ","
+         << "\"cancelled\":" << (progress.cancelled ? "true" : "false") << ","
+         << "\"finished\":" << (progress.finished ? "true" : "false") << ","
+         << "\"results\":[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const IngestResult& result = results[i];
+        if (i > 0) {
+            json << ",";
+        }
+        json << "{"
+             << "\"index\":" << result.index << ","
+             << "\"file_path\":\"" << bridge_internal::json_escape(result.file_path) << "\","
+             << "\"code\":" << static_cast<int32_t>(result.code) << ",";
+        if (result.code == ResultCode::SUCCESS) {
+            json << "\"metadata\":" << bridge_internal::metadata_to_json(result.metadata) << ",";
+        }
+        json << "\"thumbnail_path\":\"" << bridge_internal::json_escape(result.thumbnail_path) << "\","
+             << "\"error\":\"" << bridge_internal::json_escape(result.error_message) << "\""
+             << "}";
+    }
+    json << "]}";
+    
+    StringResult poll_result(ResultCode::SUCCESS, json.str());
+    return bridge_internal::convert_result(poll_result);
+}
+
+void batch_ingest_cancel(int64_t handle) {
+    std::shared_ptr<BatchIngestor> ingestor = get_ingestor_from_handle(handle);
+    if (ingestor) {
+        ingestor->cancel();
+    }
+}
+
+void batch_ingest_destroy(int64_t handle) {
+    std::shared_ptr<BatchIngestor> ingestor;
+    {
+        std::lock_guard<std::mutex> lock(g_ingestors_mutex);
+        auto it = g_ingestors.find(handle);
+        if (it == g_ingestors.end()) {
+            LOG_ERROR(TAG, "Invalid ingestion handle for destruction");
+            return;
+        }
+        ingestor = std::move(it->second);
+        g_ingestors.erase(it);
+    }
+    
+    // ワーカーの終了待ちはロックの外で行う（処理中のファイルが終わるまで待つ）
+    ingestor->cancel();
+    ingestor.reset();
+    LOG_INFO(TAG, "Batch ingestion destroyed");
+}
+
+FFIResult raw_benchmark_open(const char* file_path, uint32_t iterations) {
+    if (!file_path) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json("Null file path");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    const std::string path(file_path);
+    const RawProcessor::RawInput inputs[2] = {RawProcessor::RawInput::STDIO, RawProcessor::RawInput::MAPPED};
+    const uint32_t runs = std::max(1u, iterations);
+    RawProcessor processor;
+    
+    // 計測前に両方式で1回ずつ読み込み、ページキャッシュを温める
+    for (RawProcessor::RawInput input : inputs) {
+        BoolResult warmup = processor.load_raw_file(path, false, input);
+        if (warmup.is_error()) {
+            return bridge_internal::convert_result(warmup);
+        }
+        processor.clear();
+    }
+    
+    double total_ms[2] = {0.0, 0.0};
+    double best_ms[2] = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+    for (uint32_t i = 0; i < runs; ++i) {
+        // 実行順による偏りを避けるため、回ごとに順序を入れ替える
+        for (int k = 0; k < 2; ++k) {
+            const int index = (i % 2 == 0) ? k : 1 - k;
+            auto start = std::chrono::steady_clock::now();
+            BoolResult load_result = processor.load_raw_file(path, false, inputs[index]);
+            auto end = std::chrono::steady_clock::now();
+            processor.clear();
+            if (load_result.is_error()) {
+                return bridge_internal::convert_result(load_result);
+            }
+            const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+            total_ms[index] += ms;
+            best_ms[index] = std::min(best_ms[index], ms);
+        }
+    }
+    
+    const double stdio_ms = total_ms[0] / runs;
+    const double mapped_ms = total_ms[1] / runs;
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3)
+         << "{"
+         << "\"iterations\":" << runs << ","
+         << "\"stdio_ms\":" << stdio_ms << ","
+         << "\"stdio_best_ms\":" << best_ms[0] << ","
+         << "\"mapped_ms\":" << mapped_ms << ","
+         << "\"mapped_best_ms\":" << best_ms[1] << ","
+         << "\"speedup\":" << (mapped_ms > 0.0 ? stdio_ms / mapped_ms : 0.0)
+         << "}";
+    LOG_INFO(TAG, ("Open benchmark: " + json.str()).c_str());
+    
+    FFIResult result;
+    result.code = static_cast<int32_t>(ResultCode::SUCCESS);
+    std::string data = json.str();
+    result.data_length = static_cast<int32_t>(data.length() + 1);
+    result.data = new char[result.data_length];
+    std::strcpy(result.data, data.c_str());
+    return result;
+}
+
+FFIResult raw_benchmark_denoise(uint32_t width, uint32_t height, uint32_t iterations) {
+    if (width < 64 || height < 64) {
+        FFIResult result;
+        result.code = static_cast<int32_t>(ResultCode::ERROR_INVALID_PARAMETERS);
+        std::string error = bridge_internal::create_error_json("Benchmark image must be at least 64x64");
+        result.data_length = static_cast<int32_t>(error.length() + 1);
+        result.data = new char[result.data_length];
+        std::strcpy(result.data, error.c_str());
+        return result;
+    }
+    
+    const DenoiseBenchmark benchmark = benchmark_denoise(width, height, iterations);
+    
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3)
+         << "{"
+         << "\"width\":" << benchmark.width << ","
+         << "\"height\":" << benchmark.height << ","
+         << "\"iterations\":" << benchmark.iterations << ","
+         << "\"megapixels\":" << benchmark.megapixels << ","
+         << "\"input_psnr_db\":" << benchmark.input_psnr_db << ","
+         << "\"tiers\":[";
+    for (size_t t = 0; t < benchmark.tiers.size(); ++t) {
+        const DenoiseTierBenchmark& tier = benchmark.tiers[t];
+        json << (t > 0 ? "," : "")
+             << "{"
+             << "\"tier\":\"" << denoise_tier_name(tier.tier) << "\","
+             << "\"best_ms\":" << tier.best_ms << ","
+             << "\"ms_per_megapixel\":" << tier.ms_per_megapixel << ","
+             << "\"psnr_db\":" << tier.psnr_db
+             << "}";
+    }
+    json << "]}";
+    LOG_INFO(TAG, ("Denoise benchmark: " + json.str()).c_str());
+    
+    FFIResult result;
+    result.code = static_cast<int32_t>(ResultCode::SUCCESS);
+    std::string data = json.str();
+    result.data_length = static_cast<int32_t>(data.length() + 1);
+    result.data = new char[result.data_length];
+    std::strcpy(result.data, data.c_str());
+    return result;
+}
+
 void ffi_free_result(FFIResult* result) {
     if (result && result->data) {
         delete[] result->data;
@@ -463,15 +1242,21 @@ void ffi_free_result(FFIResult* result) {
 
 void ffi_free_image_data(FFIImageData* image_data) {
     if (image_data && image_data->data) {
-        delete[] image_data->data;
+        ffi_release_buffer(image_data->context);
+        image_data->context = nullptr;
         image_data->data = nullptr;
         image_data->width = 0;
         image_data->height = 0;
         image_data->channels = 0;
         image_data->data_length = 0;
+        image_data->bit_depth = 0;
     }
 }
 
+void ffi_release_buffer(void* context) {
+    delete static_cast<PixelBuffer*>(context);
+}
+
 FFIResult raw_processor_initialize() {
     LOG_INFO(TAG, "Initializing RAW processor library");
     
@@ -488,7 +1273,7 @@ FFIResult raw_processor_initialize() {
 void raw_processor_finalize() {
     LOG_INFO(TAG, "Finalizing RAW processor library");
     
-    std::lock_guard<std::mutex> lock(g_processors_mutex);
+    g_jobs.cancel_all();
     g_processors.clear();
     
     LOG_INFO(TAG, "RAW processor library finalized");
@@ -4,6 +4,9 @@
 #include <jni.h>
 #include <string>
 #include <memory>
+#include <mutex>
+#include "handle_table.h"
+#include "preview_scheduler.h"
 #include "raw_processor.h"
 
 namespace raw_editor {
@@ -21,12 +24,17 @@ struct FFIResult {
 };
 
 // FFI用の画像データ構造体
+// data はネイティブ側の画素バッファを直接指す（コピーしない）
+// context はバッファの参照を保持しており、ffi_release_buffer または
+// ffi_free_image_data で解放するまで data は有効
 struct FFIImageData {
     uint8_t* data;
     uint32_t width;
     uint32_t height;
     uint32_t channels;
     uint32_t data_length;
+    uint32_t bit_depth;     // 8 または 16
+    void* context;          // バッファの参照（呼び出し側のバッファに描画した場合は nullptr）
 };
 
 // FFI用の調整パラメータ構造体（Dartと同期）
@@ -107,6 +115,23 @@ struct FFIProcessingOptions {
     bool preview_mode;
     bool use_gpu;
     uint32_t thread_count;
+    uint32_t output_bit_depth;  // 8 または 16
+};
+
+// FFI用のジョブ状態
+struct FFIJobStatus {
+    int32_t state;          // 0 = 待機中, 1 = 実行中, 2 = 完了
+    int32_t code;           // 完了時の ResultCode（中止・置き換え時は ERROR_CANCELLED）
+    float progress;         // 進捗 (0〜1)
+    FFIImageData image;     // 完了したプレビュー・フル解像度処理の画像（ffi_free_image_data で解放）
+};
+
+// FFI用のプレビュー（最新優先のプレビュー要求の結果）
+struct FFIPreviewFrame {
+    int64_t sequence;       // 対応する要求の通し番号（raw_processor_request_preview の戻り値）
+    int32_t code;           // ResultCode
+    bool draft;             // 段階表示の低解像度の先行結果なら true
+    FFIImageData image;     // 成功時の画像（ffi_free_image_data で解放）
 };
 
 extern "C" {
@@ -131,6 +156,27 @@ void raw_processor_destroy(int64_t handle);
  */
 FFIResult raw_processor_load_file(int64_t handle, const char* file_path);
 
+/**
+ * RAWファイルをメタデータ・サムネイル専用に開く
+ * センサーデータは展開しないため、ギャラリー取り込みで大量のファイルを高速に処理できる
+ * 現像が必要な操作を呼ぶと、その時点で展開される
+ * @param handle プロセッサーハンドル
+ * @param file_path ファイルパス
+ * @return 読み込み結果
+ */
+FFIResult raw_processor_open_thumbnail_only(int64_t handle, const char* file_path);
+
+/**
+ * ファイル記述子からRAWファイルを読み込み（コンテンツURIで共有されたファイル用）
+ * ファイルはメモリにマップして読むため、記述子はこの呼び出しの後に閉じてよい
+ * @param handle プロセッサーハンドル
+ * @param fd 読み取り可能なファイル記述子
+ * @param name ファイルの識別名（コンテンツURIなど。ディスクキャッシュのキーに使う）
+ * @param thumbnail_only trueならメタデータ・サムネイル専用に開く
+ * @return 読み込み結果
+ */
+FFIResult raw_processor_load_descriptor(int64_t handle, int32_t fd, const char* name, bool thumbnail_only);
+
 /**
  * メタデータを抽出
  * @param handle プロセッサーハンドル
@@ -159,6 +205,26 @@ FFIImageData raw_processor_generate_preview(
     const FFIProcessingOptions* options
 );
 
+/**
+ * 呼び出し側が確保したバッファにプレビュー画像を直接描画
+ * スライダー操作中など同じサイズのプレビューを繰り返し生成する場合に、
+ * 出力バッファの確保と受け渡しのコピーを省く
+ * バッファの容量が足りない場合はネイティブ側で確保したバッファを返す（context が非 nullptr）
+ * @param handle プロセッサーハンドル
+ * @param params 調整パラメータ
+ * @param options 処理オプション
+ * @param buffer 出力先バッファ
+ * @param capacity バッファの容量（バイト）
+ * @return 画像データ
+ */
+FFIImageData raw_processor_generate_preview_into(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options,
+    uint8_t* buffer,
+    uint64_t capacity
+);
+
 /**
  * フル解像度画像を処理
  * @param handle プロセッサーハンドル
@@ -189,6 +255,121 @@ FFIResult raw_processor_save_image(
     uint32_t quality
 );
 
+/**
+ * 調整済み画像をファイルへ直接書き出す（行ストリップ単位のストリーミング出力）
+ * 出力画像をDart側へ受け渡さずに保存するため、フル解像度の書き出しに使う
+ * @param handle プロセッサーハンドル
+ * @param params 調整パラメータ
+ * @param options 処理オプション
+ * @param output_path 出力パス
+ * @param format フォーマット
+ * @param quality 品質
+ * @return 保存結果
+ */
+FFIResult raw_processor_export_to_file(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options,
+    const char* output_path,
+    const char* format,
+    uint32_t quality
+);
+
+/**
+ * プレビュー生成をジョブとして投入（すぐに戻る）
+ * 同じプロセッサーの未完了のプレビュージョブは置き換えられ、ERROR_CANCELLED で完了する
+ * @param handle プロセッサーハンドル
+ * @param params 調整パラメータ（呼び出し中にコピーされる）
+ * @param options 処理オプション（呼び出し中にコピーされる）
+ * @return ジョブID（失敗時は0）
+ */
+int64_t raw_processor_submit_preview(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options
+);
+
+/**
+ * フル解像度画像の処理をジョブとして投入（すぐに戻る）
+ * @param handle プロセッサーハンドル
+ * @param params 調整パラメータ（呼び出し中にコピーされる）
+ * @param options 処理オプション（呼び出し中にコピーされる）
+ * @return ジョブID（失敗時は0）
+ */
+int64_t raw_processor_submit_full_image(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options
+);
+
+/**
+ * ファイルへの書き出しをジョブとして投入（すぐに戻る）
+ * 中止された場合は書きかけのファイルを削除する
+ * @param handle プロセッサーハンドル
+ * @param params 調整パラメータ（呼び出し中にコピーされる）
+ * @param options 処理オプション（呼び出し中にコピーされる）
+ * @param output_path 出力パス
+ * @param format フォーマット
+ * @param quality 品質
+ * @return ジョブID（失敗時は0）
+ */
+int64_t raw_processor_submit_export(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options,
+    const char* output_path,
+    const char* format,
+    uint32_t quality
+);
+
+/**
+ * プレビューを要求（最新優先・すぐに戻る）
+ * 描画中に届いた要求は保留中の要求を置き換え、描画が終わると最新の要求だけが描画される。
+ * 結果は raw_processor_take_preview で受け取る
+ * @param handle プロセッサーハンドル
+ * @param params 調整パラメータ（呼び出し中にコピーされる）
+ * @param options 処理オプション（呼び出し中にコピーされる）
+ * @param progressive true なら1/4解像度の先行結果を先に公開してから出力解像度で描き直す
+ * @return 要求の通し番号（失敗時は0）
+ */
+int64_t raw_processor_request_preview(
+    int64_t handle,
+    const FFIAdjustmentParams* params,
+    const FFIProcessingOptions* options,
+    bool progressive
+);
+
+/**
+ * まだ受け取っていない最新のプレビューを取り出す（ブロックしない）
+ * 途中の要求の結果は、より新しい結果が公開された時点で破棄される
+ * @param handle プロセッサーハンドル
+ * @param frame プレビューの格納先
+ * @return 新しいプレビューがあれば true
+ */
+bool raw_processor_take_preview(int64_t handle, FFIPreviewFrame* frame);
+
+/**
+ * ジョブの状態を取得（ブロックしない）
+ * 完了したジョブは結果を返した時点で破棄され、以降のIDは無効になる
+ * @param job_id ジョブID
+ * @param status 状態の格納先
+ * @return 有効なジョブIDなら true
+ */
+bool raw_job_poll(int64_t job_id, FFIJobStatus* status);
+
+/**
+ * ジョブを中止（実行中なら次の確認箇所で打ち切られる）
+ * 結果は poll で ERROR_CANCELLED として受け取る
+ * @param job_id ジョブID
+ */
+void raw_job_cancel(int64_t job_id);
+
+/**
+ * ジョブの結果を受け取らないことを通知（未完了なら中止し、結果は破棄される）
+ * @param job_id ジョブID
+ */
+void raw_job_release(int64_t job_id);
+
 /**
  * 現在のファイルパスを取得
  * @param handle プロセッサーハンドル
@@ -209,6 +390,123 @@ bool raw_processor_is_loaded(int64_t handle);
  */
 void raw_processor_clear(int64_t handle);
 
+/**
+ * 現像済みベース画像キャッシュのメモリ予算を設定
+ * @param handle プロセッサーハンドル
+ * @param budget_bytes 予算（バイト）
+ */
+void raw_processor_set_cache_budget(int64_t handle, uint64_t budget_bytes);
+
+/**
+ * プロセッサーの処理区間ごとの計測結果を取得
+ * 処理中でもブロックせずに呼び出せる（各スレッドの直近の記録のみが対象）
+ * @param handle プロセッサーハンドル
+ * @return 結果のJSON（stages[] に区間名ごとの回数・合計/平均/最大時間・メガピクセルあたりの時間・確保バイト数、
+ *         frame_pool にプレビュー用フレームプールの確保回数・再利用回数・保持バイト数）
+ */
+FFIResult raw_processor_get_stats(int64_t handle);
+
+/**
+ * プロセッサーの計測記録を Chrome トレース形式で書き出す
+ * chrome://tracing や Perfetto で開ける（pid はプロセッサー、tid はスレッド）
+ * @param handle プロセッサーハンドル
+ * @param output_path 出力ファイルパス
+ * @return 処理結果
+ */
+FFIResult raw_processor_dump_trace(int64_t handle, const char* output_path);
+
+/**
+ * 計測の有効・無効を切り替える（全プロセッサー共通、既定は有効）
+ * @param enabled 有効にするか
+ */
+void raw_set_tracing_enabled(bool enabled);
+
+/**
+ * サムネイル・プレビューのディスクキャッシュを設定
+ * 以降に作成されるプロセッサー・一括取り込み・ファイル単位のサムネイル生成で共有される
+ * @param directory キャッシュディレクトリ（nullptr または空文字でキャッシュを無効化）
+ * @param budget_bytes 容量予算（バイト、0 = 既定値）
+ */
+void image_cache_configure(const char* directory, uint64_t budget_bytes);
+
+/**
+ * ディスクキャッシュの内容をすべて削除
+ */
+void image_cache_clear();
+
+/**
+ * ファイルを指定してサムネイルを生成
+ * ディスクキャッシュにあればRAWファイルを開かずに返し、なければ生成してキャッシュに保存する
+ * @param file_path ファイルパス
+ * @param max_size 最大サイズ（長辺、512を超える場合はプレビューとしてキャッシュされる）
+ * @return 画像データ（RGB）
+ */
+FFIImageData raw_generate_file_thumbnail(const char* file_path, uint32_t max_size);
+
+/**
+ * 調整パラメータの色調整を3D LUTに焼き込み、.cube ファイルとして書き出す
+ * ハイライト/シャドウ・クラリティなど周辺画素を参照する調整はLUTで表現できないためエラーになる
+ * @param params 調整パラメータ
+ * @param output_path 出力パス
+ * @param lut_size 格子サイズ（0 = 書き出し用の既定値）
+ * @return 書き出し結果
+ */
+FFIResult color_lut_export_cube(const FFIAdjustmentParams* params, const char* output_path, uint32_t lut_size);
+
+/**
+ * RAWファイルの一括取り込みを開始
+ * ワーカーごとに LibRaw インスタンスを1つ持ち、メタデータ抽出とサムネイル保存を並列に行う。
+ * 呼び出しはすぐに戻り、結果は batch_ingest_poll で受け取る
+ * @param file_paths ファイルパスの配列
+ * @param count ファイル数
+ * @param thumbnail_dir サムネイルの保存先ディレクトリ（nullptr ならサムネイルを保存しない）
+ * @param thumbnail_size サムネイルの長辺サイズ
+ * @param worker_count ワーカー数 (0 = 自動)
+ * @return 取り込みハンドル（失敗時は0）
+ */
+int64_t batch_ingest_start(const char* const* file_paths, uint32_t count, const char* thumbnail_dir,
+                           uint32_t thumbnail_size, uint32_t worker_count);
+
+/**
+ * 完了した取り込み結果と進捗を取得（ブロックしない）
+ * @param handle 取り込みハンドル
+ * @param max_results 取り出す最大件数 (0 = すべて)
+ * @return {"total","completed","cancelled","finished","results":[...]} 形式のJSON
+ */
+FFIResult batch_ingest_poll(int64_t handle, uint32_t max_results);
+
+/**
+ * 取り込みを中止（未処理のファイルは処理されない）
+ * @param handle 取り込みハンドル
+ */
+void batch_ingest_cancel(int64_t handle);
+
+/**
+ * 取り込みを破棄（処理中のファイルの完了を待つ）
+ * @param handle 取り込みハンドル
+ */
+void batch_ingest_destroy(int64_t handle);
+
+/**
+ * RAWファイルの読み込み方法を比較するベンチマーク
+ * 読み込み（open + unpack）の所要時間を、LibRaw のファイルストリームとメモリマップで交互に計測する。
+ * 各方式を計測前に1回ずつ読み込むため、ページキャッシュが温まった状態の比較になる
+ * @param file_path RAWファイルのパス
+ * @param iterations 方式ごとの計測回数（0 = 1回）
+ * @return 結果のJSON（stdio_ms / mapped_ms は平均、*_best_ms は最短、speedup は平均の比）
+ */
+FFIResult raw_benchmark_open(const char* file_path, uint32_t iterations);
+
+/**
+ * ノイズ除去の品質段階を比較するベンチマーク
+ * 合成画像にノイズを加え、プレビュー段階と書き出し段階それぞれの所要時間と画質を計測する
+ * @param width 画像の幅（64以上）
+ * @param height 画像の高さ（64以上）
+ * @param iterations 段階ごとの計測回数（0 = 1回）
+ * @return 結果のJSON（tiers[] に段階ごとの最短時間・メガピクセルあたりの時間・PSNR）
+ */
+FFIResult raw_benchmark_denoise(uint32_t width, uint32_t height, uint32_t iterations);
+
 /**
  * FFI結果のメモリを解放
  * @param result FFI結果
@@ -221,6 +519,13 @@ void ffi_free_result(FFIResult* result);
  */
 void ffi_free_image_data(FFIImageData* image_data);
 
+/**
+ * 画素バッファの参照を解放
+ * DartのNativeFinalizerから呼ばれることを想定（シグネチャは void(void*)）
+ * @param context FFIImageData::context
+ */
+void ffi_release_buffer(void* context);
+
 /**
  * ライブラリ初期化
  * @return 初期化結果
@@ -276,9 +581,51 @@ ProcessingOptions convert_processing_options(const FFIProcessingOptions& ffi_opt
 ImageData convert_from_ffi_image_data(const FFIImageData& ffi_data);
 
 /**
- * ハンドルからRawProcessorポインタを取得
+ * ハンドルテーブルに登録するプロセッサー
+ */
+struct ProcessorEntry {
+    std::mutex mutex; // 同じプロセッサーへの呼び出しを直列化する
+    RawProcessor processor;
+    PreviewScheduler previews; // 内部で同期するため mutex を取らずに使う
+};
+
+/**
+ * プロセッサーの参照
+ * 保持している間はプロセッサーがロックされ、ハンドルが破棄されても解放されない
+ * （解放は参照がすべて戻った時点で行われる）
+ */
+class ProcessorLease {
+public:
+    ProcessorLease() = default;
+    explicit ProcessorLease(HandleTable<ProcessorEntry>::Lease lease);
+
+    RawProcessor* get() const { return lease_ ? &lease_->processor : nullptr; }
+    RawProcessor* operator->() const { return get(); }
+    explicit operator bool() const { return static_cast<bool>(lease_); }
+
+private:
+    // 破棄はロック解除 → 参照解放の順（宣言と逆順）
+    HandleTable<ProcessorEntry>::Lease lease_;
+    std::unique_lock<std::mutex> lock_;
+};
+
+/**
+ * ハンドルからプロセッサーの参照を取得
+ * 他の呼び出しが同じプロセッサーを使用中なら終わるまで待つ
+ * @param handle プロセッサーハンドル
+ * @return 参照（無効・破棄済みのハンドルなら空）
+ */
+ProcessorLease get_processor_from_handle(int64_t handle);
+
+/**
+ * メタデータをJSONオブジェクトに変換
+ */
+std::string metadata_to_json(const RawMetadata& metadata);
+
+/**
+ * JSON文字列リテラル用にエスケープ
  */
-RawProcessor* get_processor_from_handle(int64_t handle);
+std::string json_escape(const std::string& value);
 
 /**
  * JSON文字列を作成
@@ -286,7 +633,7 @@ RawProcessor* get_processor_from_handle(int64_t handle);
 std::string create_json_string(const std::string& key, const std::string& value);
 
 /**
- * エラーメッセージをJSON形式で作成
+ * エラーメッセージをJSON形式で作成（メッセージはエスケープする）
  */
 std::string create_error_json(const std::string& message);
 
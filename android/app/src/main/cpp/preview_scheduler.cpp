@@ -0,0 +1,125 @@
+#include "preview_scheduler.h"
+#include <algorithm>
+
+namespace raw_editor {
+
+static const char* TAG = "PreviewScheduler";
+
+PreviewScheduler::PreviewScheduler()
+    : has_pending_(false),
+      running_(false),
+      next_sequence_(1),
+      refine_(nullptr),
+      latest_taken_(true) {
+}
+
+bool PreviewScheduler::request(const AdjustmentParams& params, const ProcessingOptions& options,
+                               bool progressive, u64& sequence) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 途中の要求は最新の要求に統合される（パラメータは常に全体のスナップショット）
+    pending_.params = params;
+    pending_.options = options;
+    pending_.options.job = nullptr;
+    pending_.progressive = progressive;
+    pending_.sequence = next_sequence_++;
+    has_pending_ = true;
+    sequence = pending_.sequence;
+
+    // 描き直し中なら中止して、新しい要求の描画を早める
+    if (refine_) {
+        refine_->cancel();
+    }
+
+    if (running_) {
+        return false;
+    }
+    running_ = true;
+    return true;
+}
+
+void PreviewScheduler::launch_failed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+}
+
+void PreviewScheduler::drain(JobControl& job, const RenderFunction& render) {
+    Request request;
+    while (next_request(job, request)) {
+        JobControl refine(&job);
+        
+        // 出力サイズが指定されていない（フル解像度の）要求は縮小できないため段階表示しない
+        const ProcessingOptions& requested = request.options;
+        if (request.progressive && requested.output_width > 0 && requested.output_height > 0) {
+            ProcessingOptions draft_options = requested;
+            draft_options.draft = true;
+            draft_options.output_width = std::max(1u, requested.output_width / DRAFT_SCALE);
+            draft_options.output_height = std::max(1u, requested.output_height / DRAFT_SCALE);
+            draft_options.job = &job;
+            ImageResult draft = render(request.params, draft_options);
+            if (draft.code != ResultCode::ERROR_CANCELLED) {
+                publish(request.sequence, true, std::move(draft));
+            }
+
+            // 先行結果の描画中に次の要求が届いていれば、描き直さずにそちらへ進む
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (has_pending_) {
+                continue;
+            }
+            refine_ = &refine;
+        }
+
+        ProcessingOptions options = requested;
+        options.job = &refine;
+        ImageResult result = render(request.params, options);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            refine_ = nullptr;
+        }
+
+        if (result.code == ResultCode::ERROR_CANCELLED) {
+            LOG_INFO(TAG, "Preview refinement superseded");
+            continue;
+        }
+        publish(request.sequence, false, std::move(result));
+    }
+}
+
+bool PreviewScheduler::take(PreviewFrame& frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (latest_taken_) {
+        return false;
+    }
+    frame = latest_;
+    latest_taken_ = true;
+    return true;
+}
+
+bool PreviewScheduler::next_request(const JobControl& job, Request& request) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_pending_ || job.is_cancelled()) {
+        // 判定と running_ の更新は同じロック内で行う（直後の request が新しいジョブを起動できる）
+        // 中止された場合は保留中の要求を残し、次の request で描画ジョブを起動し直す
+        running_ = false;
+        return false;
+    }
+    request = pending_;
+    has_pending_ = false;
+    return true;
+}
+
+void PreviewScheduler::publish(u64 sequence, bool draft, ImageResult result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 新しい要求の先行結果や最終結果を、古い要求の結果で上書きしない
+    const bool newer = sequence > latest_.sequence || (sequence == latest_.sequence && latest_.draft && !draft);
+    if (!newer) {
+        return;
+    }
+    latest_.sequence = sequence;
+    latest_.draft = draft;
+    latest_.result = std::move(result);
+    latest_taken_ = false;
+}
+
+} // namespace raw_editor
@@ -0,0 +1,110 @@
+#ifndef PREVIEW_SCHEDULER_H
+#define PREVIEW_SCHEDULER_H
+
+#include "common_types.h"
+#include "job_control.h"
+#include <functional>
+#include <mutex>
+
+namespace raw_editor {
+
+/**
+ * 公開されたプレビュー
+ */
+struct PreviewFrame {
+    u64 sequence = 0;       // 対応する要求の通し番号
+    bool draft = false;     // 段階表示の低解像度の先行結果
+    ImageResult result;
+};
+
+/**
+ * 最新優先のプレビュースケジューラ（プロセッサーごとに1つ）
+ * 描画中の要求は1つ、保留中の要求は1つまでで、描画中に届いた要求は保留中の要求を上書きする。
+ * 描画が終わると保留中の最新の要求だけを描画するため、スライダー操作が速くても
+ * 待ち行列は伸びず、最新のパラメータが反映されるまでの遅延は描画2回分に収まる。
+ * 描画中の要求は中止しない（中止し続けると結果が一度も出ないため）。
+ *
+ * 段階表示では先に1/4解像度で描画して公開し、その間に新しい要求が届かなければ
+ * 出力解像度で描き直す。描き直しの途中で新しい要求が届いた場合は描き直しを中止する。
+ *
+ * 描画スレッドは持たず、request が起動を求めたときに呼び出し側が drain をジョブとして実行する。
+ */
+class PreviewScheduler {
+public:
+    using RenderFunction = std::function<ImageResult(const AdjustmentParams&, const ProcessingOptions&)>;
+
+    // 段階表示の先行描画の縮小率（1辺あたり）
+    static constexpr u32 DRAFT_SCALE = 4;
+
+    PreviewScheduler();
+
+    PreviewScheduler(const PreviewScheduler&) = delete;
+    PreviewScheduler& operator=(const PreviewScheduler&) = delete;
+
+    /**
+     * プレビューを要求（保留中の要求は置き換えられる）
+     * @param params 調整パラメータ
+     * @param options 処理オプション
+     * @param progressive 低解像度の先行結果を先に公開するか
+     * @param sequence 要求の通し番号の格納先
+     * @return 描画ジョブの起動が必要なら true（呼び出し側で drain を実行すること）
+     */
+    bool request(const AdjustmentParams& params, const ProcessingOptions& options, bool progressive,
+                 u64& sequence);
+
+    /**
+     * 描画ジョブの起動に失敗したことを通知（次の request で再び起動を求める）
+     */
+    void launch_failed();
+
+    /**
+     * 保留中の要求がなくなるまで描画を続ける（描画ジョブ本体）
+     * @param job 描画ジョブ（中止されると保留中の要求を残したまま戻る）
+     * @param render 描画関数
+     */
+    void drain(JobControl& job, const RenderFunction& render);
+
+    /**
+     * まだ受け取っていない最新のプレビューを取り出す（ブロックしない）
+     * @param frame プレビューの格納先
+     * @return 新しいプレビューがあれば true
+     */
+    bool take(PreviewFrame& frame);
+
+private:
+    struct Request {
+        AdjustmentParams params;
+        ProcessingOptions options;
+        bool progressive = false;
+        u64 sequence = 0;
+    };
+
+    std::mutex mutex_;
+    Request pending_;
+    bool has_pending_;
+    bool running_;
+    u64 next_sequence_;
+
+    // 実行中の描き直し（新しい要求が届いたら中止する）
+    JobControl* refine_;
+
+    PreviewFrame latest_;
+    bool latest_taken_;
+
+    /**
+     * 保留中の要求を取り出す
+     * @param job 描画ジョブ
+     * @param request 要求の格納先
+     * @return 要求があれば true（なし・中止の場合は描画ジョブの終了として扱う）
+     */
+    bool next_request(const JobControl& job, Request& request);
+
+    /**
+     * 描画結果を公開（既に公開済みのものより古い結果は捨てる）
+     */
+    void publish(u64 sequence, bool draft, ImageResult result);
+};
+
+} // namespace raw_editor
+
+#endif // PREVIEW_SCHEDULER_H
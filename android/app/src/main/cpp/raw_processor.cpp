@@ -1,26 +1,59 @@
 #include "raw_processor.h"
-#include <android/log.h>
+#include "fused_pipeline.h"
+#include "jpeg_decoder.h"
+#include "scanline_writer.h"
+#include "tiled_renderer.h"
+#include "trace.h"
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
 
 namespace raw_editor {
 
 static const char* TAG = "RawProcessor";
 
+namespace {
+
+// 呼び出しの間だけ実行中のジョブを登録する（LibRawの進捗コールバックが参照する）
+class ActiveJobScope {
+public:
+    ActiveJobScope(JobControl*& slot, JobControl* job) : slot_(slot), previous_(slot) { slot_ = job; }
+    ~ActiveJobScope() { slot_ = previous_; }
+
+private:
+    JobControl*& slot_;
+    JobControl* previous_;
+};
+
+ImageResult cancelled_image() {
+    LOG_INFO(TAG, "Processing cancelled");
+    return ImageResult(ResultCode::ERROR_CANCELLED, std::string("Cancelled"));
+}
+
+} // namespace
+
 RawProcessor::RawProcessor() 
     : libraw_(std::make_unique<LibRaw>()), 
-      is_loaded_(false), 
-      cache_valid_(false) {
+      is_loaded_(false),
+      is_unpacked_(false),
+      base_method_(DemosaicMethod::HIGH_QUALITY),
+      preview_pipeline_(build_preview_stages(preview_source_)),
+      draft_pipeline_(build_preview_stages(draft_source_)),
+      active_job_(nullptr),
+      trace_context_(trace_new_context()) {
     
     // LibRawの初期設定
     libraw_->imgdata.params.use_camera_wb = 1;
     libraw_->imgdata.params.use_auto_wb = 0;
     libraw_->imgdata.params.output_color = 1; // sRGB
-    libraw_->imgdata.params.gamma_16bit = 1;
+    libraw_->imgdata.params.gamm[0] = 1.0; // リニア出力（ガンマは作業画像生成時に適用）
+    libraw_->imgdata.params.gamm[1] = 1.0;
     libraw_->imgdata.params.no_auto_bright = 1;
     libraw_->imgdata.params.bright = 1.0;
     libraw_->imgdata.params.output_bps = 16;
+    libraw_->set_progress_handler(&RawProcessor::libraw_progress, this);
     
     LOG_INFO(TAG, "RawProcessor initialized");
 }
@@ -30,12 +63,28 @@ RawProcessor::~RawProcessor() {
     LOG_INFO(TAG, "RawProcessor destroyed");
 }
 
-BoolResult RawProcessor::load_raw_file(const std::string& file_path) {
+BoolResult RawProcessor::load_raw_file(const std::string& file_path, bool thumbnail_only, RawInput input) {
+    TraceContextScope trace_context(trace_context_);
+    TraceScope trace("load_raw_file");
+    
     LOG_INFO(TAG, ("Loading RAW file: " + file_path).c_str());
     
     // 既存のファイルをクリア
     clear();
     
+    if (input == RawInput::MAPPED) {
+        auto mapped = std::make_unique<MappedFile>();
+        BoolResult map_result = mapped->open(file_path);
+        if (map_result.is_success()) {
+            return open_mapped(std::move(mapped), file_path, thumbnail_only);
+        }
+        if (map_result.code == ResultCode::ERROR_FILE_NOT_FOUND) {
+            return map_result;
+        }
+        // マップできないファイル（特殊なファイルシステムなど）はファイルストリームで読む
+        LOG_INFO(TAG, "Falling back to stream input");
+    }
+    
     // ファイル存在確認
     std::ifstream file(file_path);
     if (!file.good()) {
@@ -44,31 +93,128 @@ BoolResult RawProcessor::load_raw_file(const std::string& file_path) {
         return BoolResult(ResultCode::ERROR_FILE_NOT_FOUND, error);
     }
     
-    // LibRawでファイルを開く
-    int ret = libraw_->open_file(file_path.c_str());
+    // LibRawでファイルを開く（メタデータとサムネイルの位置はここで読まれる）
+    int ret;
+    {
+        TraceScope libraw_trace("libraw.open_file");
+        ret = libraw_->open_file(file_path.c_str());
+    }
     if (ret != LIBRAW_SUCCESS) {
         std::string error = "Failed to open RAW file: " + get_libraw_error_message(ret);
         LOG_ERROR(TAG, error.c_str());
         return BoolResult(ResultCode::ERROR_LIBRAW_ERROR, error);
     }
+    return finish_open(file_path, thumbnail_only);
+}
+
+BoolResult RawProcessor::load_raw_descriptor(int fd, const std::string& name, bool thumbnail_only) {
+    TraceContextScope trace_context(trace_context_);
+    TraceScope trace("load_raw_descriptor");
+    
+    LOG_INFO(TAG, ("Loading RAW file from descriptor: " + name).c_str());
+    
+    clear();
+    
+    auto mapped = std::make_unique<MappedFile>();
+    BoolResult map_result = mapped->open_descriptor(fd);
+    if (map_result.is_error()) {
+        return map_result;
+    }
+    return open_mapped(std::move(mapped), name, thumbnail_only);
+}
+
+BoolResult RawProcessor::load_bayer_buffer(std::vector<u16> samples, u32 width, u32 height, u32 bits_per_sample,
+                                           const std::string& name) {
+    TraceContextScope trace_context(trace_context_);
+    TraceScope trace("load_bayer_buffer");
+    
+    LOG_INFO(TAG, ("Loading Bayer buffer: " + name).c_str());
+    
+    clear();
+    
+    if (width < 2 || height < 2 || width % 2 != 0 || height % 2 != 0 || width > 65535 || height > 65535 ||
+        bits_per_sample < 10 || bits_per_sample > 16 ||
+        samples.size() != static_cast<size_t>(width) * height) {
+        std::string error = "Invalid Bayer buffer: " + std::to_string(width) + "x" + std::to_string(height);
+        LOG_ERROR(TAG, error.c_str());
+        return BoolResult(ResultCode::ERROR_INVALID_PARAMETERS, error);
+    }
     
-    // ファイル情報を読み込み
-    ret = libraw_->unpack();
+    // LibRawはバッファを直接読む（recycle まで保持する）
+    bayer_samples_ = std::move(samples);
+    const size_t bytes = bayer_samples_.size() * sizeof(u16);
+    int ret;
+    {
+        TraceScope libraw_trace("libraw.open_bayer");
+        ret = libraw_->open_bayer(reinterpret_cast<const unsigned char*>(bayer_samples_.data()),
+                                  static_cast<unsigned>(bytes), width, height, 0, 0, 0, 0, 0,
+                                  LIBRAW_OPENBAYER_RGGB, 16 - bits_per_sample, 0, 0);
+    }
     if (ret != LIBRAW_SUCCESS) {
-        std::string error = "Failed to unpack RAW file: " + get_libraw_error_message(ret);
+        std::string error = "Failed to open Bayer buffer: " + get_libraw_error_message(ret);
         LOG_ERROR(TAG, error.c_str());
         libraw_->recycle();
+        bayer_samples_.clear();
         return BoolResult(ResultCode::ERROR_LIBRAW_ERROR, error);
     }
-    
-    current_file_path_ = file_path;
+    return finish_open(name, false);
+}
+
+BoolResult RawProcessor::open_mapped(std::unique_ptr<MappedFile> mapped, const std::string& name,
+                                     bool thumbnail_only) {
+    // サムネイルのみならヘッダーと埋め込みJPEGしか読まないため、先読みを抑える
+    mapped->advise(thumbnail_only ? MappedFile::Access::RANDOM : MappedFile::Access::SEQUENTIAL);
+    
+    // LibRawはバッファを直接読む（マップは recycle まで保持する）
+    int ret;
+    {
+        TraceScope libraw_trace("libraw.open_buffer");
+        ret = libraw_->open_buffer(mapped->data(), mapped->size());
+    }
+    if (ret != LIBRAW_SUCCESS) {
+        std::string error = "Failed to open RAW file: " + get_libraw_error_message(ret);
+        LOG_ERROR(TAG, error.c_str());
+        libraw_->recycle();
+        return BoolResult(ResultCode::ERROR_LIBRAW_ERROR, error);
+    }
+    mapped_file_ = std::move(mapped);
+    return finish_open(name, thumbnail_only);
+}
+
+BoolResult RawProcessor::finish_open(const std::string& name, bool thumbnail_only) {
+    current_file_path_ = name;
     is_loaded_ = true;
     invalidate_cache();
+    if (disk_cache_) {
+        file_identity_ = current_file_identity();
+    }
     
-    LOG_INFO(TAG, "RAW file loaded successfully");
+    // センサーデータの展開は現像が必要になるまで遅延できる
+    if (!thumbnail_only) {
+        BoolResult unpack_result = ensure_unpacked();
+        if (unpack_result.is_error()) {
+            clear();
+            return unpack_result;
+        }
+    }
+    
+    LOG_INFO(TAG, thumbnail_only ? "RAW file opened for metadata and thumbnail" : "RAW file loaded successfully");
     return BoolResult(ResultCode::SUCCESS, true);
 }
 
+FileIdentity RawProcessor::current_file_identity() const {
+    // マップ済みならファイルを開き直さずに求める（記述子で開いたファイルはパスで開けない）
+    if (mapped_file_) {
+        return make_file_identity(current_file_path_, mapped_file_->data(), mapped_file_->size(),
+                                  mapped_file_->modified_ns());
+    }
+    if (!bayer_samples_.empty()) {
+        return make_file_identity(current_file_path_, reinterpret_cast<const byte*>(bayer_samples_.data()),
+                                  bayer_samples_.size() * sizeof(u16), 0);
+    }
+    return make_file_identity(current_file_path_);
+}
+
 MetadataResult RawProcessor::extract_metadata() const {
     if (!is_loaded_) {
         return MetadataResult(ResultCode::ERROR_INVALID_PARAMETERS, "No RAW file loaded");
@@ -110,8 +256,9 @@ MetadataResult RawProcessor::extract_metadata() const {
     metadata.image_height = libraw_->imgdata.sizes.height;
     
     // ホワイトバランス
-    metadata.color_temperature = libraw_->imgdata.color.WB_Coeffs[0] > 0 ? 
-        6500.0f / libraw_->imgdata.color.WB_Coeffs[0] * libraw_->imgdata.color.WB_Coeffs[2] : 0.0f;
+    // 撮影時の乗数（R, G, B, G2）から青/赤の比で概算する
+    const float* cam_mul = libraw_->imgdata.color.cam_mul;
+    metadata.color_temperature = cam_mul[0] > 0.0f ? 6500.0f / cam_mul[0] * cam_mul[2] : 0.0f;
     
     // 色空間
     metadata.color_space = "sRGB"; // デフォルト
@@ -121,122 +268,155 @@ MetadataResult RawProcessor::extract_metadata() const {
 }
 
 ImageResult RawProcessor::generate_thumbnail(u32 max_size) const {
+    TraceContextScope trace_context(trace_context_);
+    TraceScope trace("generate_thumbnail");
+    
     if (!is_loaded_) {
         return ImageResult(ResultCode::ERROR_INVALID_PARAMETERS, "No RAW file loaded");
     }
     
     LOG_INFO(TAG, ("Generating thumbnail with max size: " + std::to_string(max_size)).c_str());
     
-    // LibRawから埋め込みサムネイルを取得
-    int ret = libraw_->unpack_thumb();
-    if (ret == LIBRAW_SUCCESS && libraw_->imgdata.thumbnail.thumb) {
-        // 埋め込みサムネイルが利用可能
-        cv::Mat thumb_mat;
-        
-        if (libraw_->imgdata.thumbnail.tformat == LIBRAW_THUMBNAIL_JPEG) {
-            // JPEG サムネイル
-            std::vector<u8> jpeg_data(
-                libraw_->imgdata.thumbnail.thumb,
-                libraw_->imgdata.thumbnail.thumb + libraw_->imgdata.thumbnail.tlength
-            );
-            thumb_mat = cv::imdecode(jpeg_data, cv::IMREAD_COLOR);
-        } else {
-            // RAW サムネイル（PPM形式など）
-            cv::Mat raw_thumb(
-                libraw_->imgdata.thumbnail.theight,
-                libraw_->imgdata.thumbnail.twidth,
-                CV_8UC3,
-                libraw_->imgdata.thumbnail.thumb
-            );
-            thumb_mat = raw_thumb.clone();
-        }
-        
-        if (!thumb_mat.empty()) {
-            // サイズ調整
-            cv::Mat resized = resize_if_needed(thumb_mat, max_size, max_size);
-            cv::cvtColor(resized, resized, cv::COLOR_BGR2RGB);
-            
-            ImageData result = mat_to_image_data(resized);
-            LOG_INFO(TAG, "Thumbnail generated from embedded thumbnail");
-            return ImageResult(ResultCode::SUCCESS, result);
+    // ディスクキャッシュにあればLibRawを使わずに返す
+    if (disk_cache_ && file_identity_.is_valid()) {
+        ImageResult cached = cached_thumbnail(*disk_cache_, file_identity_, max_size);
+        if (cached.is_success()) {
+            return cached;
         }
     }
     
-    // 埋め込みサムネイルが利用できない場合、RAWから生成
-    ProcessingOptions options(true);
-    options.output_width = max_size;
-    options.output_height = max_size;
-    
-    cv::Mat image = process_with_libraw(options);
-    if (image.empty()) {
+    cv::Mat thumbnail = render_thumbnail(max_size);
+    if (thumbnail.empty()) {
         return ImageResult(ResultCode::ERROR_PROCESSING_FAILED, "Failed to process RAW for thumbnail");
     }
+    if (disk_cache_) {
+        store_thumbnail(thumbnail, max_size);
+    }
+    
+    cv::Mat rgb;
+    cv::cvtColor(thumbnail, rgb, cv::COLOR_BGR2RGB);
+    return ImageResult(ResultCode::SUCCESS, mat_to_image_data(rgb));
+}
+
+BytesResult RawProcessor::generate_encoded_thumbnail(u32 max_size) const {
+    TraceContextScope trace_context(trace_context_);
+    TraceScope trace("generate_encoded_thumbnail");
+    
+    if (!is_loaded_) {
+        return BytesResult(ResultCode::ERROR_INVALID_PARAMETERS, "No RAW file loaded");
+    }
+    
+    // キャッシュ済みのJPEGはデコードせずにそのまま返す
+    std::vector<byte> encoded;
+    if (disk_cache_ && file_identity_.is_valid() &&
+        disk_cache_->get(file_identity_.cache_key(disk_cache_kind(max_size), max_size), encoded)) {
+        return BytesResult(ResultCode::SUCCESS, encoded);
+    }
+    
+    cv::Mat thumbnail = render_thumbnail(max_size);
+    if (thumbnail.empty()) {
+        return BytesResult(ResultCode::ERROR_PROCESSING_FAILED, "Failed to process RAW for thumbnail");
+    }
     
-    cv::Mat resized = resize_if_needed(image, max_size, max_size);
-    cv::cvtColor(resized, resized, cv::COLOR_BGR2RGB);
+    encoded = store_thumbnail(thumbnail, max_size);
+    if (encoded.empty()) {
+        return BytesResult(ResultCode::ERROR_OPENCV_ERROR, "Failed to encode thumbnail");
+    }
+    return BytesResult(ResultCode::SUCCESS, encoded);
+}
+
+ImageResult RawProcessor::cached_thumbnail(DiskImageCache& cache, const FileIdentity& identity, u32 max_size) {
+    std::vector<byte> encoded;
+    if (!identity.is_valid() || !cache.get(identity.cache_key(disk_cache_kind(max_size), max_size), encoded)) {
+        return ImageResult(ResultCode::ERROR_FILE_NOT_FOUND, "Thumbnail not cached");
+    }
+    
+    cv::Mat bgr = decode_jpeg_scaled(encoded.data(), encoded.size(), 0);
+    if (bgr.empty()) {
+        return ImageResult(ResultCode::ERROR_INVALID_FORMAT, "Failed to decode cached thumbnail");
+    }
     
-    ImageData result = mat_to_image_data(resized);
-    LOG_INFO(TAG, "Thumbnail generated from RAW processing");
-    return ImageResult(ResultCode::SUCCESS, result);
+    cv::Mat rgb;
+    cv::cvtColor(bgr, rgb, cv::COLOR_BGR2RGB);
+    PixelBuffer buffer(rgb.data, rgb.total() * rgb.elemSize(), [rgb]() mutable { rgb.release(); });
+    ImageData image_data(rgb.cols, rgb.rows, 3, 8, std::move(buffer));
+    LOG_INFO(TAG, "Thumbnail served from disk cache");
+    return ImageResult(ResultCode::SUCCESS, image_data);
 }
 
 ImageResult RawProcessor::generate_preview(
     const AdjustmentParams& params,
-    const ProcessingOptions& options) {
+    const ProcessingOptions& options,
+    const PixelBuffer& destination) {
+    
+    TraceContextScope trace_context(trace_context_);
+    TraceScope trace("generate_preview");
     
     if (!is_loaded_) {
         return ImageResult(ResultCode::ERROR_INVALID_PARAMETERS, "No RAW file loaded");
     }
     
     LOG_INFO(TAG, "Generating preview with adjustments");
+    ActiveJobScope job_scope(active_job_, options.job);
     
-    // キャッシュされた画像を使用するか確認
-    cv::Mat base_image;
-    if (cache_valid_ && !cached_image_.empty()) {
-        base_image = cached_image_.clone();
-    } else {
-        base_image = process_with_libraw(options);
-        if (base_image.empty()) {
-            return ImageResult(ResultCode::ERROR_PROCESSING_FAILED, "Failed to process RAW");
-        }
-        
-        // キャッシュを更新
-        cached_image_ = base_image.clone();
-        cache_valid_ = true;
+    // 現像済みベースから出力サイズに合うピラミッドレベルを取得
+    u32 max_width = options.preview_mode ? options.output_width : 0;
+    u32 max_height = options.preview_mode ? options.output_height : 0;
+    if (options.job) {
+        options.job->begin_phase(0.0f, 0.3f);
+    }
+    DevelopedLevelInfo level;
+    cv::Mat linear = get_linear_image(max_width, max_height, false, &level);
+    if (options.job && options.job->is_cancelled()) {
+        return cancelled_image();
+    }
+    if (linear.empty()) {
+        return ImageResult(ResultCode::ERROR_PROCESSING_FAILED, "Failed to process RAW");
     }
-    
-    // 調整を段階的に適用
-    cv::Mat result = base_image.clone();
     
     try {
-        // 1. ホワイトバランス調整
-        result = apply_white_balance(result, params);
-        
-        // 2. 基本調整（露出、コントラストなど）
-        result = apply_basic_adjustments(result, params);
-        
-        // 3. HSL調整
-        result = apply_hsl_adjustments(result, params);
+        // フレームはピラミッドレベルの世代・番号と出力サイズで識別する
+        // （世代はレベルが作り直されるたびに変わる。バッファのアドレスは再確保で同じ値に戻りうるため使わない）
+        const u64 frame_key = ParamFingerprint()
+            .add(level.generation).add(static_cast<u64>(level.index))
+            .add(static_cast<u64>(linear.cols)).add(static_cast<u64>(linear.rows))
+            .add(static_cast<u64>(max_width)).add(static_cast<u64>(max_height))
+            .value();
         
-        // 4. トーンカーブ
-        result = apply_tone_curve(result, params);
-        
-        // 5. ディテール調整
-        result = apply_detail_adjustments(result, params);
-        
-        // 6. レンズ補正
-        result = apply_lens_corrections(result, params);
-        
-        // 7. 変形（回転・クロップ）
-        result = apply_transform(result, params);
+        if (options.job) {
+            options.job->begin_phase(0.3f, 0.95f);
+        }
+        // ステージの出力と中間バッファ、出力画像は前回のプレビューで解放されたブロックから確保する
+        FramePoolScope pool_scope(frame_pool_);
+        IncrementalPipeline& pipeline = options.draft ? draft_pipeline_ : preview_pipeline_;
+        PreviewSource& source = options.draft ? draft_source_ : preview_source_;
         
-        // 色空間をRGBに変換
-        cv::cvtColor(result, result, cv::COLOR_BGR2RGB);
+        // 出力サイズまで縮小し、出力に必要な領域だけを切り出して変更のあったステージ以降を適用
+        // （領域が変わればノイズ除去から作り直すため、入力のキーに含める）
+        if (source.frame.empty() || source.frame_key != frame_key) {
+            source.frame = resize_if_needed(linear, max_width, max_height);
+            source.frame_key = frame_key;
+        }
+        source.region = preview_region(source.frame.size(), params);
+        const u64 source_key = ParamFingerprint()
+            .add(frame_key)
+            .add(static_cast<u64>(source.region.x)).add(static_cast<u64>(source.region.y))
+            .add(static_cast<u64>(source.region.width)).add(static_cast<u64>(source.region.height))
+            .value();
+        cv::Mat result = pipeline.render(source_key, [&]() {
+            return source.frame(source.region);
+        }, params, options.job);
+        check_cancelled(options.job);
         
-        ImageData image_data = mat_to_image_data(result);
-        LOG_INFO(TAG, "Preview generated successfully");
+        // 表示用に8ビットRGBへ量子化
+        ImageData image_data = quantize_output(result, 8, destination);
+        LOG_INFO(TAG, ((options.draft ? "Draft preview generated, re-run from stage " :
+                                        "Preview generated, re-run from stage ") +
+                       std::to_string(pipeline.last_first_dirty_stage())).c_str());
         return ImageResult(ResultCode::SUCCESS, image_data);
         
+    } catch (const JobCancelled&) {
+        return cancelled_image();
     } catch (const cv::Exception& e) {
         std::string error = "OpenCV error during processing: " + std::string(e.what());
         LOG_ERROR(TAG, error.c_str());
@@ -252,44 +432,80 @@ ImageResult RawProcessor::process_full_image(
     const AdjustmentParams& params,
     const ProcessingOptions& options) {
     
+    TraceContextScope trace_context(trace_context_);
+    TraceScope trace("process_full_image");
+    
     if (!is_loaded_) {
         return ImageResult(ResultCode::ERROR_INVALID_PARAMETERS, "No RAW file loaded");
     }
     
     LOG_INFO(TAG, "Processing full resolution image");
+    ActiveJobScope job_scope(active_job_, options.job);
     
     // フル解像度で処理
     ProcessingOptions full_options = options;
     full_options.preview_mode = false;
     
-    cv::Mat base_image = process_with_libraw(full_options);
-    if (base_image.empty()) {
+    if (options.job) {
+        options.job->begin_phase(0.0f, 0.3f);
+    }
+    cv::Mat linear = get_linear_image(0, 0, true);
+    if (options.job && options.job->is_cancelled()) {
+        return cancelled_image();
+    }
+    if (linear.empty()) {
         return ImageResult(ResultCode::ERROR_PROCESSING_FAILED, "Failed to process RAW at full resolution");
     }
     
-    // プレビューと同じ調整パイプラインを適用
-    cv::Mat result = base_image.clone();
-    
     try {
-        result = apply_white_balance(result, params);
-        result = apply_basic_adjustments(result, params);
-        result = apply_hsl_adjustments(result, params);
-        result = apply_tone_curve(result, params);
-        result = apply_detail_adjustments(result, params);
-        result = apply_lens_corrections(result, params);
-        result = apply_transform(result, params);
+        // プレビューと同じ調整をタイル単位で並列に適用し、16ビットで貼り合わせる
+        // 作業用のfloat画像はタイル分しか存在しない。出力ビット深度への量子化は最後の1回だけ行う
+        // ハイライト/シャドウ・クラリティのベースレイヤーはフレーム全体から1度だけ作る
+        FusedPipeline pipeline(params, ColorLut3D::EXPORT_SIZE);
+        pipeline.prepare(linear);
+        const int halo = detail_halo(params, DenoiseTier::EXPORT);
         
-        // 出力サイズの調整
-        if (full_options.output_width > 0 && full_options.output_height > 0) {
-            result = resize_if_needed(result, full_options.output_width, full_options.output_height);
+        // 出力（クロップ範囲）の生成に必要な領域だけを処理する
+        // 領域外の画素はハローとして参照されるため、全体を処理した場合と結果は一致する
+        GeometrySpec geometry = geometry_spec(linear.size(), params);
+        const cv::Rect source = geometry_source_region(geometry);
+        geometry.origin = source.tl();
+        // ビネットはストリーミング書き出しと同じくタイルの float 段階で掛ける
+        // （元画像の各画素に掛けてから補間するため、remap 後に掛けるのと等価）
+        geometry.vignetting = 0.0f;
+        
+        cv::Mat result(source.size(), CV_16UC3);
+        TiledRenderer renderer(export_pool(full_options.thread_count), DEFAULT_TILE_SIZE, options.job);
+        if (options.job) {
+            options.job->begin_phase(0.3f, 0.9f);
         }
+        renderer.render(linear, source, result, halo, [&](const cv::Mat& input, const cv::Rect& padded) {
+            cv::Mat tile = apply_noise_reduction(input, params, DenoiseTier::EXPORT, padded.tl(), false);
+            check_cancelled(options.job);
+            tile = pipeline.run(tile, false, padded.tl());
+            tile = apply_sharpening(tile, params);
+            if (params.vignetting != 0.0f) {
+                apply_vignette(tile, params, linear.size(), padded.tl());
+            }
+            
+            cv::Mat widened;
+            tile.convertTo(widened, CV_16UC3, 65535.0);
+            return widened;
+        });
+        
+        // レンズ補正・変形は画像全体の座標系に依存するため貼り合わせ後に1回の remap で適用（16ビットのまま）
+        check_cancelled(options.job);
+        result = geometry_cache_.apply(result, geometry);
         
-        cv::cvtColor(result, result, cv::COLOR_BGR2RGB);
+        // 出力サイズの調整（片方だけの制限なら縦横比を保ってその辺に合わせる）
+        result = resize_if_needed(result, full_options.output_width, full_options.output_height);
         
-        ImageData image_data = mat_to_image_data(result);
+        ImageData image_data = quantize_output(result, full_options.output_bit_depth);
         LOG_INFO(TAG, "Full resolution image processed successfully");
         return ImageResult(ResultCode::SUCCESS, image_data);
         
+    } catch (const JobCancelled&) {
+        return cancelled_image();
     } catch (const cv::Exception& e) {
         std::string error = "OpenCV error during full processing: " + std::string(e.what());
         LOG_ERROR(TAG, error.c_str());
@@ -307,6 +523,9 @@ BoolResult RawProcessor::save_image(
     const std::string& format,
     u32 quality) const {
     
+    TraceContextScope trace_context(trace_context_);
+    TraceScope trace("save_image");
+    
     if (!image_data.is_valid()) {
         return BoolResult(ResultCode::ERROR_INVALID_PARAMETERS, "Invalid image data");
     }
@@ -315,22 +534,30 @@ BoolResult RawProcessor::save_image(
     
     try {
         // ImageDataをOpenCV Matに変換
+        const int depth = image_data.bit_depth == 16 ? CV_16U : CV_8U;
         cv::Mat image(
             image_data.height, 
             image_data.width, 
-            image_data.channels == 3 ? CV_8UC3 : CV_8UC1,
+            CV_MAKETYPE(depth, image_data.channels == 3 ? 3 : 1),
             const_cast<byte*>(image_data.data.data())
         );
         
         // RGB→BGRに変換（OpenCVはBGR）
+        // 画素バッファは他のImageDataやDart側と共有されている場合があるため別バッファへ変換する
         if (image_data.channels == 3) {
-            cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+            cv::Mat bgr;
+            cv::cvtColor(image, bgr, cv::COLOR_RGB2BGR);
+            image = bgr;
         }
         
         // フォーマット別のエンコードパラメータ
         std::vector<int> encode_params;
         
         if (format == "JPEG" || format == "JPG") {
+            // JPEGは8ビットのみ対応
+            if (depth == CV_16U) {
+                image.convertTo(image, CV_8U, 1.0 / 257.0);
+            }
             encode_params.push_back(cv::IMWRITE_JPEG_QUALITY);
             encode_params.push_back(static_cast<int>(quality));
         } else if (format == "PNG") {
@@ -342,6 +569,7 @@ BoolResult RawProcessor::save_image(
         }
         
         // 画像を保存
+        TraceScope encode_trace("encode." + format, static_cast<u64>(image.total()));
         bool success = cv::imwrite(output_path, image, encode_params);
         if (!success) {
             std::string error = "Failed to save image: " + output_path;
@@ -363,6 +591,127 @@ BoolResult RawProcessor::save_image(
     }
 }
 
+BoolResult RawProcessor::export_to_file(
+    const AdjustmentParams& params,
+    const ProcessingOptions& options,
+    const std::string& output_path,
+    const std::string& format,
+    u32 quality) {
+    
+    TraceContextScope trace_context(trace_context_);
+    TraceScope trace("export_to_file");
+    
+    if (!is_loaded_) {
+        return BoolResult(ResultCode::ERROR_INVALID_PARAMETERS, "No RAW file loaded");
+    }
+    
+    LOG_INFO(TAG, ("Exporting image to: " + output_path).c_str());
+    ActiveJobScope job_scope(active_job_, options.job);
+    
+    if (options.job) {
+        options.job->begin_phase(0.0f, 0.2f);
+    }
+    cv::Mat linear = get_linear_image(0, 0, true);
+    if (options.job && options.job->is_cancelled()) {
+        return BoolResult(ResultCode::ERROR_CANCELLED, std::string("Cancelled"));
+    }
+    if (linear.empty()) {
+        return BoolResult(ResultCode::ERROR_PROCESSING_FAILED, "Failed to process RAW at full resolution");
+    }
+    
+    std::unique_ptr<ScanlineWriter> writer = create_scanline_writer(format, quality);
+    const cv::Rect crop = compute_crop_rect(linear.size(), params);
+    // process_full_image と同じ規則で、実際に縮小される場合だけフレーム全体の処理に切り替える
+    const bool needs_resize = resize_scale(crop.size(), options.output_width, options.output_height) < 1.0f;
+    
+    // 回転・歪み補正・縮小はフレーム全体を参照するため、ストリップ単位では処理できない
+    if (!writer || params.rotation != 0.0f || params.lens_distortion != 0.0f || needs_resize) {
+        LOG_INFO(TAG, "Export requires the full frame, falling back to full image processing");
+        ImageResult full_result = process_full_image(params, options);
+        if (full_result.is_error()) {
+            return BoolResult(full_result.code, full_result.error_message);
+        }
+        return save_image(full_result.data, output_path, format, quality);
+    }
+    
+    try {
+        const u32 bit_depth = writer->supported_bit_depth(options.output_bit_depth);
+        const int type = bit_depth == 16 ? CV_16UC3 : CV_8UC3;
+        const double scale = bit_depth == 16 ? 65535.0 : 255.0;
+        
+        FusedPipeline pipeline(params, ColorLut3D::EXPORT_SIZE);
+        pipeline.prepare(linear);
+        const int halo = detail_halo(params, DenoiseTier::EXPORT);
+        TiledRenderer renderer(export_pool(options.thread_count), DEFAULT_TILE_SIZE, options.job);
+        
+        if (!writer->open(output_path, crop.width, crop.height, bit_depth)) {
+            LOG_ERROR(TAG, writer->error().c_str());
+            return BoolResult(ResultCode::ERROR_PROCESSING_FAILED, writer->error());
+        }
+        
+        // クロップ範囲を横長のストリップに分け、ストリップ内はタイル単位で並列処理する
+        // メモリ上に存在するのは量子化済みの1ストリップとワーカー数分の作業タイルのみ
+        const std::vector<Tile> strips =
+            plan_tiles(linear.size(), crop, crop.width, DEFAULT_TILE_SIZE, 0);
+        cv::Mat strip;
+        for (size_t i = 0; i < strips.size(); ++i) {
+            const Tile& region = strips[i];
+            if (options.job) {
+                options.job->begin_phase(0.2f + 0.8f * i / strips.size(), 0.2f + 0.8f * (i + 1) / strips.size());
+            }
+            strip.create(region.core.size(), type);
+            renderer.render(linear, region.core, strip, halo, [&](const cv::Mat& input, const cv::Rect& padded) {
+                cv::Mat tile = apply_noise_reduction(input, params, DenoiseTier::EXPORT, padded.tl(), false);
+                check_cancelled(options.job);
+                tile = pipeline.run(tile, false, padded.tl());
+                tile = apply_sharpening(tile, params);
+                if (params.vignetting != 0.0f) {
+                    apply_vignette(tile, params, linear.size(), padded.tl());
+                }
+                
+                cv::Mat quantized;
+                tile.convertTo(quantized, type, scale);
+                return quantized;
+            });
+            
+            cv::cvtColor(strip, strip, cv::COLOR_BGR2RGB);
+            TraceScope encode_trace("encode." + format, static_cast<u64>(strip.total()));
+            if (!writer->write_rows(strip)) {
+                LOG_ERROR(TAG, writer->error().c_str());
+                std::remove(output_path.c_str());
+                return BoolResult(ResultCode::ERROR_PROCESSING_FAILED, writer->error());
+            }
+        }
+        
+        if (!writer->finish()) {
+            LOG_ERROR(TAG, writer->error().c_str());
+            std::remove(output_path.c_str());
+            return BoolResult(ResultCode::ERROR_PROCESSING_FAILED, writer->error());
+        }
+        
+        LOG_INFO(TAG, "Image exported successfully");
+        return BoolResult(ResultCode::SUCCESS, true);
+        
+    } catch (const JobCancelled&) {
+        LOG_INFO(TAG, "Export cancelled");
+        writer.reset();
+        std::remove(output_path.c_str());
+        return BoolResult(ResultCode::ERROR_CANCELLED, std::string("Cancelled"));
+    } catch (const cv::Exception& e) {
+        std::string error = "OpenCV error during export: " + std::string(e.what());
+        LOG_ERROR(TAG, error.c_str());
+        writer.reset();
+        std::remove(output_path.c_str());
+        return BoolResult(ResultCode::ERROR_OPENCV_ERROR, error);
+    } catch (const std::exception& e) {
+        std::string error = "Error during export: " + std::string(e.what());
+        LOG_ERROR(TAG, error.c_str());
+        writer.reset();
+        std::remove(output_path.c_str());
+        return BoolResult(ResultCode::ERROR_PROCESSING_FAILED, error);
+    }
+}
+
 std::string RawProcessor::get_current_file_path() const {
     return current_file_path_;
 }
@@ -375,14 +724,51 @@ void RawProcessor::clear() {
     if (libraw_ && is_loaded_) {
         libraw_->recycle();
     }
+    mapped_file_.reset();
+    bayer_samples_.clear();
+    bayer_samples_.shrink_to_fit();
     current_file_path_.clear();
+    file_identity_ = FileIdentity();
     is_loaded_ = false;
+    is_unpacked_ = false;
     invalidate_cache();
+    // 次のファイルではプレビューの大きさが変わるため、空きブロックを持ち越さない
+    frame_pool_.trim();
     
     LOG_INFO(TAG, "RawProcessor cleared");
 }
 
-// プライベートメソッドの実装は続く...
-// [次のメッセージで継続]
+void RawProcessor::set_cache_memory_budget(size_t bytes) {
+    developed_cache_.set_memory_budget(bytes);
+}
+
+void RawProcessor::set_disk_cache(std::shared_ptr<DiskImageCache> cache) {
+    disk_cache_ = std::move(cache);
+    file_identity_ = disk_cache_ && is_loaded_ ? current_file_identity() : FileIdentity();
+}
+
+WorkStealingPool& RawProcessor::export_pool(u32 thread_count) {
+    const u32 resolved = WorkStealingPool::resolve_thread_count(thread_count);
+    if (!export_pool_ || export_pool_->thread_count() != resolved) {
+        export_pool_ = std::make_unique<WorkStealingPool>(resolved);
+        LOG_INFO(TAG, ("Export pool started with " + std::to_string(resolved) + " threads").c_str());
+    }
+    return *export_pool_;
+}
+
+WorkStealingPool& RawProcessor::develop_pool() const {
+    if (!export_pool_) {
+        export_pool_ = std::make_unique<WorkStealingPool>(WorkStealingPool::resolve_thread_count(0));
+        LOG_INFO(TAG, ("Develop pool started with " + std::to_string(export_pool_->thread_count()) + " threads").c_str());
+    }
+    return *export_pool_;
+}
+
+int RawProcessor::libraw_progress(void* data, enum LibRaw_progress, int, int) {
+    const RawProcessor* self = static_cast<const RawProcessor*>(data);
+    return self->active_job_ && self->active_job_->is_cancelled() ? 1 : 0;
+}
+
+// プライベートメソッドの実装は raw_processor_impl.cpp
 
 } // namespace raw_editor
\ No newline at end of file
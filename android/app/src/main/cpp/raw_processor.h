@@ -2,6 +2,17 @@
 #define RAW_PROCESSOR_H
 
 #include "common_types.h"
+#include "demosaic.h"
+#include "denoise.h"
+#include "developed_image_cache.h"
+#include "disk_image_cache.h"
+#include "frame_pool.h"
+#include "geometry_cache.h"
+#include "incremental_pipeline.h"
+#include "job_control.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include <libraw/libraw.h>
 #include <opencv2/opencv.hpp>
 #include <string>
@@ -24,12 +35,49 @@ public:
     RawProcessor(RawProcessor&&) = delete;
     RawProcessor& operator=(RawProcessor&&) = delete;
     
+    /**
+     * RAWファイルの読み込み方法
+     */
+    enum class RawInput {
+        MAPPED,     // メモリにマップして LibRaw に渡す（既定）
+        STDIO       // LibRaw のファイルストリームで読む（比較用）
+    };
+    
     /**
      * RAWファイルを読み込む
+     * ファイルはメモリにマップして読むため、同じファイルを開き直すとページキャッシュから読まれる
+     * （マップできないファイルシステムでは LibRaw のファイルストリームで読む）
      * @param file_path RAWファイルのパス
+     * @param thumbnail_only trueならメタデータとサムネイルのみ読み込み、センサーデータの展開は
+     *                       現像が必要になるまで遅延する（ギャラリー取り込み用）
+     * @param input 読み込み方法
+     * @return 読み込み結果
+     */
+    BoolResult load_raw_file(const std::string& file_path, bool thumbnail_only = false,
+                             RawInput input = RawInput::MAPPED);
+    
+    /**
+     * ファイル記述子からRAWファイルを読み込む（コンテンツURIなどパスを持たないファイル用）
+     * 記述子は呼び出し側が所有し、この呼び出しの後に閉じてよい
+     * @param fd 読み取り可能なファイル記述子
+     * @param name ファイルの識別名（コンテンツURIなど。キャッシュキーと get_current_file_path に使う）
+     * @param thumbnail_only trueならメタデータとサムネイルのみ読み込む
+     * @return 読み込み結果
+     */
+    BoolResult load_raw_descriptor(int fd, const std::string& name, bool thumbnail_only = false);
+    
+    /**
+     * メモリ上のベイヤー配列（RGGB、16ビットリトルエンディアン）をRAWファイルとして読み込む
+     * 合成データによるベンチマーク・回帰確認用。現像はファイルと同じ経路（デモザイク / LibRaw）で行う
+     * @param samples センサー値（width * height 要素、行順。読み込み後は RawProcessor が保持する）
+     * @param width 幅（偶数）
+     * @param height 高さ（偶数）
+     * @param bits_per_sample 有効ビット数（10〜16）
+     * @param name 識別名（get_current_file_path に使う）
      * @return 読み込み結果
      */
-    BoolResult load_raw_file(const std::string& file_path);
+    BoolResult load_bayer_buffer(std::vector<u16> samples, u32 width, u32 height, u32 bits_per_sample,
+                                 const std::string& name);
     
     /**
      * RAWメタデータを抽出
@@ -37,26 +85,58 @@ public:
      */
     MetadataResult extract_metadata() const;
     
+    // これ以下の長辺サイズはサムネイル、超える場合はプレビューとしてディスクキャッシュに保存する
+    static constexpr u32 THUMBNAIL_MAX_SIZE = 512;
+    
     /**
      * サムネイル画像を生成
+     * 埋め込みJPEGは max_size に必要な分だけ縮小デコードする。
+     * ディスクキャッシュが設定されていれば、ヒット時はLibRawを使わずに返し、ミス時は結果を保存する
      * @param max_size 最大サイズ（長辺）
      * @return サムネイル画像データ
      */
     ImageResult generate_thumbnail(u32 max_size = 512) const;
     
+    /**
+     * JPEGエンコード済みのサムネイルを生成
+     * ディスクキャッシュにあればデコードせずにそのまま返す
+     * @param max_size 最大サイズ（長辺）
+     * @return JPEGデータ
+     */
+    BytesResult generate_encoded_thumbnail(u32 max_size = 512) const;
+    
+    /**
+     * ディスクキャッシュからサムネイルを取得（RAWファイルは開かない）
+     * @param cache ディスクキャッシュ
+     * @param identity ファイルの同一性
+     * @param max_size 最大サイズ（長辺）
+     * @return サムネイル画像データ（キャッシュにない場合は ERROR_FILE_NOT_FOUND）
+     */
+    static ImageResult cached_thumbnail(DiskImageCache& cache, const FileIdentity& identity, u32 max_size);
+    
     /**
      * プレビュー画像を生成（調整適用）
+     * 出力サイズがフル解像度の1/2以下ならハーフサイズ現像のプロキシから生成し、
+     * 調整はすべて出力解像度で行う。
+     * ステージごとの結果をキャッシュし、変更されたパラメータを読む最初のステージから再実行する
+     * options.job が指定されていれば、現像中・ステージ間で中止を確認する（中止時は ERROR_CANCELLED）
+     * options.draft の場合は専用のステージキャッシュを使い、通常のプレビューのキャッシュを保つ
      * @param params 調整パラメータ
      * @param options 処理オプション
+     * @param destination 出力先バッファ（呼び出し側が確保したメモリに直接描画する場合）
+     *                    空、または容量不足の場合は新しいバッファを確保する
      * @return プレビュー画像データ
      */
     ImageResult generate_preview(
         const AdjustmentParams& params,
-        const ProcessingOptions& options = ProcessingOptions(true)
+        const ProcessingOptions& options = ProcessingOptions(true),
+        const PixelBuffer& destination = PixelBuffer()
     );
     
     /**
      * 最終画像を出力（フル解像度）
+     * 調整はタイル単位で options.thread_count 本のワーカーに分散して実行する
+     * options.job が指定されていれば、現像中・タイルごとに中止を確認し、進捗を報告する
      * @param params 調整パラメータ
      * @param options 処理オプション
      * @return 出力画像データ
@@ -71,6 +151,7 @@ public:
      * @param image_data 画像データ
      * @param output_path 出力パス
      * @param format 出力フォーマット ("JPEG", "PNG", "TIFF")
+     *               16ビットのImageDataはPNG/TIFFでは16ビットのまま保存される
      * @param quality JPEG品質 (1-100)
      * @return 保存結果
      */
@@ -81,6 +162,27 @@ public:
         u32 quality = 95
     ) const;
     
+    /**
+     * 調整済み画像を行ストリップ単位でファイルへ直接書き出す
+     * ストリップごとにタイル処理してエンコーダへ渡すため、出力画像全体はメモリ上に作られない。
+     * 行単位で書き出せないフォーマット（PNG）や、画像全体を参照する変形
+     * （回転・歪み補正・縮小出力）がある場合は process_full_image + 保存にフォールバックする
+     * 中止された場合は書きかけのファイルを削除する
+     * @param params 調整パラメータ
+     * @param options 処理オプション（thread_count・output_bit_depth・出力サイズ・job）
+     * @param output_path 出力パス
+     * @param format 出力フォーマット ("JPEG", "PNG", "TIFF")
+     * @param quality JPEG品質 (1-100)
+     * @return 保存結果
+     */
+    BoolResult export_to_file(
+        const AdjustmentParams& params,
+        const ProcessingOptions& options,
+        const std::string& output_path,
+        const std::string& format = "JPEG",
+        u32 quality = 95
+    );
+    
     /**
      * 現在読み込まれているRAWファイルのパスを取得
      * @return ファイルパス
@@ -97,20 +199,236 @@ public:
      * リソースをクリア
      */
     void clear();
+    
+    /**
+     * 現像済みベース画像キャッシュのメモリ予算を設定
+     * @param bytes 予算（バイト）
+     */
+    void set_cache_memory_budget(size_t bytes);
+    
+    /**
+     * サムネイル・プレビューのディスクキャッシュを設定
+     * @param cache ディスクキャッシュ（nullptr で無効化、複数のプロセッサーで共有できる）
+     */
+    void set_disk_cache(std::shared_ptr<DiskImageCache> cache);
+    
+    /**
+     * 計測の識別子（このプロセッサーの処理で記録したイベントに付く。trace_snapshot に渡す）
+     * 生成後は変わらないため、処理中でもロックなしで読める
+     */
+    u32 trace_context() const { return trace_context_; }
+    
+    /**
+     * プレビュー用フレームプールの統計（スライダー操作中の確保回数の確認用）
+     * プール自身が同期するため、処理中でもロックなしで読める
+     */
+    FramePoolStats frame_pool_stats() const { return frame_pool_.stats(); }
 
 private:
+    // raw_bench が非公開のステージを個別に計測する
+    friend class PipelineBenchmark;
+    
+    /**
+     * プレビューのステージへの入力
+     * 出力サイズに縮小したフレームのうち、出力に必要な領域だけをステージに渡す
+     */
+    struct PreviewSource {
+        u64 frame_key = 0;  // フレームの識別キー（ピラミッドレベルと出力サイズ）
+        cv::Mat frame;      // 縮小したフレーム全体（16ビットリニア、ベースレイヤーの生成にも使う）
+        cv::Rect region;    // ステージに渡す領域（フレーム座標）
+    };
+    
     std::unique_ptr<LibRaw> libraw_;
+    std::unique_ptr<MappedFile> mapped_file_; // LibRaw が参照中の入力（recycle まで解放しない）
+    std::vector<u16> bayer_samples_;          // load_bayer_buffer の入力（同上）
     std::string current_file_path_;
     bool is_loaded_;
-    mutable cv::Mat cached_image_;
-    mutable bool cache_valid_;
+    mutable bool is_unpacked_;
+    mutable DevelopedImageCache developed_cache_;
+    mutable DemosaicMethod base_method_; // キャッシュ中のベース画像のデモザイク方式
+    mutable GeometryCache geometry_cache_;
+    mutable std::unique_ptr<WorkStealingPool> export_pool_;
+    std::shared_ptr<DiskImageCache> disk_cache_;
+    FileIdentity file_identity_;
+    FramePool frame_pool_; // プレビューのステージ出力・中間バッファ・出力画像を再利用する
+    PreviewSource preview_source_;
+    PreviewSource draft_source_;
+    IncrementalPipeline preview_pipeline_;
+    IncrementalPipeline draft_pipeline_; // 低解像度の先行プレビュー用（通常のプレビューのキャッシュを追い出さない）
+    
+    // 実行中の非同期ジョブ（LibRawの進捗コールバックから中止を確認する）
+    mutable JobControl* active_job_;
+    
+    const u32 trace_context_;
     
     /**
-     * LibRawで画像を処理してOpenCV Mat形式に変換
-     * @param options 処理オプション
-     * @return OpenCV Mat
+     * LibRawの進捗コールバック
+     * 実行中のジョブが中止されていれば現像を打ち切る（dcraw_process は LIBRAW_CANCELLED_BY_CALLBACK を返す）
+     * @param data RawProcessor
+     * @return 0 = 続行、非0 = 中止
+     */
+    static int libraw_progress(void* data, enum LibRaw_progress stage, int iteration, int expected);
+    
+    /**
+     * 埋め込みサムネイル（なければ現像結果）から指定サイズのサムネイルを作成
+     * @param max_size 最大サイズ（長辺）
+     * @return 8ビットBGR画像（失敗時は空）
+     */
+    cv::Mat render_thumbnail(u32 max_size) const;
+    
+    /**
+     * サムネイルをJPEGにエンコードし、ディスクキャッシュが設定されていれば保存
+     * @param thumbnail 8ビットBGR画像
+     * @param max_size 要求された最大サイズ（キャッシュキーの一部）
+     * @return JPEGデータ（エンコード失敗時は空）
      */
-    cv::Mat process_with_libraw(const ProcessingOptions& options);
+    std::vector<byte> store_thumbnail(const cv::Mat& thumbnail, u32 max_size) const;
+    
+    /**
+     * 要求サイズに対応するディスクキャッシュの種類
+     * @param max_size 最大サイズ（長辺）
+     * @return DiskImageCache::KIND_THUMBNAIL または KIND_PREVIEW
+     */
+    static u32 disk_cache_kind(u32 max_size);
+    
+    /**
+     * マップ済みのファイルを LibRaw で開く
+     * @param mapped マップ済みのファイル
+     * @param name ファイルの識別名
+     * @param thumbnail_only trueならセンサーデータを展開しない
+     * @return 読み込み結果
+     */
+    BoolResult open_mapped(std::unique_ptr<MappedFile> mapped, const std::string& name, bool thumbnail_only);
+    
+    /**
+     * LibRaw で開いた後の共通処理（状態の更新と、必要ならセンサーデータの展開）
+     * @param name ファイルの識別名
+     * @param thumbnail_only trueならセンサーデータを展開しない
+     * @return 読み込み結果
+     */
+    BoolResult finish_open(const std::string& name, bool thumbnail_only);
+    
+    /**
+     * 読み込み中のファイルの同一性（ディスクキャッシュのキー）
+     * @return 同一性
+     */
+    FileIdentity current_file_identity() const;
+    
+    /**
+     * センサーデータを展開（展開済みなら何もしない）
+     * @return 展開結果
+     */
+    BoolResult ensure_unpacked() const;
+    
+    /**
+     * RAW現像を行い、16ビットリニアの画像をキャッシュに登録
+     * ベイヤー配列のセンサーは独自のデモザイクで並列に現像し、それ以外（X-Trans など）は LibRaw で現像する
+     * @param method デモザイク方式（HALF_SIZE ならプロキシを登録）
+     * @return 成功ならtrue（中止された場合は false）
+     */
+    bool develop(DemosaicMethod method) const;
+    
+    /**
+     * 展開済みのセンサーデータからデモザイクの入力を作る
+     * @param frame 格納先
+     * @return 独自のデモザイクで扱えるベイヤー配列なら true
+     */
+    bool describe_bayer_frame(BayerFrame& frame) const;
+    
+    /**
+     * LibRawでRAW現像を行い、16ビットリニアの画像をキャッシュに登録
+     * @param method デモザイク方式（HALF_SIZE はハーフサイズ現像、BILINEAR は LibRaw の線形補間）
+     * @return 成功ならtrue
+     */
+    bool process_with_libraw(DemosaicMethod method) const;
+    
+    /**
+     * 現像結果をキャッシュに登録
+     * @param image 16ビットリニアBGR画像
+     * @param method デモザイク方式
+     */
+    void store_developed(const cv::Mat& image, DemosaicMethod method) const;
+    
+    /**
+     * フル解像度で現像した場合の画像サイズを取得（現像前に判定できる値）
+     * @return 画像サイズ
+     */
+    cv::Size full_developed_size() const;
+    
+    /**
+     * 指定サイズの出力がプロキシ（ハーフサイズ現像）で賄えるかチェック
+     * @param max_width 最大幅 (0 = フル解像度)
+     * @param max_height 最大高さ (0 = フル解像度)
+     * @return 賄えるならtrue
+     */
+    bool proxy_suffices(u32 max_width, u32 max_height) const;
+    
+    /**
+     * 現像済みベース画像から16ビットリニア画像を取得（必要なら現像を実行）
+     * 返される画像はキャッシュとバッファを共有する
+     * @param max_width 最大幅 (0 = フル解像度)
+     * @param max_height 最大高さ (0 = フル解像度)
+     * @param final_quality 書き出しなどの最終出力なら true（フル解像度は高品質のデモザイクで現像する）
+     * @param level 出力：取得したピラミッドレベルの番号と世代（キャッシュのキー用、nullptr = 不要）
+     * @return 16ビットリニアBGR画像
+     */
+    cv::Mat get_linear_image(u32 max_width, u32 max_height, bool final_quality = false,
+                             DevelopedLevelInfo* level = nullptr) const;
+    
+    /**
+     * 現像済みベース画像から作業用画像を取得（必要なら現像を実行）
+     * @param max_width 最大幅 (0 = フル解像度)
+     * @param max_height 最大高さ (0 = フル解像度)
+     * @return 8ビットBGR画像（sRGBガンマ）
+     */
+    cv::Mat get_working_image(u32 max_width, u32 max_height) const;
+    
+    /**
+     * 16ビットリニア画像を8ビットsRGBガンマ画像に変換
+     * @param linear 16ビットリニア画像
+     * @return 8ビット画像
+     */
+    cv::Mat linear_to_display(const cv::Mat& linear) const;
+    
+    /**
+     * プレビュー用の増分パイプラインのステージを構築
+     * 重いノイズ除去を先頭に置き、他のスライダー操作ではキャッシュが再利用されるようにする
+     * ステージは source.region の画像を受け取り、フレーム上の位置に合わせて処理する
+     * @param source パイプラインの入力（render の前に generate_preview が更新する）
+     * @return ステージ一覧（実行順）
+     */
+    std::vector<PipelineStage> build_preview_stages(const PreviewSource& source) const;
+    
+    /**
+     * プレビューでステージに渡す領域
+     * 幾何補正が参照する範囲にディテール処理のハローを加え、グリッドに揃える
+     * （クロップや回転の小さな変更ではノイズ除去からの再実行にならない）
+     * @param frame フレームのサイズ
+     * @param params 調整パラメータ
+     * @return 領域（フレーム座標）
+     */
+    cv::Rect preview_region(const cv::Size& frame, const AdjustmentParams& params) const;
+    
+    /**
+     * 書き出し用スレッドプールを取得（ワーカー数が変わった場合は作り直す）
+     * @param thread_count ワーカー数 (0 = 自動)
+     * @return スレッドプール
+     */
+    WorkStealingPool& export_pool(u32 thread_count);
+    
+    /**
+     * 現像用のスレッドプールを取得（書き出し用のプールがあれば共有し、なければワーカー数を自動で作る）
+     * @return スレッドプール
+     */
+    WorkStealingPool& develop_pool() const;
+    
+    /**
+     * ディテール調整が参照する周辺画素の幅
+     * @param params 調整パラメータ
+     * @param tier ノイズ除去の品質段階
+     * @return ハロー幅（ピクセル）
+     */
+    int detail_halo(const AdjustmentParams& params, DenoiseTier tier) const;
     
     /**
      * 基本調整を適用
@@ -145,7 +463,28 @@ private:
     cv::Mat apply_tone_curve(const cv::Mat& image, const AdjustmentParams& params) const;
     
     /**
-     * シャープニング・ノイズ除去を適用
+     * ノイズ除去を適用
+     * 16ビットのリニア画像に対して行うため、後段の調整による量子化の影響を受けない
+     * @param linear 16ビットリニアBGR画像
+     * @param params 調整パラメータ
+     * @param tier 品質段階（プレビューはウェーブレット、書き出しはNLM）
+     * @param origin 入力の左上のフレーム上の位置（タイル処理時）
+     * @param parallel 行方向に並列化するか（タイル処理時は false）
+     * @return ノイズ除去済み16ビットリニア画像
+     */
+    cv::Mat apply_noise_reduction(const cv::Mat& linear, const AdjustmentParams& params, DenoiseTier tier,
+                                  cv::Point origin = cv::Point(), bool parallel = true) const;
+    
+    /**
+     * シャープニング（アンシャープマスク）を適用
+     * @param image 入力画像
+     * @param params 調整パラメータ
+     * @return 調整済み画像
+     */
+    cv::Mat apply_sharpening(const cv::Mat& image, const AdjustmentParams& params) const;
+    
+    /**
+     * シャープニング・ノイズ除去を適用（旧パイプラインの順序・プレビュー段階のノイズ除去）
      * @param image 入力画像
      * @param params 調整パラメータ
      * @return 調整済み画像
@@ -153,13 +492,32 @@ private:
     cv::Mat apply_detail_adjustments(const cv::Mat& image, const AdjustmentParams& params) const;
     
     /**
-     * レンズ補正を適用
+     * レンズ補正を適用（ビネット・歪み補正）
      * @param image 入力画像
      * @param params 調整パラメータ
      * @return 調整済み画像
      */
     cv::Mat apply_lens_corrections(const cv::Mat& image, const AdjustmentParams& params) const;
     
+    /**
+     * ビネット補正を画像の一部に適用
+     * 補正量はフレーム全体の中心からの距離で決まるため、タイル・ストリップ単位でも適用できる
+     * @param image float画像（in-placeで補正）
+     * @param params 調整パラメータ
+     * @param frame_size フレーム全体のサイズ
+     * @param offset image の左上のフレーム上の位置
+     */
+    void apply_vignette(cv::Mat& image, const AdjustmentParams& params,
+                        const cv::Size& frame_size, const cv::Point& offset) const;
+    
+    /**
+     * クロップ範囲を計算
+     * @param size 画像サイズ
+     * @param params 調整パラメータ
+     * @return クロップ矩形
+     */
+    cv::Rect compute_crop_rect(const cv::Size& size, const AdjustmentParams& params) const;
+    
     /**
      * 変形（回転・クロップ）を適用
      * @param image 入力画像
@@ -168,13 +526,42 @@ private:
      */
     cv::Mat apply_transform(const cv::Mat& image, const AdjustmentParams& params) const;
     
+    /**
+     * 幾何補正の指定を作成
+     * @param frame フレーム全体のサイズ
+     * @param params 調整パラメータ
+     * @return 幾何補正の指定（origin はフレームの左上）
+     */
+    GeometrySpec geometry_spec(const cv::Size& frame, const AdjustmentParams& params) const;
+    
+    /**
+     * レンズ補正と変形をまとめて適用
+     * 参照座標テーブルとビネットのゲイン場はキャッシュされ、クロップ範囲だけを1回の remap で生成する
+     * @param image 入力画像
+     * @param params 調整パラメータ
+     * @return 補正済み画像（クロップ範囲）
+     */
+    cv::Mat apply_geometry(const cv::Mat& image, const AdjustmentParams& params) const;
+    
     /**
      * OpenCV MatをImageDataに変換
+     * 連続したMatはコピーせずバッファを共有するため、変換後に mat を書き換えないこと
      * @param mat OpenCV Mat
      * @return ImageData
      */
     ImageData mat_to_image_data(const cv::Mat& mat) const;
     
+    /**
+     * 作業用float画像を出力ビット深度のRGB ImageDataに量子化
+     * 既に出力ビット深度に量子化済みの画像はそのまま変換する
+     * @param image [0, 1]範囲のfloat BGR画像
+     * @param bit_depth 出力ビット深度 (8 または 16)
+     * @param destination 出力先バッファ（空、または容量不足の場合は新しく確保する）
+     * @return ImageData
+     */
+    ImageData quantize_output(const cv::Mat& image, u32 bit_depth,
+                              const PixelBuffer& destination = PixelBuffer()) const;
+    
     /**
      * 色温度を色調整行列に変換
      * @param temperature 色温度
@@ -199,6 +586,15 @@ private:
      */
     cv::Mat resize_if_needed(const cv::Mat& image, u32 max_width, u32 max_height) const;
     
+    /**
+     * resize_if_needed が使う縮小倍率（片方だけの制限にも対応）
+     * @param size 入力サイズ
+     * @param max_width 最大幅 (0 = 制限なし)
+     * @param max_height 最大高さ (0 = 制限なし)
+     * @return 倍率（1以上ならリサイズしない）
+     */
+    static f32 resize_scale(const cv::Size& size, u32 max_width, u32 max_height);
+    
     /**
      * キャッシュを無効化
      */
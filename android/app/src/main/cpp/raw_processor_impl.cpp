@@ -1,57 +1,458 @@
 // raw_processor.cpp の続き - プライベートメソッドの実装
 
 #include "raw_processor.h"
-#include <android/log.h>
+#include "fused_pipeline.h"
+#include "jpeg_decoder.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 namespace raw_editor {
 
-cv::Mat RawProcessor::process_with_libraw(const ProcessingOptions& options) {
-    LOG_INFO(TAG, "Processing with LibRaw");
+static const char* TAG = "RawProcessor";
+
+// サムネイル・プレビューをキャッシュへ保存する際のJPEG品質
+static constexpr int THUMBNAIL_JPEG_QUALITY = 85;
+
+// プレビューでステージに渡す領域を揃えるグリッド（ピクセル）
+static constexpr int PREVIEW_REGION_GRID = 64;
+
+BoolResult RawProcessor::ensure_unpacked() const {
+    if (is_unpacked_) {
+        return BoolResult(ResultCode::SUCCESS, true);
+    }
     
-    // LibRawでRAW現像処理
-    int ret = libraw_->dcraw_process();
+    // サムネイル専用に開いたマップでも、展開は先頭から順に読むため先読みを広げる
+    if (mapped_file_) {
+        mapped_file_->advise(MappedFile::Access::SEQUENTIAL);
+    }
+    
+    // センサーデータを展開（ファイル全体のデコードを伴うため、現像が必要になるまで遅延する）
+    int ret;
+    {
+        TraceScope trace("libraw.unpack");
+        ret = libraw_->unpack();
+    }
+    if (ret != LIBRAW_SUCCESS) {
+        std::string error = "Failed to unpack RAW file: " + get_libraw_error_message(ret);
+        LOG_ERROR(TAG, error.c_str());
+        return BoolResult(ResultCode::ERROR_LIBRAW_ERROR, error);
+    }
+    
+    is_unpacked_ = true;
+    return BoolResult(ResultCode::SUCCESS, true);
+}
+
+bool RawProcessor::develop(DemosaicMethod method) const {
+    if (ensure_unpacked().is_error()) {
+        return false;
+    }
+    
+    BayerFrame frame;
+    if (!describe_bayer_frame(frame)) {
+        // X-Trans・4色・非CFAのセンサーは LibRaw で現像する
+        return process_with_libraw(method);
+    }
+    
+    LOG_INFO(TAG, (std::string("Demosaicing (") + demosaic_method_name(method) + ")").c_str());
+    cv::Mat image;
+    try {
+        image = demosaic_bayer(frame, method, develop_pool(), active_job_);
+    } catch (const JobCancelled&) {
+        LOG_INFO(TAG, "Demosaic cancelled");
+        return false;
+    } catch (const std::exception& e) {
+        LOG_ERROR(TAG, ("Demosaic failed: " + std::string(e.what())).c_str());
+        return false;
+    }
+    
+    if (image.empty()) {
+        return process_with_libraw(method);
+    }
+    
+    store_developed(image, method);
+    LOG_INFO(TAG, "Demosaic completed successfully");
+    return true;
+}
+
+bool RawProcessor::describe_bayer_frame(BayerFrame& frame) const {
+    // 展開直後の値を使う（imgdata 側は dcraw_process で書き換えられる）
+    const libraw_rawdata_t& raw = libraw_->imgdata.rawdata;
+    const libraw_colordata_t& color = raw.color;
+    const libraw_image_sizes_t& sizes = raw.sizes;
+    const unsigned filters = raw.iparams.filters;
+    
+    // 特殊な配列 (< 1000、X-Trans = 9)、4色、色ごとに展開済みのデータ、斜め配列（Fuji SuperCCD）は対象外
+    if (!raw.raw_image || filters < 1000 || raw.iparams.colors != 3 || raw.ioparams.fuji_width ||
+        sizes.pixel_aspect != 1.0) {
+        return false;
+    }
+    
+    // LibRaw の FC(row, col)。2x2周期でない配列は対象外
+    auto fc = [filters](int row, int col) {
+        return static_cast<int>(filters >> ((((row << 1) & 14) | (col & 1)) << 1) & 3);
+    };
+    for (int row = 0; row < 8; ++row) {
+        for (int col = 0; col < 2; ++col) {
+            if (fc(row, col) != fc(row & 1, col)) {
+                return false;
+            }
+        }
+    }
+    
+    // 黒レベルのパターンは2x2周期のもののみ畳み込める
+    const unsigned pattern_rows = color.cblack[4];
+    const unsigned pattern_cols = color.cblack[5];
+    if (pattern_rows > 2 || pattern_cols > 2) {
+        return false;
+    }
+    
+    // ホワイトバランス（dcraw の scale_colors と同じく、最小の倍率が 1 になるよう正規化）
+    f32 multipliers[4];
+    const bool camera_wb = libraw_->imgdata.params.use_camera_wb &&
+                           color.cam_mul[0] > 0 && color.cam_mul[1] > 0 && color.cam_mul[2] > 0;
+    for (int c = 0; c < 4; ++c) {
+        multipliers[c] = camera_wb ? color.cam_mul[c] : color.pre_mul[c];
+    }
+    if (multipliers[3] <= 0) {
+        multipliers[3] = multipliers[1];
+    }
+    if (multipliers[0] <= 0 || multipliers[1] <= 0 || multipliers[2] <= 0) {
+        return false;
+    }
+    const f32 min_multiplier = *std::min_element(multipliers, multipliers + 4);
+    
+    for (int row = 0; row < 2; ++row) {
+        for (int col = 0; col < 2; ++col) {
+            const int c = fc(row, col);
+            f32 black = static_cast<f32>(color.black + color.cblack[c]);
+            if (pattern_rows > 0 && pattern_cols > 0) {
+                black += color.cblack[6 + (row % pattern_rows) * pattern_cols + col % pattern_cols];
+            }
+            const f32 range = static_cast<f32>(color.maximum) - black;
+            if (range <= 0) {
+                return false;
+            }
+            
+            frame.color[row][col] = c == 3 ? 1 : c; // 2つ目の緑
+            frame.black[row][col] = black;
+            frame.scale[row][col] = multipliers[c] / min_multiplier * 65535.0f / range;
+        }
+    }
+    
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            frame.camera_to_output[i][j] = color.rgb_cam[i][j];
+        }
+    }
+    
+    frame.stride = sizes.raw_pitch / sizeof(u16);
+    frame.data = raw.raw_image + sizes.top_margin * frame.stride + sizes.left_margin;
+    frame.width = sizes.width;
+    frame.height = sizes.height;
+    frame.flip = sizes.flip;
+    return true;
+}
+
+bool RawProcessor::process_with_libraw(DemosaicMethod method) const {
+    const bool half_size = method == DemosaicMethod::HALF_SIZE;
+    LOG_INFO(TAG, half_size ? "Processing proxy with LibRaw" : "Processing with LibRaw");
+    
+    if (ensure_unpacked().is_error()) {
+        return false;
+    }
+    
+    // LibRawでRAW現像処理（unpack済みのデータから何度でも現像し直せる）
+    // 双線形の段階では補間品質を下げる（X-Trans は補間の反復回数が減る）
+    libraw_->imgdata.params.half_size = half_size ? 1 : 0;
+    libraw_->imgdata.params.user_qual = method == DemosaicMethod::BILINEAR ? 0 : -1;
+    int ret;
+    {
+        TraceScope trace("libraw.dcraw_process");
+        ret = libraw_->dcraw_process();
+    }
+    libraw_->imgdata.params.half_size = 0;
+    libraw_->imgdata.params.user_qual = -1;
     if (ret != LIBRAW_SUCCESS) {
         LOG_ERROR(TAG, ("LibRaw dcraw_process failed: " + get_libraw_error_message(ret)).c_str());
-        return cv::Mat();
+        return false;
     }
     
     // 処理済み画像を取得
-    libraw_processed_image_t* processed = libraw_->dcraw_make_mem_image(&ret);
+    libraw_processed_image_t* processed;
+    {
+        TraceScope trace("libraw.dcraw_make_mem_image");
+        processed = libraw_->dcraw_make_mem_image(&ret);
+    }
     if (ret != LIBRAW_SUCCESS || !processed) {
         LOG_ERROR(TAG, ("LibRaw dcraw_make_mem_image failed: " + get_libraw_error_message(ret)).c_str());
-        return cv::Mat();
+        return false;
     }
     
-    // OpenCV Matに変換
-    cv::Mat result;
+    // 16ビットリニアのBGR画像に変換（パイプラインはBGR順を前提とする）
+    cv::Mat base;
     
-    if (processed->type == LIBRAW_IMAGE_BITMAP) {
+    if (processed->type == LIBRAW_IMAGE_BITMAP && processed->bits == 16) {
         if (processed->colors == 3) {
-            // RGB 画像
-            cv::Mat rgb_image(processed->height, processed->width, CV_8UC3, processed->data);
-            result = rgb_image.clone();
+            cv::Mat rgb_image(processed->height, processed->width, CV_16UC3, processed->data);
+            cv::cvtColor(rgb_image, base, cv::COLOR_RGB2BGR);
         } else if (processed->colors == 1) {
-            // グレースケール画像
-            cv::Mat gray_image(processed->height, processed->width, CV_8UC1, processed->data);
-            result = gray_image.clone();
+            cv::Mat gray_image(processed->height, processed->width, CV_16UC1, processed->data);
+            cv::cvtColor(gray_image, base, cv::COLOR_GRAY2BGR);
         }
     }
     
     // メモリを解放
     LibRaw::dcraw_clear_mem(processed);
     
-    if (result.empty()) {
+    if (base.empty()) {
         LOG_ERROR(TAG, "Failed to convert LibRaw image to OpenCV Mat");
-        return cv::Mat();
+        return false;
     }
     
-    // プレビューモードの場合はリサイズ
-    if (options.preview_mode && (options.output_width > 0 || options.output_height > 0)) {
-        result = resize_if_needed(result, options.output_width, options.output_height);
+    store_developed(base, method);
+    LOG_INFO(TAG, "LibRaw processing completed successfully");
+    return true;
+}
+
+void RawProcessor::store_developed(const cv::Mat& image, DemosaicMethod method) const {
+    if (method == DemosaicMethod::HALF_SIZE) {
+        developed_cache_.set_proxy(image, full_developed_size());
+    } else {
+        developed_cache_.set_base(image);
+        base_method_ = method;
+    }
+}
+
+cv::Mat RawProcessor::render_thumbnail(u32 max_size) const {
+    // LibRawから埋め込みサムネイルを取得（センサーデータは展開しない）
+    int ret;
+    {
+        TraceScope trace("libraw.unpack_thumb");
+        ret = libraw_->unpack_thumb();
+    }
+    if (ret == LIBRAW_SUCCESS && libraw_->imgdata.thumbnail.thumb) {
+        // 埋め込みサムネイルが利用可能
+        const libraw_thumbnail_t& thumbnail = libraw_->imgdata.thumbnail;
+        cv::Mat thumb_mat;
+        
+        if (thumbnail.tformat == LIBRAW_THUMBNAIL_JPEG) {
+            // JPEG サムネイル（フルサイズのことが多いため、DCT領域で縮小しながらデコード）
+            const byte* jpeg_data = reinterpret_cast<const byte*>(thumbnail.thumb);
+            thumb_mat = decode_jpeg_scaled(jpeg_data, thumbnail.tlength, max_size);
+            if (thumb_mat.empty()) {
+                std::vector<byte> buffer(jpeg_data, jpeg_data + thumbnail.tlength);
+                thumb_mat = cv::imdecode(buffer, cv::IMREAD_COLOR);
+            }
+        } else if (thumbnail.tformat == LIBRAW_THUMBNAIL_BITMAP) {
+            // RAW サムネイル（RGB順の8ビットビットマップ）
+            cv::Mat raw_thumb(thumbnail.theight, thumbnail.twidth, CV_8UC3, thumbnail.thumb);
+            cv::cvtColor(raw_thumb, thumb_mat, cv::COLOR_RGB2BGR);
+        }
+        
+        if (!thumb_mat.empty()) {
+            LOG_INFO(TAG, "Thumbnail generated from embedded thumbnail");
+            return resize_if_needed(thumb_mat, max_size, max_size);
+        }
     }
     
-    LOG_INFO(TAG, "LibRaw processing completed successfully");
-    return result;
+    // 埋め込みサムネイルが利用できない場合、現像済みベースから生成
+    cv::Mat image = get_working_image(max_size, max_size);
+    if (image.empty()) {
+        return image;
+    }
+    
+    LOG_INFO(TAG, "Thumbnail generated from RAW processing");
+    return resize_if_needed(image, max_size, max_size);
+}
+
+std::vector<byte> RawProcessor::store_thumbnail(const cv::Mat& thumbnail, u32 max_size) const {
+    std::vector<byte> encoded;
+    TraceScope trace("encode.thumbnail", static_cast<u64>(thumbnail.total()));
+    if (!cv::imencode(".jpg", thumbnail, encoded, {cv::IMWRITE_JPEG_QUALITY, THUMBNAIL_JPEG_QUALITY})) {
+        encoded.clear();
+        return encoded;
+    }
+    
+    if (disk_cache_ && file_identity_.is_valid()) {
+        disk_cache_->put(file_identity_.cache_key(disk_cache_kind(max_size), max_size), encoded);
+    }
+    return encoded;
+}
+
+u32 RawProcessor::disk_cache_kind(u32 max_size) {
+    return max_size <= THUMBNAIL_MAX_SIZE ? DiskImageCache::KIND_THUMBNAIL : DiskImageCache::KIND_PREVIEW;
+}
+
+cv::Size RawProcessor::full_developed_size() const {
+    const auto& sizes = libraw_->imgdata.sizes;
+    
+    // 90度回転（flip & 4）では縦横が入れ替わる
+    if (sizes.flip & 4) {
+        return cv::Size(sizes.height, sizes.width);
+    }
+    return cv::Size(sizes.width, sizes.height);
+}
+
+bool RawProcessor::proxy_suffices(u32 max_width, u32 max_height) const {
+    if (max_width == 0 && max_height == 0) {
+        return false;
+    }
+    
+    // resize_if_needed と同じ規則で出力倍率を求め、1/2以下ならプロキシで足りる
+    const cv::Size full = full_developed_size();
+    if (full.width <= 0 || full.height <= 0) {
+        return false;
+    }
+    f32 scale_x = max_width > 0 ? static_cast<f32>(max_width) / full.width : 1.0f;
+    f32 scale_y = max_height > 0 ? static_cast<f32>(max_height) / full.height : 1.0f;
+    return std::min(scale_x, scale_y) <= 0.5f;
+}
+
+cv::Mat RawProcessor::get_linear_image(u32 max_width, u32 max_height, bool final_quality,
+                                       DevelopedLevelInfo* level) const {
+    // 最終出力でフル解像度付近が必要なら、プレビュー用に双線形補間で現像したベースを現像し直す
+    if (final_quality && developed_cache_.has_base() && base_method_ != DemosaicMethod::HIGH_QUALITY &&
+        !proxy_suffices(max_width, max_height)) {
+        if (!develop(DemosaicMethod::HIGH_QUALITY)) {
+            return cv::Mat();
+        }
+    }
+    
+    // キャッシュで賄えない場合のみ現像を実行
+    if (!developed_cache_.can_serve(max_width, max_height)) {
+        // 表示解像度の要求にはハーフサイズ現像のプロキシで応え、フル解像度の現像を遅らせる
+        bool developed = false;
+        if (!developed_cache_.has_proxy() && proxy_suffices(max_width, max_height)) {
+            developed = develop(DemosaicMethod::HALF_SIZE) && developed_cache_.can_serve(max_width, max_height);
+        }
+        if (active_job_ && active_job_->is_cancelled()) {
+            return cv::Mat();
+        }
+        // フル解像度はプレビューなら双線形、最終出力なら高品質で現像する
+        if (!developed && !develop(final_quality ? DemosaicMethod::HIGH_QUALITY : DemosaicMethod::BILINEAR)) {
+            return cv::Mat();
+        }
+    }
+    
+    return developed_cache_.get_level(max_width, max_height, level);
+}
+
+cv::Mat RawProcessor::get_working_image(u32 max_width, u32 max_height) const {
+    cv::Mat linear = get_linear_image(max_width, max_height);
+    if (linear.empty()) {
+        return cv::Mat();
+    }
+    
+    return linear_to_display(linear);
+}
+
+cv::Mat RawProcessor::linear_to_display(const cv::Mat& linear) const {
+    TraceScope trace("linear_to_display", static_cast<u64>(linear.total()));
+    
+    // 16ビットリニア → 8ビットsRGBのルックアップテーブル（初回のみ生成）
+    static const std::vector<uchar> srgb_lut = [] {
+        std::vector<uchar> lut(65536);
+        for (int i = 0; i < 65536; ++i) {
+            f32 v = i / 65535.0f;
+            f32 encoded = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+            lut[i] = cv::saturate_cast<uchar>(encoded * 255.0f);
+        }
+        return lut;
+    }();
+    
+    cv::Mat display(linear.size(), CV_8UC(linear.channels()));
+    const int row_elements = linear.cols * linear.channels();
+    
+    cv::parallel_for_(cv::Range(0, linear.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            const u16* src = linear.ptr<u16>(y);
+            uchar* dst = display.ptr<uchar>(y);
+            for (int i = 0; i < row_elements; ++i) {
+                dst[i] = srgb_lut[src[i]];
+            }
+        }
+    });
+    
+    return display;
+}
+
+std::vector<PipelineStage> RawProcessor::build_preview_stages(const PreviewSource& source) const {
+    std::vector<PipelineStage> stages;
+    
+    // 1. ノイズ除去（最も重いため先頭に置き、他の調整の変更ではキャッシュを再利用する）
+    stages.push_back({
+        "denoise",
+        [](const AdjustmentParams& p) {
+            return ParamFingerprint().add({p.noise_reduction, p.color_noise_reduction}).value();
+        },
+        [](const AdjustmentParams& p) {
+            return p.noise_reduction != 0.0f || p.color_noise_reduction != 0.0f;
+        },
+        [this, &source](const cv::Mat& image, const AdjustmentParams& p) {
+            return apply_noise_reduction(image, p, DenoiseTier::PREVIEW, source.region.tl());
+        }
+    });
+    
+    // 2. ホワイトバランス〜トーンカーブ（融合パス、16ビットリニア→float）
+    stages.push_back({
+        "color",
+        [](const AdjustmentParams& p) {
+            return ParamFingerprint()
+                .add({p.exposure, p.highlights, p.shadows, p.whites, p.blacks,
+                      p.contrast, p.brightness, p.clarity, p.vibrance, p.saturation,
+                      p.temperature, p.tint})
+                .add({p.hue_red, p.hue_orange, p.hue_yellow, p.hue_green,
+                      p.hue_aqua, p.hue_blue, p.hue_purple, p.hue_magenta})
+                .add({p.saturation_red, p.saturation_orange, p.saturation_yellow, p.saturation_green,
+                      p.saturation_aqua, p.saturation_blue, p.saturation_purple, p.saturation_magenta})
+                .add({p.luminance_red, p.luminance_orange, p.luminance_yellow, p.luminance_green,
+                      p.luminance_aqua, p.luminance_blue, p.luminance_purple, p.luminance_magenta})
+                .add({p.curve_highlights, p.curve_lights, p.curve_darks, p.curve_shadows})
+                .value();
+        },
+        [](const AdjustmentParams&) { return true; },
+        [&source](const cv::Mat& image, const AdjustmentParams& p) {
+            // ベースレイヤーは切り出す前のフレーム全体から作る（書き出しと同じ効き方になる）
+            FusedPipeline pipeline(p);
+            pipeline.prepare(source.frame);
+            return pipeline.run(image, true, source.region.tl());
+        }
+    });
+    
+    // 3. シャープニング
+    stages.push_back({
+        "sharpen",
+        [](const AdjustmentParams& p) { return ParamFingerprint().add(p.sharpening).value(); },
+        [](const AdjustmentParams& p) { return p.sharpening != 0.0f; },
+        [this](const cv::Mat& image, const AdjustmentParams& p) {
+            return apply_sharpening(image, p);
+        }
+    });
+    
+    // 4. 幾何補正（ビネット・歪み補正・回転・クロップを1回の remap で行う）
+    stages.push_back({
+        "geometry",
+        [](const AdjustmentParams& p) {
+            return ParamFingerprint()
+                .add({p.vignetting, p.lens_distortion, p.rotation,
+                      p.crop_left, p.crop_top, p.crop_right, p.crop_bottom})
+                .value();
+        },
+        [](const AdjustmentParams& p) {
+            return p.vignetting != 0.0f || p.lens_distortion != 0.0f || p.rotation != 0.0f ||
+                   p.crop_left != 0.0f || p.crop_top != 0.0f ||
+                   p.crop_right != 1.0f || p.crop_bottom != 1.0f;
+        },
+        [this, &source](const cv::Mat& image, const AdjustmentParams& p) {
+            GeometrySpec geometry = geometry_spec(source.frame.size(), p);
+            geometry.origin = source.region.tl();
+            return geometry_cache_.apply(image, geometry);
+        }
+    });
+    
+    return stages;
 }
 
 cv::Mat RawProcessor::apply_basic_adjustments(const cv::Mat& image, const AdjustmentParams& params) const {
@@ -66,48 +467,13 @@ cv::Mat RawProcessor::apply_basic_adjustments(const cv::Mat& image, const Adjust
         result *= exposure_factor;
     }
     
-    // ハイライト・シャドウ調整
-    if (params.highlights != 0.0f || params.shadows != 0.0f) {
+    // ハイライト・シャドウ・クラリティ（縮小輝度のガイデッドフィルタによるベースレイヤーを共有し、1回の走査で適用）
+    if (params.highlights != 0.0f || params.shadows != 0.0f || params.clarity != 0.0f) {
         cv::Mat luminance;
         cv::cvtColor(result, luminance, cv::COLOR_BGR2GRAY);
-        
-        // ハイライトマスク（明るい部分）
-        cv::Mat highlight_mask;
-        cv::threshold(luminance, highlight_mask, 0.7f, 1.0f, cv::THRESH_BINARY);
-        cv::GaussianBlur(highlight_mask, highlight_mask, cv::Size(21, 21), 0);
-        
-        // シャドウマスク（暗い部分）
-        cv::Mat shadow_mask;
-        cv::threshold(luminance, shadow_mask, 0.3f, 1.0f, cv::THRESH_BINARY_INV);
-        cv::GaussianBlur(shadow_mask, shadow_mask, cv::Size(21, 21), 0);
-        
-        // ハイライト調整適用
-        if (params.highlights != 0.0f) {
-            f32 highlight_factor = 1.0f + params.highlights / 100.0f;
-            std::vector<cv::Mat> channels;
-            cv::split(result, channels);
-            
-            for (auto& channel : channels) {
-                cv::Mat adjusted = channel * highlight_factor;
-                channel = channel.mul(1.0f - highlight_mask) + adjusted.mul(highlight_mask);
-            }
-            
-            cv::merge(channels, result);
-        }
-        
-        // シャドウ調整適用
-        if (params.shadows != 0.0f) {
-            f32 shadow_factor = 1.0f + params.shadows / 100.0f;
-            std::vector<cv::Mat> channels;
-            cv::split(result, channels);
-            
-            for (auto& channel : channels) {
-                cv::Mat adjusted = channel * shadow_factor;
-                channel = channel.mul(1.0f - shadow_mask) + adjusted.mul(shadow_mask);
-            }
-            
-            cv::merge(channels, result);
-        }
+        ToneBaseLayer base = ToneBaseLayer::from_luminance(luminance);
+        apply_local_tone(result, luminance, base,
+                         params.highlights / 100.0f, params.shadows / 100.0f, params.clarity / 100.0f);
     }
     
     // ホワイト・ブラック調整
@@ -161,15 +527,6 @@ cv::Mat RawProcessor::apply_basic_adjustments(const cv::Mat& image, const Adjust
         cv::cvtColor(hsv, result, cv::COLOR_HSV2BGR);
     }
     
-    // クラリティ（ローカルコントラスト）
-    if (params.clarity != 0.0f) {
-        cv::Mat blurred;
-        cv::GaussianBlur(result, blurred, cv::Size(0, 0), 10.0);
-        cv::Mat unsharp_mask = result - blurred;
-        f32 clarity_factor = params.clarity / 100.0f;
-        result += unsharp_mask * clarity_factor;
-    }
-    
     // 値を0-1範囲にクランプ
     cv::threshold(result, result, 0.0, 0.0, cv::THRESH_TOZERO);
     cv::threshold(result, result, 1.0, 1.0, cv::THRESH_TRUNC);
@@ -221,113 +578,19 @@ cv::Mat RawProcessor::apply_white_balance(const cv::Mat& image, const Adjustment
 cv::Mat RawProcessor::apply_hsl_adjustments(const cv::Mat& image, const AdjustmentParams& params) const {
     if (image.empty()) return image;
     
-    // HSL調整が不要かチェック
-    bool has_hsl_adjustments = 
-        params.hue_red != 0.0f || params.hue_orange != 0.0f || params.hue_yellow != 0.0f ||
-        params.hue_green != 0.0f || params.hue_aqua != 0.0f || params.hue_blue != 0.0f ||
-        params.hue_purple != 0.0f || params.hue_magenta != 0.0f ||
-        params.saturation_red != 0.0f || params.saturation_orange != 0.0f ||
-        params.saturation_yellow != 0.0f || params.saturation_green != 0.0f ||
-        params.saturation_aqua != 0.0f || params.saturation_blue != 0.0f ||
-        params.saturation_purple != 0.0f || params.saturation_magenta != 0.0f ||
-        params.luminance_red != 0.0f || params.luminance_orange != 0.0f ||
-        params.luminance_yellow != 0.0f || params.luminance_green != 0.0f ||
-        params.luminance_aqua != 0.0f || params.luminance_blue != 0.0f ||
-        params.luminance_purple != 0.0f || params.luminance_magenta != 0.0f;
-    
-    if (!has_hsl_adjustments) {
+    // バンドごとの調整値は融合パイプラインと共通の変換で求める
+    PointOpsProgram program = compile_point_ops(params);
+    if (!program.has_hsl) {
         return image;
     }
     
-    cv::Mat result = image.clone();
-    result.convertTo(result, CV_32F, 1.0/255.0);
-    
-    // HSV色空間に変換
-    cv::Mat hsv;
-    cv::cvtColor(result, hsv, cv::COLOR_BGR2HSV);
-    
-    std::vector<cv::Mat> hsv_channels;
-    cv::split(hsv, hsv_channels);
-    
-    cv::Mat hue = hsv_channels[0];
-    cv::Mat saturation = hsv_channels[1];
-    cv::Mat value = hsv_channels[2];
-    
-    // 色相範囲の定義（0-360度をOpenCVの0-180に変換）
-    struct ColorRange {
-        f32 min_hue, max_hue;
-        f32 hue_adj, sat_adj, lum_adj;
-    };
-    
-    std::vector<ColorRange> color_ranges = {
-        {0, 15, params.hue_red, params.saturation_red, params.luminance_red},          // 赤
-        {15, 45, params.hue_orange, params.saturation_orange, params.luminance_orange}, // オレンジ
-        {45, 75, params.hue_yellow, params.saturation_yellow, params.luminance_yellow}, // 黄
-        {75, 105, params.hue_green, params.saturation_green, params.luminance_green},   // 緑
-        {105, 135, params.hue_aqua, params.saturation_aqua, params.luminance_aqua},     // シアン
-        {135, 165, params.hue_blue, params.saturation_blue, params.luminance_blue},     // 青
-        {165, 195, params.hue_purple, params.saturation_purple, params.luminance_purple}, // 紫
-        {195, 225, params.hue_magenta, params.saturation_magenta, params.luminance_magenta}, // マゼンタ
-        {345, 360, params.hue_red, params.saturation_red, params.luminance_red},        // 赤（wraparound）
-    };
-    
-    for (const auto& range : color_ranges) {
-        if (range.hue_adj == 0.0f && range.sat_adj == 0.0f && range.lum_adj == 0.0f) {
-            continue;
-        }
-        
-        // 色相マスクを作成
-        cv::Mat mask;
-        if (range.max_hue > 180) {
-            // 色相が180度を超える場合（赤の wraparound）
-            cv::Mat mask1, mask2;
-            cv::inRange(hue, cv::Scalar(range.min_hue / 2), cv::Scalar(180), mask1);
-            cv::inRange(hue, cv::Scalar(0), cv::Scalar((range.max_hue - 360) / 2), mask2);
-            mask = mask1 | mask2;
-        } else {
-            cv::inRange(hue, cv::Scalar(range.min_hue / 2), cv::Scalar(range.max_hue / 2), mask);
-        }
-        
-        mask.convertTo(mask, CV_32F, 1.0/255.0);
-        
-        // フェザリング（ソフトな境界）
-        cv::GaussianBlur(mask, mask, cv::Size(5, 5), 2.0);
-        
-        // 色相調整
-        if (range.hue_adj != 0.0f) {
-            cv::Mat adjusted_hue = hue + range.hue_adj / 2.0f; // OpenCVは0-180なので半分
-            hue = hue.mul(1.0f - mask) + adjusted_hue.mul(mask);
-        }
-        
-        // 彩度調整
-        if (range.sat_adj != 0.0f) {
-            f32 sat_factor = 1.0f + range.sat_adj / 100.0f;
-            cv::Mat adjusted_sat = saturation * sat_factor;
-            saturation = saturation.mul(1.0f - mask) + adjusted_sat.mul(mask);
-        }
-        
-        // 明度調整
-        if (range.lum_adj != 0.0f) {
-            f32 lum_factor = 1.0f + range.lum_adj / 100.0f;
-            cv::Mat adjusted_val = value * lum_factor;
-            value = value.mul(1.0f - mask) + adjusted_val.mul(mask);
-        }
-    }
-    
-    // 値を正規化
-    cv::normalize(hue, hue, 0, 180, cv::NORM_MINMAX);
-    cv::threshold(saturation, saturation, 0.0, 0.0, cv::THRESH_TOZERO);
-    cv::threshold(saturation, saturation, 1.0, 1.0, cv::THRESH_TRUNC);
-    cv::threshold(value, value, 0.0, 0.0, cv::THRESH_TOZERO);
-    cv::threshold(value, value, 1.0, 1.0, cv::THRESH_TRUNC);
+    HslKernel kernel(program.hsl_hue, program.hsl_saturation, program.hsl_luminance);
     
-    // チャンネルをマージしてBGRに戻す
-    hsv_channels[0] = hue;
-    hsv_channels[1] = saturation;
-    hsv_channels[2] = value;
+    cv::Mat result;
+    image.convertTo(result, CV_32F, 1.0/255.0);
     
-    cv::merge(hsv_channels, hsv);
-    cv::cvtColor(hsv, result, cv::COLOR_HSV2BGR);
+    // 8バンドをLUT参照で1回の走査にまとめて適用（色相は画素ごとに円環上で折り返す）
+    kernel.apply(result);
     
     // 8ビットに戻す
     result.convertTo(result, CV_8U, 255.0);
@@ -389,40 +652,69 @@ cv::Mat RawProcessor::apply_tone_curve(const cv::Mat& image, const AdjustmentPar
     return result;
 }
 
+cv::Rect RawProcessor::preview_region(const cv::Size& frame, const AdjustmentParams& params) const {
+    const int halo = detail_halo(params, DenoiseTier::PREVIEW);
+    const cv::Rect source = geometry_source_region(geometry_spec(frame, params));
+    
+    // ハローを加えた範囲をグリッドの外側へ広げ、フレームに収める
+    const int x0 = std::max(0, source.x - halo) / PREVIEW_REGION_GRID * PREVIEW_REGION_GRID;
+    const int y0 = std::max(0, source.y - halo) / PREVIEW_REGION_GRID * PREVIEW_REGION_GRID;
+    const int x1 = std::min(frame.width, (source.br().x + halo + PREVIEW_REGION_GRID - 1) /
+                                             PREVIEW_REGION_GRID * PREVIEW_REGION_GRID);
+    const int y1 = std::min(frame.height, (source.br().y + halo + PREVIEW_REGION_GRID - 1) /
+                                              PREVIEW_REGION_GRID * PREVIEW_REGION_GRID);
+    return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+int RawProcessor::detail_halo(const AdjustmentParams& params, DenoiseTier tier) const {
+    // シャープニング: sigma 1 のガウシアン（floatではOpenCVは半径4のカーネルを使う）
+    constexpr int SHARPEN_RADIUS = 4;
+    
+    int radius = denoise_halo(denoise_strength(params), tier);
+    if (params.sharpening != 0.0f) {
+        radius += SHARPEN_RADIUS;
+    }
+    return radius;
+}
+
+cv::Mat RawProcessor::apply_noise_reduction(const cv::Mat& linear, const AdjustmentParams& params, DenoiseTier tier,
+                                            cv::Point origin, bool parallel) const {
+    return denoise_linear(linear, denoise_strength(params), tier, origin, parallel);
+}
+
+cv::Mat RawProcessor::apply_sharpening(const cv::Mat& image, const AdjustmentParams& params) const {
+    if (image.empty() || params.sharpening == 0.0f) {
+        return image;
+    }
+    TraceScope trace("sharpen", static_cast<u64>(image.total()));
+    
+    cv::Mat blurred;
+    cv::GaussianBlur(image, blurred, cv::Size(0, 0), 1.0);
+    cv::Mat sharpened = image + (image - blurred) * (params.sharpening / 100.0f);
+    return sharpened;
+}
+
 cv::Mat RawProcessor::apply_detail_adjustments(const cv::Mat& image, const AdjustmentParams& params) const {
     if (image.empty()) return image;
     
-    cv::Mat result = image.clone();
-    
     // シャープニング
-    if (params.sharpening != 0.0f) {
-        cv::Mat blurred;
-        cv::GaussianBlur(result, blurred, cv::Size(0, 0), 1.0);
-        cv::Mat sharpened = result + (result - blurred) * (params.sharpening / 100.0f);
-        result = sharpened;
+    cv::Mat result = apply_sharpening(image, params);
+    if (result.data == image.data) {
+        result = image.clone();
     }
     
-    // ノイズ除去
-    if (params.noise_reduction != 0.0f) {
-        f32 h = params.noise_reduction * 0.3f; // 強度調整
-        cv::fastNlMeansDenoisingColored(result, result, h, h, 7, 21);
+    if (params.noise_reduction == 0.0f && params.color_noise_reduction == 0.0f) {
+        return result;
     }
     
-    // カラーノイズ除去
-    if (params.color_noise_reduction != 0.0f) {
-        cv::Mat lab;
-        cv::cvtColor(result, lab, cv::COLOR_BGR2Lab);
-        
-        std::vector<cv::Mat> lab_channels;
-        cv::split(lab, lab_channels);
-        
-        // a,bチャンネル（色情報）にのみノイズ除去を適用
-        f32 h_color = params.color_noise_reduction * 0.2f;
-        cv::fastNlMeansDenoising(lab_channels[1], lab_channels[1], h_color, 7, 21);
-        cv::fastNlMeansDenoising(lab_channels[2], lab_channels[2], h_color, 7, 21);
-        
-        cv::merge(lab_channels, lab);
-        cv::cvtColor(lab, result, cv::COLOR_Lab2BGR);
+    // ガンマ空間のfloat画像のまま、プレビューと同じ段階でノイズ除去を行う
+    if (result.depth() == CV_32F) {
+        denoise_encoded(result, denoise_strength(params), DenoiseTier::PREVIEW);
+    } else {
+        cv::Mat work;
+        result.convertTo(work, CV_32F, 1.0 / 255.0);
+        denoise_encoded(work, denoise_strength(params), DenoiseTier::PREVIEW);
+        work.convertTo(result, result.type(), 255.0);
     }
     
     return result;
@@ -431,86 +723,77 @@ cv::Mat RawProcessor::apply_detail_adjustments(const cv::Mat& image, const Adjus
 cv::Mat RawProcessor::apply_lens_corrections(const cv::Mat& image, const AdjustmentParams& params) const {
     if (image.empty()) return image;
     
-    cv::Mat result = image.clone();
-    
-    // ビネット補正
-    if (params.vignetting != 0.0f) {
-        cv::Point2f center(image.cols / 2.0f, image.rows / 2.0f);
-        f32 max_dist = std::sqrt(center.x * center.x + center.y * center.y);
-        
-        cv::Mat vignette_mask = cv::Mat::zeros(image.size(), CV_32F);
-        
-        for (int y = 0; y < image.rows; ++y) {
-            for (int x = 0; x < image.cols; ++x) {
-                f32 dist = std::sqrt((x - center.x) * (x - center.x) + (y - center.y) * (y - center.y));
-                f32 normalized_dist = dist / max_dist;
-                
-                f32 vignette_factor = 1.0f + params.vignetting / 100.0f * (1.0f - normalized_dist);
-                vignette_mask.at<f32>(y, x) = vignette_factor;
+    GeometrySpec spec;
+    spec.frame = image.size();
+    spec.crop = cv::Rect(cv::Point(0, 0), image.size());
+    spec.vignetting = params.vignetting;
+    spec.distortion = params.lens_distortion;
+    return geometry_cache_.apply(image, spec);
+}
+
+void RawProcessor::apply_vignette(cv::Mat& image, const AdjustmentParams& params,
+                                  const cv::Size& frame_size, const cv::Point& offset) const {
+    CV_Assert(image.depth() == CV_32F);
+    
+    cv::Point2f center(frame_size.width / 2.0f, frame_size.height / 2.0f);
+    f32 max_dist = std::sqrt(center.x * center.x + center.y * center.y);
+    const f32 strength = params.vignetting / 100.0f;
+    const int channels = image.channels();
+    
+    for (int y = 0; y < image.rows; ++y) {
+        f32* row = image.ptr<f32>(y);
+        const f32 dy = (y + offset.y) - center.y;
+        for (int x = 0; x < image.cols; ++x) {
+            const f32 dx = (x + offset.x) - center.x;
+            f32 normalized_dist = std::sqrt(dx * dx + dy * dy) / max_dist;
+            
+            f32 vignette_factor = 1.0f + strength * (1.0f - normalized_dist);
+            for (int c = 0; c < channels; ++c) {
+                row[x * channels + c] *= vignette_factor;
             }
         }
-        
-        result.convertTo(result, CV_32F);
-        std::vector<cv::Mat> channels;
-        cv::split(result, channels);
-        
-        for (auto& channel : channels) {
-            channel = channel.mul(vignette_mask);
-        }
-        
-        cv::merge(channels, result);
-        result.convertTo(result, CV_8U);
-    }
-    
-    // レンズ歪み補正（簡易版）
-    if (params.lens_distortion != 0.0f) {
-        cv::Mat camera_matrix = cv::Mat::eye(3, 3, CV_64F);
-        camera_matrix.at<double>(0, 0) = image.cols;
-        camera_matrix.at<double>(1, 1) = image.rows;
-        camera_matrix.at<double>(0, 2) = image.cols / 2.0;
-        camera_matrix.at<double>(1, 2) = image.rows / 2.0;
-        
-        cv::Mat dist_coeffs = cv::Mat::zeros(4, 1, CV_64F);
-        dist_coeffs.at<double>(0, 0) = params.lens_distortion / 1000.0; // 樽型/糸巻き型歪み
-        
-        cv::undistort(result, result, camera_matrix, dist_coeffs);
     }
-    
-    return result;
+}
+
+cv::Rect RawProcessor::compute_crop_rect(const cv::Size& size, const AdjustmentParams& params) const {
+    int x = static_cast<int>(params.crop_left * size.width);
+    int y = static_cast<int>(params.crop_top * size.height);
+    int width = static_cast<int>((params.crop_right - params.crop_left) * size.width);
+    int height = static_cast<int>((params.crop_bottom - params.crop_top) * size.height);
+    
+    // 境界チェック
+    x = std::max(0, std::min(x, size.width - 1));
+    y = std::max(0, std::min(y, size.height - 1));
+    width = std::max(1, std::min(width, size.width - x));
+    height = std::max(1, std::min(height, size.height - y));
+    
+    return cv::Rect(x, y, width, height);
 }
 
 cv::Mat RawProcessor::apply_transform(const cv::Mat& image, const AdjustmentParams& params) const {
     if (image.empty()) return image;
     
-    cv::Mat result = image.clone();
-    
-    // 回転
-    if (params.rotation != 0.0f) {
-        cv::Point2f center(image.cols / 2.0f, image.rows / 2.0f);
-        cv::Mat rotation_matrix = cv::getRotationMatrix2D(center, params.rotation, 1.0);
-        cv::warpAffine(result, result, rotation_matrix, image.size());
-    }
-    
-    // クロップ
-    if (params.crop_left != 0.0f || params.crop_top != 0.0f || 
-        params.crop_right != 1.0f || params.crop_bottom != 1.0f) {
-        
-        int x = static_cast<int>(params.crop_left * image.cols);
-        int y = static_cast<int>(params.crop_top * image.rows);
-        int width = static_cast<int>((params.crop_right - params.crop_left) * image.cols);
-        int height = static_cast<int>((params.crop_bottom - params.crop_top) * image.rows);
-        
-        // 境界チェック
-        x = std::max(0, std::min(x, image.cols - 1));
-        y = std::max(0, std::min(y, image.rows - 1));
-        width = std::max(1, std::min(width, image.cols - x));
-        height = std::max(1, std::min(height, image.rows - y));
-        
-        cv::Rect crop_rect(x, y, width, height);
-        result = result(crop_rect).clone();
-    }
+    GeometrySpec spec;
+    spec.frame = image.size();
+    spec.crop = compute_crop_rect(image.size(), params);
+    spec.rotation = params.rotation;
+    return geometry_cache_.apply(image, spec);
+}
+
+GeometrySpec RawProcessor::geometry_spec(const cv::Size& frame, const AdjustmentParams& params) const {
+    GeometrySpec spec;
+    spec.frame = frame;
+    spec.crop = compute_crop_rect(frame, params);
+    spec.vignetting = params.vignetting;
+    spec.distortion = params.lens_distortion;
+    spec.rotation = params.rotation;
+    return spec;
+}
+
+cv::Mat RawProcessor::apply_geometry(const cv::Mat& image, const AdjustmentParams& params) const {
+    if (image.empty()) return image;
     
-    return result;
+    return geometry_cache_.apply(image, geometry_spec(image.size(), params));
 }
 
 ImageData RawProcessor::mat_to_image_data(const cv::Mat& mat) const {
@@ -518,21 +801,71 @@ ImageData RawProcessor::mat_to_image_data(const cv::Mat& mat) const {
         return ImageData();
     }
     
-    ImageData image_data(mat.cols, mat.rows, mat.channels(), 8);
+    const u32 bit_depth = mat.depth() == CV_16U ? 16 : 8;
     
-    // データをコピー
+    // 連続したMatはバッファをコピーせずに共有する（ImageDataが生きている間Matの参照を保持）
     if (mat.isContinuous()) {
-        std::memcpy(image_data.data.data(), mat.data, mat.total() * mat.elemSize());
+        cv::Mat owner = mat;
+        PixelBuffer buffer(owner.data, mat.total() * mat.elemSize(), [owner]() mutable { owner.release(); });
+        return ImageData(mat.cols, mat.rows, mat.channels(), bit_depth, std::move(buffer));
+    }
+    
+    // 行ごとにコピー
+    ImageData image_data(mat.cols, mat.rows, mat.channels(), bit_depth);
+    const size_t row_bytes = mat.cols * mat.elemSize();
+    for (int y = 0; y < mat.rows; ++y) {
+        const uchar* src_row = mat.ptr<uchar>(y);
+        uchar* dst_row = image_data.data.data() + y * row_bytes;
+        std::memcpy(dst_row, src_row, row_bytes);
+    }
+    
+    return image_data;
+}
+
+ImageData RawProcessor::quantize_output(const cv::Mat& image, u32 bit_depth,
+                                        const PixelBuffer& destination) const {
+    if (image.empty()) {
+        return ImageData();
+    }
+    TraceScope trace("quantize_output", static_cast<u64>(image.total()));
+    
+    // 作業用のfloat画像を出力ビット深度へ量子化（パイプライン全体でここが唯一の量子化）
+    const int depth = bit_depth == 16 ? CV_16U : CV_8U;
+    cv::Mat converted;
+    if (image.depth() == depth) {
+        // タイル書き出しでは各タイルが量子化済み
+        converted = image;
+    } else if (image.depth() == CV_32F) {
+        image.convertTo(converted, depth, depth == CV_16U ? 65535.0 : 255.0);
     } else {
-        // 行ごとにコピー
-        for (int y = 0; y < mat.rows; ++y) {
-            const uchar* src_row = mat.ptr<uchar>(y);
-            uchar* dst_row = image_data.data.data() + y * mat.cols * mat.channels();
-            std::memcpy(dst_row, src_row, mat.cols * mat.channels());
+        image.convertTo(converted, depth, depth == CV_16U ? 257.0 : 1.0 / 257.0);
+    }
+    
+    // 呼び出し側のバッファに収まる場合は、最後の書き込みをそのバッファへ直接行う
+    const int type = converted.type();
+    const size_t bytes = converted.total() * converted.elemSize();
+    const bool use_destination = !destination.empty() && destination.size() >= bytes;
+    PixelBuffer target_buffer = use_destination ? destination : PixelBuffer();
+    cv::Mat output = use_destination
+        ? cv::Mat(converted.rows, converted.cols, type, target_buffer.data())
+        : cv::Mat();
+    
+    if (converted.channels() == 3) {
+        // 入力画像と共有している場合は書き換えないよう別バッファへ出力する
+        if (!use_destination && converted.data != image.data) {
+            output = converted;
         }
+        cv::cvtColor(converted, output, cv::COLOR_BGR2RGB);
+    } else if (use_destination) {
+        converted.copyTo(output);
+    } else {
+        output = converted;
     }
     
-    return image_data;
+    if (use_destination) {
+        return ImageData(output.cols, output.rows, output.channels(), depth == CV_16U ? 16 : 8, target_buffer);
+    }
+    return mat_to_image_data(output);
 }
 
 cv::Mat RawProcessor::calculate_white_balance_matrix(f32 temperature, f32 tint) const {
@@ -592,15 +925,21 @@ std::string RawProcessor::get_libraw_error_message(int error_code) const {
     }
 }
 
+f32 RawProcessor::resize_scale(const cv::Size& size, u32 max_width, u32 max_height) {
+    if (size.empty()) {
+        return 1.0f;
+    }
+    f32 scale_x = max_width > 0 ? static_cast<f32>(max_width) / size.width : 1.0f;
+    f32 scale_y = max_height > 0 ? static_cast<f32>(max_height) / size.height : 1.0f;
+    return std::min(scale_x, scale_y);
+}
+
 cv::Mat RawProcessor::resize_if_needed(const cv::Mat& image, u32 max_width, u32 max_height) const {
-    if (image.empty() || (max_width == 0 && max_height == 0)) {
+    if (image.empty()) {
         return image;
     }
     
-    f32 scale_x = max_width > 0 ? static_cast<f32>(max_width) / image.cols : 1.0f;
-    f32 scale_y = max_height > 0 ? static_cast<f32>(max_height) / image.rows : 1.0f;
-    f32 scale = std::min(scale_x, scale_y);
-    
+    const f32 scale = resize_scale(image.size(), max_width, max_height);
     if (scale >= 1.0f) {
         return image; // リサイズ不要
     }
@@ -611,8 +950,11 @@ cv::Mat RawProcessor::resize_if_needed(const cv::Mat& image, u32 max_width, u32
 }
 
 void RawProcessor::invalidate_cache() {
-    cached_image_.release();
-    cache_valid_ = false;
+    developed_cache_.clear();
+    preview_pipeline_.invalidate();
+    draft_pipeline_.invalidate();
+    preview_source_ = PreviewSource();
+    draft_source_ = PreviewSource();
 }
 
 } // namespace raw_editor
\ No newline at end of file
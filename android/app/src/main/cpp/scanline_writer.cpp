@@ -0,0 +1,428 @@
+#include "scanline_writer.h"
+#include <algorithm>
+#include <csetjmp>
+#include <cstring>
+#include <limits>
+#include <zlib.h>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+namespace raw_editor {
+
+std::unique_ptr<ScanlineWriter> create_scanline_writer(const std::string& format, u32 quality) {
+    if (format == "JPEG" || format == "JPG") {
+        return std::make_unique<JpegScanlineWriter>(quality);
+    }
+    if (format == "TIFF") {
+        return std::make_unique<TiffScanlineWriter>();
+    }
+    return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// JPEG
+// ---------------------------------------------------------------------------
+
+namespace {
+
+/**
+ * libjpeg のエラーを longjmp で呼び出し元へ戻すためのエラーマネージャ
+ */
+struct JpegErrorManager {
+    jpeg_error_mgr base;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+void jpeg_error_exit(j_common_ptr cinfo) {
+    JpegErrorManager* error = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, error->message);
+    longjmp(error->jump, 1);
+}
+
+} // namespace
+
+struct JpegScanlineWriter::Codec {
+    jpeg_compress_struct cinfo;
+    JpegErrorManager error;
+    // setjmp をまたいでデストラクタが飛ばされないよう、行ポインタはここに保持する
+    std::vector<JSAMPROW> rows;
+    bool created = false;
+};
+
+JpegScanlineWriter::JpegScanlineWriter(u32 quality)
+    : quality_(std::max(1u, std::min(100u, quality))),
+      codec_(std::make_unique<Codec>()),
+      file_(nullptr) {
+}
+
+JpegScanlineWriter::~JpegScanlineWriter() {
+    close();
+}
+
+bool JpegScanlineWriter::open(const std::string& path, int width, int height, u32 bit_depth) {
+    if (width <= 0 || height <= 0 || bit_depth != 8) {
+        error_ = "Unsupported JPEG output parameters";
+        return false;
+    }
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        error_ = "Failed to open output file: " + path;
+        return false;
+    }
+
+    jpeg_compress_struct& cinfo = codec_->cinfo;
+    cinfo.err = jpeg_std_error(&codec_->error.base);
+    codec_->error.base.error_exit = jpeg_error_exit;
+    if (setjmp(codec_->error.jump)) {
+        error_ = codec_->error.message;
+        close();
+        return false;
+    }
+
+    jpeg_create_compress(&cinfo);
+    codec_->created = true;
+    jpeg_stdio_dest(&cinfo, file_);
+
+    cinfo.image_width = static_cast<JDIMENSION>(width);
+    cinfo.image_height = static_cast<JDIMENSION>(height);
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, static_cast<int>(quality_), TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    return true;
+}
+
+bool JpegScanlineWriter::write_rows(const cv::Mat& rows) {
+    if (!codec_->created || rows.type() != CV_8UC3) {
+        error_ = "JPEG writer is not ready or rows are not 8-bit RGB";
+        return false;
+    }
+
+    codec_->rows.resize(rows.rows);
+    for (int y = 0; y < rows.rows; ++y) {
+        codec_->rows[y] = const_cast<JSAMPROW>(rows.ptr<uchar>(y));
+    }
+
+    if (setjmp(codec_->error.jump)) {
+        error_ = codec_->error.message;
+        close();
+        return false;
+    }
+
+    JDIMENSION written = 0;
+    while (written < static_cast<JDIMENSION>(rows.rows)) {
+        written += jpeg_write_scanlines(&codec_->cinfo, codec_->rows.data() + written,
+                                        static_cast<JDIMENSION>(rows.rows) - written);
+    }
+    return true;
+}
+
+bool JpegScanlineWriter::finish() {
+    if (!codec_->created) {
+        return false;
+    }
+
+    if (setjmp(codec_->error.jump)) {
+        error_ = codec_->error.message;
+        close();
+        return false;
+    }
+
+    jpeg_finish_compress(&codec_->cinfo);
+    close();
+    return true;
+}
+
+void JpegScanlineWriter::close() {
+    if (codec_ && codec_->created) {
+        jpeg_destroy_compress(&codec_->cinfo);
+        codec_->created = false;
+    }
+    if (file_) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TIFF
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// TIFFタグ
+constexpr u16 TAG_IMAGE_WIDTH = 256;
+constexpr u16 TAG_IMAGE_LENGTH = 257;
+constexpr u16 TAG_BITS_PER_SAMPLE = 258;
+constexpr u16 TAG_COMPRESSION = 259;
+constexpr u16 TAG_PHOTOMETRIC = 262;
+constexpr u16 TAG_STRIP_OFFSETS = 273;
+constexpr u16 TAG_SAMPLES_PER_PIXEL = 277;
+constexpr u16 TAG_ROWS_PER_STRIP = 278;
+constexpr u16 TAG_STRIP_BYTE_COUNTS = 279;
+constexpr u16 TAG_X_RESOLUTION = 282;
+constexpr u16 TAG_Y_RESOLUTION = 283;
+constexpr u16 TAG_PLANAR_CONFIG = 284;
+constexpr u16 TAG_RESOLUTION_UNIT = 296;
+constexpr u16 TAG_PREDICTOR = 317;
+
+// フィールド型
+constexpr u16 TYPE_SHORT = 3;
+constexpr u16 TYPE_LONG = 4;
+constexpr u16 TYPE_RATIONAL = 5;
+
+constexpr u16 COMPRESSION_DEFLATE = 8;
+constexpr u16 PREDICTOR_HORIZONTAL = 2;
+
+// ヘッダは "II"（リトルエンディアン）。画素データはホストのバイト順のまま書くため
+// リトルエンディアンのホスト（ARM/x86の Android）を前提とする
+void put_u16(std::vector<byte>& out, u16 value) {
+    out.push_back(static_cast<byte>(value & 0xFF));
+    out.push_back(static_cast<byte>(value >> 8));
+}
+
+void put_u32(std::vector<byte>& out, u32 value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<byte>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+void put_entry(std::vector<byte>& out, u16 tag, u16 type, u32 count, u32 value) {
+    put_u16(out, tag);
+    put_u16(out, type);
+    put_u32(out, count);
+    if (type == TYPE_SHORT && count == 1) {
+        // SHORT値は4バイト欄の先頭に左詰め
+        put_u16(out, static_cast<u16>(value));
+        put_u16(out, 0);
+    } else {
+        put_u32(out, value);
+    }
+}
+
+/**
+ * 水平差分予測（各サンプルから左隣の画素の同じチャンネルを引く）
+ */
+template<typename T>
+void apply_horizontal_predictor(T* row, int width) {
+    for (int i = width * 3 - 1; i >= 3; --i) {
+        row[i] = static_cast<T>(row[i] - row[i - 3]);
+    }
+}
+
+} // namespace
+
+TiffScanlineWriter::TiffScanlineWriter()
+    : file_(nullptr),
+      width_(0),
+      height_(0),
+      bit_depth_(8),
+      row_bytes_(0),
+      rows_written_(0),
+      strip_rows_(0) {
+}
+
+TiffScanlineWriter::~TiffScanlineWriter() {
+    close();
+}
+
+bool TiffScanlineWriter::open(const std::string& path, int width, int height, u32 bit_depth) {
+    if (width <= 0 || height <= 0 || (bit_depth != 8 && bit_depth != 16)) {
+        error_ = "Unsupported TIFF output parameters";
+        return false;
+    }
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        error_ = "Failed to open output file: " + path;
+        return false;
+    }
+
+    width_ = width;
+    height_ = height;
+    bit_depth_ = bit_depth;
+    row_bytes_ = static_cast<size_t>(width) * 3 * (bit_depth / 8);
+    rows_written_ = 0;
+    strip_rows_ = 0;
+    strip_.resize(row_bytes_ * ROWS_PER_STRIP);
+    compressed_.resize(compressBound(static_cast<uLong>(strip_.size())));
+    strip_offsets_.clear();
+    strip_byte_counts_.clear();
+
+    // IFDオフセットは finish() で書き換える
+    std::vector<byte> header;
+    header.push_back('I');
+    header.push_back('I');
+    put_u16(header, 42);
+    put_u32(header, 0);
+    if (std::fwrite(header.data(), 1, header.size(), file_) != header.size()) {
+        error_ = "Failed to write TIFF header";
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool TiffScanlineWriter::write_rows(const cv::Mat& rows) {
+    const int expected_type = bit_depth_ == 16 ? CV_16UC3 : CV_8UC3;
+    if (!file_ || rows.type() != expected_type || rows.cols != width_ ||
+        rows_written_ + rows.rows > height_) {
+        error_ = "TIFF writer is not ready or rows do not match the image";
+        return false;
+    }
+
+    for (int y = 0; y < rows.rows; ++y) {
+        byte* dst = strip_.data() + strip_rows_ * row_bytes_;
+        std::memcpy(dst, rows.ptr<uchar>(y), row_bytes_);
+        if (bit_depth_ == 16) {
+            apply_horizontal_predictor(reinterpret_cast<u16*>(dst), width_);
+        } else {
+            apply_horizontal_predictor(dst, width_);
+        }
+
+        ++strip_rows_;
+        ++rows_written_;
+        if (strip_rows_ == ROWS_PER_STRIP && !flush_strip()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TiffScanlineWriter::finish() {
+    if (!file_) {
+        return false;
+    }
+    if (strip_rows_ > 0 && !flush_strip()) {
+        return false;
+    }
+    if (rows_written_ != height_) {
+        error_ = "TIFF writer finished before all rows were written";
+        close();
+        return false;
+    }
+    if (!write_directory()) {
+        return false;
+    }
+    close();
+    return true;
+}
+
+bool TiffScanlineWriter::flush_strip() {
+    const uLong source_length = static_cast<uLong>(strip_rows_ * row_bytes_);
+    uLongf compressed_length = static_cast<uLongf>(compressed_.size());
+    if (compress2(compressed_.data(), &compressed_length, strip_.data(), source_length,
+                  Z_DEFAULT_COMPRESSION) != Z_OK) {
+        error_ = "Failed to compress TIFF strip";
+        close();
+        return false;
+    }
+
+    const long offset = std::ftell(file_);
+    if (offset < 0 ||
+        static_cast<unsigned long long>(offset) + compressed_length > std::numeric_limits<u32>::max()) {
+        error_ = "TIFF output exceeds 4 GiB";
+        close();
+        return false;
+    }
+
+    if (std::fwrite(compressed_.data(), 1, compressed_length, file_) != compressed_length) {
+        error_ = "Failed to write TIFF strip";
+        close();
+        return false;
+    }
+
+    strip_offsets_.push_back(static_cast<u32>(offset));
+    strip_byte_counts_.push_back(static_cast<u32>(compressed_length));
+    strip_rows_ = 0;
+    return true;
+}
+
+bool TiffScanlineWriter::write_directory() {
+    // IFDはワード境界から始める
+    long end = std::ftell(file_);
+    if (end < 0) {
+        error_ = "Failed to locate end of TIFF data";
+        close();
+        return false;
+    }
+    if (end % 2 != 0) {
+        std::fputc(0, file_);
+        ++end;
+    }
+
+    constexpr u16 ENTRY_COUNT = 14;
+    const u32 ifd_offset = static_cast<u32>(end);
+    const u32 extra_offset = ifd_offset + 2 + ENTRY_COUNT * 12 + 4;
+    const u32 strip_count = static_cast<u32>(strip_offsets_.size());
+
+    // IFDの後ろに置く値の配置
+    const u32 bits_offset = extra_offset;
+    const u32 x_resolution_offset = bits_offset + 8;
+    const u32 y_resolution_offset = x_resolution_offset + 8;
+    const u32 offsets_offset = y_resolution_offset + 8;
+    const u32 counts_offset = offsets_offset + strip_count * 4;
+
+    std::vector<byte> ifd;
+    put_u16(ifd, ENTRY_COUNT);
+    put_entry(ifd, TAG_IMAGE_WIDTH, TYPE_LONG, 1, static_cast<u32>(width_));
+    put_entry(ifd, TAG_IMAGE_LENGTH, TYPE_LONG, 1, static_cast<u32>(height_));
+    put_entry(ifd, TAG_BITS_PER_SAMPLE, TYPE_SHORT, 3, bits_offset);
+    put_entry(ifd, TAG_COMPRESSION, TYPE_SHORT, 1, COMPRESSION_DEFLATE);
+    put_entry(ifd, TAG_PHOTOMETRIC, TYPE_SHORT, 1, 2); // RGB
+    put_entry(ifd, TAG_STRIP_OFFSETS, TYPE_LONG, strip_count,
+              strip_count == 1 ? strip_offsets_[0] : offsets_offset);
+    put_entry(ifd, TAG_SAMPLES_PER_PIXEL, TYPE_SHORT, 1, 3);
+    put_entry(ifd, TAG_ROWS_PER_STRIP, TYPE_LONG, 1, ROWS_PER_STRIP);
+    put_entry(ifd, TAG_STRIP_BYTE_COUNTS, TYPE_LONG, strip_count,
+              strip_count == 1 ? strip_byte_counts_[0] : counts_offset);
+    put_entry(ifd, TAG_X_RESOLUTION, TYPE_RATIONAL, 1, x_resolution_offset);
+    put_entry(ifd, TAG_Y_RESOLUTION, TYPE_RATIONAL, 1, y_resolution_offset);
+    put_entry(ifd, TAG_PLANAR_CONFIG, TYPE_SHORT, 1, 1); // チャンネル交互配置
+    put_entry(ifd, TAG_RESOLUTION_UNIT, TYPE_SHORT, 1, 2); // インチ
+    put_entry(ifd, TAG_PREDICTOR, TYPE_SHORT, 1, PREDICTOR_HORIZONTAL);
+    put_u32(ifd, 0); // 次のIFDなし
+
+    for (int i = 0; i < 3; ++i) {
+        put_u16(ifd, static_cast<u16>(bit_depth_));
+    }
+    put_u16(ifd, 0);
+    put_u32(ifd, 72);
+    put_u32(ifd, 1);
+    put_u32(ifd, 72);
+    put_u32(ifd, 1);
+    if (strip_count > 1) {
+        for (u32 offset : strip_offsets_) {
+            put_u32(ifd, offset);
+        }
+        for (u32 count : strip_byte_counts_) {
+            put_u32(ifd, count);
+        }
+    }
+
+    std::vector<byte> offset_field;
+    put_u32(offset_field, ifd_offset);
+
+    if (std::fwrite(ifd.data(), 1, ifd.size(), file_) != ifd.size() ||
+        std::fseek(file_, 4, SEEK_SET) != 0 ||
+        std::fwrite(offset_field.data(), 1, offset_field.size(), file_) != offset_field.size()) {
+        error_ = "Failed to write TIFF directory";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void TiffScanlineWriter::close() {
+    if (file_) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+} // namespace raw_editor
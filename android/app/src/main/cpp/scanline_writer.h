@@ -0,0 +1,127 @@
+#ifndef SCANLINE_WRITER_H
+#define SCANLINE_WRITER_H
+
+#include "common_types.h"
+#include <opencv2/opencv.hpp>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace raw_editor {
+
+/**
+ * 行単位の画像エンコーダ
+ * 上から順に渡された行をそのままファイルへ書き出すため、
+ * 画像全体をメモリに保持せずにエンコードできる
+ */
+class ScanlineWriter {
+public:
+    virtual ~ScanlineWriter() = default;
+
+    /**
+     * 出力ファイルを開いてヘッダを書き込む
+     * @param path 出力パス
+     * @param width 画像の幅
+     * @param height 画像の高さ
+     * @param bit_depth ビット深度 (8 または 16)
+     * @return 成功ならtrue
+     */
+    virtual bool open(const std::string& path, int width, int height, u32 bit_depth) = 0;
+
+    /**
+     * 行を書き込む
+     * @param rows RGB画像の連続する行（幅は open で指定した値）
+     * @return 成功ならtrue
+     */
+    virtual bool write_rows(const cv::Mat& rows) = 0;
+
+    /**
+     * 残りのデータを書き出してファイルを閉じる
+     * @return 成功ならtrue
+     */
+    virtual bool finish() = 0;
+
+    /**
+     * エンコーダが受け付けるビット深度
+     * @param requested 要求されたビット深度
+     * @return 実際に書き出すビット深度
+     */
+    virtual u32 supported_bit_depth(u32 requested) const = 0;
+
+    const std::string& error() const { return error_; }
+
+protected:
+    std::string error_;
+};
+
+/**
+ * フォーマット名に対応する行単位エンコーダを生成
+ * @param format 出力フォーマット ("JPEG", "JPG", "TIFF")
+ * @param quality JPEG品質 (1-100)
+ * @return エンコーダ（行単位で書き出せないフォーマットは nullptr）
+ */
+std::unique_ptr<ScanlineWriter> create_scanline_writer(const std::string& format, u32 quality);
+
+/**
+ * libjpeg の行単位APIで書き出すJPEGエンコーダ（8ビットのみ）
+ */
+class JpegScanlineWriter : public ScanlineWriter {
+public:
+    explicit JpegScanlineWriter(u32 quality);
+    ~JpegScanlineWriter() override;
+
+    bool open(const std::string& path, int width, int height, u32 bit_depth) override;
+    bool write_rows(const cv::Mat& rows) override;
+    bool finish() override;
+    u32 supported_bit_depth(u32) const override { return 8; }
+
+private:
+    struct Codec;
+
+    u32 quality_;
+    std::unique_ptr<Codec> codec_;
+    FILE* file_;
+
+    void close();
+};
+
+/**
+ * ストリップ単位で書き出すTIFFエンコーダ（RGB 8/16ビット、Deflate圧縮・水平差分予測）
+ * 圧縮後のストリップサイズは書き出すまで分からないため、
+ * IFDはファイル末尾に置き、ヘッダのIFDオフセットを最後に書き換える
+ */
+class TiffScanlineWriter : public ScanlineWriter {
+public:
+    TiffScanlineWriter();
+    ~TiffScanlineWriter() override;
+
+    bool open(const std::string& path, int width, int height, u32 bit_depth) override;
+    bool write_rows(const cv::Mat& rows) override;
+    bool finish() override;
+    u32 supported_bit_depth(u32 requested) const override { return requested == 16 ? 16 : 8; }
+
+private:
+    // 1ストリップあたりの行数
+    static constexpr int ROWS_PER_STRIP = 16;
+
+    FILE* file_;
+    int width_;
+    int height_;
+    u32 bit_depth_;
+    size_t row_bytes_;
+    int rows_written_;
+    std::vector<byte> strip_;
+    int strip_rows_;
+    std::vector<byte> compressed_;
+    std::vector<u32> strip_offsets_;
+    std::vector<u32> strip_byte_counts_;
+
+    bool flush_strip();
+    bool write_directory();
+    void close();
+};
+
+} // namespace raw_editor
+
+#endif // SCANLINE_WRITER_H
@@ -0,0 +1,145 @@
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
+
+namespace raw_editor {
+
+WorkStealingPool::WorkStealingPool(u32 thread_count)
+    : pending_(0),
+      next_queue_(0),
+      stopping_(false) {
+    u32 count = resolve_thread_count(thread_count);
+
+    // 呼び出しスレッド用のキューを末尾に1つ追加する
+    for (u32 i = 0; i <= count; ++i) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (u32 i = 0; i < count; ++i) {
+        workers_.emplace_back(&WorkStealingPool::worker_loop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+u32 WorkStealingPool::resolve_thread_count(u32 requested) {
+    if (requested > 0) {
+        return requested;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void WorkStealingPool::parallel_for(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+
+    Batch batch;
+    batch.task = &task;
+    batch.trace_context = trace_current_context();
+    batch.remaining = count;
+
+    // タスクをワーカーのキューへ巡回的に配る（連続するタイルは同じワーカーへ）
+    const size_t queue_count = queues_.size();
+    const size_t chunk = std::max<size_t>(1, count / queue_count);
+    size_t start_queue = next_queue_.fetch_add(1) % queue_count;
+    pending_ += count;
+    for (size_t i = 0; i < count; ++i) {
+        WorkerQueue& queue = *queues_[(start_queue + i / chunk) % queue_count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Task{&batch, i});
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_.notify_all();
+
+    // 呼び出しスレッドも自分のバッチが終わるまで処理に参加する
+    const size_t caller_queue = queue_count - 1;
+    while (batch.remaining.load() > 0) {
+        Task next;
+        if (try_pop(caller_queue, next)) {
+            execute(next);
+        } else {
+            std::unique_lock<std::mutex> lock(batch.mutex);
+            batch.done.wait(lock, [&] { return batch.remaining.load() == 0; });
+        }
+    }
+
+    // 最後のタスクを実行したワーカーが batch.mutex を離すまで待ってから Batch を破棄する
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+void WorkStealingPool::worker_loop(size_t worker_index) {
+    while (true) {
+        Task task;
+        if (try_pop(worker_index, task)) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_.wait(lock, [this] { return stopping_ || pending_.load() > 0; });
+        if (stopping_ && pending_.load() == 0) {
+            return;
+        }
+    }
+}
+
+bool WorkStealingPool::try_pop(size_t worker_index, Task& task) {
+    {
+        WorkerQueue& own = *queues_[worker_index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        WorkerQueue& victim = *queues_[(worker_index + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::execute(const Task& task) {
+    Batch& batch = *task.batch;
+    TraceContextScope trace_context(batch.trace_context);
+    try {
+        (*batch.task)(task.index);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(batch.mutex);
+        if (!batch.error) {
+            batch.error = std::current_exception();
+        }
+    }
+
+    // 減算と通知は batch.mutex を持ったまま行う（呼び出し元はこのロックが外れるまで Batch を破棄しない）
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    if (batch.remaining.fetch_sub(1) == 1) {
+        batch.done.notify_all();
+    }
+}
+
+} // namespace raw_editor
@@ -0,0 +1,91 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "common_types.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace raw_editor {
+
+/**
+ * ワークスティーリング型スレッドプール
+ * ワーカーごとにタスクキューを持ち、自分のキューが空になると
+ * 他のワーカーのキューの先頭からタスクを奪って実行する。
+ * タイルごとに処理時間がばらつく場合でも負荷が均等になる。
+ */
+class WorkStealingPool {
+public:
+    /**
+     * @param thread_count ワーカー数 (0 = CPUコア数)
+     */
+    explicit WorkStealingPool(u32 thread_count = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * count個のタスクを並列実行し、すべて完了するまで待つ
+     * 呼び出しスレッドも実行に参加する。タスク内の例外は最初の1つが再送出される
+     * @param count タスク数
+     * @param task タスク（引数はタスク番号）
+     */
+    void parallel_for(size_t count, const std::function<void(size_t)>& task);
+
+    u32 thread_count() const { return static_cast<u32>(workers_.size()); }
+
+    /**
+     * thread_count の指定値を実際のワーカー数に解決
+     * @param requested 指定値 (0 = 自動)
+     * @return ワーカー数
+     */
+    static u32 resolve_thread_count(u32 requested);
+
+private:
+    struct Batch {
+        const std::function<void(size_t)>* task = nullptr;
+        u32 trace_context = 0; // 呼び出し元の計測の識別子（タスクに引き継ぐ）
+        std::atomic<size_t> remaining{0};
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+
+    struct Task {
+        Batch* batch;
+        size_t index;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> pending_;
+    std::atomic<size_t> next_queue_;
+    bool stopping_;
+
+    void worker_loop(size_t worker_index);
+
+    /**
+     * 自分のキューの末尾、なければ他のキューの先頭からタスクを取得
+     */
+    bool try_pop(size_t worker_index, Task& task);
+
+    void execute(const Task& task);
+};
+
+} // namespace raw_editor
+
+#endif // THREAD_POOL_H
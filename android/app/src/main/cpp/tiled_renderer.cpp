@@ -0,0 +1,71 @@
+#include "tiled_renderer.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+
+namespace raw_editor {
+
+std::vector<Tile> plan_tiles(const cv::Size& size, const cv::Rect& region, int tile_width, int tile_height,
+                             int halo) {
+    std::vector<Tile> tiles;
+    const cv::Rect bounds(0, 0, size.width, size.height);
+    const cv::Rect area = region & bounds;
+    if (area.empty() || tile_width <= 0 || tile_height <= 0) {
+        return tiles;
+    }
+
+    for (int y = area.y; y < area.y + area.height; y += tile_height) {
+        for (int x = area.x; x < area.x + area.width; x += tile_width) {
+            Tile tile;
+            tile.core = cv::Rect(x, y, std::min(tile_width, area.x + area.width - x),
+                                 std::min(tile_height, area.y + area.height - y));
+            tile.padded = cv::Rect(tile.core.x - halo, tile.core.y - halo,
+                                   tile.core.width + halo * 2, tile.core.height + halo * 2) & bounds;
+            tiles.push_back(tile);
+        }
+    }
+    return tiles;
+}
+
+TiledRenderer::TiledRenderer(WorkStealingPool& pool, int tile_size, JobControl* job)
+    : pool_(pool),
+      tile_size_(std::max(1, tile_size)),
+      job_(job) {
+}
+
+void TiledRenderer::render(const cv::Mat& source, cv::Mat& destination, int halo,
+                           const TileFunction& render) const {
+    this->render(source, cv::Rect(0, 0, source.cols, source.rows), destination, halo, render);
+}
+
+void TiledRenderer::render(const cv::Mat& source, const cv::Rect& region, cv::Mat& destination, int halo,
+                           const TileFunction& render) const {
+    CV_Assert(destination.size() == region.size());
+
+    const std::vector<Tile> tiles =
+        plan_tiles(source.size(), region, tile_size_, tile_size_, std::max(0, halo));
+
+    std::atomic<size_t> completed(0);
+    pool_.parallel_for(tiles.size(), [&](size_t index) {
+        // 中止された場合は未着手のタイルを処理しない（例外は parallel_for から再送出される）
+        check_cancelled(job_);
+        const Tile& tile = tiles[index];
+
+        TraceTileScope trace_tile(static_cast<int>(index));
+        TraceScope trace("tile", static_cast<u64>(tile.core.area()));
+        cv::Mat rendered = render(source(tile.padded), tile.padded);
+        CV_Assert(rendered.size() == tile.padded.size() && rendered.type() == destination.type());
+
+        // ハローを捨てて core 部分だけを書き込む（タイル同士の書き込み先は重ならない）
+        const cv::Rect inner(tile.core.tl() - tile.padded.tl(), tile.core.size());
+        const cv::Rect target_rect(tile.core.tl() - region.tl(), tile.core.size());
+        cv::Mat target = destination(target_rect);
+        rendered(inner).copyTo(target);
+        
+        if (job_) {
+            job_->report(++completed, tiles.size());
+        }
+    });
+}
+
+} // namespace raw_editor
@@ -0,0 +1,91 @@
+#ifndef TILED_RENDERER_H
+#define TILED_RENDERER_H
+
+#include "common_types.h"
+#include "job_control.h"
+#include "thread_pool.h"
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <vector>
+
+namespace raw_editor {
+
+// 既定のタイルサイズ（ハローを除いた一辺のピクセル数）
+constexpr int DEFAULT_TILE_SIZE = 512;
+
+/**
+ * タイル
+ * core は出力に書き込む領域、padded はハローを含めた入力領域
+ * padded は画像の端で切り詰められる（画像端の扱いは全体処理と同じになる）
+ */
+struct Tile {
+    cv::Rect core;
+    cv::Rect padded;
+};
+
+/**
+ * 画像内の領域をタイルに分割
+ * @param size 画像サイズ（ハローはこの範囲に切り詰められる）
+ * @param region 分割する領域
+ * @param tile_width タイルの幅
+ * @param tile_height タイルの高さ
+ * @param halo ハロー幅（ピクセル）
+ * @return タイル一覧（行優先順）
+ */
+std::vector<Tile> plan_tiles(const cv::Size& size, const cv::Rect& region, int tile_width, int tile_height,
+                             int halo);
+
+/**
+ * タイル分割レンダラ
+ * 入力画像をハロー付きのタイルに分割してスレッドプールで並列に処理し、
+ * 各タイルの core 部分を出力画像に貼り合わせる。
+ * ハローが各空間演算のカーネル半径の合計以上であれば、結果は全体処理と一致する。
+ * 同時に存在する作業バッファはワーカー数×タイル分に限られる。
+ * ジョブを指定した場合は各タイルの開始前に中止を確認し、完了したタイル数を進捗として報告する。
+ */
+class TiledRenderer {
+public:
+    /**
+     * タイル処理関数
+     * padded 領域の入力と、その領域の入力画像上の位置を受け取り、
+     * 同じサイズの出力（出力画像と同じ型）を返す
+     */
+    using TileFunction = std::function<cv::Mat(const cv::Mat& input, const cv::Rect& padded)>;
+
+    /**
+     * @param pool スレッドプール
+     * @param tile_size タイルの一辺のピクセル数
+     * @param job 中止要求・進捗の報告先（nullptr = なし）
+     */
+    explicit TiledRenderer(WorkStealingPool& pool, int tile_size = DEFAULT_TILE_SIZE, JobControl* job = nullptr);
+
+    /**
+     * タイル単位で処理して貼り合わせる
+     * @param source 入力画像
+     * @param destination 出力画像（source と同サイズで確保済みであること）
+     * @param halo ハロー幅（ピクセル）
+     * @param render タイル処理関数
+     */
+    void render(const cv::Mat& source, cv::Mat& destination, int halo, const TileFunction& render) const;
+
+    /**
+     * 入力画像の一部の領域だけをタイル単位で処理する
+     * ハローは領域の外側の画素も参照するため、領域の境界でも全体処理と一致する
+     * @param source 入力画像
+     * @param region 処理する領域
+     * @param destination 出力画像（region と同サイズで確保済みであること）
+     * @param halo ハロー幅（ピクセル）
+     * @param render タイル処理関数
+     */
+    void render(const cv::Mat& source, const cv::Rect& region, cv::Mat& destination, int halo,
+                const TileFunction& render) const;
+
+private:
+    WorkStealingPool& pool_;
+    int tile_size_;
+    JobControl* job_;
+};
+
+} // namespace raw_editor
+
+#endif // TILED_RENDERER_H
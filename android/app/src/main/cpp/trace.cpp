@@ -0,0 +1,237 @@
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+namespace raw_editor {
+
+namespace {
+
+// スレッドごとのリングバッファ
+// 書き込みは所有スレッドだけが行い、ロックは集計時の読み出しとの排他のためだけに使う（通常は競合しない）
+struct TraceRing {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    u64 written = 0;
+    u32 index = 0;
+    bool in_use = false;
+};
+
+// リングはスレッドが終了しても記録を残したまま次のスレッドに再利用する
+// （リングの数は同時に存在したスレッド数の最大値に限られる）
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceRing>> rings;
+};
+
+TraceRegistry& registry() {
+    // スレッドの終了処理から参照されるため解放しない
+    static TraceRegistry* instance = new TraceRegistry();
+    return *instance;
+}
+
+std::atomic<bool> g_enabled(true);
+std::atomic<u32> g_next_context(1);
+
+thread_local u32 t_context = 0;
+thread_local int t_tile = -1;
+
+class RingHolder {
+public:
+    ~RingHolder() {
+        if (ring_) {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            ring_->in_use = false;
+        }
+    }
+
+    TraceRing& ring() {
+        if (!ring_) {
+            TraceRegistry& all = registry();
+            std::lock_guard<std::mutex> lock(all.mutex);
+            for (auto& candidate : all.rings) {
+                if (!candidate->in_use) {
+                    ring_ = candidate.get();
+                    break;
+                }
+            }
+            if (!ring_) {
+                all.rings.push_back(std::make_unique<TraceRing>());
+                ring_ = all.rings.back().get();
+                ring_->index = static_cast<u32>(all.rings.size() - 1);
+                ring_->events.resize(TRACE_RING_CAPACITY);
+            }
+            ring_->in_use = true;
+        }
+        return *ring_;
+    }
+
+private:
+    TraceRing* ring_ = nullptr;
+};
+
+thread_local RingHolder t_ring;
+
+void copy_name(char* destination, const char* name) {
+    std::strncpy(destination, name ? name : "", TraceEvent::NAME_LENGTH - 1);
+    destination[TraceEvent::NAME_LENGTH - 1] = '\0';
+}
+
+void json_escape_into(std::ostringstream& out, const char* text) {
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\' << *c;
+        } else if (static_cast<unsigned char>(*c) >= 0x20) {
+            out << *c;
+        }
+    }
+}
+
+} // namespace
+
+void set_tracing_enabled(bool enabled) {
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool tracing_enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+u64 trace_now_ns() {
+    return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+u32 trace_new_context() {
+    return g_next_context.fetch_add(1);
+}
+
+u32 trace_current_context() {
+    return t_context;
+}
+
+int trace_current_tile() {
+    return t_tile;
+}
+
+TraceContextScope::TraceContextScope(u32 context) : previous_(t_context) {
+    t_context = context;
+}
+
+TraceContextScope::~TraceContextScope() {
+    t_context = previous_;
+}
+
+TraceTileScope::TraceTileScope(int tile) : previous_(t_tile) {
+    t_tile = tile;
+}
+
+TraceTileScope::~TraceTileScope() {
+    t_tile = previous_;
+}
+
+TraceScope::TraceScope(const char* name, u64 pixels) : active_(tracing_enabled()) {
+    if (!active_) {
+        return;
+    }
+    copy_name(event_.name, name);
+    event_.pixels = pixels;
+    event_.bytes = 0;
+    event_.context = t_context;
+    event_.tile = t_tile;
+    event_.start_ns = trace_now_ns();
+}
+
+TraceScope::TraceScope(const std::string& name, u64 pixels) : TraceScope(name.c_str(), pixels) {
+}
+
+TraceScope::~TraceScope() {
+    if (!active_) {
+        return;
+    }
+    event_.duration_ns = trace_now_ns() - event_.start_ns;
+
+    TraceRing& ring = t_ring.ring();
+    event_.thread = ring.index;
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.events[ring.written % TRACE_RING_CAPACITY] = event_;
+    ++ring.written;
+}
+
+std::vector<TraceEvent> trace_snapshot(u32 context, u64 since_ns) {
+    std::vector<TraceEvent> events;
+
+    TraceRegistry& all = registry();
+    std::lock_guard<std::mutex> registry_lock(all.mutex);
+    for (auto& ring : all.rings) {
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        const u64 count = std::min<u64>(ring->written, TRACE_RING_CAPACITY);
+        for (u64 i = ring->written - count; i < ring->written; ++i) {
+            const TraceEvent& event = ring->events[i % TRACE_RING_CAPACITY];
+            if ((context == 0 || event.context == context) && event.start_ns >= since_ns) {
+                events.push_back(event);
+            }
+        }
+    }
+
+    std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+        return a.start_ns < b.start_ns;
+    });
+    return events;
+}
+
+std::vector<TraceStageStats> trace_summarize(const std::vector<TraceEvent>& events) {
+    std::vector<TraceStageStats> stats;
+    std::unordered_map<std::string, size_t> index;
+
+    for (const TraceEvent& event : events) {
+        auto found = index.find(event.name);
+        if (found == index.end()) {
+            found = index.emplace(event.name, stats.size()).first;
+            stats.emplace_back();
+            stats.back().name = event.name;
+        }
+        TraceStageStats& entry = stats[found->second];
+        ++entry.count;
+        entry.total_ns += event.duration_ns;
+        entry.max_ns = std::max(entry.max_ns, event.duration_ns);
+        entry.pixels += event.pixels;
+        entry.bytes += event.bytes;
+    }
+
+    std::sort(stats.begin(), stats.end(), [](const TraceStageStats& a, const TraceStageStats& b) {
+        return a.total_ns > b.total_ns;
+    });
+    return stats;
+}
+
+std::string trace_to_chrome_json(const std::vector<TraceEvent>& events) {
+    // 完了イベント（ph = X）の列。時刻はマイクロ秒、先頭のイベントを0とする
+    const u64 origin = events.empty() ? 0 : events.front().start_ns;
+    std::ostringstream json;
+    json << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent& event = events[i];
+        char timing[64];
+        std::snprintf(timing, sizeof(timing), "\"ts\":%.3f,\"dur\":%.3f",
+                      (event.start_ns - origin) / 1000.0, event.duration_ns / 1000.0);
+
+        json << (i > 0 ? "," : "") << "{\"name\":\"";
+        json_escape_into(json, event.name);
+        json << "\",\"cat\":\"pipeline\",\"ph\":\"X\"," << timing
+             << ",\"pid\":" << event.context << ",\"tid\":" << event.thread
+             << ",\"args\":{\"tile\":" << event.tile
+             << ",\"pixels\":" << event.pixels
+             << ",\"bytes\":" << event.bytes << "}}";
+    }
+    json << "]}";
+    return json.str();
+}
+
+} // namespace raw_editor
@@ -0,0 +1,140 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "common_types.h"
+#include <string>
+#include <vector>
+
+namespace raw_editor {
+
+/**
+ * 計測イベント（区間1つ分）
+ */
+struct TraceEvent {
+    static constexpr size_t NAME_LENGTH = 32;
+
+    char name[NAME_LENGTH];     // 区間の名前（長すぎる名前は切り詰める）
+    u64 start_ns;               // 開始時刻（steady_clock）
+    u64 duration_ns;            // 所要時間
+    u64 pixels;                 // 処理した画素数（0 = 記録なし）
+    u64 bytes;                  // 確保した出力バッファのバイト数（0 = 記録なし）
+    u32 context;                // 記録したプロセッサーの識別子（0 = プロセッサー外）
+    u32 thread;                 // 記録したスレッドのリング番号
+    int tile;                   // タイル番号（-1 = タイル処理の外）
+};
+
+/**
+ * 区間名ごとの集計
+ */
+struct TraceStageStats {
+    std::string name;
+    u64 count = 0;
+    u64 total_ns = 0;
+    u64 max_ns = 0;
+    u64 pixels = 0;
+    u64 bytes = 0;
+};
+
+// スレッドごとのリングバッファに保持するイベント数（古いものから上書きする）
+constexpr size_t TRACE_RING_CAPACITY = 1024;
+
+/**
+ * 計測の有効・無効を切り替える（既定は有効）
+ * 無効な間の TraceScope は時刻も取らない
+ */
+void set_tracing_enabled(bool enabled);
+bool tracing_enabled();
+
+/**
+ * 現在時刻（steady_clock のナノ秒）
+ */
+u64 trace_now_ns();
+
+/**
+ * プロセッサーごとの識別子を払い出す（1から始まる）
+ */
+u32 trace_new_context();
+
+/**
+ * このスレッドで記録中のプロセッサーの識別子
+ */
+u32 trace_current_context();
+
+/**
+ * このスレッドで処理中のタイル番号（タイル処理の外では -1）
+ */
+int trace_current_tile();
+
+/**
+ * スコープの間、このスレッドの記録をプロセッサーに結び付ける
+ * スレッドプールのタスクには呼び出し元の識別子が引き継がれる
+ */
+class TraceContextScope {
+public:
+    explicit TraceContextScope(u32 context);
+    ~TraceContextScope();
+
+    TraceContextScope(const TraceContextScope&) = delete;
+    TraceContextScope& operator=(const TraceContextScope&) = delete;
+
+private:
+    u32 previous_;
+};
+
+/**
+ * スコープの間、このスレッドの記録にタイル番号を付ける
+ */
+class TraceTileScope {
+public:
+    explicit TraceTileScope(int tile);
+    ~TraceTileScope();
+
+    TraceTileScope(const TraceTileScope&) = delete;
+    TraceTileScope& operator=(const TraceTileScope&) = delete;
+
+private:
+    int previous_;
+};
+
+/**
+ * スコープの開始から終了までを1区間として、このスレッドのリングバッファに記録する
+ * 名前は構築時にコピーするため、一時的な文字列を渡してよい
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, u64 pixels = 0);
+    explicit TraceScope(const std::string& name, u64 pixels = 0);
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    void set_pixels(u64 pixels) { event_.pixels = pixels; }
+    void add_bytes(u64 bytes) { event_.bytes += bytes; }
+
+private:
+    TraceEvent event_;
+    bool active_;
+};
+
+/**
+ * 記録済みのイベントを集める（開始時刻順）
+ * @param context プロセッサーの識別子（0 = すべて）
+ * @param since_ns この時刻より前に始まったイベントを除く
+ * @return イベント（各スレッドの直近 TRACE_RING_CAPACITY 件まで）
+ */
+std::vector<TraceEvent> trace_snapshot(u32 context, u64 since_ns = 0);
+
+/**
+ * イベントを区間名ごとに集計する（合計時間の降順）
+ */
+std::vector<TraceStageStats> trace_summarize(const std::vector<TraceEvent>& events);
+
+/**
+ * Chrome トレース形式（chrome://tracing・Perfetto で読める JSON）に変換する
+ */
+std::string trace_to_chrome_json(const std::vector<TraceEvent>& events);
+
+} // namespace raw_editor
+
+#endif // TRACE_H
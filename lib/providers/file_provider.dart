@@ -77,14 +77,14 @@ class FileProvider extends ChangeNotifier {
       if (result != null && result.files.isNotEmpty) {
         _setLoading(true);
         
-        for (final file in result.files) {
-          if (file.path != null) {
-            final rawImage = await _fileService.importRawImage(file.path!);
-            if (rawImage != null) {
-              await _databaseService.insertRawImage(rawImage);
-              _rawImages.add(rawImage);
-            }
-          }
+        final filePaths = result.files
+            .where((file) => file.path != null)
+            .map((file) => file.path!)
+            .toList();
+        final rawImages = await _fileService.importRawImages(filePaths);
+        for (final rawImage in rawImages) {
+          await _databaseService.insertRawImage(rawImage);
+          _rawImages.add(rawImage);
         }
         
         _applyFilterAndSort();
@@ -1,5 +1,4 @@
 import 'dart:io';
-import 'dart:typed_data';
 import 'package:flutter/foundation.dart';
 import 'package:path/path.dart' as path;
 import 'package:path_provider/path_provider.dart';
@@ -15,6 +14,7 @@ class FileService {
   ];
   
   final RawProcessingService _rawProcessingService = RawProcessingService.instance;
+  bool _imageCacheConfigured = false;
   
   /// デバイス内のRAW画像をスキャン
   Future<List<RawImage>> scanForRawImages() async {
@@ -46,33 +46,75 @@ class FileService {
   Future<RawImage?> importRawImage(String filePath) async {
     debugPrint('Importing RAW image: $filePath');
     
+    if (!await File(filePath).exists()) {
+      debugPrint('File does not exist: $filePath');
+      return null;
+    }
+    
+    final rawImages = await importRawImages([filePath]);
+    return rawImages.isNotEmpty ? rawImages.first : null;
+  }
+  
+  /// 複数のRAW画像を一括でインポート
+  /// メタデータ抽出とサムネイル生成はネイティブのワーカープールで並列に行われる
+  Future<List<RawImage>> importRawImages(
+    List<String> filePaths, {
+    void Function(int completed, int total)? onProgress,
+  }) async {
+    final candidates = filePaths.where((filePath) {
+      final extension = path.extension(filePath).toLowerCase();
+      return extension.isNotEmpty && supportedRawExtensions.contains(extension.substring(1));
+    }).toList();
+    if (candidates.isEmpty) {
+      return [];
+    }
+    
+    await _ensureImageCache();
+    
+    final tempDir = await getTempDirectory();
+    final thumbnailsDir = Directory(path.join(tempDir.path, 'thumbnails'));
+    if (!await thumbnailsDir.exists()) {
+      await thumbnailsDir.create(recursive: true);
+    }
+    
+    final rawImages = <RawImage>[];
     try {
-      final file = File(filePath);
-      if (!await file.exists()) {
-        debugPrint('File does not exist: $filePath');
-        return null;
-      }
-      
-      // ファイル拡張子をチェック
-      final extension = path.extension(filePath).toLowerCase().substring(1);
-      if (!supportedRawExtensions.contains(extension)) {
-        debugPrint('Unsupported file format: $extension');
-        return null;
+      await for (final update in _rawProcessingService.ingestBatch(
+        candidates,
+        thumbnailDir: thumbnailsDir.path,
+      )) {
+        for (final result in update['results'] as List<dynamic>) {
+          final rawImage = await _rawImageFromIngestResult(result as Map<String, dynamic>);
+          if (rawImage != null) {
+            rawImages.add(rawImage);
+          }
+        }
+        onProgress?.call(update['completed'] as int, update['total'] as int);
       }
+    } catch (e) {
+      debugPrint('Error importing RAW images: $e');
+    }
+    
+    debugPrint('Imported ${rawImages.length} of ${candidates.length} RAW images');
+    return rawImages;
+  }
+  
+  /// 一括取り込みの結果からRawImageを作成
+  Future<RawImage?> _rawImageFromIngestResult(Map<String, dynamic> result) async {
+    final filePath = result['file_path'] as String;
+    if (result['code'] != 0) {
+      debugPrint('Failed to import $filePath: ${result['error']}');
+      return null;
+    }
+    
+    try {
+      final fileStat = await File(filePath).stat();
+      final metadata = result['metadata'] as Map<String, dynamic>?;
+      final thumbnailPath = result['thumbnail_path'] as String;
       
-      // ファイル情報を取得
-      final fileStat = await file.stat();
-      final fileName = path.basename(filePath);
-      
-      // メタデータを抽出
-      final metadata = await _extractMetadataFromFile(filePath);
-      
-      // サムネイルを生成
-      final thumbnailPath = await _generateAndSaveThumbnail(filePath, fileName);
-      
-      final rawImage = RawImage(
+      return RawImage(
         filePath: filePath,
-        fileName: fileName,
+        fileName: path.basename(filePath),
         fileSize: fileStat.size,
         dateCreated: fileStat.changed,
         dateModified: fileStat.modified,
@@ -89,13 +131,10 @@ class FileService {
         colorSpace: metadata?['color_space'],
         imageWidth: metadata?['image_width']?.toInt(),
         imageHeight: metadata?['image_height']?.toInt(),
-        thumbnailPath: thumbnailPath,
+        thumbnailPath: thumbnailPath.isNotEmpty ? thumbnailPath : null,
       );
-      
-      debugPrint('RAW image imported successfully: $fileName');
-      return rawImage;
     } catch (e) {
-      debugPrint('Error importing RAW image: $e');
+      debugPrint('Error reading imported file $filePath: $e');
       return null;
     }
   }
@@ -244,85 +283,37 @@ class FileService {
   
   /// ディレクトリをスキャンしてRAW画像を検索
   Future<List<RawImage>> _scanDirectory(Directory directory) async {
-    final rawImages = <RawImage>[];
+    final filePaths = <String>[];
     
     try {
       await for (final entity in directory.list(recursive: true)) {
         if (entity is File) {
-          final extension = path.extension(entity.path).toLowerCase().substring(1);
-          
-          if (supportedRawExtensions.contains(extension)) {
-            final rawImage = await importRawImage(entity.path);
-            if (rawImage != null) {
-              rawImages.add(rawImage);
-            }
-          }
+          filePaths.add(entity.path);
         }
       }
     } catch (e) {
       debugPrint('Error scanning directory ${directory.path}: $e');
     }
     
-    return rawImages;
+    // 見つかったファイルはまとめてネイティブ側で並列に取り込む
+    return importRawImages(filePaths);
   }
   
-  /// ファイルからメタデータを抽出
-  Future<Map<String, dynamic>?> _extractMetadataFromFile(String filePath) async {
-    try {
-      final processorHandle = _rawProcessingService.createProcessor();
-      
-      final loaded = await _rawProcessingService.loadRawFile(processorHandle, filePath);
-      if (!loaded) {
-        _rawProcessingService.destroyProcessor(processorHandle);
-        return null;
-      }
-      
-      final metadata = await _rawProcessingService.extractMetadata(processorHandle);
-      _rawProcessingService.destroyProcessor(processorHandle);
-      
-      return metadata;
-    } catch (e) {
-      debugPrint('Error extracting metadata from $filePath: $e');
-      return null;
-    }
-  }
-  
-  /// サムネイルを生成して保存
-  Future<String?> _generateAndSaveThumbnail(String filePath, String fileName) async {
+  /// サムネイル・プレビューのディスクキャッシュを有効化
+  /// キャッシュはアプリのサポートディレクトリに置き、一時ディレクトリの削除や再起動をまたいで再利用する
+  Future<void> _ensureImageCache() async {
+    if (_imageCacheConfigured) return;
+    
     try {
-      final processorHandle = _rawProcessingService.createProcessor();
-      
-      final loaded = await _rawProcessingService.loadRawFile(processorHandle, filePath);
-      if (!loaded) {
-        _rawProcessingService.destroyProcessor(processorHandle);
-        return null;
+      final supportDir = await getApplicationSupportDirectory();
+      final cacheDir = Directory(path.join(supportDir.path, 'image_cache'));
+      if (!await cacheDir.exists()) {
+        await cacheDir.create(recursive: true);
       }
-      
-      final thumbnailData = await _rawProcessingService.generateThumbnail(processorHandle);
-      _rawProcessingService.destroyProcessor(processorHandle);
-      
-      if (thumbnailData != null) {
-        // サムネイルを保存
-        final tempDir = await getTempDirectory();
-        final thumbnailsDir = Directory(path.join(tempDir.path, 'thumbnails'));
-        
-        if (!await thumbnailsDir.exists()) {
-          await thumbnailsDir.create(recursive: true);
-        }
-        
-        final nameWithoutExt = path.basenameWithoutExtension(fileName);
-        final thumbnailPath = path.join(thumbnailsDir.path, '${nameWithoutExt}_thumb.jpg');
-        
-        final thumbnailFile = File(thumbnailPath);
-        await thumbnailFile.writeAsBytes(thumbnailData);
-        
-        return thumbnailPath;
-      }
-      
-      return null;
+      _rawProcessingService.configureImageCache(cacheDir.path);
+      _imageCacheConfigured = true;
     } catch (e) {
-      debugPrint('Error generating thumbnail for $filePath: $e');
-      return null;
+      debugPrint('Failed to configure image cache: $e');
     }
   }
   
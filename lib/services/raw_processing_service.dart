@@ -18,32 +18,91 @@ typedef DestroyProcessorDart = void Function(int);
 typedef LoadFileC = Pointer<FFIResult> Function(Int64, Pointer<Utf8>);
 typedef LoadFileDart = Pointer<FFIResult> Function(int, Pointer<Utf8>);
 
+typedef LoadDescriptorC = Pointer<FFIResult> Function(Int64, Int32, Pointer<Utf8>, Bool);
+typedef LoadDescriptorDart = Pointer<FFIResult> Function(int, int, Pointer<Utf8>, bool);
+
+typedef BenchmarkOpenC = Pointer<FFIResult> Function(Pointer<Utf8>, Uint32);
+typedef BenchmarkOpenDart = Pointer<FFIResult> Function(Pointer<Utf8>, int);
+typedef BenchmarkDenoiseC = Pointer<FFIResult> Function(Uint32, Uint32, Uint32);
+typedef BenchmarkDenoiseDart = Pointer<FFIResult> Function(int, int, int);
+
 typedef ExtractMetadataC = Pointer<FFIResult> Function(Int64);
 typedef ExtractMetadataDart = Pointer<FFIResult> Function(int);
 
-typedef GenerateThumbnailC = Pointer<FFIImageData> Function(Int64, Uint32);
-typedef GenerateThumbnailDart = Pointer<FFIImageData> Function(int, int);
+// 画像データは構造体を値で受け取る（画素バッファはネイティブ側のメモリを直接参照する）
+typedef GenerateThumbnailC = FFIImageData Function(Int64, Uint32);
+typedef GenerateThumbnailDart = FFIImageData Function(int, int);
+
+typedef GeneratePreviewC = FFIImageData Function(Int64, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>);
+typedef GeneratePreviewDart = FFIImageData Function(int, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>);
 
-typedef GeneratePreviewC = Pointer<FFIImageData> Function(Int64, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>);
-typedef GeneratePreviewDart = Pointer<FFIImageData> Function(int, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>);
+typedef GeneratePreviewIntoC = FFIImageData Function(Int64, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>, Pointer<Uint8>, Uint64);
+typedef GeneratePreviewIntoDart = FFIImageData Function(int, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>, Pointer<Uint8>, int);
 
-typedef ProcessFullImageC = Pointer<FFIImageData> Function(Int64, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>);
-typedef ProcessFullImageDart = Pointer<FFIImageData> Function(int, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>);
+typedef ProcessFullImageC = FFIImageData Function(Int64, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>);
+typedef ProcessFullImageDart = FFIImageData Function(int, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>);
 
 typedef SaveImageC = Pointer<FFIResult> Function(Int64, Pointer<FFIImageData>, Pointer<Utf8>, Pointer<Utf8>, Uint32);
 typedef SaveImageDart = Pointer<FFIResult> Function(int, Pointer<FFIImageData>, Pointer<Utf8>, Pointer<Utf8>, int);
 
+typedef ExportToFileC = Pointer<FFIResult> Function(Int64, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>, Pointer<Utf8>, Pointer<Utf8>, Uint32);
+typedef ExportToFileDart = Pointer<FFIResult> Function(int, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>, Pointer<Utf8>, Pointer<Utf8>, int);
+
+typedef ColorLutExportC = Pointer<FFIResult> Function(Pointer<FFIAdjustmentParams>, Pointer<Utf8>, Uint32);
+typedef ColorLutExportDart = Pointer<FFIResult> Function(Pointer<FFIAdjustmentParams>, Pointer<Utf8>, int);
+
+typedef ImageCacheConfigureC = Void Function(Pointer<Utf8>, Uint64);
+typedef ImageCacheConfigureDart = void Function(Pointer<Utf8>, int);
+
+typedef FileThumbnailC = FFIImageData Function(Pointer<Utf8>, Uint32);
+typedef FileThumbnailDart = FFIImageData Function(Pointer<Utf8>, int);
+
+typedef BatchIngestStartC = Int64 Function(Pointer<Pointer<Utf8>>, Uint32, Pointer<Utf8>, Uint32, Uint32);
+typedef BatchIngestStartDart = int Function(Pointer<Pointer<Utf8>>, int, Pointer<Utf8>, int, int);
+
+typedef BatchIngestPollC = Pointer<FFIResult> Function(Int64, Uint32);
+typedef BatchIngestPollDart = Pointer<FFIResult> Function(int, int);
+
+typedef BatchIngestHandleC = Void Function(Int64);
+typedef BatchIngestHandleDart = void Function(int);
+
+typedef SubmitJobC = Int64 Function(Int64, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>);
+typedef SubmitJobDart = int Function(int, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>);
+
+typedef SubmitExportC = Int64 Function(Int64, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>, Pointer<Utf8>, Pointer<Utf8>, Uint32);
+typedef SubmitExportDart = int Function(int, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>, Pointer<Utf8>, Pointer<Utf8>, int);
+
+typedef RequestPreviewC = Int64 Function(Int64, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>, Bool);
+typedef RequestPreviewDart = int Function(int, Pointer<FFIAdjustmentParams>, Pointer<FFIProcessingOptions>, bool);
+
+typedef TakePreviewC = Bool Function(Int64, Pointer<FFIPreviewFrame>);
+typedef TakePreviewDart = bool Function(int, Pointer<FFIPreviewFrame>);
+
+typedef JobPollC = Bool Function(Int64, Pointer<FFIJobStatus>);
+typedef JobPollDart = bool Function(int, Pointer<FFIJobStatus>);
+
+typedef JobHandleC = Void Function(Int64);
+typedef JobHandleDart = void Function(int);
+
 typedef IsLoadedC = Bool Function(Int64);
 typedef IsLoadedDart = bool Function(int);
 
 typedef ClearProcessorC = Void Function(Int64);
 typedef ClearProcessorDart = void Function(int);
 
+typedef GetStatsC = Pointer<FFIResult> Function(Int64);
+typedef GetStatsDart = Pointer<FFIResult> Function(int);
+
+typedef DumpTraceC = Pointer<FFIResult> Function(Int64, Pointer<Utf8>);
+typedef DumpTraceDart = Pointer<FFIResult> Function(int, Pointer<Utf8>);
+
+typedef SetTracingEnabledC = Void Function(Bool);
+typedef SetTracingEnabledDart = void Function(bool);
+
 typedef FreeResultC = Void Function(Pointer<FFIResult>);
 typedef FreeResultDart = void Function(Pointer<FFIResult>);
 
-typedef FreeImageDataC = Void Function(Pointer<FFIImageData>);
-typedef FreeImageDataDart = void Function(Pointer<FFIImageData>);
+typedef ReleaseBufferC = Void Function(Pointer<Void>);
 
 // C構造体の定義
 class FFIResult extends Struct {
@@ -70,6 +129,12 @@ class FFIImageData extends Struct {
   
   @Uint32()
   external int dataLength;
+  
+  @Uint32()
+  external int bitDepth;
+  
+  // 画素バッファの参照（ffi_release_buffer で解放する）
+  external Pointer<Void> context;
 }
 
 class FFIAdjustmentParams extends Struct {
@@ -210,9 +275,67 @@ class FFIProcessingOptions extends Struct {
   
   @Uint32()
   external int threadCount;
+  
+  @Uint32()
+  external int outputBitDepth;
+}
+
+class FFIJobStatus extends Struct {
+  // 0 = 待機中, 1 = 実行中, 2 = 完了
+  @Int32()
+  external int state;
+  
+  // 完了時の結果コード（中止・置き換え時は -8）
+  @Int32()
+  external int code;
+  
+  @Float()
+  external double progress;
+  
+  external FFIImageData image;
+}
+
+class FFIPreviewFrame extends Struct {
+  // 対応する要求の通し番号
+  @Int64()
+  external int sequence;
+  
+  @Int32()
+  external int code;
+  
+  // 段階表示の低解像度の先行結果
+  @Bool()
+  external bool draft;
+  
+  external FFIImageData image;
+}
+
+/// 最新優先のプレビュー要求の結果
+/// [sequence] は [RawProcessingService.requestPreview] が返した通し番号に対応する
+class PreviewFrame {
+  const PreviewFrame(this.sequence, this.draft, this.image);
+  
+  final int sequence;
+  final bool draft;
+  final Uint8List image;
+}
+
+/// ネイティブのワーカーで実行されるジョブ
+/// [result] はジョブの完了で確定する。[cancel] を呼ぶと実行中の処理も途中で打ち切られる
+class NativeJob<T> {
+  NativeJob._(this.id, this.result, this._cancel);
+  
+  final int id;
+  final Future<T> result;
+  final void Function(int) _cancel;
+  
+  void cancel() => _cancel(id);
 }
 
 class RawProcessingService {
+  // ジョブの状態
+  static const int _jobFinished = 2;
+  
   static RawProcessingService? _instance;
   static RawProcessingService get instance => _instance ??= RawProcessingService._();
   
@@ -222,15 +345,39 @@ class RawProcessingService {
   late CreateProcessorDart _createProcessor;
   late DestroyProcessorDart _destroyProcessor;
   late LoadFileDart _loadFile;
+  late LoadFileDart _openThumbnailOnly;
+  late LoadDescriptorDart _loadDescriptor;
+  late BenchmarkOpenDart _benchmarkOpen;
+  late BenchmarkDenoiseDart _benchmarkDenoise;
   late ExtractMetadataDart _extractMetadata;
   late GenerateThumbnailDart _generateThumbnail;
   late GeneratePreviewDart _generatePreview;
+  late GeneratePreviewIntoDart _generatePreviewInto;
   late ProcessFullImageDart _processFullImage;
   late SaveImageDart _saveImage;
+  late ExportToFileDart _exportToFile;
+  late ColorLutExportDart _colorLutExport;
+  late ImageCacheConfigureDart _imageCacheConfigure;
+  late FileThumbnailDart _fileThumbnail;
+  late BatchIngestStartDart _batchIngestStart;
+  late BatchIngestPollDart _batchIngestPoll;
+  late BatchIngestHandleDart _batchIngestCancel;
+  late BatchIngestHandleDart _batchIngestDestroy;
+  late SubmitJobDart _submitPreview;
+  late SubmitJobDart _submitFullImage;
+  late SubmitExportDart _submitExport;
+  late RequestPreviewDart _requestPreview;
+  late TakePreviewDart _takePreview;
+  late JobPollDart _jobPoll;
+  late JobHandleDart _jobCancel;
+  late JobHandleDart _jobRelease;
   late IsLoadedDart _isLoaded;
   late ClearProcessorDart _clearProcessor;
+  late GetStatsDart _getStats;
+  late DumpTraceDart _dumpTrace;
+  late SetTracingEnabledDart _setTracingEnabled;
   late FreeResultDart _freeResult;
-  late FreeImageDataDart _freeImageData;
+  late Pointer<NativeFunction<ReleaseBufferC>> _releaseBuffer;
   
   bool _initialized = false;
   
@@ -251,15 +398,39 @@ class RawProcessingService {
       _createProcessor = _library.lookup<NativeFunction<CreateProcessorC>>('raw_processor_create').asFunction();
       _destroyProcessor = _library.lookup<NativeFunction<DestroyProcessorC>>('raw_processor_destroy').asFunction();
       _loadFile = _library.lookup<NativeFunction<LoadFileC>>('raw_processor_load_file').asFunction();
+      _openThumbnailOnly = _library.lookup<NativeFunction<LoadFileC>>('raw_processor_open_thumbnail_only').asFunction();
+      _loadDescriptor = _library.lookup<NativeFunction<LoadDescriptorC>>('raw_processor_load_descriptor').asFunction();
+      _benchmarkOpen = _library.lookup<NativeFunction<BenchmarkOpenC>>('raw_benchmark_open').asFunction();
+      _benchmarkDenoise = _library.lookup<NativeFunction<BenchmarkDenoiseC>>('raw_benchmark_denoise').asFunction();
       _extractMetadata = _library.lookup<NativeFunction<ExtractMetadataC>>('raw_processor_extract_metadata').asFunction();
       _generateThumbnail = _library.lookup<NativeFunction<GenerateThumbnailC>>('raw_processor_generate_thumbnail').asFunction();
       _generatePreview = _library.lookup<NativeFunction<GeneratePreviewC>>('raw_processor_generate_preview').asFunction();
+      _generatePreviewInto = _library.lookup<NativeFunction<GeneratePreviewIntoC>>('raw_processor_generate_preview_into').asFunction();
       _processFullImage = _library.lookup<NativeFunction<ProcessFullImageC>>('raw_processor_process_full_image').asFunction();
       _saveImage = _library.lookup<NativeFunction<SaveImageC>>('raw_processor_save_image').asFunction();
+      _exportToFile = _library.lookup<NativeFunction<ExportToFileC>>('raw_processor_export_to_file').asFunction();
+      _colorLutExport = _library.lookup<NativeFunction<ColorLutExportC>>('color_lut_export_cube').asFunction();
+      _imageCacheConfigure = _library.lookup<NativeFunction<ImageCacheConfigureC>>('image_cache_configure').asFunction();
+      _fileThumbnail = _library.lookup<NativeFunction<FileThumbnailC>>('raw_generate_file_thumbnail').asFunction();
+      _batchIngestStart = _library.lookup<NativeFunction<BatchIngestStartC>>('batch_ingest_start').asFunction();
+      _batchIngestPoll = _library.lookup<NativeFunction<BatchIngestPollC>>('batch_ingest_poll').asFunction();
+      _batchIngestCancel = _library.lookup<NativeFunction<BatchIngestHandleC>>('batch_ingest_cancel').asFunction();
+      _batchIngestDestroy = _library.lookup<NativeFunction<BatchIngestHandleC>>('batch_ingest_destroy').asFunction();
+      _submitPreview = _library.lookup<NativeFunction<SubmitJobC>>('raw_processor_submit_preview').asFunction();
+      _submitFullImage = _library.lookup<NativeFunction<SubmitJobC>>('raw_processor_submit_full_image').asFunction();
+      _submitExport = _library.lookup<NativeFunction<SubmitExportC>>('raw_processor_submit_export').asFunction();
+      _requestPreview = _library.lookup<NativeFunction<RequestPreviewC>>('raw_processor_request_preview').asFunction();
+      _takePreview = _library.lookup<NativeFunction<TakePreviewC>>('raw_processor_take_preview').asFunction();
+      _jobPoll = _library.lookup<NativeFunction<JobPollC>>('raw_job_poll').asFunction();
+      _jobCancel = _library.lookup<NativeFunction<JobHandleC>>('raw_job_cancel').asFunction();
+      _jobRelease = _library.lookup<NativeFunction<JobHandleC>>('raw_job_release').asFunction();
       _isLoaded = _library.lookup<NativeFunction<IsLoadedC>>('raw_processor_is_loaded').asFunction();
       _clearProcessor = _library.lookup<NativeFunction<ClearProcessorC>>('raw_processor_clear').asFunction();
+      _getStats = _library.lookup<NativeFunction<GetStatsC>>('raw_processor_get_stats').asFunction();
+      _dumpTrace = _library.lookup<NativeFunction<DumpTraceC>>('raw_processor_dump_trace').asFunction();
+      _setTracingEnabled = _library.lookup<NativeFunction<SetTracingEnabledC>>('raw_set_tracing_enabled').asFunction();
       _freeResult = _library.lookup<NativeFunction<FreeResultC>>('ffi_free_result').asFunction();
-      _freeImageData = _library.lookup<NativeFunction<FreeImageDataC>>('ffi_free_image_data').asFunction();
+      _releaseBuffer = _library.lookup<NativeFunction<ReleaseBufferC>>('ffi_release_buffer');
       
       _initialized = true;
       debugPrint('RawProcessingService initialized successfully');
@@ -282,12 +453,15 @@ class RawProcessingService {
   }
   
   /// RAWファイルを読み込み
-  Future<bool> loadRawFile(int handle, String filePath) async {
+  /// [thumbnailOnly] が true ならメタデータとサムネイルのみ読み込む（センサーデータは現像時に展開）
+  Future<bool> loadRawFile(int handle, String filePath, {bool thumbnailOnly = false}) async {
     _checkInitialized();
     
     final pathPointer = filePath.toNativeUtf8();
     try {
-      final resultPointer = _loadFile(handle, pathPointer);
+      final resultPointer = thumbnailOnly
+          ? _openThumbnailOnly(handle, pathPointer)
+          : _loadFile(handle, pathPointer);
       final result = resultPointer.ref;
       
       final success = result.code == 0; // SUCCESS
@@ -299,6 +473,54 @@ class RawProcessingService {
     }
   }
   
+  /// ファイル記述子からRAWファイルを読み込み（コンテンツURIで共有されたファイル用）
+  /// [name] はキャッシュキーに使う識別名（コンテンツURIなど）。記述子は呼び出し後に閉じてよい
+  Future<bool> loadRawFileDescriptor(int handle, int fd, String name, {bool thumbnailOnly = false}) async {
+    _checkInitialized();
+    
+    final namePointer = name.toNativeUtf8();
+    try {
+      final resultPointer = _loadDescriptor(handle, fd, namePointer, thumbnailOnly);
+      final success = resultPointer.ref.code == 0;
+      _freeResult(resultPointer);
+      
+      return success;
+    } finally {
+      malloc.free(namePointer);
+    }
+  }
+  
+  /// RAWファイルの読み込み（open + unpack）の所要時間をファイルストリームとメモリマップで比較
+  /// 結果は stdio_ms / mapped_ms（平均）、stdio_best_ms / mapped_best_ms（最短）、speedup
+  Future<Map<String, dynamic>?> benchmarkOpen(String filePath, {int iterations = 5}) async {
+    _checkInitialized();
+    
+    final pathPointer = filePath.toNativeUtf8();
+    try {
+      final resultPointer = _benchmarkOpen(pathPointer, iterations);
+      final result = resultPointer.ref;
+      final jsonString = result.code == 0 && result.data != nullptr ? result.data.toDartString() : null;
+      _freeResult(resultPointer);
+      
+      return jsonString != null ? json.decode(jsonString) as Map<String, dynamic> : null;
+    } finally {
+      malloc.free(pathPointer);
+    }
+  }
+  
+  /// ノイズ除去のプレビュー段階と書き出し段階を合成画像で比較
+  /// 結果は input_psnr_db と、tiers（段階ごとの best_ms / ms_per_megapixel / psnr_db）
+  Future<Map<String, dynamic>?> benchmarkDenoise({int width = 2048, int height = 1536, int iterations = 3}) async {
+    _checkInitialized();
+    
+    final resultPointer = _benchmarkDenoise(width, height, iterations);
+    final result = resultPointer.ref;
+    final jsonString = result.code == 0 && result.data != nullptr ? result.data.toDartString() : null;
+    _freeResult(resultPointer);
+    
+    return jsonString != null ? json.decode(jsonString) as Map<String, dynamic> : null;
+  }
+  
   /// メタデータを抽出
   Future<Map<String, dynamic>?> extractMetadata(int handle) async {
     _checkInitialized();
@@ -326,19 +548,7 @@ class RawProcessingService {
   Future<Uint8List?> generateThumbnail(int handle, {int maxSize = 512}) async {
     _checkInitialized();
     
-    final imageDataPointer = _generateThumbnail(handle, maxSize);
-    final imageData = imageDataPointer.ref;
-    
-    if (imageData.data != nullptr && imageData.dataLength > 0) {
-      final data = Uint8List.fromList(
-        imageData.data.asTypedList(imageData.dataLength)
-      );
-      _freeImageData(imageDataPointer);
-      return data;
-    } else {
-      _freeImageData(imageDataPointer);
-      return null;
-    }
+    return _adoptImageData(_generateThumbnail(handle, maxSize));
   }
   
   /// プレビュー画像を生成
@@ -356,29 +566,51 @@ class RawProcessingService {
     final paramsPointer = _convertAdjustmentParams(adjustments);
     
     // 処理オプションを設定
-    final optionsPointer = malloc<FFIProcessingOptions>();
-    optionsPointer.ref
-      ..outputWidth = outputWidth ?? 1920
-      ..outputHeight = outputHeight ?? 1080
-      ..quality = quality
-      ..previewMode = previewMode
-      ..useGpu = true
-      ..threadCount = 0;
+    final optionsPointer = _createProcessingOptions(
+      outputWidth: outputWidth ?? 1920,
+      outputHeight: outputHeight ?? 1080,
+      quality: quality,
+      previewMode: previewMode,
+      bitDepth: 8,
+    );
     
     try {
-      final imageDataPointer = _generatePreview(handle, paramsPointer, optionsPointer);
-      final imageData = imageDataPointer.ref;
-      
-      if (imageData.data != nullptr && imageData.dataLength > 0) {
-        final data = Uint8List.fromList(
-          imageData.data.asTypedList(imageData.dataLength)
-        );
-        _freeImageData(imageDataPointer);
-        return data;
-      } else {
-        _freeImageData(imageDataPointer);
-        return null;
-      }
+      return _adoptImageData(_generatePreview(handle, paramsPointer, optionsPointer));
+    } finally {
+      malloc.free(paramsPointer);
+      malloc.free(optionsPointer);
+    }
+  }
+  
+  /// 呼び出し側が確保したバッファにプレビュー画像を直接描画
+  /// スライダー操作中のように繰り返し生成する場合は同じバッファを使い回す
+  /// 戻り値はバッファを参照するビューなので、次の描画で内容が上書きされる
+  /// 容量が足りない場合はネイティブ側で確保したバッファが返る
+  Future<Uint8List?> generatePreviewInto(
+    int handle,
+    AdjustmentParameters adjustments,
+    Pointer<Uint8> buffer,
+    int capacity, {
+    int? outputWidth,
+    int? outputHeight,
+    int quality = 85,
+  }) async {
+    _checkInitialized();
+    
+    final paramsPointer = _convertAdjustmentParams(adjustments);
+    
+    final optionsPointer = _createProcessingOptions(
+      outputWidth: outputWidth ?? 1920,
+      outputHeight: outputHeight ?? 1080,
+      quality: quality,
+      previewMode: true,
+      bitDepth: 8,
+    );
+    
+    try {
+      return _adoptImageData(
+        _generatePreviewInto(handle, paramsPointer, optionsPointer, buffer, capacity)
+      );
     } finally {
       malloc.free(paramsPointer);
       malloc.free(optionsPointer);
@@ -392,34 +624,22 @@ class RawProcessingService {
     int? outputWidth,
     int? outputHeight,
     int quality = 95,
+    int bitDepth = 8,
   }) async {
     _checkInitialized();
     
     final paramsPointer = _convertAdjustmentParams(adjustments);
     
-    final optionsPointer = malloc<FFIProcessingOptions>();
-    optionsPointer.ref
-      ..outputWidth = outputWidth ?? 0
-      ..outputHeight = outputHeight ?? 0
-      ..quality = quality
-      ..previewMode = false
-      ..useGpu = true
-      ..threadCount = 0;
+    final optionsPointer = _createProcessingOptions(
+      outputWidth: outputWidth ?? 0,
+      outputHeight: outputHeight ?? 0,
+      quality: quality,
+      previewMode: false,
+      bitDepth: bitDepth,
+    );
     
     try {
-      final imageDataPointer = _processFullImage(handle, paramsPointer, optionsPointer);
-      final imageData = imageDataPointer.ref;
-      
-      if (imageData.data != nullptr && imageData.dataLength > 0) {
-        final data = Uint8List.fromList(
-          imageData.data.asTypedList(imageData.dataLength)
-        );
-        _freeImageData(imageDataPointer);
-        return data;
-      } else {
-        _freeImageData(imageDataPointer);
-        return null;
-      }
+      return _adoptImageData(_processFullImage(handle, paramsPointer, optionsPointer));
     } finally {
       malloc.free(paramsPointer);
       malloc.free(optionsPointer);
@@ -436,6 +656,7 @@ class RawProcessingService {
     String outputPath, {
     String format = 'JPEG',
     int quality = 95,
+    int bitDepth = 8,
   }) async {
     _checkInitialized();
     
@@ -449,7 +670,8 @@ class RawProcessingService {
       ..width = width
       ..height = height
       ..channels = channels
-      ..dataLength = imageData.length;
+      ..dataLength = imageData.length
+      ..bitDepth = bitDepth;
     
     final pathPointer = outputPath.toNativeUtf8();
     final formatPointer = format.toNativeUtf8();
@@ -470,6 +692,395 @@ class RawProcessingService {
     }
   }
   
+  /// 調整済み画像をファイルへ直接書き出し
+  /// 画素データをDart側へ受け渡さず、ネイティブ側で行ストリップ単位にエンコードする
+  Future<bool> exportToFile(
+    int handle,
+    AdjustmentParameters adjustments,
+    String outputPath, {
+    String format = 'JPEG',
+    int quality = 95,
+    int? outputWidth,
+    int? outputHeight,
+    int bitDepth = 8,
+  }) async {
+    _checkInitialized();
+    
+    final paramsPointer = _convertAdjustmentParams(adjustments);
+    
+    final optionsPointer = _createProcessingOptions(
+      outputWidth: outputWidth ?? 0,
+      outputHeight: outputHeight ?? 0,
+      quality: quality,
+      previewMode: false,
+      bitDepth: bitDepth,
+    );
+    
+    final pathPointer = outputPath.toNativeUtf8();
+    final formatPointer = format.toNativeUtf8();
+    
+    try {
+      final resultPointer = _exportToFile(handle, paramsPointer, optionsPointer, pathPointer, formatPointer, quality);
+      final result = resultPointer.ref;
+      
+      final success = result.code == 0;
+      _freeResult(resultPointer);
+      
+      return success;
+    } finally {
+      malloc.free(paramsPointer);
+      malloc.free(optionsPointer);
+      malloc.free(pathPointer);
+      malloc.free(formatPointer);
+    }
+  }
+  
+  /// 色調整を3D LUT（.cube）として書き出す
+  /// ハイライト/シャドウ・クラリティを含む調整はLUTで表現できないため false を返す
+  /// [lutSize] が 0 なら書き出し用の既定サイズ（65）を使う
+  Future<bool> exportColorLut(
+    AdjustmentParameters adjustments,
+    String outputPath, {
+    int lutSize = 0,
+  }) async {
+    _checkInitialized();
+    
+    final paramsPointer = _convertAdjustmentParams(adjustments);
+    final pathPointer = outputPath.toNativeUtf8();
+    
+    try {
+      final resultPointer = _colorLutExport(paramsPointer, pathPointer, lutSize);
+      final success = resultPointer.ref.code == 0;
+      _freeResult(resultPointer);
+      
+      return success;
+    } finally {
+      malloc.free(paramsPointer);
+      malloc.free(pathPointer);
+    }
+  }
+  
+  /// サムネイル・プレビューのディスクキャッシュを設定
+  /// [directory] が null ならキャッシュを無効化する
+  void configureImageCache(String? directory, {int budgetBytes = 0}) {
+    _checkInitialized();
+    
+    final dirPointer = directory != null ? directory.toNativeUtf8() : nullptr;
+    try {
+      _imageCacheConfigure(dirPointer, budgetBytes);
+    } finally {
+      if (dirPointer != nullptr) {
+        malloc.free(dirPointer);
+      }
+    }
+  }
+  
+  /// ファイルを指定してサムネイルを取得（キャッシュ済みならRAWファイルを開かない）
+  Future<Uint8List?> thumbnailForFile(String filePath, {int maxSize = 512}) async {
+    _checkInitialized();
+    
+    final pathPointer = filePath.toNativeUtf8();
+    try {
+      return _adoptImageData(_fileThumbnail(pathPointer, maxSize));
+    } finally {
+      malloc.free(pathPointer);
+    }
+  }
+  
+  /// RAWファイルを一括で取り込む（メタデータ抽出とサムネイル保存）
+  /// 処理はネイティブのワーカーで行われ、完了した結果を [pollInterval] ごとにまとめて流す。
+  /// 各イベントは {total, completed, cancelled, finished, results: [...]} 形式。
+  /// 購読をキャンセルすると未処理のファイルは処理されない
+  Stream<Map<String, dynamic>> ingestBatch(
+    List<String> filePaths, {
+    String? thumbnailDir,
+    int thumbnailSize = 512,
+    int workerCount = 0,
+    Duration pollInterval = const Duration(milliseconds: 100),
+  }) async* {
+    _checkInitialized();
+    
+    final pathsPointer = malloc<Pointer<Utf8>>(filePaths.length);
+    for (var i = 0; i < filePaths.length; i++) {
+      pathsPointer[i] = filePaths[i].toNativeUtf8();
+    }
+    final dirPointer = thumbnailDir != null ? thumbnailDir.toNativeUtf8() : nullptr;
+    
+    int handle;
+    try {
+      handle = _batchIngestStart(pathsPointer, filePaths.length, dirPointer, thumbnailSize, workerCount);
+    } finally {
+      // パスはネイティブ側でコピーされる
+      for (var i = 0; i < filePaths.length; i++) {
+        malloc.free(pathsPointer[i]);
+      }
+      malloc.free(pathsPointer);
+      if (dirPointer != nullptr) {
+        malloc.free(dirPointer);
+      }
+    }
+    if (handle == 0) {
+      return;
+    }
+    
+    var finished = false;
+    try {
+      while (!finished) {
+        await Future.delayed(pollInterval);
+        
+        final resultPointer = _batchIngestPoll(handle, 0);
+        final result = resultPointer.ref;
+        if (result.code != 0 || result.data == nullptr) {
+          _freeResult(resultPointer);
+          break;
+        }
+        final update = json.decode(result.data.toDartString()) as Map<String, dynamic>;
+        _freeResult(resultPointer);
+        
+        finished = update['finished'] == true;
+        yield update;
+      }
+    } finally {
+      if (!finished) {
+        _batchIngestCancel(handle);
+      }
+      _batchIngestDestroy(handle);
+    }
+  }
+  
+  /// プレビュー生成をネイティブのワーカーで実行する
+  /// 同じプロセッサーの前のプレビュージョブは置き換えられ、その結果は null になる
+  NativeJob<Uint8List?> submitPreview(
+    int handle,
+    AdjustmentParameters adjustments, {
+    int? outputWidth,
+    int? outputHeight,
+    int quality = 85,
+    Duration pollInterval = const Duration(milliseconds: 8),
+  }) {
+    _checkInitialized();
+    
+    final paramsPointer = _convertAdjustmentParams(adjustments);
+    final optionsPointer = _createProcessingOptions(
+      outputWidth: outputWidth ?? 1920,
+      outputHeight: outputHeight ?? 1080,
+      quality: quality,
+      previewMode: true,
+      bitDepth: 8,
+    );
+    
+    final int jobId;
+    try {
+      // パラメータはネイティブ側でコピーされる
+      jobId = _submitPreview(handle, paramsPointer, optionsPointer);
+    } finally {
+      malloc.free(paramsPointer);
+      malloc.free(optionsPointer);
+    }
+    
+    return NativeJob._(
+      jobId,
+      _awaitJob(jobId, pollInterval, null).then((finished) => finished.$2),
+      _jobCancel,
+    );
+  }
+  
+  /// プレビューを要求する（最新優先・すぐに戻る）
+  /// 描画中に届いた要求は保留中の要求を置き換えるため、スライダー操作ごとに呼んでよい。
+  /// [progressive] が true なら1/4解像度の先行結果を先に公開してから描き直す。
+  /// 結果は [previewFrames] で受け取る。戻り値は要求の通し番号（失敗時は0）
+  int requestPreview(
+    int handle,
+    AdjustmentParameters adjustments, {
+    bool progressive = true,
+    int? outputWidth,
+    int? outputHeight,
+    int quality = 85,
+  }) {
+    _checkInitialized();
+    
+    final paramsPointer = _convertAdjustmentParams(adjustments);
+    final optionsPointer = _createProcessingOptions(
+      outputWidth: outputWidth ?? 1920,
+      outputHeight: outputHeight ?? 1080,
+      quality: quality,
+      previewMode: true,
+      bitDepth: 8,
+    );
+    
+    try {
+      // パラメータはネイティブ側でコピーされる
+      return _requestPreview(handle, paramsPointer, optionsPointer, progressive);
+    } finally {
+      malloc.free(paramsPointer);
+      malloc.free(optionsPointer);
+    }
+  }
+  
+  /// [requestPreview] で要求したプレビューを公開順に流す
+  /// 途中の要求の結果は、より新しい結果が公開された時点で飛ばされる。購読を止めると監視も止まる
+  Stream<PreviewFrame> previewFrames(
+    int handle, {
+    Duration pollInterval = const Duration(milliseconds: 8),
+  }) async* {
+    _checkInitialized();
+    
+    final framePointer = malloc<FFIPreviewFrame>();
+    try {
+      while (true) {
+        if (_takePreview(handle, framePointer)) {
+          final frame = framePointer.ref;
+          final image = _adoptImageData(frame.image);
+          if (frame.code == 0 && image != null) {
+            yield PreviewFrame(frame.sequence, frame.draft, image);
+          }
+        }
+        await Future.delayed(pollInterval);
+      }
+    } finally {
+      malloc.free(framePointer);
+    }
+  }
+  
+  /// フル解像度画像の処理をネイティブのワーカーで実行する
+  /// [onProgress] には 0〜1 の進捗が通知される
+  NativeJob<Uint8List?> submitFullImage(
+    int handle,
+    AdjustmentParameters adjustments, {
+    int? outputWidth,
+    int? outputHeight,
+    int quality = 95,
+    int bitDepth = 8,
+    void Function(double progress)? onProgress,
+    Duration pollInterval = const Duration(milliseconds: 100),
+  }) {
+    _checkInitialized();
+    
+    final paramsPointer = _convertAdjustmentParams(adjustments);
+    final optionsPointer = _createProcessingOptions(
+      outputWidth: outputWidth ?? 0,
+      outputHeight: outputHeight ?? 0,
+      quality: quality,
+      previewMode: false,
+      bitDepth: bitDepth,
+    );
+    
+    final int jobId;
+    try {
+      jobId = _submitFullImage(handle, paramsPointer, optionsPointer);
+    } finally {
+      malloc.free(paramsPointer);
+      malloc.free(optionsPointer);
+    }
+    
+    return NativeJob._(
+      jobId,
+      _awaitJob(jobId, pollInterval, onProgress).then((finished) => finished.$2),
+      _jobCancel,
+    );
+  }
+  
+  /// ファイルへの書き出しをネイティブのワーカーで実行する
+  /// 中止された場合は書きかけのファイルが削除され、結果は false になる
+  NativeJob<bool> submitExport(
+    int handle,
+    AdjustmentParameters adjustments,
+    String outputPath, {
+    String format = 'JPEG',
+    int quality = 95,
+    int? outputWidth,
+    int? outputHeight,
+    int bitDepth = 8,
+    void Function(double progress)? onProgress,
+    Duration pollInterval = const Duration(milliseconds: 100),
+  }) {
+    _checkInitialized();
+    
+    final paramsPointer = _convertAdjustmentParams(adjustments);
+    final optionsPointer = _createProcessingOptions(
+      outputWidth: outputWidth ?? 0,
+      outputHeight: outputHeight ?? 0,
+      quality: quality,
+      previewMode: false,
+      bitDepth: bitDepth,
+    );
+    final pathPointer = outputPath.toNativeUtf8();
+    final formatPointer = format.toNativeUtf8();
+    
+    final int jobId;
+    try {
+      jobId = _submitExport(handle, paramsPointer, optionsPointer, pathPointer, formatPointer, quality);
+    } finally {
+      malloc.free(paramsPointer);
+      malloc.free(optionsPointer);
+      malloc.free(pathPointer);
+      malloc.free(formatPointer);
+    }
+    
+    return NativeJob._(
+      jobId,
+      _awaitJob(jobId, pollInterval, onProgress).then((finished) => finished.$1 == 0),
+      _jobCancel,
+    );
+  }
+  
+  /// ジョブの完了を待つ
+  /// 結果コードと画像（プレビュー・フル解像度処理が成功した場合のみ）を返す
+  /// 待っている途中で例外が起きた場合は、ネイティブ側に結果を破棄させる
+  Future<(int, Uint8List?)> _awaitJob(
+    int jobId,
+    Duration pollInterval,
+    void Function(double progress)? onProgress,
+  ) async {
+    if (jobId == 0) {
+      return (-5, null); // ERROR_INVALID_PARAMETERS
+    }
+    
+    final statusPointer = malloc<FFIJobStatus>();
+    var finished = false;
+    try {
+      while (true) {
+        if (!_jobPoll(jobId, statusPointer)) {
+          finished = true;
+          return (-999, null); // ERROR_UNKNOWN
+        }
+        final status = statusPointer.ref;
+        if (status.state == _jobFinished) {
+          finished = true;
+          onProgress?.call(1.0);
+          return (status.code, _adoptImageData(status.image));
+        }
+        onProgress?.call(status.progress);
+        await Future.delayed(pollInterval);
+      }
+    } finally {
+      malloc.free(statusPointer);
+      if (!finished) {
+        _jobRelease(jobId);
+      }
+    }
+  }
+  
+  /// 処理オプションのFFI構造体を作成（呼び出し側で解放する）
+  Pointer<FFIProcessingOptions> _createProcessingOptions({
+    required int outputWidth,
+    required int outputHeight,
+    required int quality,
+    required bool previewMode,
+    required int bitDepth,
+  }) {
+    final optionsPointer = malloc<FFIProcessingOptions>();
+    optionsPointer.ref
+      ..outputWidth = outputWidth
+      ..outputHeight = outputHeight
+      ..quality = quality
+      ..previewMode = previewMode
+      ..useGpu = true
+      ..threadCount = 0
+      ..outputBitDepth = bitDepth;
+    return optionsPointer;
+  }
+  
   /// プロセッサーが読み込み済みかチェック
   bool isLoaded(int handle) {
     _checkInitialized();
@@ -482,6 +1093,59 @@ class RawProcessingService {
     _clearProcessor(handle);
   }
   
+  /// 処理区間ごとの計測結果を取得（処理中でもブロックしない）
+  Map<String, dynamic>? getStats(int handle) {
+    _checkInitialized();
+    
+    final resultPointer = _getStats(handle);
+    final result = resultPointer.ref;
+    final jsonString = result.code == 0 && result.data != nullptr ? result.data.toDartString() : null;
+    _freeResult(resultPointer);
+    
+    return jsonString != null ? json.decode(jsonString) as Map<String, dynamic> : null;
+  }
+  
+  /// 計測記録を Chrome トレース形式（chrome://tracing・Perfetto）で書き出す
+  bool dumpTrace(int handle, String outputPath) {
+    _checkInitialized();
+    
+    final pathPointer = outputPath.toNativeUtf8();
+    try {
+      final resultPointer = _dumpTrace(handle, pathPointer);
+      final success = resultPointer.ref.code == 0;
+      _freeResult(resultPointer);
+      
+      return success;
+    } finally {
+      malloc.free(pathPointer);
+    }
+  }
+  
+  /// 計測の有効・無効を切り替える（全プロセッサー共通）
+  void setTracingEnabled(bool enabled) {
+    _checkInitialized();
+    _setTracingEnabled(enabled);
+  }
+  
+  /// ネイティブの画素バッファをコピーせずにUint8Listとして受け取る
+  /// contextがある場合はリストが回収されたときに ffi_release_buffer で解放される
+  Uint8List? _adoptImageData(FFIImageData imageData) {
+    if (imageData.data == nullptr || imageData.dataLength == 0) {
+      return null;
+    }
+    
+    if (imageData.context == nullptr) {
+      // 呼び出し側のバッファに描画された場合
+      return imageData.data.asTypedList(imageData.dataLength);
+    }
+    
+    return imageData.data.asTypedList(
+      imageData.dataLength,
+      finalizer: _releaseBuffer.cast(),
+      token: imageData.context,
+    );
+  }
+  
   /// 調整パラメータをFFI構造体に変換
   Pointer<FFIAdjustmentParams> _convertAdjustmentParams(AdjustmentParameters params) {
     final paramsPointer = malloc<FFIAdjustmentParams>();